@@ -27,8 +27,11 @@ THE SOFTWARE.
 #include "program_state.hpp"
 #include "hip_runtime_api.h"
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <tuple>
 #include <type_traits>
@@ -118,6 +121,170 @@ inline hip_impl::kernarg make_kernarg(
 }
 
 
+constexpr std::size_t kernarg_align_up(std::size_t x, std::size_t y) {
+    return (x + y - 1) / y * y;
+}
+
+// Offset of the n-th formal argument when the formals are laid out with their
+// natural C++ size and alignment, which is what the device compiler emits.
+template <std::size_t n, typename... Ts>
+struct packed_kernarg_offset {
+    using T = typename std::tuple_element<n, std::tuple<Ts...>>::type;
+    using P = typename std::tuple_element<n - 1, std::tuple<Ts...>>::type;
+
+    static constexpr std::size_t value = kernarg_align_up(
+        packed_kernarg_offset<n - 1, Ts...>::value + sizeof(P), alignof(T));
+};
+
+template <typename... Ts>
+struct packed_kernarg_offset<0, Ts...> {
+    static constexpr std::size_t value = 0;
+};
+
+template <typename... Ts>
+struct packed_kernarg_size {
+    static constexpr std::size_t value = 0;
+};
+
+template <typename T, typename... Ts>
+struct packed_kernarg_size<T, Ts...> {
+    using L = typename std::tuple_element<sizeof...(Ts), std::tuple<T, Ts...>>::type;
+
+    static constexpr std::size_t value =
+        packed_kernarg_offset<sizeof...(Ts), T, Ts...>::value + sizeof(L);
+};
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n == sizeof...(Ts)>::type* = nullptr>
+inline bool kernarg_layout_matches(const kernargs_size_align&, std::size_t) {
+    return true;
+}
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n != sizeof...(Ts)>::type* = nullptr>
+inline bool kernarg_layout_matches(
+    const kernargs_size_align& size_align, std::size_t offset) {
+    using T = typename std::tuple_element<n, std::tuple<Ts...>>::type;
+
+    offset = round_up_to_next_multiple_nonnegative(
+        offset, size_align.alignment(n));
+
+    if (offset != packed_kernarg_offset<n, Ts...>::value) return false;
+    if (size_align.size(n) != sizeof(T)) return false;
+
+    return kernarg_layout_matches<n + 1, Ts...>(
+        size_align, offset + size_align.size(n));
+}
+
+// Checks the code object metadata of a kernel against the compile-time layout
+// of its formals. Kernels that agree are remembered in a small direct-mapped
+// cache per signature, so that steady state launches skip the metadata lookup.
+template <typename... Formals>
+inline bool kernarg_layout_is_static(std::uintptr_t function_address) {
+    static constexpr std::size_t cache_size = 16;
+    static std::atomic<std::uintptr_t> verified[cache_size];
+
+    auto& slot = verified[(function_address >> 4) % cache_size];
+    if (slot.load(std::memory_order_relaxed) == function_address) return true;
+
+    auto& ps = hip_impl::get_program_state();
+    if (!kernarg_layout_matches<0, Formals...>(
+            ps.get_kernargs_size_align(function_address), 0)) {
+        return false;
+    }
+
+    slot.store(function_address, std::memory_order_relaxed);
+    return true;
+}
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n == sizeof...(Ts)>::type* = nullptr>
+inline void pack_kernarg(const std::tuple<Ts...>&, std::uint8_t*) {}
+
+template <
+    std::size_t n,
+    typename... Ts,
+    typename std::enable_if<n != sizeof...(Ts)>::type* = nullptr>
+inline void pack_kernarg(const std::tuple<Ts...>& formals, std::uint8_t* p) {
+    using T = typename std::tuple_element<n, std::tuple<Ts...>>::type;
+
+    static_assert(
+        !std::is_reference<T>{},
+        "A __global__ function cannot have a reference as one of its "
+            "arguments.");
+    #if defined(HIP_STRICT)
+        static_assert(
+            std::is_trivially_copyable<T>{},
+            "Only TriviallyCopyable types can be arguments to a __global__ "
+                "function");
+    #endif
+
+    std::memcpy(
+        p + packed_kernarg_offset<n, Ts...>::value,
+        &std::get<n>(formals),
+        sizeof(T));
+    pack_kernarg<n + 1>(formals, p);
+}
+
+// Kernel arguments packed into a fixed-size buffer that lives on the caller's
+// stack. The heap allocated hip_impl::kernarg is only used when the layout
+// reported by the code object differs from the compile-time one.
+template <typename... Formals>
+class packed_kernarg {
+public:
+    static constexpr std::size_t static_size = packed_kernarg_size<Formals...>::value;
+
+    std::uint8_t* data() {
+        return fallback ? fallback->data() : buffer;
+    }
+
+    std::size_t size() {
+        return fallback ? fallback->size() : static_size;
+    }
+
+    std::uint8_t* static_buffer() { return buffer; }
+
+    void use_fallback(hip_impl::kernarg kernarg) {
+        fallback.reset(new hip_impl::kernarg{std::move(kernarg)});
+    }
+private:
+    alignas(alignof(std::max_align_t))
+        std::uint8_t buffer[static_size ? static_size : 1]{};
+    std::unique_ptr<hip_impl::kernarg> fallback;
+};
+
+template <typename... Formals, typename... Actuals>
+inline packed_kernarg<Formals...> make_packed_kernarg(
+    void (*kernel)(Formals...), std::tuple<Actuals...> actuals) {
+    static_assert(sizeof...(Formals) == sizeof...(Actuals),
+        "The count of formal arguments must match the count of actuals.");
+
+    packed_kernarg<Formals...> kernarg;
+    if (sizeof...(Formals) == 0) return kernarg;
+
+    std::tuple<Formals...> to_formals{std::move(actuals)};
+    const auto function_address = reinterpret_cast<std::uintptr_t>(kernel);
+
+    if (kernarg_layout_is_static<Formals...>(function_address)) {
+        pack_kernarg<0>(to_formals, kernarg.static_buffer());
+    }
+    else {
+        auto& ps = hip_impl::get_program_state();
+        kernarg.use_fallback(make_kernarg<0>(
+            to_formals,
+            ps.get_kernargs_size_align(function_address),
+            hip_impl::kernarg{}));
+    }
+
+    return kernarg;
+}
+
 HIP_INTERNAL_EXPORTED_API hsa_agent_t target_agent(hipStream_t stream);
 
 inline
@@ -177,7 +344,7 @@ void hipLaunchKernelGGL(F kernel, const dim3& numBlocks, const dim3& dimBlocks,
                         std::uint32_t sharedMemBytes, hipStream_t stream,
                         Args... args) {
     hip_impl::hip_init();
-    auto kernarg = hip_impl::make_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
+    auto kernarg = hip_impl::make_packed_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
     std::size_t kernarg_size = kernarg.size();
 
     void* config[]{
@@ -161,6 +161,10 @@ enum hipLimit_t {
 #define hipEventDisableTiming                                                                      \
     0x2  ///< Disable event's capability to record timing information.  May improve performance.
 #define hipEventInterprocess 0x4  ///< Event can support IPC.  @warning - not supported in HIP.
+#define hipEventTimingOnly                                                                         \
+    0x20000000  /// < Event only takes a timestamp: recording it reuses the completion of the last
+                /// kernel on the stream when possible instead of enqueuing a barrier marker.  The
+                /// flag is a no-op on CUDA platforms.
 #define hipEventReleaseToDevice                                                                    \
     0x40000000  /// < Use a device-scope release when recording this event.  This flag is useful to
                 /// obtain more precise timings of commands between events.  The flag is a no-op on
@@ -966,6 +970,78 @@ hipError_t hipStreamGetPriority(hipStream_t stream, int* priority);
 hipError_t hipExtStreamCreateWithCUMask(hipStream_t* stream, uint32_t cuMaskSize, const uint32_t* cuMask);
 
 
+/**
+ * @brief Acquire a stream from the runtime-managed stream pool of the current device.
+ *
+ * @param[out] stream Returned stream
+ * @param[in ] flags Flags of the stream, hipStreamDefault or hipStreamNonBlocking
+ * @param[in ] priority Priority of the stream, clamped as in hipStreamCreateWithPriority
+ * @param[in ] cuMaskSize Size of the CU mask bit array, 0 if all CUs may be used
+ * @param[in ] cuMask CU mask bit array, as in hipExtStreamCreateWithCUMask
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorOutOfMemory
+ *
+ * Returns a stream released earlier with the same attributes when there is one, which avoids
+ * creating a new HW queue. The pool keeps at most HIP_STREAM_POOL_MAX_QUEUES streams per device
+ * (default 32). When it is full and no stream is idle, an in-use stream with the same
+ * attributes is shared, so work from its users is serialized. A stream with other flags or CU
+ * mask is never returned; without a match a new stream is created, and destroyed once released.
+ * Streams must be handed back with hipExtStreamPoolRelease; hipStreamDestroy on a pool stream
+ * releases it.
+ *
+ * @see hipExtStreamPoolRelease, hipStreamCreateWithPriority, hipExtStreamCreateWithCUMask
+ */
+hipError_t hipExtStreamPoolAcquire(hipStream_t* stream, unsigned int flags, int priority,
+                                   uint32_t cuMaskSize, const uint32_t* cuMask);
+
+
+/**
+ * @brief Release a stream acquired with hipExtStreamPoolAcquire.
+ *
+ * @param[in] stream Stream to release
+ * @return #hipSuccess, #hipErrorInvalidHandle
+ *
+ * The stream returns to the pool without waiting for its work; work already queued stays ahead
+ * of the work of the stream's next owner. @p stream must not be used after it is released.
+ *
+ * @see hipExtStreamPoolAcquire
+ */
+hipError_t hipExtStreamPoolRelease(hipStream_t stream);
+
+
+/**
+ * Host wait statistics of a stream, see hipExtStreamGetWaitStats.
+ */
+typedef struct hipExtStreamWaitStats_t {
+    uint64_t waits;             ///< Host waits on the stream
+    uint64_t spinCompletions;   ///< Waits that completed while spinning
+    uint64_t yieldCompletions;  ///< Waits that completed while yielding
+    uint64_t blockCompletions;  ///< Waits that completed while blocked
+    uint64_t waitNs;            ///< Total time spent waiting, in nanoseconds
+    uint64_t spinNs;            ///< Current spin interval of the adaptive policy, in nanoseconds
+} hipExtStreamWaitStats_t;
+
+
+/**
+ * @brief Return the host wait statistics of a stream.
+ *
+ * @param[in ] stream Stream to query, 0 for the null stream
+ * @param[out] stats Returned statistics
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Counts the waits of hipStreamSynchronize and hipDeviceSynchronize on @p stream and of
+ * synchronous copies issued to it. hipEventSynchronize waits with the same policy, after the
+ * flags of the event's device, but learns from the waits on the event itself.
+ *
+ * With hipDeviceScheduleAuto, or HIP_WAIT_MODE=3, these waits use an adaptive policy: they spin
+ * for twice the recent average wait of the stream, up to HIP_WAIT_SPIN_US microseconds (default
+ * 50), then yield for as long, then block. hipDeviceScheduleSpin always spins and
+ * hipDeviceScheduleBlockingSync always blocks.
+ *
+ * @see hipStreamSynchronize, hipEventSynchronize, hipSetDeviceFlags
+ */
+hipError_t hipExtStreamGetWaitStats(hipStream_t stream, hipExtStreamWaitStats_t* stats);
+
+
 /**
  * Stream CallBack struct
  */
@@ -996,6 +1072,148 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
  */
 
 
+/**
+ *-------------------------------------------------------------------------------------------------
+ *-------------------------------------------------------------------------------------------------
+ *  @defgroup Graph Stream Capture and Graph Replay
+ *  @{
+ *
+ *  A capturing stream records the work issued to it into a graph instead of executing it. The
+ *  graph is instantiated once and then launched as often as needed, which skips argument
+ *  validation and packing, and lets independent work run on several streams.
+ *
+ *  While capturing, kernel launches, hipMemcpyAsync() and its HtoD/DtoH/DtoD variants,
+ *  hipMemsetAsync() and its D8/D16/D32 variants, hipEventRecord() and hipStreamWaitEvent() are
+ *  captured. A stream that waits for an event recorded during the capture joins it, and the
+ *  commands issued to it become branches of the graph. Other operations on a capturing stream,
+ *  such as 2D and 3D copies, launches with start or stop events, cooperative launches, callbacks
+ *  and synchronization, return #hipErrorNotSupported and fail the capture.
+ */
+
+typedef struct ihipGraph_t* hipExtGraph_t;
+typedef struct ihipGraphExec_t* hipExtGraphExec_t;
+
+/**
+ * @brief Start capturing the work issued to a stream.
+ *
+ * @param[in] stream Stream to capture, not the null stream
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Work issued to @p stream is recorded, not executed, until hipExtStreamEndCapture(). Work that
+ * was queued before keeps running. Fails if @p stream is already capturing.
+ *
+ * @see hipExtStreamEndCapture, hipExtGraphInstantiate
+ */
+hipError_t hipExtStreamBeginCapture(hipStream_t stream);
+
+/**
+ * @brief Stop capturing and return the captured graph.
+ *
+ * @param[in ] stream Stream passed to hipExtStreamBeginCapture()
+ * @param[out] graph Returned graph
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported
+ *
+ * Also ends the capture of the streams that joined it; a joined stream destroyed before leaves
+ * the capture, and destroying @p stream drops it. Returns #hipErrorNotSupported and no graph if
+ * an operation that can't be captured was issued during the capture. Captured pointers and events
+ * are used as they are when the graph is launched.
+ *
+ * @see hipExtStreamBeginCapture, hipExtGraphDestroy
+ */
+hipError_t hipExtStreamEndCapture(hipStream_t stream, hipExtGraph_t* graph);
+
+/**
+ * @brief Return the number of nodes of a graph.
+ *
+ * @param[in ] graph Graph to query
+ * @param[out] count Number of nodes
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Nodes are numbered from 0 in capture order.
+ */
+hipError_t hipExtGraphGetNodeCount(hipExtGraph_t graph, size_t* count);
+
+/**
+ * @brief Destroy a graph. Instances created from it are not affected.
+ *
+ * @param[in] graph Graph to destroy
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipExtGraphDestroy(hipExtGraph_t graph);
+
+/**
+ * @brief Create a launchable instance of a graph.
+ *
+ * @param[out] exec Returned instance
+ * @param[in ] graph Graph to instantiate
+ * @param[in ] maxStreams Most streams a launch spreads the graph over, at most 8
+ * @return #hipSuccess, #hipErrorInvalidValue, #hipErrorOutOfMemory
+ *
+ * Nodes that depend on each other are kept on one stream where possible, and independent
+ * branches are given their own stream, up to @p maxStreams. Streams other than the one the graph
+ * is launched on are created for, and owned by, the instance. With a @p maxStreams
+ * of 0 or 1 the whole graph runs on the launch stream, in capture order.
+ *
+ * @see hipExtGraphLaunch, hipExtGraphExecDestroy
+ */
+hipError_t hipExtGraphInstantiate(hipExtGraphExec_t* exec, hipExtGraph_t graph,
+                                  unsigned int maxStreams);
+
+/**
+ * @brief Change the arguments of a kernel node of an instance.
+ *
+ * @param[in] exec Instance to update
+ * @param[in] node Index of a kernel node
+ * @param[in] kernelParams Arguments, as for hipModuleLaunchKernel()
+ * @param[in] extra Arguments, as for hipModuleLaunchKernel()
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * Applies to launches of @p exec made after the call; launches already made are not affected.
+ */
+hipError_t hipExtGraphExecSetKernelArgs(hipExtGraphExec_t exec, size_t node, void** kernelParams,
+                                        void** extra);
+
+/**
+ * @brief Change the pointers of a memcpy node of an instance.
+ *
+ * @param[in] exec Instance to update
+ * @param[in] node Index of a memcpy node
+ * @param[in] dst New destination
+ * @param[in] src New source
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * The size and kind of the copy are kept. Applies to launches made after the call.
+ */
+hipError_t hipExtGraphExecSetMemcpyParams(hipExtGraphExec_t exec, size_t node, void* dst,
+                                          const void* src);
+
+/**
+ * @brief Launch an instance on a stream.
+ *
+ * @param[in] exec Instance to launch
+ * @param[in] stream Stream to launch on
+ * @return #hipSuccess, #hipErrorInvalidValue
+ *
+ * The graph starts after the work already queued on @p stream, and work queued on @p stream
+ * afterwards starts once the whole graph has completed, on all its streams.
+ */
+hipError_t hipExtGraphLaunch(hipExtGraphExec_t exec, hipStream_t stream);
+
+/**
+ * @brief Destroy an instance. Its launches still run to completion.
+ *
+ * @param[in] exec Instance to destroy
+ * @return #hipSuccess, #hipErrorInvalidValue
+ */
+hipError_t hipExtGraphExecDestroy(hipExtGraphExec_t exec);
+
+
+// end doxygen Graph
+/**
+ * @}
+ */
+
+
 /**
  *-------------------------------------------------------------------------------------------------
  *-------------------------------------------------------------------------------------------------
@@ -1018,6 +1236,11 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
  for the synchroniation but can result in lower power and more resources for other CPU threads.
  * #hipEventDisableTiming : Disable recording of timing information.  On ROCM platform, timing
  information is always recorded and this flag has no performance benefit.
+ * #hipEventTimingOnly : The event is only used for timing.  hipEventRecord() does not enqueue a
+ barrier when the last command of the stream is a kernel: the event takes the end timestamp of that
+ kernel instead.  Kernels launched on a stream after a timing-only event was recorded on it carry
+ the timestamps needed for this.  Cannot be combined with #hipEventDisableTiming or
+ #hipEventInterprocess.
 
  * @warning On AMD platform, hipEventInterprocess support is under development.  Use of this flag
  will return an error.
@@ -1164,6 +1387,46 @@ hipError_t hipEventElapsedTime(float* ms, hipEvent_t start, hipEvent_t stop);
  */
 hipError_t hipEventQuery(hipEvent_t event);
 
+/**
+ * @brief Returns marker reuse counters for a device
+ *
+ * @param[in] device Ordinal of the device
+ * @param[out] reused Number of event, synchronization and null-stream markers that reused the
+ * last marker of their stream
+ * @param[out] created Number of such markers that had to be created
+ * @returns #hipSuccess, #hipErrorInvalidDevice, #hipErrorInvalidValue
+ *
+ * A stream's last marker is reused when nothing was enqueued on the stream since it was created,
+ * so recording several events back to back, or synchronizing a stream right after recording an
+ * event on it, creates a single marker. Markers are not pooled across streams or once completed.
+ * Counters are cumulative for the lifetime of the process.
+ *
+ * @see hipEventRecord, hipStreamSynchronize
+ */
+hipError_t hipExtGetMarkerReuseStats(int device, uint64_t* reused, uint64_t* created);
+
+/**
+ * @brief Reads the timestamps of several events in one call
+ *
+ * @param[out] timestamps Returns the timestamp of each event, in ns
+ * @param[in] events Events to read, recorded with hipEventRecord() or passed to
+ * hipExtLaunchKernel() and similar launches
+ * @param[in] count Number of events
+ * @returns #hipSuccess, #hipErrorInvalidValue, #hipErrorInvalidHandle, #hipErrorNotReady
+ *
+ * Timestamps are taken on the device timestamp clock and only their differences are meaningful:
+ * the difference between the timestamps of two events is what hipEventElapsedTime() returns for
+ * them, in ns.  Intended for reading many #hipEventTimingOnly events at once, e.g. start and stop
+ * events around every kernel.
+ *
+ * #hipErrorInvalidHandle is returned if any event is null, was never recorded, or was created
+ * with #hipEventDisableTiming.  Otherwise #hipErrorNotReady is returned if any event has not
+ * completed yet; the timestamps of those events are set to 0 and the others are still returned.
+ *
+ * @see hipEventElapsedTime, hipEventCreateWithFlags
+ */
+hipError_t hipExtEventGetTimestamps(uint64_t* timestamps, const hipEvent_t* events, size_t count);
+
 
 // end doxygen Events
 /**
@@ -1376,6 +1639,41 @@ hipError_t hipHostRegister(void* hostPtr, size_t sizeBytes, unsigned int flags);
  */
 hipError_t hipHostUnregister(void* hostPtr);
 
+/**
+ * Pin cache statistics, see hipExtPinCacheGetStats. The hit rate is hits / lookups.
+ */
+typedef struct hipExtPinCacheStats_t {
+    size_t budget;              ///< Bytes the cache may keep pinned, 0 if it is disabled
+    size_t pinned;              ///< Bytes pinned, including dropped ranges not yet unpinned
+    size_t peakPinned;          ///< Most bytes pinned at once
+    uint64_t lookups;           ///< Copies that looked up their host range
+    uint64_t hits;              ///< Lookups that found the range pinned
+    uint64_t misses;            ///< Lookups that did not
+    uint64_t pins;              ///< Ranges pinned on a miss
+    uint64_t evictions;         ///< Ranges unpinned to stay under the budget
+    uint64_t invalidations;     ///< Ranges dropped because they were unmapped or freed
+    uint64_t rejected;          ///< Ranges that could not be pinned
+} hipExtPinCacheStats_t;
+
+/**
+ *  @brief Return the statistics of the pinned host memory cache
+ *
+ *  @param[out] stats Returned statistics
+ *
+ *  With HIP_PIN_CACHE_SIZE set to a budget in MB, copies of at least HIP_PIN_CACHE_MIN_KB
+ *  between a device and pageable host memory keep the host pages they touch pinned, least
+ *  recently used first within the budget, so copying the same buffers again goes straight to
+ *  the DMA engines. Pages are dropped from the cache when they are unmapped, freed back to the
+ *  system, or registered with hipHostRegister. The cache needs userfaultfd, and is disabled
+ *  otherwise.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidValue, #hipErrorNotSupported (runtime without a pin
+ *  cache)
+ *
+ *  @see hipHostRegister
+ */
+hipError_t hipExtPinCacheGetStats(hipExtPinCacheStats_t* stats);
+
 /**
  *  Allocates at least width (in bytes) * height bytes of linear memory
  *  Padding may occur to ensure alighnment requirements are met for the given row
@@ -1436,6 +1734,101 @@ hipError_t hipMemAllocPitch(hipDeviceptr_t* dptr, size_t* pitch, size_t widthInB
  */
 hipError_t hipFree(void* ptr);
 
+/**
+ *  @brief Allocate device memory in stream order
+ *
+ *  @param[out] ptr Pointer to the allocated memory
+ *  @param[in]  size Requested memory size
+ *  @param[in]  stream Stream the memory is first used on, 0 for the null stream
+ *
+ *  The memory comes from the memory pool of the stream's device and may be used by work
+ *  enqueued on stream from this point on; using it on another stream requires synchronizing
+ *  with stream first. A block freed with hipFreeAsync is handed out again right away on the
+ *  stream it was freed on, and on other streams once the free has completed or after making
+ *  stream wait for it, so the call does not synchronize and usually does not allocate.
+ *
+ *  Requests are rounded up to a size class: 512 bytes, then four classes per power of two.
+ *  If size is 0, no memory is allocated, *ptr returns nullptr, and hipSuccess is returned.
+ *
+ *  @return #hipSuccess, #hipErrorOutOfMemory, #hipErrorInvalidValue,
+ *  #hipErrorNotSupported (stream is being captured)
+ *
+ *  @see hipFreeAsync, hipExtMemPoolSetReleaseThreshold, hipExtMemPoolTrimTo,
+ *  hipExtMemPoolGetStats
+ */
+hipError_t hipMallocAsync(void** ptr, size_t size, hipStream_t stream);
+
+/**
+ *  @brief Free memory allocated by hipMallocAsync in stream order
+ *
+ *  @param[in] ptr Pointer to memory to be freed
+ *  @param[in] stream Stream ordering the free, 0 for the null stream
+ *
+ *  The memory goes back to the memory pool of its device once the work enqueued on stream so
+ *  far has completed; the call itself does not synchronize. Memory is returned to the system
+ *  by hipExtMemPoolTrimTo, or when the pool holds more than its release threshold.
+ *  hipFree on memory from hipMallocAsync is a hipFreeAsync on the null stream.
+ *  If pointer is NULL, hipSuccess is returned.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidDevicePointer, #hipErrorNotSupported (stream is being
+ *  captured)
+ *
+ *  @see hipMallocAsync
+ */
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream);
+
+/**
+ *  @brief Return unused memory of a device's memory pool to the system
+ *
+ *  @param[in] device Device whose pool is trimmed
+ *  @param[in] minBytesToKeep Memory the pool may keep, in bytes
+ *
+ *  Releases blocks whose hipFreeAsync has completed until the pool holds at most
+ *  minBytesToKeep bytes, counting memory still allocated. Blocks still in use, or whose free is
+ *  still pending on its stream, are kept.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ */
+hipError_t hipExtMemPoolTrimTo(int device, size_t minBytesToKeep);
+
+/**
+ *  @brief Set how much memory a device's memory pool keeps cached
+ *
+ *  @param[in] device Device whose pool is configured
+ *  @param[in] bytes Release threshold, in bytes
+ *
+ *  Whenever a hipFreeAsync leaves the pool holding more than bytes, the pool releases completed
+ *  blocks, largest first, until it is back under the threshold. The default is SIZE_MAX: the
+ *  pool keeps everything until trimmed.
+ *
+ *  @return #hipSuccess, #hipErrorInvalidDevice
+ */
+hipError_t hipExtMemPoolSetReleaseThreshold(int device, size_t bytes);
+
+/**
+ * Memory pool statistics of a device, see hipExtMemPoolGetStats.
+ */
+typedef struct hipExtMemPoolStats_t {
+    size_t reserved;            ///< Bytes held by the pool, allocated or cached
+    size_t used;                ///< Bytes allocated by hipMallocAsync and not yet freed
+    size_t peakReserved;        ///< Most bytes held at once
+    size_t peakUsed;            ///< Most bytes allocated at once
+    uint64_t allocations;       ///< hipMallocAsync calls served
+    uint64_t reuses;            ///< Allocations served from cached blocks
+    uint64_t dependencyWaits;   ///< Reuses that made the stream wait for a pending free
+    uint64_t releases;          ///< Blocks returned to the system
+} hipExtMemPoolStats_t;
+
+/**
+ *  @brief Return the memory pool statistics of a device
+ *
+ *  @param[in ] device Device to query
+ *  @param[out] stats Returned statistics
+ *
+ *  @return #hipSuccess, #hipErrorInvalidDevice, #hipErrorInvalidValue
+ */
+hipError_t hipExtMemPoolGetStats(int device, hipExtMemPoolStats_t* stats);
+
 /**
  *  @brief Free memory allocated by the hcc hip host memory allocation API.  [Deprecated]
  *
@@ -1836,6 +2229,10 @@ hipError_t hipMemcpyFromSymbolAsync(void* dst, const void* symbolName,
  *
  *  @warning If host or dest are not pinned, the memory copy will be performed synchronously.  For
  * best performance, use hipHostMalloc to allocate host memory that is transferred asynchronously.
+ * Setting HIP_COPY_THREADS runs copies between pageable host memory and device memory on runtime
+ * threads instead, in stream order; the host buffer must then not be modified or freed until the
+ * copy completes. A failure of such a copy is returned by the next hipStreamSynchronize,
+ * hipStreamQuery or hipDeviceSynchronize covering the stream.
  *
  *  @warning on HCC hipMemcpyAsync does not support overlapped H2D and D2H copies.
  *  For hipMemcpy, the copy is always performed by the device associated with the specified stream.
@@ -77,6 +77,39 @@ hipError_t hipHccModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
                                     hipEvent_t stopEvent = nullptr)
                                     __attribute__((deprecated("use hipExtModuleLaunchKernel instead")));
 
+/**
+ * Parameters of one kernel launch of hipExtModuleLaunchKernelBatch.
+ */
+typedef struct hipExtLaunchBatchParams_t {
+    hipFunction_t function;  ///< Kernel to launch
+    dim3 gridDim;            ///< Grid dimensions, in blocks
+    dim3 blockDim;           ///< Block dimensions, in work-items
+    size_t sharedMemBytes;   ///< Dynamic shared memory, in bytes
+    void** kernelParams;     ///< Kernel arguments, as for hipModuleLaunchKernel
+    void** extra;            ///< Packed kernel arguments, as for hipModuleLaunchKernel
+} hipExtLaunchBatchParams;
+
+/**
+ * @brief launches a sequence of kernels on a stream in one call
+ *
+ * @param [in] launches  Kernels to launch, in order
+ * @param [in] count     Number of entries in launches
+ * @param [in] stream    Stream where the kernels should be dispatched.  May be 0, in which case the
+ default stream is used with associated synchronization rules.
+ * @param [in] flags     Same as for hipExtModuleLaunchKernel: if bit 0 is set, the kernels may run
+ out of order
+ *
+ * @returns hipSuccess, hipInvalidDevice, hipErrorNotInitialized, hipErrorInvalidValue,
+ hipErrorInvalidConfiguration, hipErrorInvalidResourceHandle
+ *
+ * Equivalent to calling hipModuleLaunchKernel for each entry, but all arguments are validated and
+ captured before the first kernel is dispatched, and the stream is acquired only once.  If any entry
+ is invalid nothing is launched.
+ */
+HIP_PUBLIC_API
+hipError_t hipExtModuleLaunchKernelBatch(const hipExtLaunchBatchParams* launches, uint32_t count,
+                                         hipStream_t stream, uint32_t flags = 0);
+
 #if defined(__HIP_ROCclr__) && defined(__cplusplus)
 
 extern "C" hipError_t hipExtLaunchKernel(const void* function_address, dim3 numBlocks,
@@ -100,7 +133,7 @@ inline void hipExtLaunchKernelGGL(F kernel, const dim3& numBlocks, const dim3& d
                        stopEvent, (int)flags);
 }
 #elif defined(__HIP_PLATFORM_HCC__) && GENERIC_GRID_LAUNCH == 1 && defined(__HCC__)
-//kernel_descriptor and hip_impl::make_kernarg are in "grid_launch_GGL.hpp"
+//kernel_descriptor and hip_impl::make_packed_kernarg are in "grid_launch_GGL.hpp"
 
 namespace hip_impl {
 inline
@@ -137,7 +170,7 @@ void hipExtLaunchKernelGGL(F kernel, const dim3& numBlocks,
                            Args... args) {
     hip_impl::hip_init();
     auto kernarg =
-        hip_impl::make_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
+        hip_impl::make_packed_kernarg(kernel, std::tuple<Args...>{std::move(args)...});
     std::size_t kernarg_size = kernarg.size();
 
     void* config[]{
@@ -239,6 +239,7 @@ typedef enum cudaChannelFormatKind hipChannelFormatKind;
 #define hipEventInterprocess cudaEventInterprocess
 #define hipEventReleaseToDevice 0 /* no-op on CUDA platform */
 #define hipEventReleaseToSystem 0 /* no-op on CUDA platform */
+#define hipEventTimingOnly 0 /* no-op on CUDA platform */
 
 
 #define hipHostMallocDefault cudaHostAllocDefault
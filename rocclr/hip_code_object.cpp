@@ -14,21 +14,6 @@ uint64_t CodeObject::ElfSize(const void *emi) {
   return amd::Elf::getElfSize(emi);
 }
 
-bool CodeObject::isCompatibleCodeObject(const std::string& codeobj_target_id,
-                                        const char* device_name) {
-  // Workaround for device name mismatch.
-  // Device name may contain feature strings delimited by '+', e.g.
-  // gfx900+xnack. Currently HIP-Clang does not include feature strings
-  // in code object target id in fat binary. Therefore drop the feature
-  // strings from device name before comparing it with code object target id.
-  std::string short_name(device_name);
-  auto feature_loc = short_name.find('+');
-  if (feature_loc != std::string::npos) {
-    short_name.erase(feature_loc);
-  }
-  return codeobj_target_id == short_name;
-}
-
 // This will be moved to COMGR eventually
 hipError_t CodeObject::ExtractCodeObjectFromFile(amd::Os::FileDesc fdesc, size_t fsize,
                        const std::vector<const char*>& device_names,
@@ -47,7 +32,7 @@ hipError_t CodeObject::ExtractCodeObjectFromFile(amd::Os::FileDesc fdesc, size_t
   }
 
   // retrieve code_objs{binary_image, binary_size} for devices
-  hip_error = extractCodeObjectFromFatBinary(image, device_names, code_objs);
+  hip_error = extractCodeObjectFromFatBinary(image, device_names, code_objs, fsize);
 
   // Unmap the file memory after extracting code object.
   if (!amd::Os::MemoryUnmapFile(image, fsize)) {
@@ -74,45 +59,33 @@ hipError_t CodeObject::ExtractCodeObjectFromMemory(const void* data,
 // This will be moved to COMGR eventually
 hipError_t CodeObject::extractCodeObjectFromFatBinary(const void* data,
                        const std::vector<const char*>& device_names,
-                       std::vector<std::pair<const void*, size_t>>& code_objs) {
-  std::string magic((const char*)data, sizeof(CLANG_OFFLOAD_BUNDLER_MAGIC_STR) - 1);
-  if (magic.compare(CLANG_OFFLOAD_BUNDLER_MAGIC_STR)) {
+                       std::vector<std::pair<const void*, size_t>>& code_objs,
+                       size_t size) {
+  const hip_impl::Bundle_index index{data, size};
+  if (!index.valid()) {
     return hipErrorInvalidKernelFile;
   }
 
   code_objs.resize(device_names.size());
-  const auto obheader = reinterpret_cast<const __ClangOffloadBundleHeader*>(data);
-  const auto* desc = &obheader->desc[0];
   unsigned num_code_objs = 0;
-  for (uint64_t i = 0; i < obheader->numBundles; ++i,
-       desc = reinterpret_cast<const __ClangOffloadBundleDesc*>(
-           reinterpret_cast<uintptr_t>(&desc->triple[0]) + desc->tripleSize)) {
-
-    std::size_t offset = 0;
-    if (!std::strncmp(desc->triple, HIP_AMDGCN_AMDHSA_TRIPLE,
-        sizeof(HIP_AMDGCN_AMDHSA_TRIPLE) - 1)) {
-      offset = sizeof(HIP_AMDGCN_AMDHSA_TRIPLE); //For code objects created by CLang
-    } else if (!std::strncmp(desc->triple, HCC_AMDGCN_AMDHSA_TRIPLE,
-               sizeof(HCC_AMDGCN_AMDHSA_TRIPLE) - 1)) {
-      offset = sizeof(HCC_AMDGCN_AMDHSA_TRIPLE); //For code objects created by Hcc
-    } else {
-      continue;
+  for (size_t dev = 0; dev < device_names.size(); ++dev) {
+    // Workaround for device name mismatch.
+    // Device name may contain feature strings delimited by '+', e.g.
+    // gfx900+xnack. Currently HIP-Clang does not include feature strings
+    // in code object target id in fat binary. Therefore drop the feature
+    // strings from device name before comparing it with code object target id.
+    hip_impl::Byte_view name(device_names[dev]);
+    const char* feature = std::strchr(device_names[dev], '+');
+    if (feature != nullptr) {
+      name = hip_impl::Byte_view(device_names[dev], feature - device_names[dev]);
     }
-    std::string target(desc->triple + offset, desc->tripleSize - offset);
-
-    const void *image = reinterpret_cast<const void*>(
-        reinterpret_cast<uintptr_t>(obheader) + desc->offset);
-    size_t size = desc->size;
 
-    for (size_t dev = 0; dev < device_names.size(); ++dev) {
-      const char* name = device_names[dev];
-
-      if (!isCompatibleCodeObject(target, name)) {
-          continue;
-      }
-      code_objs[dev] = std::make_pair(image, size);
-      num_code_objs++;
+    const hip_impl::Bundle_index::Entry* entry = index.find(name);
+    if (entry == nullptr) {
+      continue;
     }
+    code_objs[dev] = std::make_pair(entry->blob.data(), entry->blob.size());
+    num_code_objs++;
   }
   if (num_code_objs == device_names.size()) {
     return hipSuccess;
@@ -10,6 +10,7 @@
 #include "hip_internal.hpp"
 #include "device/device.hpp"
 #include "platform/program.hpp"
+#include "src/code_object_bundle_index.hpp"
 
 //Forward Declaration for friend usage
 class PlatformState;
@@ -57,15 +58,14 @@ public:
   static uint64_t ElfSize(const void* emi);
 
 protected:
+  // size bounds the bundle when known, e.g. for a mapped file.
   static hipError_t extractCodeObjectFromFatBinary(const void*,
                     const std::vector<const char*>&,
-                    std::vector<std::pair<const void*, size_t>>&);
+                    std::vector<std::pair<const void*, size_t>>&,
+                    size_t size = hip_impl::Bundle_index::unknown_size);
 
   CodeObject() {}
 private:
-  static bool isCompatibleCodeObject(const std::string& codeobj_target_id,
-                                     const char* device_name);
-
   friend const std::vector<hipModule_t>& modules();
 };
 
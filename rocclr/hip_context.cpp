@@ -32,6 +32,8 @@ namespace hip {
 thread_local Device* g_device = nullptr;
 thread_local std::stack<Device*> g_ctxtStack;
 thread_local hipError_t g_lastError = hipSuccess;
+thread_local uint32_t g_pendingSubmits = 0;
+thread_local uint32_t g_submitScopeDepth = 0;
 std::once_flag g_ihipInitialized;
 Device* host_device = nullptr;
 
@@ -84,9 +86,11 @@ amd::HostQueue* getQueue(hipStream_t stream) {
     return getNullStream();
   } else {
     constexpr bool WaitNullStreamOnly = true;
-    amd::HostQueue* queue = reinterpret_cast<hip::Stream*>(stream)->asHostQueue();
-    if (!(reinterpret_cast<hip::Stream*>(stream)->Flags() & hipStreamNonBlocking)) {
-      iHipWaitActiveStreams(queue, WaitNullStreamOnly);
+    hip::Stream* hip_stream = reinterpret_cast<hip::Stream*>(stream);
+    amd::HostQueue* queue = hip_stream->asHostQueue();
+    if (!(hip_stream->Flags() & hipStreamNonBlocking)) {
+      hip_stream->BeginSubmit();
+      iHipWaitActiveStreams(hip_stream, WaitNullStreamOnly);
     }
     return queue;
   }
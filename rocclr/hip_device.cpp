@@ -30,8 +30,9 @@ amd::HostQueue* Device::NullStream(bool skip_alloc) {
   if (null_queue == nullptr) {
     return nullptr;
   }
+  null_stream_.BeginSubmit();
   // Wait for all active streams before executing commands on the default
-  iHipWaitActiveStreams(null_queue);
+  iHipWaitActiveStreams(&null_stream_);
   return null_queue;
 }
 
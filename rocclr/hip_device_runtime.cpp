@@ -452,7 +452,7 @@ hipError_t hipDeviceSynchronize ( void ) {
     HIP_RETURN(hipErrorOutOfMemory);
   }
 
-  queue->finish();
+  hip::getCurrentDevice()->GetNullStream()->Wait(queue);
 
   hip::Stream::syncNonBlockingStreams();
 
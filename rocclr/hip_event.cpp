@@ -51,7 +51,19 @@ hipError_t Event::synchronize() {
     return hipSuccess;
   }
 
-  event_->awaitCompletion();
+  // The scheduling flags of the device that records the event apply, not the caller's
+  hip::Device* device = hip::getCurrentDevice();
+  amd::Context& context = event_->command().queue()->context();
+  for (auto& it : g_devices) {
+    if (it->asContext() == &context) {
+      device = it;
+      break;
+    }
+  }
+  hip_impl::Wait_policy policy = (flags & hipEventBlockingSync) ?
+      hip_impl::Wait_policy::blocked : device->WaitPolicy();
+  waiter_.wait(policy, [this]() { return ready(); },
+               [this](bool) { event_->awaitCompletion(); });
 
   return hipSuccess;
 }
@@ -90,7 +102,10 @@ hipError_t Event::elapsedTime(Event& eStop, float& ms) {
     return hipErrorNotReady;
   }
 
-  if (event_ != eStop.event_ && recorded_ && eStop.recorded_) {
+  if (event_ == eStop.event_ && (flags & eStop.flags & hipEventTimingOnly)) {
+    // Both events reused the same command, so nothing ran between them
+    ms = 0.f;
+  } else if (event_ != eStop.event_ && recorded_ && eStop.recorded_) {
     ms = static_cast<float>(static_cast<int64_t>(eStop.event_->profilingInfo().end_ -
                           event_->profilingInfo().end_))/1000000.f;
   } else if (event_ == eStop.event_ && (recorded_ || eStop.recorded_)) {
@@ -113,6 +128,21 @@ hipError_t Event::elapsedTime(Event& eStop, float& ms) {
   return hipSuccess;
 }
 
+hipError_t Event::timestamp(uint64_t& ns) {
+  amd::ScopedLock lock(lock_);
+
+  if (event_ == nullptr || (flags & hipEventDisableTiming)) {
+    return hipErrorInvalidHandle;
+  }
+
+  if (!ready()) {
+    return hipErrorNotReady;
+  }
+
+  ns = start_ ? event_->profilingInfo().start_ : event_->profilingInfo().end_;
+  return hipSuccess;
+}
+
 hipError_t Event::streamWait(amd::HostQueue* hostQueue, uint flags) {
   if ((event_ == nullptr) || (event_->command().queue() == hostQueue)) {
     return hipSuccess;
@@ -137,29 +167,44 @@ hipError_t Event::streamWait(amd::HostQueue* hostQueue, uint flags) {
   return hipSuccess;
 }
 
-void Event::addMarker(amd::HostQueue* queue, amd::Command* command, bool record) {
+bool Event::addMarker(amd::HostQueue* queue, amd::Command* command, bool record, bool start) {
   amd::ScopedLock lock(lock_);
-
-  if (queue->properties().test(CL_QUEUE_PROFILING_ENABLE)) {
-    if (command == nullptr) {
-      command = queue->getLastQueuedCommand(true);
-      if ((command == nullptr) || (command->type() == 0)) {
-        // if lastEnqueuedCommand is user invisible command(command->type() == 0),
-        // which is only used for sync, create a new amd:Marker
-        // and release() lastEnqueuedCommand
-        if (command != nullptr) {
-          command->release();
-        }
+  bool reused = false;
+
+  if (command == nullptr) {
+    const bool profiling = queue->properties().test(CL_QUEUE_PROFILING_ENABLE);
+    command = queue->getLastQueuedCommand(true);
+    // The last queued command completes after everything enqueued so far, so it can stand in
+    // for a new marker if it has timestamps: on a profiling queue any user visible command does
+    // (command->type() == 0 is only used for sync). Otherwise reuse only this event's own marker,
+    // since sharing another event's marker would confuse elapsedTime(), or any command when the
+    // event takes no timestamps. Timing-only events also reuse any command with timestamps,
+    // e.g. the kernels of a stream with timed launches, and elapsedTime() knows that two such
+    // events on the same command are 0 ms apart.
+    reused = (command != nullptr) &&
+             ((profiling && (command->type() != 0)) || (event_ == &command->event()) ||
+              (flags & hipEventDisableTiming) ||
+              ((flags & hipEventTimingOnly) && command->profilingInfo().enabled_));
+    if (!reused) {
+      if (command != nullptr) {
+        command->release();
+      }
+      if (profiling) {
         command = new amd::Marker(*queue, kMarkerDisableFlush);
-        command->enqueue();
+      } else {
+        command = new hip::ProfileMarker(*queue, false);
       }
+      command->enqueue();
     }
-  } else if (command == nullptr) {
-    command = new hip::ProfileMarker(*queue, false);
-    command->enqueue();
   }
 
-  if (event_ == &command->event()) return;
+  if (event_ == &command->event()) {
+    if (reused) {
+      // Drop the reference taken by getLastQueuedCommand(), event_ already holds one
+      command->release();
+    }
+    return reused;
+  }
 
   if (event_ != nullptr) {
     event_->release();
@@ -167,6 +212,8 @@ void Event::addMarker(amd::HostQueue* queue, amd::Command* command, bool record)
 
   event_ = &command->event();
   recorded_ = record;
+  start_ = start;
+  return reused;
 }
 
 }
@@ -177,12 +224,14 @@ hipError_t ihipEventCreateWithFlags(hipEvent_t* event, unsigned flags) {
   }
 
   unsigned supportedFlags = hipEventDefault | hipEventBlockingSync | hipEventDisableTiming |
-                            hipEventReleaseToDevice | hipEventReleaseToSystem;
+                            hipEventReleaseToDevice | hipEventReleaseToSystem |
+                            hipEventTimingOnly;
   const unsigned releaseFlags = (hipEventReleaseToDevice | hipEventReleaseToSystem);
 
   const bool illegalFlags =
-      (flags & ~supportedFlags) ||             // can't set any unsupported flags.
-      (flags & releaseFlags) == releaseFlags;  // can't set both release flags
+      (flags & ~supportedFlags) ||              // can't set any unsupported flags.
+      (flags & releaseFlags) == releaseFlags || // can't set both release flags
+      ((flags & hipEventTimingOnly) && (flags & hipEventDisableTiming)); // timing-only is timed
 
   if (!illegalFlags) {
     hip::Event* e = new hip::Event(flags);
@@ -257,10 +306,19 @@ hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream) {
     HIP_RETURN(hipErrorInvalidHandle);
   }
 
+  if (ihipStreamCapturing(stream)) {
+    HIP_RETURN(ihipCaptureEventRecord(stream, event));
+  }
+
   hip::Event* e = reinterpret_cast<hip::Event*>(event);
   amd::HostQueue* queue = hip::getQueue(stream);
 
-  e->addMarker(queue, nullptr, true);
+  hip::Stream* s = (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream() :
+                   reinterpret_cast<hip::Stream*>(stream);
+  if (e->flags & hipEventTimingOnly) {
+    s->EnableTimedLaunches();
+  }
+  s->GetDevice()->CountMarker(e->addMarker(queue, nullptr, true));
   HIP_RETURN(hipSuccess);
 }
 
@@ -282,3 +340,43 @@ hipError_t hipEventQuery(hipEvent_t event) {
 
   HIP_RETURN(ihipEventQuery(event));
 }
+
+hipError_t hipExtGetMarkerReuseStats(int device, uint64_t* reused, uint64_t* created) {
+  HIP_INIT_API(hipExtGetMarkerReuseStats, device, reused, created);
+
+  if (reused == nullptr || created == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  g_devices[device]->GetMarkerStats(reused, created);
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtEventGetTimestamps(uint64_t* timestamps, const hipEvent_t* events, size_t count) {
+  HIP_INIT_API(hipExtEventGetTimestamps, timestamps, events, count);
+
+  if (count == 0) {
+    HIP_RETURN(hipSuccess);
+  }
+  if (timestamps == nullptr || events == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  hipError_t status = hipSuccess;
+  for (size_t i = 0; i < count; ++i) {
+    timestamps[i] = 0;
+    if (events[i] == nullptr) {
+      HIP_RETURN(hipErrorInvalidHandle);
+    }
+    hipError_t e = reinterpret_cast<hip::Event*>(events[i])->timestamp(timestamps[i]);
+    if (e == hipErrorNotReady) {
+      status = hipErrorNotReady;
+    } else if (e != hipSuccess) {
+      HIP_RETURN(e);
+    }
+  }
+  HIP_RETURN(status);
+}
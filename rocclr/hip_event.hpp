@@ -39,7 +39,8 @@ public:
 class Event {
 public:
   Event(unsigned int flags) : flags(flags), lock_("hipEvent_t", true),
-                              event_(nullptr), recorded_(false) {
+                              event_(nullptr), recorded_(false), start_(false),
+                              waiter_(WaitSpinNs()) {
     // No need to init event_ here as addMarker does that
   }
 
@@ -53,9 +54,14 @@ public:
   hipError_t query();
   hipError_t synchronize();
   hipError_t elapsedTime(Event& stop, float& ms);
+  //! Returns the timestamp of the event in ns, see hipExtEventGetTimestamps
+  hipError_t timestamp(uint64_t& ns);
   hipError_t streamWait(amd::HostQueue* queue, uint flags);
 
-  void addMarker(amd::HostQueue* queue, amd::Command* command, bool record);
+  //! Makes the event track command, or a marker after the last command of queue if null.
+  //! start is set for the start event of a launch, which takes the start timestamp of command.
+  //! Returns true if an already enqueued command was reused instead of a new marker.
+  bool addMarker(amd::HostQueue* queue, amd::Command* command, bool record, bool start = false);
 
   amd::Monitor& lock() { return lock_; }
 
@@ -68,6 +74,12 @@ private:
   //! hip*ModuleLaunchKernel API which takes start and stop events so no
   //! hipEventRecord is called. Cleanup needed once those APIs are deprecated.
   bool recorded_;
+  //! The event is the start event of a launch, see addMarker()
+  bool start_;
+
+  //! Learns how long waits on this event take. ROCclr events don't keep their hip::Stream,
+  //! so they are not counted in the stream wait statistics
+  hip_impl::Adaptive_waiter waiter_;
 
   bool ready();
 };
@@ -45,6 +45,7 @@ DeviceVar::DeviceVar(std::string name, hipModule_t hmod) : shadowVptr(nullptr),
 DeviceVar::~DeviceVar() {
   if (amd_mem_obj_ != nullptr) {
     amd::MemObjMap::RemoveMemObj(device_ptr_);
+    ihipEvictSubBufferViews(amd_mem_obj_);
     amd_mem_obj_->release();
   }
 
@@ -77,11 +78,33 @@ DeviceFunc::DeviceFunc(std::string name, hipModule_t hmod) : dflock_("function l
 }
 
 DeviceFunc::~DeviceFunc() {
+  for (auto& elem : launchKernels_) {
+    elem->release();
+  }
   if (kernel_ != nullptr) {
     kernel_->release();
   }
 }
 
+amd::Kernel* DeviceFunc::acquireLaunchKernel() {
+  {
+    amd::ScopedLock lock(dflock_);
+    if (!launchKernels_.empty()) {
+      amd::Kernel* kernel = launchKernels_.back();
+      launchKernels_.pop_back();
+      return kernel;
+    }
+  }
+  // One copy per concurrent launch, so the pool stays at the peak number of
+  // threads launching this function at the same time.
+  return new amd::Kernel(*kernel_);
+}
+
+void DeviceFunc::releaseLaunchKernel(amd::Kernel* kernel) {
+  amd::ScopedLock lock(dflock_);
+  launchKernels_.push_back(kernel);
+}
+
 //Abstract functions
 Function::Function(std::string name, FatBinaryInfo** modules)
                    : name_(name), modules_(modules) {
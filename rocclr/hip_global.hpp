@@ -49,9 +49,16 @@ public:
   std::string name() const { return name_; }
   amd::Kernel* kernel() const { return kernel_; }
 
+  //Private copy of kernel_ to set launch arguments on, so concurrent launches
+  //of this function don't share kernel parameter state. Return it with
+  //releaseLaunchKernel() once the command has captured the arguments.
+  amd::Kernel* acquireLaunchKernel();
+  void releaseLaunchKernel(amd::Kernel* kernel);
+
 private:
   std::string name_;        //name of the func(not unique identifier)
   amd::Kernel* kernel_;     //Kernel ptr referencing to ROCclr Symbol
+  std::vector<amd::Kernel*> launchKernels_;  //Idle launch copies, guarded by dflock_
 };
 
 //Abstract Structures
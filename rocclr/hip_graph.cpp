@@ -0,0 +1,570 @@
+/* Copyright (c) 2015-present Advanced Micro Devices, Inc.
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in
+ all copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ THE SOFTWARE. */
+
+#include <hip/hip_runtime.h>
+#include <algorithm>
+#include <mutex>
+#include "hip_internal.hpp"
+#include "hip_event.hpp"
+#include "src/command_graph.hpp"
+
+extern hipError_t ihipCreateLaunchCommand(amd::NDRangeKernelCommand*& command, hipFunction_t f,
+                                          amd::HostQueue* queue, uint32_t globalWorkSizeX,
+                                          uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
+                                          uint32_t blockDimX, uint32_t blockDimY,
+                                          uint32_t blockDimZ, uint32_t sharedMemBytes,
+                                          void **kernelParams, void **extra, bool profileNDRange,
+                                          uint32_t flags, uint32_t params, uint32_t gridId,
+                                          uint32_t numGrids, uint64_t prevGridSum,
+                                          uint64_t allGridSum, uint32_t firstDevice);
+extern hipError_t ihipPackKernelArgs(hipFunction_t f, void** kernelParams, void** extra,
+                                     std::vector<char>& kernargs);
+extern hipError_t ihipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind,
+                             amd::HostQueue& queue, bool isAsync);
+extern hipError_t ihipMemset(void* dst, int64_t value, size_t valueSize, size_t sizeBytes,
+                             hipStream_t stream, bool isAsync);
+
+// ================================================================================================
+// Stream capture and graph replay
+//
+// ROCclr commands can't be enqueued twice, so kernel nodes keep their arguments packed as
+// in 'extra' and each replay creates the launch commands again, skipping the API entry and
+// argument marshalling of an eager launch.
+
+struct ihipGraphNode_t {
+  enum Type { Kernel, Memcpy, Memset, EventRecord, EventWait };
+  Type type;
+
+  // Kernel
+  hipFunction_t function;
+  dim3 globalWorkSize;
+  dim3 blockDim;
+  uint32_t sharedMemBytes;
+  uint32_t flags;  // launch flags, or hipStreamWaitEvent flags for EventWait
+  std::vector<char> kernargs;
+
+  // Memcpy, Memset
+  void* dst;
+  const void* src;
+  size_t sizeBytes;
+  hipMemcpyKind kind;
+  int64_t value;
+  size_t valueSize;
+
+  // EventRecord, EventWait
+  hipEvent_t event;
+};
+
+struct ihipGraph_t {
+  ihipGraph_t(hipStream_t origin) : capture_{origin} {}
+
+  hip_impl::Graph_capture<ihipGraphNode_t> capture_;
+  /// Set once the capture ends
+  hip_impl::Command_graph<ihipGraphNode_t> graph_;
+};
+
+struct ihipGraphExec_t {
+  /// Serializes launches and parameter updates
+  std::mutex lock_;
+  std::vector<ihipGraphNode_t> nodes_;
+  hip_impl::Lane_plan plan_;
+  /// Streams of the lanes, owned by the graph so no other work shares them. Lane 0 is the
+  /// launch stream
+  std::vector<hip::Stream*> lanes_;
+  /// Markers of the nodes other lanes wait for, nullptr for the other nodes
+  std::vector<hip::Event*> signals_;
+  /// Marks the start of a launch on lane 0, and the end of each lane
+  std::vector<hip::Event*> forkJoin_;
+};
+
+namespace {
+
+/// Captures in progress, searched by waits of streams that are not capturing yet. The lock
+/// also guards starting, joining and ending captures
+std::mutex g_capturesLock;
+std::vector<ihipGraph_t*> g_captures;
+std::atomic<size_t> g_captureCount{0};
+
+hip::Stream* asStream(hipStream_t stream) {
+  return (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                             : reinterpret_cast<hip::Stream*>(stream);
+}
+
+hipError_t ihipCaptureNode(hipStream_t stream, ihipGraphNode_t node, hipEvent_t event = nullptr) {
+  ihipGraph_t* graph = asStream(stream)->Capture();
+  if (graph == nullptr) {
+    // The capture ended meanwhile
+    return hipErrorInvalidValue;
+  }
+  graph->capture_.add(stream, std::move(node), event);
+  return hipSuccess;
+}
+
+hipError_t ihipReplayNode(const ihipGraphNode_t& node, hipStream_t stream,
+                          amd::HostQueue* queue) {
+  switch (node.type) {
+  case ihipGraphNode_t::Kernel: {
+    size_t size = node.kernargs.size();
+    void* extra[] = {HIP_LAUNCH_PARAM_BUFFER_POINTER, const_cast<char*>(node.kernargs.data()),
+                     HIP_LAUNCH_PARAM_BUFFER_SIZE, &size, HIP_LAUNCH_PARAM_END};
+    amd::NDRangeKernelCommand* command = nullptr;
+    hipError_t status = ihipCreateLaunchCommand(command, node.function, queue,
+                                                node.globalWorkSize.x, node.globalWorkSize.y,
+                                                node.globalWorkSize.z, node.blockDim.x,
+                                                node.blockDim.y, node.blockDim.z,
+                                                node.sharedMemBytes, nullptr, extra,
+                                                asStream(stream)->TimedLaunches(), node.flags,
+                                                0, 0, 0, 0, 0, 0);
+    if (status != hipSuccess) {
+      return status;
+    }
+    command->enqueue();
+    command->release();
+    return hipSuccess;
+  }
+  case ihipGraphNode_t::Memcpy:
+    return ihipMemcpy(node.dst, node.src, node.sizeBytes, node.kind, *queue, true);
+  case ihipGraphNode_t::Memset:
+    return ihipMemset(node.dst, node.value, node.valueSize, node.sizeBytes, stream, true);
+  case ihipGraphNode_t::EventRecord: {
+    hip::Event* e = reinterpret_cast<hip::Event*>(node.event);
+    hip::Stream* s = asStream(stream);
+    if (e->flags & hipEventTimingOnly) {
+      s->EnableTimedLaunches();
+    }
+    s->GetDevice()->CountMarker(e->addMarker(queue, nullptr, true));
+    return hipSuccess;
+  }
+  case ihipGraphNode_t::EventWait:
+    return reinterpret_cast<hip::Event*>(node.event)->streamWait(queue, node.flags);
+  }
+  return hipErrorUnknown;
+}
+
+hipError_t ihipGraphLaunch(ihipGraphExec_t* exec, hipStream_t stream) {
+  const hip_impl::Lane_plan& plan = exec->plan_;
+  const size_t count = exec->nodes_.size();
+
+  // Lane 0 is stream itself, which keeps the implicit synchronization of a launch on it
+  std::vector<hipStream_t> streams(plan.lanes, stream);
+  std::vector<amd::HostQueue*> queues(plan.lanes, nullptr);
+  queues[0] = hip::getQueue(stream);
+  for (unsigned l = 1; l < plan.lanes; ++l) {
+    streams[l] = reinterpret_cast<hipStream_t>(exec->lanes_[l]);
+    queues[l] = exec->lanes_[l]->asHostQueue();
+  }
+  if (std::find(queues.begin(), queues.end(), nullptr) != queues.end()) {
+    return hipErrorOutOfMemory;
+  }
+
+  // The other lanes start after the work already queued on stream
+  if (plan.lanes > 1) {
+    exec->forkJoin_[0]->addMarker(queues[0], nullptr, true);
+    for (unsigned l = 1; l < plan.lanes; ++l) {
+      exec->forkJoin_[0]->streamWait(queues[l], 0);
+    }
+  }
+
+  hipError_t status = hipSuccess;
+  for (size_t i = 0; i < count && status == hipSuccess; ++i) {
+    const unsigned l = plan.lane[i];
+    for (auto w : plan.waits[i]) {
+      exec->signals_[w]->streamWait(queues[l], 0);
+    }
+    status = ihipReplayNode(exec->nodes_[i], streams[l], queues[l]);
+    if (plan.signals[i]) {
+      exec->signals_[i]->addMarker(queues[l], nullptr, true);
+    }
+  }
+
+  // Work queued on stream from now on waits for every lane, also on failure
+  for (unsigned l = 1; l < plan.lanes; ++l) {
+    exec->forkJoin_[l]->addMarker(queues[l], nullptr, true);
+    exec->forkJoin_[l]->streamWait(queues[0], 0);
+  }
+  return status;
+}
+
+void ihipGraphExecDestroy(ihipGraphExec_t* exec) {
+  for (size_t l = 1; l < exec->lanes_.size(); ++l) {
+    if (exec->lanes_[l] != nullptr) {
+      exec->lanes_[l]->Destroy();
+    }
+  }
+  for (auto e : exec->signals_) {
+    delete e;
+  }
+  for (auto e : exec->forkJoin_) {
+    delete e;
+  }
+  delete exec;
+}
+
+} // namespace
+
+// ================================================================================================
+hipError_t ihipCaptureUnsupported(hipStream_t stream) {
+  ihipGraph_t* graph = asStream(stream)->Capture();
+  if (graph != nullptr) {
+    graph->capture_.invalidate();
+  }
+  return hipErrorNotSupported;
+}
+
+// ================================================================================================
+void ihipStreamLeaveCapture(hip::Stream* stream) {
+  if (stream->Capture() == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(g_capturesLock);
+  ihipGraph_t* graph = stream->Capture();
+  if (graph == nullptr) {
+    return;
+  }
+  if (graph->capture_.origin() != reinterpret_cast<hipStream_t>(stream)) {
+    graph->capture_.leave(stream);
+    stream->SetCapture(nullptr);
+    return;
+  }
+  // Nothing can end the capture anymore, so drop it
+  g_captures.erase(std::find(g_captures.begin(), g_captures.end(), graph));
+  g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+  for (const void* s : graph->capture_.streams()) {
+    static_cast<hip::Stream*>(const_cast<void*>(s))->SetCapture(nullptr);
+  }
+  delete graph;
+}
+
+// ================================================================================================
+hipError_t ihipCaptureKernel(hipStream_t stream, hipFunction_t f, const dim3& globalWorkSize,
+                             const dim3& blockDim, uint32_t sharedMemBytes, void** kernelParams,
+                             void** extra, uint32_t flags) {
+  if (f == nullptr) {
+    return hipErrorInvalidResourceHandle;
+  }
+  ihipGraphNode_t node{};
+  node.type = ihipGraphNode_t::Kernel;
+  node.function = f;
+  node.globalWorkSize = globalWorkSize;
+  node.blockDim = blockDim;
+  node.sharedMemBytes = sharedMemBytes;
+  node.flags = flags;
+  hipError_t status = ihipPackKernelArgs(f, kernelParams, extra, node.kernargs);
+  if (status != hipSuccess) {
+    return status;
+  }
+  return ihipCaptureNode(stream, std::move(node));
+}
+
+// ================================================================================================
+hipError_t ihipCaptureKernels(hipStream_t stream, const ihipCapturedKernel* kernels,
+                              uint32_t count, uint32_t flags) {
+  std::vector<ihipGraphNode_t> nodes(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    const ihipCapturedKernel& k = kernels[i];
+    if (k.function == nullptr) {
+      return hipErrorInvalidResourceHandle;
+    }
+    nodes[i].type = ihipGraphNode_t::Kernel;
+    nodes[i].function = k.function;
+    nodes[i].globalWorkSize = k.globalWorkSize;
+    nodes[i].blockDim = k.blockDim;
+    nodes[i].sharedMemBytes = k.sharedMemBytes;
+    nodes[i].flags = flags;
+    hipError_t status = ihipPackKernelArgs(k.function, k.kernelParams, k.extra,
+                                           nodes[i].kernargs);
+    if (status != hipSuccess) {
+      return status;
+    }
+  }
+
+  // Ending the capture takes the lock, so it can't end between the nodes
+  std::lock_guard<std::mutex> lock(g_capturesLock);
+  ihipGraph_t* graph = asStream(stream)->Capture();
+  if (graph == nullptr) {
+    return hipErrorInvalidValue;
+  }
+  for (auto& node : nodes) {
+    graph->capture_.add(stream, std::move(node));
+  }
+  return hipSuccess;
+}
+
+// ================================================================================================
+hipError_t ihipCaptureMemcpy(hipStream_t stream, void* dst, const void* src, size_t sizeBytes,
+                             hipMemcpyKind kind) {
+  if (sizeBytes == 0) {
+    return hipSuccess;
+  }
+  if (dst == nullptr || src == nullptr) {
+    return hipErrorInvalidValue;
+  }
+  ihipGraphNode_t node{};
+  node.type = ihipGraphNode_t::Memcpy;
+  node.dst = dst;
+  node.src = src;
+  node.sizeBytes = sizeBytes;
+  node.kind = kind;
+  return ihipCaptureNode(stream, std::move(node));
+}
+
+// ================================================================================================
+hipError_t ihipCaptureMemset(hipStream_t stream, void* dst, int64_t value, size_t valueSize,
+                             size_t sizeBytes) {
+  ihipGraphNode_t node{};
+  node.type = ihipGraphNode_t::Memset;
+  node.dst = dst;
+  node.value = value;
+  node.valueSize = valueSize;
+  node.sizeBytes = sizeBytes;
+  return ihipCaptureNode(stream, std::move(node));
+}
+
+// ================================================================================================
+hipError_t ihipCaptureEventRecord(hipStream_t stream, hipEvent_t event) {
+  ihipGraphNode_t node{};
+  node.type = ihipGraphNode_t::EventRecord;
+  node.event = event;
+  return ihipCaptureNode(stream, std::move(node), event);
+}
+
+// ================================================================================================
+bool ihipCaptureStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int flags,
+                                hipError_t* status) {
+  if (stream == nullptr) {
+    return false;
+  }
+  hip::Stream* s = reinterpret_cast<hip::Stream*>(stream);
+  if (s->Capture() == nullptr && g_captureCount.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(g_capturesLock);
+  ihipGraph_t* graph = s->Capture();
+  if (graph == nullptr) {
+    // A stream waiting for an event recorded during a capture joins it
+    auto it = std::find_if(g_captures.cbegin(), g_captures.cend(),
+                           [event](ihipGraph_t* g) { return g->capture_.recorded(event); });
+    if (it == g_captures.cend()) {
+      return false;
+    }
+    graph = *it;
+    graph->capture_.wait(stream, event);
+    s->SetCapture(graph);
+  } else if (!graph->capture_.wait(stream, event)) {
+    // An event from outside the capture is waited for at every launch
+    ihipGraphNode_t node{};
+    node.type = ihipGraphNode_t::EventWait;
+    node.event = event;
+    node.flags = flags;
+    graph->capture_.add(stream, std::move(node));
+  }
+  *status = hipSuccess;
+  return true;
+}
+
+// ================================================================================================
+hipError_t hipExtStreamBeginCapture(hipStream_t stream) {
+  HIP_INIT_API(hipExtStreamBeginCapture, stream);
+
+  // The null stream synchronizes with every blocking stream, which a graph can't record
+  if (stream == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  hip::Stream* s = reinterpret_cast<hip::Stream*>(stream);
+  std::lock_guard<std::mutex> lock(g_capturesLock);
+  if (s->Capture() != nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  ihipGraph_t* graph = new ihipGraph_t(stream);
+  g_captures.push_back(graph);
+  g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+  s->SetCapture(graph);
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtStreamEndCapture(hipStream_t stream, hipExtGraph_t* graph) {
+  HIP_INIT_API(hipExtStreamEndCapture, stream, graph);
+
+  if (stream == nullptr || graph == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  ihipGraph_t* g = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(g_capturesLock);
+    g = reinterpret_cast<hip::Stream*>(stream)->Capture();
+    if (g == nullptr || g->capture_.origin() != stream) {
+      HIP_RETURN(hipErrorInvalidValue);
+    }
+    g_captures.erase(std::find(g_captures.begin(), g_captures.end(), g));
+    g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+    for (const void* s : g->capture_.streams()) {
+      static_cast<hip::Stream*>(const_cast<void*>(s))->SetCapture(nullptr);
+    }
+  }
+  if (!g->capture_.valid()) {
+    delete g;
+    HIP_RETURN(hipErrorNotSupported);
+  }
+  g->graph_ = g->capture_.finish();
+  *graph = g;
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphGetNodeCount(hipExtGraph_t graph, size_t* count) {
+  HIP_INIT_API(hipExtGraphGetNodeCount, graph, count);
+
+  if (graph == nullptr || count == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  *count = graph->graph_.nodes.size();
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphDestroy(hipExtGraph_t graph) {
+  HIP_INIT_API(hipExtGraphDestroy, graph);
+
+  if (graph == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  delete graph;
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphInstantiate(hipExtGraphExec_t* exec, hipExtGraph_t graph,
+                                  unsigned int maxStreams) {
+  HIP_INIT_API(hipExtGraphInstantiate, exec, graph, maxStreams);
+
+  if (exec == nullptr || graph == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  ihipGraphExec_t* e = new ihipGraphExec_t;
+  e->nodes_ = graph->graph_.nodes;
+  e->plan_ = hip_impl::plan_lanes(graph->graph_.deps, maxStreams);
+  e->lanes_.assign(e->plan_.lanes, nullptr);
+  e->signals_.assign(e->nodes_.size(), nullptr);
+  e->forkJoin_.assign(e->plan_.lanes, nullptr);
+  for (size_t i = 0; i < e->nodes_.size(); ++i) {
+    if (e->plan_.signals[i]) {
+      e->signals_[i] = new hip::Event(hipEventDisableTiming);
+    }
+  }
+
+  for (unsigned l = 0; l < e->plan_.lanes; ++l) {
+    if (e->plan_.lanes > 1) {
+      e->forkJoin_[l] = new hip::Event(hipEventDisableTiming);
+    }
+    if (l == 0) {
+      continue;
+    }
+    // Lanes only synchronize through the graph's own events
+    hip::Stream* lane = new hip::Stream(hip::getCurrentDevice(), hip::Stream::Priority::Normal,
+                                        hipStreamNonBlocking);
+    if (!lane->Create()) {
+      // Create() destroyed the stream
+      ihipGraphExecDestroy(e);
+      HIP_RETURN(hipErrorOutOfMemory);
+    }
+    e->lanes_[l] = lane;
+  }
+  *exec = e;
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphExecSetKernelArgs(hipExtGraphExec_t exec, size_t node, void** kernelParams,
+                                        void** extra) {
+  HIP_INIT_API(hipExtGraphExecSetKernelArgs, exec, node, kernelParams, extra);
+
+  if (exec == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  std::lock_guard<std::mutex> lock(exec->lock_);
+  if (node >= exec->nodes_.size() || exec->nodes_[node].type != ihipGraphNode_t::Kernel) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  // Pack first, so that a bad update leaves the node as it was
+  ihipGraphNode_t& n = exec->nodes_[node];
+  std::vector<char> kernargs;
+  hipError_t status = ihipPackKernelArgs(n.function, kernelParams, extra, kernargs);
+  if (status == hipSuccess) {
+    n.kernargs.swap(kernargs);
+  }
+
+  HIP_RETURN(status);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphExecSetMemcpyParams(hipExtGraphExec_t exec, size_t node, void* dst,
+                                          const void* src) {
+  HIP_INIT_API(hipExtGraphExecSetMemcpyParams, exec, node, dst, src);
+
+  if (exec == nullptr || dst == nullptr || src == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  std::lock_guard<std::mutex> lock(exec->lock_);
+  if (node >= exec->nodes_.size() || exec->nodes_[node].type != ihipGraphNode_t::Memcpy) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  exec->nodes_[node].dst = dst;
+  exec->nodes_[node].src = src;
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtGraphLaunch(hipExtGraphExec_t exec, hipStream_t stream) {
+  HIP_INIT_API(hipExtGraphLaunch, exec, stream);
+
+  if (exec == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  HIP_RETURN_ONCAPTURE(stream);
+
+  std::lock_guard<std::mutex> lock(exec->lock_);
+  HIP_RETURN(ihipGraphLaunch(exec, stream));
+}
+
+// ================================================================================================
+hipError_t hipExtGraphExecDestroy(hipExtGraphExec_t exec) {
+  HIP_INIT_API(hipExtGraphExecDestroy, exec);
+
+  if (exec == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  ihipGraphExecDestroy(exec);
+
+  HIP_RETURN(hipSuccess);
+}
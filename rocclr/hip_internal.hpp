@@ -26,6 +26,9 @@
 #include "trace_helper.h"
 #include "utils/debug.hpp"
 #include "hip_formatting.hpp"
+#include "src/adaptive_wait.hpp"
+#include <atomic>
+#include <unordered_map>
 #include <unordered_set>
 #include <thread>
 #include <stack>
@@ -66,16 +69,29 @@ typedef struct ihipIpcMemHandle_st {
     hip::g_device = g_devices[0];                          \
   }
 
+// API arguments are converted to strings only when API logging is enabled,
+// so the ostringstream formatting in ToString() stays off the fast path.
+#define HIP_API_LOG_ENABLED() \
+  ((AMD_LOG_LEVEL >= amd::LOG_INFO) && (AMD_LOG_MASK & amd::LOG_API))
+
 #define HIP_API_PRINT(...)                                 \
-  uint64_t startTimeUs=0 ; HIPPrintDuration(amd::LOG_INFO, amd::LOG_API, &startTimeUs, "%-5d: [%zx] %s%s ( %s )%s",  getpid(), std::this_thread::get_id(), KGRN,    \
-          __func__, ToString( __VA_ARGS__ ).c_str(),KNRM);
+  uint64_t startTimeUs=0 ;                                 \
+  if (HIP_API_LOG_ENABLED()) {                             \
+    HIPPrintDuration(amd::LOG_INFO, amd::LOG_API, &startTimeUs, "%-5d: [%zx] %s%s ( %s )%s",  getpid(), std::this_thread::get_id(), KGRN,    \
+          __func__, ToString( __VA_ARGS__ ).c_str(),KNRM); \
+  }
 
 #define HIP_ERROR_PRINT(err, ...)                             \
-  ClPrint(amd::LOG_INFO, amd::LOG_API, "%-5d: [%zx] %s: Returned %s : %s", getpid(), std::this_thread::get_id(),  \
-          __func__, hipGetErrorName(err), ToString( __VA_ARGS__ ).c_str());
+  do {                                                        \
+    if (HIP_API_LOG_ENABLED()) {                              \
+      ClPrint(amd::LOG_INFO, amd::LOG_API, "%-5d: [%zx] %s: Returned %s : %s", getpid(), std::this_thread::get_id(),  \
+            __func__, hipGetErrorName(err), ToString( __VA_ARGS__ ).c_str()); \
+    }                                                         \
+  } while (0)
 
 // This macro should be called at the beginning of every HIP API.
 #define HIP_INIT_API(cid, ...)                               \
+  hip::SubmitScope submitScope;                              \
   HIP_API_PRINT(__VA_ARGS__)                                 \
   amd::Thread* thread = amd::Thread::current();              \
   if (!VDI_CHECK_THREAD(thread)) {                           \
@@ -86,13 +102,15 @@ typedef struct ihipIpcMemHandle_st {
 
 #define HIP_RETURN_DURATION(ret, ...)                      \
   hip::g_lastError = ret;                         \
-  HIPPrintDuration(amd::LOG_INFO, amd::LOG_API, &startTimeUs, "%-5d: [%zx] %s: Returned %s : %s",  getpid(), std::this_thread::get_id(),  \
+  if (HIP_API_LOG_ENABLED()) {                    \
+    HIPPrintDuration(amd::LOG_INFO, amd::LOG_API, &startTimeUs, "%-5d: [%zx] %s: Returned %s : %s",  getpid(), std::this_thread::get_id(),  \
           __func__, hipGetErrorName(hip::g_lastError), ToString( __VA_ARGS__ ).c_str()); \
+  }                                               \
   return hip::g_lastError;
 
 #define HIP_RETURN(ret, ...)                      \
   hip::g_lastError = ret;                         \
-  HIP_ERROR_PRINT(hip::g_lastError, __VA_ARGS__)  \
+  HIP_ERROR_PRINT(hip::g_lastError, __VA_ARGS__); \
   return hip::g_lastError;
 
 #define HIP_RETURN_ONFAIL(func)          \
@@ -113,6 +131,22 @@ typedef struct ihipIpcMemHandle_st {
     }                                    \
   } while (0);
 
+// For operations a graph can't record: fails the API, and the capture, if stream is capturing.
+#define HIP_RETURN_ONCAPTURE(stream)                    \
+  do {                                                  \
+    if (ihipStreamCapturing(stream)) {                  \
+      HIP_RETURN(ihipCaptureUnsupported(stream));       \
+    }                                                   \
+  } while (0)
+
+
+namespace hip_impl {
+class Callback_executor;
+template <typename Stream> class Stream_pool;
+template <typename Stream, typename Event> class Memory_pool;
+}
+
+struct ihipGraph_t;
 
 namespace hc {
 class accelerator;
@@ -121,6 +155,7 @@ class accelerator_view;
 
 namespace hip {
   class Device;
+  class Event;
 
   class Stream {
   public:
@@ -133,6 +168,29 @@ namespace hip {
     unsigned int flags_;
     bool null_;
     const std::vector<uint32_t> cuMask_;
+    /// Unique ID, never reused, so stale waitedEpochs_ entries can't match a new stream
+    const uint64_t id_;
+    /// Number of API calls that got this stream for submission and haven't returned yet
+    std::atomic<uint32_t> pendingSubmits_;
+    /// Bumped each time such an API call returns, i.e. after its commands were enqueued
+    std::atomic<uint64_t> submitEpoch_;
+    /// Set once the stream was submitted to outside of any HIP API call, where the submission
+    /// can't be published. Waits on the stream then never skip it
+    std::atomic<bool> untrackedSubmits_;
+    /// Submit epochs of other streams on the device that this stream has already waited for,
+    /// keyed by stream ID. Guarded by the device stream set lock
+    std::unordered_map<uint64_t, uint64_t> waitedEpochs_;
+    /// Learns how long host waits on the stream take and keeps their statistics
+    hip_impl::Adaptive_waiter waiter_;
+    /// Set once a timing-only event is recorded on the stream. Kernels then take timestamps,
+    /// so later timing-only events can reuse them instead of enqueuing a marker
+    std::atomic<bool> timedLaunches_;
+    /// Graph the stream's work is being captured into, or nullptr
+    std::atomic<ihipGraph_t*> capture_;
+    /// Set for streams created by the device stream pool, before they are handed out
+    bool pooled_ = false;
+
+    friend class Device;
 
   public:
     Stream(Device* dev, Priority p = Priority::Normal, unsigned int f = 0, bool null_stream = false,
@@ -156,6 +214,27 @@ namespace hip {
     unsigned int Flags() const { return flags_; }
     /// Returns the priority for the current stream
     Priority GetPriority() const { return priority_; }
+    /// Returns the device the stream belongs to
+    Device* GetDevice() const { return device_; }
+    /// Returns the waiter used by host waits on the stream
+    hip_impl::Adaptive_waiter& Waiter() { return waiter_; }
+    /// Waits on the host for all commands submitted to queue, the stream's host queue
+    void Wait(amd::HostQueue* queue);
+    /// Returns true if kernels launched on the stream should collect timestamps
+    bool TimedLaunches() const { return timedLaunches_.load(std::memory_order_relaxed); }
+    /// Makes kernels launched on the stream from now on collect timestamps
+    void EnableTimedLaunches() { timedLaunches_.store(true, std::memory_order_relaxed); }
+    /// Returns the graph capturing the stream's work, or nullptr
+    ihipGraph_t* Capture() const { return capture_.load(std::memory_order_acquire); }
+    /// Starts or ends capturing the stream's work into graph
+    void SetCapture(ihipGraph_t* graph) { capture_.store(graph, std::memory_order_release); }
+    /// Returns true if the stream belongs to the device stream pool
+    bool Pooled() const { return pooled_; }
+
+    /// Marks the stream as being submitted to by the current API call
+    void BeginSubmit();
+    /// Publishes all submissions of the current thread's API call. Called by SubmitScope
+    static void EndSubmits();
 
     /// Sync all non-blocking streams
     static void syncNonBlockingStreams();
@@ -175,6 +254,22 @@ namespace hip {
     unsigned int flags_;
     /// Maintain list of user enabled peers
     std::list<int> userEnabledPeers;
+    /// Streams with a host queue on this device, including the null stream once allocated
+    amd::Monitor streamSetLock_{"Guards device stream set"};
+    std::vector<Stream*> streamSet_;
+    bool nullStreamActive_ = false;
+    /// Event markers recycled from an already enqueued command vs. newly created
+    std::atomic<uint64_t> markerHits_{0};
+    std::atomic<uint64_t> markerMisses_{0};
+    /// Runs stream callbacks, started on first use
+    std::once_flag callbackExecutorOnce_;
+    hip_impl::Callback_executor* callbackExecutor_ = nullptr;
+    /// Streams handed out by hipExtStreamPoolAcquire, created on first use
+    std::once_flag streamPoolOnce_;
+    hip_impl::Stream_pool<Stream*>* streamPool_ = nullptr;
+    /// Blocks handed out by hipMallocAsync, created on first use
+    std::once_flag memPoolOnce_;
+    hip_impl::Memory_pool<Stream*, Event*>* memPool_ = nullptr;
 
   public:
     Device(amd::Context* ctx, int devId):
@@ -209,12 +304,62 @@ namespace hip {
     unsigned int getFlags() const { return flags_; }
     void setFlags(unsigned int flags) { flags_ = flags; }
     amd::HostQueue* NullStream(bool skip_alloc = false);
+    /// Returns the null stream object, without allocating its host queue
+    Stream* GetNullStream() { return &null_stream_; }
+    /// Returns the host wait policy for the schedule flags of the device
+    hip_impl::Wait_policy WaitPolicy() const;
+
+    /// Registers a stream whose host queue was just created
+    void AddStream(Stream* stream);
+    /// Unregisters a stream before its host queue is released
+    void RemoveStream(Stream* stream);
+    /// Waits for all non-blocking streams on the device
+    void SyncNonBlockingStreams();
+    /// Enqueues a marker on blocking_stream for the active streams it has to wait for
+    void WaitActiveStreams(Stream* blocking_stream, bool wait_null_stream);
+
+    /// Counts an event marker as reused (hit) or newly created (miss)
+    void CountMarker(bool reused) {
+      (reused ? markerHits_ : markerMisses_).fetch_add(1, std::memory_order_relaxed);
+    }
+    void GetMarkerStats(uint64_t* hits, uint64_t* misses) const {
+      *hits = markerHits_.load(std::memory_order_relaxed);
+      *misses = markerMisses_.load(std::memory_order_relaxed);
+    }
+
+    /// Returns the executor running hipStreamAddCallback callbacks for the device
+    hip_impl::Callback_executor* CallbackExecutor();
+
+    /// Returns the pool of recycled streams for the device
+    hip_impl::Stream_pool<Stream*>* StreamPool();
+
+    /// Returns the stream-ordered memory pool of the device
+    hip_impl::Memory_pool<Stream*, Event*>* MemPool();
   };
 
   extern std::once_flag g_ihipInitialized;
   /// Current thread's device
   extern thread_local Device* g_device;
   extern thread_local hipError_t g_lastError;
+  /// Number of streams the current thread's API call got for submission
+  extern thread_local uint32_t g_pendingSubmits;
+  /// Number of SubmitScope objects live on the current thread
+  extern thread_local uint32_t g_submitScopeDepth;
+
+  /// Publishes the stream submissions of a HIP API call when the call leaves, by any return
+  /// path or exception. Created by HIP_INIT_API; with nested API calls, only the outermost
+  /// scope publishes, once all of the commands are enqueued
+  class SubmitScope {
+  public:
+    SubmitScope() { g_submitScopeDepth++; }
+    ~SubmitScope() {
+      if ((--g_submitScopeDepth == 0) && (g_pendingSubmits != 0)) {
+        Stream::EndSubmits();
+      }
+    }
+    SubmitScope(const SubmitScope&) = delete;
+    SubmitScope& operator=(const SubmitScope&) = delete;
+  };
   /// Device representing the host - for pinned memory
   extern Device* host_device;
 
@@ -232,6 +377,8 @@ namespace hip {
   extern amd::HostQueue* getNullStream(amd::Context&);
   /// Get default stream of the thread
   extern amd::HostQueue* getNullStream();
+  /// Longest spin of the adaptive wait policy, from HIP_WAIT_SPIN_US
+  extern uint64_t WaitSpinNs();
 };
 
 struct ihipExec_t {
@@ -242,9 +389,46 @@ struct ihipExec_t {
   std::vector<char> arguments_;
 };
 
-/// Wait all active streams on the blocking queue. The method enqueues a wait command and
+/// Wait all active streams on the blocking stream. The method enqueues a wait command and
 /// doesn't stall the current thread
-extern void iHipWaitActiveStreams(amd::HostQueue* blocking_queue, bool wait_null_stream = false);
+extern void iHipWaitActiveStreams(hip::Stream* blocking_stream, bool wait_null_stream = false);
+
+/// Returns true if the work submitted to stream is being captured into a graph
+inline bool ihipStreamCapturing(hipStream_t stream) {
+  return stream != nullptr && reinterpret_cast<hip::Stream*>(stream)->Capture() != nullptr;
+}
+/// Stream capture hooks, see hip_graph.cpp. Each adds the operation to the graph capturing
+/// stream instead of enqueuing it
+extern hipError_t ihipCaptureKernel(hipStream_t stream, hipFunction_t f,
+                                    const dim3& globalWorkSize, const dim3& blockDim,
+                                    uint32_t sharedMemBytes, void** kernelParams, void** extra,
+                                    uint32_t flags);
+/// The arguments of ihipCaptureKernel, for ihipCaptureKernels
+struct ihipCapturedKernel {
+  hipFunction_t function;
+  dim3 globalWorkSize;
+  dim3 blockDim;
+  uint32_t sharedMemBytes;
+  void** kernelParams;
+  void** extra;
+};
+/// Captures the kernels as consecutive nodes, all of them or none
+extern hipError_t ihipCaptureKernels(hipStream_t stream, const ihipCapturedKernel* kernels,
+                                     uint32_t count, uint32_t flags);
+extern hipError_t ihipCaptureMemcpy(hipStream_t stream, void* dst, const void* src,
+                                    size_t sizeBytes, hipMemcpyKind kind);
+extern hipError_t ihipCaptureMemset(hipStream_t stream, void* dst, int64_t value,
+                                    size_t valueSize, size_t sizeBytes);
+extern hipError_t ihipCaptureEventRecord(hipStream_t stream, hipEvent_t event);
+/// Returns false if the wait is not part of a capture, else its status in status
+extern bool ihipCaptureStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int flags,
+                                       hipError_t* status);
+/// Invalidates the capture of stream, for an operation that can't be captured, and returns
+/// hipErrorNotSupported
+extern hipError_t ihipCaptureUnsupported(hipStream_t stream);
+/// Removes a stream that is being destroyed from its capture. The capture is dropped if it
+/// started on the stream
+extern void ihipStreamLeaveCapture(hip::Stream* stream);
 
 extern std::vector<hip::Device*> g_devices;
 extern hipError_t ihipDeviceGetCount(int* count);
@@ -252,6 +436,8 @@ extern int ihipGetDevice();
 extern hipError_t ihipMalloc(void** ptr, size_t sizeBytes, unsigned int flags);
 extern amd::Memory* getMemoryObject(const void* ptr, size_t& offset);
 extern amd::Memory* getMemoryObjectWithOffset(const void* ptr, const size_t size);
+/// Drops the cached sub-buffer views of memory, which keep it alive. Call before releasing it
+extern void ihipEvictSubBufferViews(amd::Memory* memory);
 
 constexpr bool kOptionChangeable = true;
 constexpr bool kNewDevProg = false;
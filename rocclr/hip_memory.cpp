@@ -20,14 +20,41 @@
 
 #include <hip/hip_runtime.h>
 #include "hip_internal.hpp"
+#include "hip_event.hpp"
 #include "hip_platform.hpp"
 #include "hip_conversions.hpp"
 #include "platform/context.hpp"
 #include "platform/command.hpp"
 #include "platform/memory.hpp"
+#include "src/mem_pool.hpp"
+#include "src/range_index.hpp"
+
+#include <algorithm>
+
+// ================================================================================================
+/// Allocations made by ihipMalloc and the memory pools, resolved without taking the lock of
+/// amd::MemObjMap. Entries are erased before the memory is freed.
+static hip_impl::Range_index<amd::Memory*>& memoryIndex() {
+  static auto* index = new hip_impl::Range_index<amd::Memory*>;
+  return *index;
+}
+
+/// Adds the SVM allocation at ptr to the pointer index
+static void ihipIndexAllocation(void* ptr) {
+  amd::Memory* memObj = amd::MemObjMap::FindMemObj(ptr);
+  if (memObj != nullptr) {
+    memoryIndex().insert(ptr, memObj->getSize(), memObj);
+  }
+}
 
 // ================================================================================================
 amd::Memory* getMemoryObject(const void* ptr, size_t& offset) {
+  hip_impl::Range_index<amd::Memory*>::Range range;
+  if (memoryIndex().find(ptr, range)) {
+    offset = reinterpret_cast<uintptr_t>(ptr) - range.base;
+    return range.value;
+  }
+
   amd::Memory *memObj = amd::MemObjMap::FindMemObj(ptr);
   if (memObj != nullptr) {
     if (memObj->getSvmPtr() != nullptr) {
@@ -43,6 +70,84 @@ amd::Memory* getMemoryObject(const void* ptr, size_t& offset) {
   return memObj;
 }
 
+// ================================================================================================
+/// Sub-buffer views of allocations, kept so that texture objects bound again and again to the
+/// same range of an arena share one amd::Buffer instead of creating and destroying a view each
+/// time. Each allocation keeps its most recently used views, newest first. A cached view holds
+/// a reference to its parent, so views are evicted before the allocation is freed.
+class SubBufferViews {
+public:
+  static constexpr size_t kViewsPerAllocation = 4;
+
+  /// Returns a view of [offset, offset + size) of parent, retained for the caller
+  amd::Memory* acquire(amd::Memory* parent, size_t offset, size_t size) {
+    amd::ScopedLock lock(lock_);
+    std::vector<amd::Memory*>& views = views_[parent];
+    for (auto it = views.begin(); it != views.end(); ++it) {
+      amd::Memory* view = *it;
+      if (view->getOrigin() == offset && view->getSize() == size) {
+        std::rotate(views.begin(), it, it + 1);
+        view->retain();
+        return view;
+      }
+    }
+
+    amd::Memory* view = new (parent->getContext()) amd::Buffer(*parent, parent->getMemFlags(),
+                                                               offset, size);
+    if (view == nullptr) {
+      return nullptr;
+    }
+    if (!view->create(nullptr)) {
+      view->release();
+      return nullptr;
+    }
+    if (views.size() == kViewsPerAllocation) {
+      // Texture objects still bound to the evicted view keep it alive
+      views.back()->release();
+      views.pop_back();
+    }
+    views.insert(views.begin(), view);
+    view->retain();
+    return view;
+  }
+
+  /// Drops the cached views of parent
+  void evict(amd::Memory* parent) {
+    amd::ScopedLock lock(lock_);
+    auto it = views_.find(parent);
+    if (it == views_.end()) {
+      return;
+    }
+    for (amd::Memory* view : it->second) {
+      view->release();
+    }
+    views_.erase(it);
+  }
+
+private:
+  amd::Monitor lock_{"Guards sub-buffer views"};
+  std::unordered_map<amd::Memory*, std::vector<amd::Memory*>> views_;
+};
+
+static SubBufferViews& subBufferViews() {
+  static auto* views = new SubBufferViews;
+  return *views;
+}
+
+// ================================================================================================
+void ihipEvictSubBufferViews(amd::Memory* memory) {
+  subBufferViews().evict(memory);
+}
+
+/// Removes the allocation at ptr from the pointer index and drops its sub-buffer views
+static void ihipUnindexAllocation(void* ptr) {
+  hip_impl::Range_index<amd::Memory*>::Range range;
+  if (memoryIndex().find(ptr, range)) {
+    subBufferViews().evict(range.value);
+  }
+  memoryIndex().erase(ptr);
+}
+
 // ================================================================================================
 amd::Memory* getMemoryObjectWithOffset(const void* ptr, const size_t size) {
   size_t offset;
@@ -50,20 +155,60 @@ amd::Memory* getMemoryObjectWithOffset(const void* ptr, const size_t size) {
 
   if (memObj != nullptr) {
     assert(size <= (memObj->getSize() - offset));
-    memObj = new (memObj->getContext()) amd::Buffer(*memObj, memObj->getMemFlags(), offset, size);
-    if (memObj == nullptr) {;
-      return nullptr;
-    }
-
-    if (!memObj->create(nullptr)) {
-      memObj->release();
-      return nullptr;
-    }
+    memObj = subBufferViews().acquire(memObj, offset, size);
   }
 
   return memObj;
 }
 
+// ================================================================================================
+hip_impl::Memory_pool<hip::Stream*, hip::Event*>* hip::Device::MemPool() {
+  std::call_once(memPoolOnce_, [this]() {
+    hip_impl::Memory_pool<Stream*, Event*>::Hooks hooks;
+    hooks.allocate = [this](size_t size) -> void* {
+      const amd::Device* dev = devices()[0];
+      if (dev->info().maxMemAllocSize_ < size) {
+        return nullptr;
+      }
+      void* ptr = amd::SvmBuffer::malloc(*context_, 0, size, dev->info().memBaseAddrAlign_,
+                                         nullptr);
+      if (ptr != nullptr) {
+        ihipIndexAllocation(ptr);
+      }
+      return ptr;
+    };
+    hooks.release = [this](void* ptr, Event*& event) {
+      ihipUnindexAllocation(ptr);
+      amd::SvmBuffer::free(*context_, ptr);
+      delete event;
+    };
+    hooks.record = [](Stream* stream, Event*& event) {
+      if (event == nullptr) {
+        event = new Event(hipEventDisableTiming);
+      }
+      stream->GetDevice()->CountMarker(event->addMarker(stream->asHostQueue(), nullptr, true));
+    };
+    hooks.done = [](Event*& event) { return event->query() == hipSuccess; };
+    hooks.wait = [](Stream* stream, Event*& event) {
+      event->streamWait(stream->asHostQueue(), 0);
+    };
+    memPool_ = new hip_impl::Memory_pool<Stream*, Event*>(std::move(hooks));
+  });
+  return memPool_;
+}
+
+// ================================================================================================
+/// Hands ptr back to the memory pool of its device, in stream order on stream or on the device's
+/// null stream. Returns false if ptr is not a block from hipMallocAsync.
+static bool ihipMemPoolFree(void* ptr, amd::Memory* memory_object, hip::Stream* stream) {
+  for (auto& dev : g_devices) {
+    if (dev->asContext() == &memory_object->getContext()) {
+      return dev->MemPool()->free(ptr, (stream != nullptr) ? stream : dev->GetNullStream());
+    }
+  }
+  return false;
+}
+
 // ================================================================================================
 hipError_t ihipFree(void *ptr)
 {
@@ -90,7 +235,12 @@ hipError_t ihipFree(void *ptr)
       // Wait on the device, associated with the current memory object
       hip::getNullStream(memory_object->getContext())->finish();
     }
-    amd::SvmBuffer::free(memory_object->getContext(), ptr);
+    // Blocks from hipMallocAsync go back to their pool instead, idle by now
+    if (!ihipMemPoolFree(ptr, memory_object, nullptr)) {
+      subBufferViews().evict(memory_object);
+      memoryIndex().erase(ptr);
+      amd::SvmBuffer::free(memory_object->getContext(), ptr);
+    }
     return hipSuccess;
   }
   return hipErrorInvalidValue;
@@ -127,10 +277,23 @@ hipError_t ihipMalloc(void** ptr, size_t sizeBytes, unsigned int flags)
     LogPrintfError("Allocation failed : Device memory : required :%zu | free :%zu | total :%zu \n", sizeBytes, free, total);
     return hipErrorOutOfMemory;
   }
+  ihipIndexAllocation(*ptr);
 
   return hipSuccess;
 }
 
+// ================================================================================================
+/// Whether async copies to and from pageable host memory may return before the copy is done.
+/// The queue's own thread then stages them in stream order, and the application must leave the
+/// host buffer alone until they complete. Opted into with HIP_COPY_THREADS, as on HCC.
+static bool ihipPageableCopyAsync() {
+  static const bool enabled = []() {
+    char *var = getenv("HIP_COPY_THREADS");
+    return var != nullptr && atoi(var) > 0;
+  }();
+  return enabled;
+}
+
 // ================================================================================================
 hipError_t ihipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind,
                       amd::HostQueue& queue, bool isAsync = false) {
@@ -169,7 +332,7 @@ hipError_t ihipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKin
     }
     command = new amd::WriteMemoryCommand(*pQueue, CL_COMMAND_WRITE_BUFFER, waitList,
               *dstMemory->asBuffer(), dOffset, sizeBytes, src);
-    isAsync = false;
+    isAsync = isAsync && ihipPageableCopyAsync();
   } else if ((srcMemory != nullptr) && (dstMemory == nullptr)) {
     amd::HostQueue* pQueue = &queue;
     if (queueDevice != srcMemory->getContext().devices()[0]) {
@@ -181,7 +344,7 @@ hipError_t ihipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKin
     }
     command = new amd::ReadMemoryCommand(*pQueue, CL_COMMAND_READ_BUFFER, waitList,
               *srcMemory->asBuffer(), sOffset, sizeBytes, dst);
-    isAsync = false;
+    isAsync = isAsync && ihipPageableCopyAsync();
   } else if ((srcMemory != nullptr) && (dstMemory != nullptr)) {
     // Check if the queue device doesn't match the device on any memory object.
     // And any of them are not host allocation.
@@ -286,6 +449,91 @@ hipError_t hipFree(void* ptr) {
   HIP_RETURN(ihipFree(ptr));
 }
 
+hipError_t hipMallocAsync(void** ptr, size_t sizeBytes, hipStream_t stream) {
+  HIP_INIT_API(hipMallocAsync, ptr, sizeBytes, stream);
+
+  if (ptr == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  *ptr = nullptr;
+  if (sizeBytes == 0) {
+    HIP_RETURN(hipSuccess);
+  }
+  HIP_RETURN_ONCAPTURE(stream);
+
+  // Orders the stream after the null stream, as any other command on it
+  hip::getQueue(stream);
+  hip::Stream* s = (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                       : reinterpret_cast<hip::Stream*>(stream);
+  *ptr = s->GetDevice()->MemPool()->allocate(sizeBytes, s);
+
+  HIP_RETURN((*ptr != nullptr) ? hipSuccess : hipErrorOutOfMemory, *ptr);
+}
+
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream) {
+  HIP_INIT_API(hipFreeAsync, ptr, stream);
+
+  if (ptr == nullptr) {
+    HIP_RETURN(hipSuccess);
+  }
+  HIP_RETURN_ONCAPTURE(stream);
+
+  size_t offset = 0;
+  amd::Memory* memory_object = getMemoryObject(ptr, offset);
+  if (memory_object == nullptr || offset != 0) {
+    HIP_RETURN(hipErrorInvalidDevicePointer);
+  }
+
+  hip::getQueue(stream);
+  hip::Stream* s = (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                       : reinterpret_cast<hip::Stream*>(stream);
+  HIP_RETURN(ihipMemPoolFree(ptr, memory_object, s) ? hipSuccess : hipErrorInvalidDevicePointer);
+}
+
+hipError_t hipExtMemPoolTrimTo(int device, size_t minBytesToKeep) {
+  HIP_INIT_API(hipExtMemPoolTrimTo, device, minBytesToKeep);
+
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  g_devices[device]->MemPool()->trim(minBytesToKeep);
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtMemPoolSetReleaseThreshold(int device, size_t bytes) {
+  HIP_INIT_API(hipExtMemPoolSetReleaseThreshold, device, bytes);
+
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  g_devices[device]->MemPool()->set_release_threshold(bytes);
+  HIP_RETURN(hipSuccess);
+}
+
+hipError_t hipExtMemPoolGetStats(int device, hipExtMemPoolStats_t* stats) {
+  HIP_INIT_API(hipExtMemPoolGetStats, device, stats);
+
+  if (stats == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  if (device < 0 || static_cast<size_t>(device) >= g_devices.size()) {
+    HIP_RETURN(hipErrorInvalidDevice);
+  }
+
+  const auto s = g_devices[device]->MemPool()->stats();
+  stats->reserved = s.reserved;
+  stats->used = s.used;
+  stats->peakReserved = s.peak_reserved;
+  stats->peakUsed = s.peak_used;
+  stats->allocations = s.allocations;
+  stats->reuses = s.reuses;
+  stats->dependencyWaits = s.dependency_waits;
+  stats->releases = s.releases;
+  HIP_RETURN(hipSuccess);
+}
+
 hipError_t hipMemcpy(void* dst, const void* src, size_t sizeBytes, hipMemcpyKind kind) {
   HIP_INIT_API(hipMemcpy, dst, src, sizeBytes, kind);
 
@@ -297,6 +545,8 @@ hipError_t hipMemcpyWithStream(void* dst, const void* src, size_t sizeBytes,
                                hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpyWithStream, dst, src, sizeBytes, kind, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   amd::HostQueue* queue = hip::getQueue(stream);
 
   HIP_RETURN_DURATION(ihipMemcpy(dst, src, sizeBytes, kind, *queue, false));
@@ -335,6 +585,7 @@ hipError_t ihipArrayDestroy(hipArray* array) {
   for (auto& dev : g_devices) {
     dev->NullStream()->finish();
   }
+  subBufferViews().evict(as_amd(memObj));
   as_amd(memObj)->release();
 
   delete array;
@@ -735,6 +986,7 @@ hipError_t hipHostUnregister(void* hostPtr) {
   }
 
   if (amd::SvmBuffer::malloced(hostPtr)) {
+    ihipUnindexAllocation(hostPtr);
     amd::SvmBuffer::free(*hip::host_device->asContext(), hostPtr);
     HIP_RETURN(hipSuccess);
   } else {
@@ -752,6 +1004,7 @@ hipError_t hipHostUnregister(void* hostPtr) {
         }
       }
       amd::MemObjMap::RemoveMemObj(hostPtr);
+      subBufferViews().evict(mem);
       mem->release();
       HIP_RETURN(hipSuccess);
     }
@@ -761,6 +1014,17 @@ hipError_t hipHostUnregister(void* hostPtr) {
   HIP_RETURN(hipErrorInvalidValue);
 }
 
+// ================================================================================================
+/// Pageable copies are pinned by the ROCclr device layer, which keeps no cache to report on.
+hipError_t hipExtPinCacheGetStats(hipExtPinCacheStats_t* stats) {
+  HIP_INIT_API(hipExtPinCacheGetStats, stats);
+
+  if (stats == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  HIP_RETURN(hipErrorNotSupported);
+}
+
 // Deprecated function:
 hipError_t hipHostAlloc(void** ptr, size_t sizeBytes, unsigned int flags) {
   HIP_RETURN(ihipMalloc(ptr, sizeBytes, flags), *ptr);
@@ -879,13 +1143,21 @@ hipError_t hipMemcpyDtoD(hipDeviceptr_t dstDevice,
   HIP_RETURN_DURATION(ihipMemcpy(dstDevice, srcDevice, ByteCount, hipMemcpyDeviceToDevice, *hip::getQueue(nullptr)));
 }
 
+// Enqueues the copy on stream, or adds it to the graph capturing stream. The capture check
+// comes first, since getQueue() may enqueue waits for other streams.
+static hipError_t ihipMemcpyAsync(void* dst, const void* src, size_t sizeBytes,
+                                  hipMemcpyKind kind, hipStream_t stream) {
+  if (ihipStreamCapturing(stream)) {
+    return ihipCaptureMemcpy(stream, dst, src, sizeBytes, kind);
+  }
+  return ihipMemcpy(dst, src, sizeBytes, kind, *hip::getQueue(stream), true);
+}
+
 hipError_t hipMemcpyAsync(void* dst, const void* src, size_t sizeBytes,
                           hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpyAsync, dst, src, sizeBytes, kind, stream);
 
-  amd::HostQueue* queue = hip::getQueue(stream);
-
-  HIP_RETURN_DURATION(ihipMemcpy(dst, src, sizeBytes, kind, *queue, true));
+  HIP_RETURN_DURATION(ihipMemcpyAsync(dst, src, sizeBytes, kind, stream));
 }
 
 hipError_t hipMemcpyHtoDAsync(hipDeviceptr_t dstDevice,
@@ -894,7 +1166,7 @@ hipError_t hipMemcpyHtoDAsync(hipDeviceptr_t dstDevice,
                               hipStream_t stream) {
   HIP_INIT_API(hipMemcpyHtoDAsync, dstDevice, srcHost, ByteCount, stream);
 
-  HIP_RETURN_DURATION(ihipMemcpy(dstDevice, srcHost, ByteCount, hipMemcpyHostToDevice, *hip::getQueue(stream), true));
+  HIP_RETURN_DURATION(ihipMemcpyAsync(dstDevice, srcHost, ByteCount, hipMemcpyHostToDevice, stream));
 }
 
 hipError_t hipMemcpyDtoDAsync(hipDeviceptr_t dstDevice,
@@ -903,7 +1175,7 @@ hipError_t hipMemcpyDtoDAsync(hipDeviceptr_t dstDevice,
                               hipStream_t stream) {
   HIP_INIT_API(hipMemcpyDtoDAsync, dstDevice, srcDevice, ByteCount, stream);
 
-  HIP_RETURN_DURATION(ihipMemcpy(dstDevice, srcDevice, ByteCount, hipMemcpyDeviceToDevice, *hip::getQueue(stream), true));
+  HIP_RETURN_DURATION(ihipMemcpyAsync(dstDevice, srcDevice, ByteCount, hipMemcpyDeviceToDevice, stream));
 }
 
 hipError_t hipMemcpyDtoHAsync(void* dstHost,
@@ -912,7 +1184,7 @@ hipError_t hipMemcpyDtoHAsync(void* dstHost,
                               hipStream_t stream) {
   HIP_INIT_API(hipMemcpyDtoHAsync, dstHost, srcDevice, ByteCount, stream);
 
-  HIP_RETURN_DURATION(ihipMemcpy(dstHost, srcDevice, ByteCount, hipMemcpyDeviceToHost, *hip::getQueue(stream), true));
+  HIP_RETURN_DURATION(ihipMemcpyAsync(dstHost, srcDevice, ByteCount, hipMemcpyDeviceToHost, stream));
 }
 
 hipError_t ihipMemcpyAtoD(hipArray* srcArray,
@@ -1540,6 +1812,8 @@ hipError_t hipMemcpy2DAsync(void* dst, size_t dpitch, const void* src, size_t sp
                             size_t height, hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpy2DAsync, dst, dpitch, src, spitch, width, height, kind, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpy2D(dst, dpitch, src, spitch, width, height, kind, stream, true));
 }
 
@@ -1677,6 +1951,8 @@ hipError_t hipMemcpy3D(const hipMemcpy3DParms* p) {
 hipError_t hipMemcpy3DAsync(const hipMemcpy3DParms* p, hipStream_t stream) {
   HIP_INIT_API(hipMemcpy3DAsync, p, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpy3D(p, stream, true));
 }
 
@@ -1689,6 +1965,8 @@ hipError_t hipDrvMemcpy3D(const HIP_MEMCPY3D* pCopy) {
 hipError_t hipDrvMemcpy3DAsync(const HIP_MEMCPY3D* pCopy, hipStream_t stream) {
   HIP_INIT_API(hipDrvMemcpy3DAsync, pCopy, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpyParam3D(pCopy, stream, true));
 }
 
@@ -1738,6 +2016,10 @@ hipError_t ihipMemset(void* dst, int64_t value, size_t valueSize, size_t sizeByt
     return hipErrorInvalidValue;
   }
 
+  if (isAsync && ihipStreamCapturing(stream)) {
+    return ihipCaptureMemset(stream, dst, value, valueSize, sizeBytes);
+  }
+
   hipError_t hip_error = hipSuccess;
   amd::HostQueue* queue = hip::getQueue(stream);
 
@@ -1914,6 +2196,8 @@ hipError_t hipMemset2DAsync(void* dst, size_t pitch, int value,
                             size_t width, size_t height, hipStream_t stream) {
   HIP_INIT_API(hipMemset2DAsync, dst, pitch, value, width, height, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN(ihipMemset3D({dst, pitch, width, height}, value, {width, height, 1}, stream, true));
 }
 
@@ -1926,6 +2210,8 @@ hipError_t hipMemset3D(hipPitchedPtr pitchedDevPtr, int value, hipExtent extent)
 hipError_t hipMemset3DAsync(hipPitchedPtr pitchedDevPtr, int value, hipExtent extent, hipStream_t stream) {
   HIP_INIT_API(hipMemset3DAsync, pitchedDevPtr, value, extent, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN(ihipMemset3D(pitchedDevPtr, value, extent, stream, false));
 }
 
@@ -2009,6 +2295,12 @@ hipError_t hipIpcCloseMemHandle(void* dev_ptr) {
     HIP_RETURN(hipErrorNoDevice);
   }
 
+  // The views of the mapping keep it alive, drop them before detaching
+  amd::Memory* mapped = amd::MemObjMap::FindMemObj(dev_ptr);
+  if (mapped != nullptr) {
+    subBufferViews().evict(mapped);
+  }
+
   /* detach the memory */
   if (!device->IpcDetach(dev_ptr)){
      HIP_RETURN(hipErrorInvalidHandle);
@@ -2104,6 +2396,8 @@ hipError_t hipMemcpyParam2DAsync(const hip_Memcpy2D* pCopy,
                                  hipStream_t stream) {
   HIP_INIT_API(hipMemcpyParam2DAsync, pCopy);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN(ihipMemcpyParam2D(pCopy, stream, true));
 }
 
@@ -2153,12 +2447,16 @@ hipError_t hipMemcpy2DFromArray(void* dst, size_t dpitch, hipArray_const_t src,
 hipError_t hipMemcpy2DFromArrayAsync(void* dst, size_t dpitch, hipArray_const_t src, size_t wOffsetSrc, size_t hOffsetSrc, size_t width, size_t height, hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpy2DFromArrayAsync, dst, dpitch, src, wOffsetSrc, hOffsetSrc, width, height, kind, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpy2DFromArray(dst, dpitch, src, wOffsetSrc, hOffsetSrc, width, height, kind, stream, true));
 }
 
 hipError_t hipMemcpyFromArrayAsync(void* dst, hipArray_const_t src, size_t wOffsetSrc, size_t hOffsetSrc, size_t count, hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpyFromArrayAsync, dst, src, wOffsetSrc, hOffsetSrc, count, kind, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   if (src == nullptr) {
     HIP_RETURN(hipErrorInvalidValue);
   }
@@ -2174,12 +2472,16 @@ hipError_t hipMemcpyFromArrayAsync(void* dst, hipArray_const_t src, size_t wOffs
 hipError_t hipMemcpy2DToArrayAsync(hipArray* dst, size_t wOffset, size_t hOffset, const void* src, size_t spitch, size_t width, size_t height, hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpy2DToArrayAsync, dst, wOffset, hOffset, src, spitch, width, height, kind);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpy2DToArray(dst, wOffset, hOffset, src, spitch, width, height, kind, stream, true));
 }
 
 hipError_t hipMemcpyToArrayAsync(hipArray_t dst, size_t wOffset, size_t hOffset, const void* src, size_t count, hipMemcpyKind kind, hipStream_t stream) {
   HIP_INIT_API(hipMemcpyToArrayAsync, dst, wOffset, hOffset, src, count, kind);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   if (dst == nullptr) {
     HIP_RETURN(hipErrorInvalidValue);
   }
@@ -2218,6 +2520,8 @@ hipError_t hipMemcpyAtoHAsync(void* dstHost,
                               hipStream_t stream) {
   HIP_INIT_API(hipMemcpyAtoHAsync, dstHost, srcArray, srcOffset, ByteCount, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpyAtoH(srcArray, dstHost, {srcOffset, 0, 0}, {0, 0, 0}, {ByteCount, 1, 1}, 0, 0, stream, true));
 }
 
@@ -2237,6 +2541,8 @@ hipError_t hipMemcpyHtoAAsync(hipArray* dstArray,
                               hipStream_t stream) {
   HIP_INIT_API(hipMemcpyHtoAAsync, dstArray, dstOffset, srcHost, ByteCount, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   HIP_RETURN_DURATION(ihipMemcpyHtoA(srcHost, dstArray, {0, 0, 0}, {dstOffset, 0, 0}, {ByteCount, 1, 1}, 0, 0, stream, true));
 }
 
@@ -19,6 +19,7 @@
  THE SOFTWARE. */
 
 #include <hip/hip_runtime.h>
+#include <hip/hip_ext.h>
 #include <elf/elf.hpp>
 #include <fstream>
 
@@ -202,26 +203,21 @@ hipError_t hipFuncSetSharedMemConfig ( const void* func, hipSharedMemConfig conf
   HIP_RETURN(hipSuccess);
 }
 
-hipError_t ihipModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
-                                 uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
-                                 uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
-                                 uint32_t sharedMemBytes, hipStream_t hStream,
-                                 void **kernelParams, void **extra,
-                                 hipEvent_t startEvent, hipEvent_t stopEvent, uint32_t flags = 0,
-                                 uint32_t params = 0, uint32_t gridId = 0, uint32_t numGrids = 0,
-                                 uint64_t prevGridSum = 0, uint64_t allGridSum = 0, uint32_t firstDevice = 0) {
-  HIP_INIT_API(ihipModuleLaunchKernel, f, globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ,
-    blockDimX, blockDimY, blockDimZ, sharedMemBytes, hStream, kernelParams, extra, startEvent,
-    stopEvent, flags, params);
-
+// Creates the command launching f on queue, with its arguments validated and captured, but
+// doesn't enqueue it.
+hipError_t ihipCreateLaunchCommand(amd::NDRangeKernelCommand*& command, hipFunction_t f,
+                                   amd::HostQueue* queue, uint32_t globalWorkSizeX,
+                                   uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
+                                   uint32_t blockDimX, uint32_t blockDimY,
+                                   uint32_t blockDimZ, uint32_t sharedMemBytes,
+                                   void **kernelParams, void **extra, bool profileNDRange,
+                                   uint32_t flags, uint32_t params, uint32_t gridId,
+                                   uint32_t numGrids, uint64_t prevGridSum,
+                                   uint64_t allGridSum, uint32_t firstDevice) {
   hip::DeviceFunc* function = hip::DeviceFunc::asFunction(f);
-  amd::Kernel* kernel = function->kernel();
-
-  amd::ScopedLock lock(function->dflock_);
-
-  hip::Event* eStart = reinterpret_cast<hip::Event*>(startEvent);
-  hip::Event* eStop = reinterpret_cast<hip::Event*>(stopEvent);
-  amd::HostQueue* queue = hip::getQueue(hStream);
+  if (!queue) {
+    return hipErrorOutOfMemory;
+  }
   const amd::Device& device = queue->vdev()->device();
 
   // Make sure dispatch doesn't exceed max workgroup size limit
@@ -249,16 +245,12 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
       return hipErrorLaunchFailure;
     }
   }
-  if (!queue) {
-    return hipErrorOutOfMemory;
-  }
 
   size_t globalWorkOffset[3] = {0};
   size_t globalWorkSize[3] = { globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ };
   size_t localWorkSize[3] = { blockDimX, blockDimY, blockDimZ };
   amd::NDRangeContainer ndrange(3, globalWorkOffset, globalWorkSize, localWorkSize);
   amd::Command::EventWaitList waitList;
-  bool profileNDRange = false;
   address kernargs = nullptr;
 
   // 'extra' is a struct that contains the following info: {
@@ -273,6 +265,10 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
     kernargs = reinterpret_cast<address>(extra[1]);
   }
 
+  // Arguments are set on a launch private copy of the kernel and captured by
+  // the command, so launches of f from other threads don't need a lock.
+  amd::Kernel* kernel = function->acquireLaunchKernel();
+
     const amd::KernelSignature& signature = kernel->signature();
     for (size_t i = 0; i < signature.numParameters(); ++i) {
       const amd::KernelParameterDescriptor& desc = signature.at(i);
@@ -287,30 +283,115 @@ hipError_t ihipModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
     }
   }
 
-  profileNDRange = (startEvent != nullptr || stopEvent != nullptr);
-
   // Flag set to 1 signifies that kernel can be launched in anyorder
   if (flags & hipExtAnyOrderLaunch) {
       params |= amd::NDRangeKernelCommand::AnyOrderLaunch;
   }
 
-  amd::NDRangeKernelCommand* command = new amd::NDRangeKernelCommand(
+  command = new amd::NDRangeKernelCommand(
     *queue, waitList, *kernel, ndrange, sharedMemBytes,
     params, gridId, numGrids, prevGridSum, allGridSum, firstDevice, profileNDRange);
   if (!command) {
+    function->releaseLaunchKernel(kernel);
     return hipErrorOutOfMemory;
   }
 
   // Capture the kernel arguments
-  if (CL_SUCCESS != command->captureAndValidate()) {
+  cl_int status = command->captureAndValidate();
+  function->releaseLaunchKernel(kernel);
+  if (CL_SUCCESS != status) {
     delete command;
+    command = nullptr;
     return hipErrorOutOfMemory;
   }
 
+  return hipSuccess;
+}
+
+// Copies the arguments of a launch of f into kernargs, laid out as the kernel signature like
+// the buffer passed in 'extra', so the launch can be replayed later.
+hipError_t ihipPackKernelArgs(hipFunction_t f, void** kernelParams, void** extra,
+                              std::vector<char>& kernargs) {
+  if (kernelParams != nullptr && extra != nullptr) {
+    return hipErrorInvalidValue;
+  }
+  const amd::KernelSignature& signature = hip::DeviceFunc::asFunction(f)->kernel()->signature();
+  size_t size = 0;
+  for (size_t i = 0; i < signature.numParameters(); ++i) {
+    const amd::KernelParameterDescriptor& desc = signature.at(i);
+    size = std::max(size, desc.offset_ + desc.size_);
+  }
+
+  if (extra != nullptr) {
+    if (extra[0] != HIP_LAUNCH_PARAM_BUFFER_POINTER ||
+        extra[2] != HIP_LAUNCH_PARAM_BUFFER_SIZE || extra[4] != HIP_LAUNCH_PARAM_END) {
+      return hipErrorNotInitialized;
+    }
+    // The kernel reads the size of its signature, which the caller's buffer must cover
+    if (extra[3] == nullptr || *reinterpret_cast<size_t*>(extra[3]) < size) {
+      return hipErrorInvalidValue;
+    }
+    const char* args = reinterpret_cast<const char*>(extra[1]);
+    kernargs.assign(args, args + size);
+    return hipSuccess;
+  }
+
+  if (kernelParams == nullptr && signature.numParameters() != 0) {
+    return hipErrorInvalidValue;
+  }
+  kernargs.assign(size, 0);
+  for (size_t i = 0; i < signature.numParameters(); ++i) {
+    const amd::KernelParameterDescriptor& desc = signature.at(i);
+    ::memcpy(kernargs.data() + desc.offset_, kernelParams[i], desc.size_);
+  }
+  return hipSuccess;
+}
+
+hipError_t ihipModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
+                                 uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
+                                 uint32_t blockDimX, uint32_t blockDimY, uint32_t blockDimZ,
+                                 uint32_t sharedMemBytes, hipStream_t hStream,
+                                 void **kernelParams, void **extra,
+                                 hipEvent_t startEvent, hipEvent_t stopEvent, uint32_t flags = 0,
+                                 uint32_t params = 0, uint32_t gridId = 0, uint32_t numGrids = 0,
+                                 uint64_t prevGridSum = 0, uint64_t allGridSum = 0, uint32_t firstDevice = 0) {
+  HIP_INIT_API(ihipModuleLaunchKernel, f, globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ,
+    blockDimX, blockDimY, blockDimZ, sharedMemBytes, hStream, kernelParams, extra, startEvent,
+    stopEvent, flags, params);
+
+  if (ihipStreamCapturing(hStream)) {
+    if (startEvent != nullptr || stopEvent != nullptr || params != 0) {
+      return ihipCaptureUnsupported(hStream);
+    }
+    return ihipCaptureKernel(hStream, f, dim3(globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ),
+                             dim3(blockDimX, blockDimY, blockDimZ), sharedMemBytes, kernelParams,
+                             extra, flags);
+  }
+
+  hip::Event* eStart = reinterpret_cast<hip::Event*>(startEvent);
+  hip::Event* eStop = reinterpret_cast<hip::Event*>(stopEvent);
+  amd::HostQueue* queue = hip::getQueue(hStream);
+
+  // Streams with timing-only events get kernel timestamps, which those events reuse
+  hip::Stream* stream = (hStream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                             : reinterpret_cast<hip::Stream*>(hStream);
+  bool profileNDRange = (startEvent != nullptr || stopEvent != nullptr ||
+                         stream->TimedLaunches());
+
+  amd::NDRangeKernelCommand* command = nullptr;
+  hipError_t status = ihipCreateLaunchCommand(command, f, queue, globalWorkSizeX,
+                                              globalWorkSizeY, globalWorkSizeZ, blockDimX,
+                                              blockDimY, blockDimZ, sharedMemBytes, kernelParams,
+                                              extra, profileNDRange, flags, params, gridId,
+                                              numGrids, prevGridSum, allGridSum, firstDevice);
+  if (status != hipSuccess) {
+    return status;
+  }
+
   command->enqueue();
 
   if (startEvent != nullptr) {
-    eStart->addMarker(queue, command, false);
+    eStart->addMarker(queue, command, false, true);
     command->retain();
   }
   if (stopEvent != nullptr) {
@@ -363,6 +444,77 @@ hipError_t hipExtModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
       localWorkSizeZ, sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent, flags));
 }
 
+hipError_t hipExtModuleLaunchKernelBatch(const hipExtLaunchBatchParams* launches, uint32_t count,
+                                         hipStream_t hStream, uint32_t flags)
+{
+  HIP_INIT_API(hipExtModuleLaunchKernelBatch, launches, count, hStream, flags);
+
+  if (count == 0) {
+    HIP_RETURN(hipSuccess);
+  }
+  if (launches == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  const bool capturing = ihipStreamCapturing(hStream);
+  amd::HostQueue* queue = capturing ? nullptr : hip::getQueue(hStream);
+  hip::Stream* stream = (hStream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                             : reinterpret_cast<hip::Stream*>(hStream);
+  const bool profileNDRange = stream->TimedLaunches();
+
+  // Validate and capture every launch first, so that a bad entry launches nothing
+  std::vector<amd::NDRangeKernelCommand*> commands;
+  commands.reserve(count);
+  hipError_t status = hipSuccess;
+  for (uint32_t i = 0; i < count && status == hipSuccess; ++i) {
+    const hipExtLaunchBatchParams& l = launches[i];
+    size_t globalWorkSizeX = static_cast<size_t>(l.gridDim.x) * l.blockDim.x;
+    size_t globalWorkSizeY = static_cast<size_t>(l.gridDim.y) * l.blockDim.y;
+    size_t globalWorkSizeZ = static_cast<size_t>(l.gridDim.z) * l.blockDim.z;
+    if (l.function == nullptr) {
+      status = hipErrorInvalidResourceHandle;
+    } else if (l.kernelParams != nullptr && l.extra != nullptr) {
+      status = hipErrorInvalidValue;
+    } else if (globalWorkSizeX > UINT32_MAX || globalWorkSizeY > UINT32_MAX ||
+               globalWorkSizeZ > UINT32_MAX) {
+      status = hipErrorInvalidConfiguration;
+    } else if (!capturing) {
+      amd::NDRangeKernelCommand* command = nullptr;
+      status = ihipCreateLaunchCommand(command, l.function, queue, globalWorkSizeX,
+                                       globalWorkSizeY, globalWorkSizeZ, l.blockDim.x,
+                                       l.blockDim.y, l.blockDim.z,
+                                       static_cast<uint32_t>(l.sharedMemBytes), l.kernelParams,
+                                       l.extra, profileNDRange, flags, 0, 0, 0, 0, 0, 0);
+      if (status == hipSuccess) {
+        commands.push_back(command);
+      }
+    }
+  }
+
+  for (auto command : commands) {
+    if (status == hipSuccess) {
+      command->enqueue();
+    }
+    command->release();
+  }
+
+  if (capturing && status == hipSuccess) {
+    // Pack every entry before adding any, the batch is captured whole or not at all
+    std::vector<ihipCapturedKernel> kernels(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      const hipExtLaunchBatchParams& l = launches[i];
+      kernels[i] = {l.function,
+                    dim3(l.gridDim.x * l.blockDim.x, l.gridDim.y * l.blockDim.y,
+                         l.gridDim.z * l.blockDim.z),
+                    l.blockDim, static_cast<uint32_t>(l.sharedMemBytes), l.kernelParams,
+                    l.extra};
+    }
+    status = ihipCaptureKernels(hStream, kernels.data(), count, flags);
+  }
+
+  HIP_RETURN(status);
+}
+
 
 
 hipError_t hipHccModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
@@ -19,37 +19,93 @@
  THE SOFTWARE. */
 
 #include <hip/hip_runtime.h>
+#include <algorithm>
 #include "hip_internal.hpp"
 #include "hip_event.hpp"
 #include "thread/monitor.hpp"
 #include "hip_prof_api.h"
+#include "src/callback_executor.hpp"
+#include "src/stream_pool.hpp"
 
 extern api_callbacks_table_t callbacks_table;
 
-static amd::Monitor streamSetLock{"Guards global stream set"};
-static std::unordered_set<hip::Stream*> streamSet;
+// Streams the current thread's API call got for submission, published by its SubmitScope
+static thread_local std::vector<hip::Stream*> pendingSubmitStreams;
+static std::atomic<uint64_t> nextStreamId{0};
 
 // Internal structure for stream callback handler
-class StreamCallback {
+class StreamCallback : public hip_impl::Callback_executor::Task {
    public:
     StreamCallback(hipStream_t stream, hipStreamCallback_t callback, void* userData,
-                  amd::Command* command)
+                  amd::Command* command, amd::UserEvent* done,
+                  hip_impl::Callback_executor* executor)
         : stream_(stream), callBack_(callback),
-          userData_(userData), command_(command) {
+          userData_(userData), command_(command), done_(done), executor_(executor) {
+          run = &StreamCallback::runTask;
         };
     hipStream_t stream_;
     hipStreamCallback_t callBack_;
     void* userData_;
     amd::Command* command_;
+    // Completed once the callback returned; the stream's later work waits on it
+    amd::UserEvent* done_;
+    hip_impl::Callback_executor* executor_;
+
+    static void runTask(Task* t) {
+      StreamCallback* cbo = static_cast<StreamCallback*>(t);
+      cbo->callBack_(cbo->stream_, hipSuccess, cbo->userData_);
+      cbo->done_->setStatus(CL_COMPLETE);
+      cbo->done_->release();
+      cbo->command_->release();
+      delete cbo;
+    }
 };
 
 namespace hip {
 
+// ================================================================================================
+uint64_t WaitSpinNs() {
+  static const uint64_t spinNs = []() {
+    char *var = getenv("HIP_WAIT_SPIN_US");
+    int us = var ? atoi(var) : 50;
+    return static_cast<uint64_t>(us > 0 ? us : 0) * 1000;
+  }();
+  return spinNs;
+}
+
+// ================================================================================================
+hip_impl::Wait_policy Device::WaitPolicy() const {
+  // HIP_WAIT_MODE as with HCC: 1 blocks, 2 spins, 3 is adaptive
+  static const int waitMode = []() {
+    char *var = getenv("HIP_WAIT_MODE");
+    return var ? atoi(var) : 0;
+  }();
+  if (waitMode == 1) {
+    return hip_impl::Wait_policy::blocked;
+  } else if (waitMode == 2) {
+    return hip_impl::Wait_policy::active;
+  } else if (waitMode == 3) {
+    return hip_impl::Wait_policy::adaptive;
+  }
+
+  switch (flags_ & hipDeviceScheduleMask) {
+    case hipDeviceScheduleAuto:
+      return hip_impl::Wait_policy::adaptive;
+    case hipDeviceScheduleBlockingSync:
+      return hip_impl::Wait_policy::blocked;
+    default:
+      return hip_impl::Wait_policy::active;
+  }
+}
+
 // ================================================================================================
 Stream::Stream(hip::Device* dev, Priority p,
     unsigned int f, bool null_stream, const std::vector<uint32_t>& cuMask)
   : queue_(nullptr), lock_("Stream Callback lock"), device_(dev),
-    priority_(p), flags_(f), null_(null_stream), cuMask_(cuMask) {}
+    priority_(p), flags_(f), null_(null_stream), cuMask_(cuMask),
+    id_(nextStreamId++), pendingSubmits_(0), submitEpoch_(0), untrackedSubmits_(false),
+    waiter_(WaitSpinNs()),
+    timedLaunches_(false), capture_(nullptr) {}
 
 // ================================================================================================
 bool Stream::Create() {
@@ -80,9 +136,8 @@ bool Stream::Create() {
   bool result = (queue != nullptr) ? queue->create() : false;
   // Insert just created stream into the list of the blocking queues
   if (result) {
-    amd::ScopedLock lock(streamSetLock);
-    streamSet.insert(this);
     queue_ = queue;
+    device_->AddStream(this);
   } else {
     queue_ = queue;
     Destroy();
@@ -108,9 +163,19 @@ amd::HostQueue* Stream::asHostQueue(bool skip_alloc) {
 
 // ================================================================================================
 void Stream::Destroy() {
+  ihipStreamLeaveCapture(this);
   if (queue_ != nullptr) {
-    amd::ScopedLock lock(streamSetLock);
-    streamSet.erase(this);
+    device_->RemoveStream(this);
+    // This thread's API call can't publish the stream anymore. API calls still submitting to
+    // it on other threads publish it before it goes away
+    auto it = std::remove(pendingSubmitStreams.begin(), pendingSubmitStreams.end(), this);
+    const auto dropped = static_cast<uint32_t>(std::distance(it, pendingSubmitStreams.end()));
+    pendingSubmitStreams.erase(it, pendingSubmitStreams.end());
+    pendingSubmits_ -= dropped;
+    g_pendingSubmits -= dropped;
+    while (pendingSubmits_ != 0) {
+      std::this_thread::yield();
+    }
 
     queue_->release();
     queue_ = nullptr;
@@ -118,6 +183,25 @@ void Stream::Destroy() {
   delete this;
 }
 
+// ================================================================================================
+void Stream::Wait(amd::HostQueue* queue) {
+  amd::Command* command = queue->getLastQueuedCommand(true);
+  if (command == nullptr) {
+    // Nothing was submitted to the queue
+    return;
+  }
+
+  amd::Event& event = command->event();
+  if (command->type() != 0) {
+    event.notifyCmdQueue();
+  }
+  // Spinning polls the last command as hipStreamQuery does; blocking is ROCclr's own wait,
+  // which spins or sleeps as set by hipSetDeviceFlags
+  waiter_.wait(device_->WaitPolicy(), [command]() { return command->status() == CL_COMPLETE; },
+               [queue](bool) { queue->finish(); });
+  command->release();
+}
+
 // ================================================================================================
 void Stream::Finish() const {
   if (queue_ != nullptr) {
@@ -130,43 +214,147 @@ int Stream::DeviceId() const {
   return device_->deviceId();
 }
 
+// ================================================================================================
+void Stream::BeginSubmit() {
+  if (g_submitScopeDepth == 0) {
+    // No API call to publish the submission when it's done
+    untrackedSubmits_ = true;
+    return;
+  }
+  pendingSubmits_++;
+  pendingSubmitStreams.push_back(this);
+  g_pendingSubmits++;
+}
+
+// ================================================================================================
+void Stream::EndSubmits() {
+  for (auto stream : pendingSubmitStreams) {
+    // Bump the epoch before dropping the pending count, so a waiter that sees no pending
+    // submissions also sees the epochs of all finished ones
+    stream->submitEpoch_++;
+    stream->pendingSubmits_--;
+  }
+  pendingSubmitStreams.clear();
+  g_pendingSubmits = 0;
+}
+
+// ================================================================================================
 void Stream::syncNonBlockingStreams() {
-  amd::ScopedLock lock(streamSetLock);
-  for (auto& it : streamSet) {
+  for (auto& it : g_devices) {
+    it->SyncNonBlockingStreams();
+  }
+}
+
+// ================================================================================================
+hip_impl::Callback_executor* Device::CallbackExecutor() {
+  // Never freed: callbacks may still be in flight while the process exits, and joining their
+  // threads from a destructor could deadlock
+  std::call_once(callbackExecutorOnce_, [this]() {
+    char *var = getenv("HIP_CALLBACK_THREADS");
+    int threads = var ? atoi(var) : 1;
+    callbackExecutor_ = new hip_impl::Callback_executor(threads > 0 ? threads : 1);
+  });
+  return callbackExecutor_;
+}
+
+// ================================================================================================
+hip_impl::Stream_pool<Stream*>* Device::StreamPool() {
+  std::call_once(streamPoolOnce_, [this]() {
+    char *var = getenv("HIP_STREAM_POOL_MAX_QUEUES");
+    int maxQueues = var ? atoi(var) : 32;
+    streamPool_ = new hip_impl::Stream_pool<Stream*>(maxQueues > 0 ? maxQueues : 1,
+      [this](const hip_impl::Stream_pool<Stream*>::Key& key) -> Stream* {
+        Stream* stream = new Stream(this, static_cast<Stream::Priority>(key.priority), key.flags,
+                                    false, key.cu_mask);
+        if (!stream->Create()) {
+          stream->Destroy();
+          return nullptr;
+        }
+        stream->pooled_ = true;
+        return stream;
+      },
+      [](Stream* stream) { stream->Destroy(); });
+  });
+  return streamPool_;
+}
+
+// ================================================================================================
+void Device::AddStream(Stream* stream) {
+  amd::ScopedLock lock(streamSetLock_);
+  streamSet_.push_back(stream);
+  if (stream->Null()) {
+    nullStreamActive_ = true;
+  }
+}
+
+// ================================================================================================
+void Device::RemoveStream(Stream* stream) {
+  amd::ScopedLock lock(streamSetLock_);
+  streamSet_.erase(std::remove(streamSet_.begin(), streamSet_.end(), stream), streamSet_.end());
+  if (stream->Null()) {
+    nullStreamActive_ = false;
+  }
+  for (auto it : streamSet_) {
+    it->waitedEpochs_.erase(stream->id_);
+  }
+}
+
+// ================================================================================================
+void Device::SyncNonBlockingStreams() {
+  amd::ScopedLock lock(streamSetLock_);
+  for (auto& it : streamSet_) {
     if (it->Flags() & hipStreamNonBlocking) {
       it->asHostQueue()->finish();
     }
   }
 }
 
-};
-
 // ================================================================================================
-void iHipWaitActiveStreams(amd::HostQueue* blocking_queue, bool wait_null_stream) {
+void Device::WaitActiveStreams(Stream* blocking_stream, bool wait_null_stream) {
+  amd::HostQueue* blocking_queue = blocking_stream->asHostQueue();
   amd::Command::EventWaitList eventWaitList;
+  // Epochs covered by this wait, recorded only after the marker is in the blocking queue
+  std::vector<std::pair<uint64_t, uint64_t>> waitedEpochs;
+
+  auto waitStream = [&](Stream* stream) {
+    // Read the pending count first: if it's zero, every submission counted in the epoch
+    // has already been enqueued and is visible to getLastQueuedCommand()
+    const bool idle = (stream->pendingSubmits_ == 0) && !stream->untrackedSubmits_;
+    const uint64_t epoch = stream->submitEpoch_;
+    auto it = blocking_stream->waitedEpochs_.find(stream->id_);
+    if (idle && (it != blocking_stream->waitedEpochs_.end()) && (it->second == epoch)) {
+      // Nothing was submitted since the last wait
+      return;
+    }
+    // Get the last valid command
+    amd::Command* command = stream->queue_->getLastQueuedCommand(true);
+    if (command != nullptr) {
+      // Check the current active status
+      if (command->status() != CL_COMPLETE) {
+        command->notifyCmdQueue();
+        eventWaitList.push_back(command);
+      } else {
+        command->release();
+      }
+    }
+    if (idle) {
+      waitedEpochs.push_back(std::make_pair(stream->id_, epoch));
+    }
+  };
+
   {
-    amd::ScopedLock lock(streamSetLock);
-
-    for (const auto& stream : streamSet) {
-      amd::HostQueue* active_queue = stream->asHostQueue();
-      // If it's the current device
-      if ((&active_queue->device() == &blocking_queue->device()) &&
-          // Make sure it's a default stream
-          ((stream->Flags() & hipStreamNonBlocking) == 0) &&
-          // and it's not the current stream
-          (active_queue != blocking_queue) &&
-          // check for a wait on the null stream
-          (stream->Null() == wait_null_stream)) {
-        // Get the last valid command
-        amd::Command* command = active_queue->getLastQueuedCommand(true);
-        if (command != nullptr) {
-          // Check the current active status
-          if (command->status() != CL_COMPLETE) {
-            command->notifyCmdQueue();
-            eventWaitList.push_back(command);
-          } else {
-            command->release();
-          }
+    amd::ScopedLock lock(streamSetLock_);
+    if (wait_null_stream) {
+      if (nullStreamActive_ && (blocking_stream != &null_stream_)) {
+        waitStream(&null_stream_);
+      }
+    } else {
+      for (auto stream : streamSet_) {
+        // Make sure it's a default stream, it's not the current stream
+        // and check for a wait on the null stream
+        if (((stream->Flags() & hipStreamNonBlocking) == 0) &&
+            (stream != blocking_stream) && !stream->Null()) {
+          waitStream(stream);
         }
       }
     }
@@ -185,15 +373,29 @@ void iHipWaitActiveStreams(amd::HostQueue* blocking_queue, bool wait_null_stream
   for (const auto& it : eventWaitList) {
     it->release();
   }
+
+  if (!waitedEpochs.empty()) {
+    amd::ScopedLock lock(streamSetLock_);
+    for (const auto& it : waitedEpochs) {
+      uint64_t& waited = blocking_stream->waitedEpochs_[it.first];
+      waited = std::max(waited, it.second);
+    }
+  }
+}
+
+};
+
+// ================================================================================================
+void iHipWaitActiveStreams(hip::Stream* blocking_stream, bool wait_null_stream) {
+  blocking_stream->GetDevice()->WaitActiveStreams(blocking_stream, wait_null_stream);
 }
 
 // ================================================================================================
 void CL_CALLBACK ihipStreamCallback(cl_event event, cl_int command_exec_status, void* user_data) {
-  hipError_t status = hipSuccess;
+  // Runs on the thread completing the command, which must not block on user code.
+  // Callbacks of one stream complete in order and stay in order on the executor
   StreamCallback* cbo = reinterpret_cast<StreamCallback*>(user_data);
-  cbo->callBack_(cbo->stream_, status, cbo->userData_);
-  cbo->command_->release();
-  delete cbo;
+  cbo->executor_->post(cbo->stream_, cbo);
 }
 
 // ================================================================================================
@@ -211,6 +413,16 @@ static hipError_t ihipStreamCreate(hipStream_t* stream,
   return hipSuccess;
 }
 
+// ================================================================================================
+static hip::Stream::Priority ihipStreamPriority(int priority) {
+  if (priority <= hip::Stream::Priority::High) {
+    return hip::Stream::Priority::High;
+  } else if (priority >= hip::Stream::Priority::Low) {
+    return hip::Stream::Priority::Low;
+  }
+  return hip::Stream::Priority::Normal;
+}
+
 // ================================================================================================
 hipError_t hipStreamCreateWithFlags(hipStream_t *stream, unsigned int flags) {
   HIP_INIT_API(hipStreamCreateWithFlags, stream, flags);
@@ -241,16 +453,7 @@ hipError_t hipStreamCreateWithPriority(hipStream_t* stream, unsigned int flags,
     HIP_RETURN(hipErrorInvalidValue);
   }
 
-  hip::Stream::Priority streamPriority;
-  if (priority <= hip::Stream::Priority::High) {
-    streamPriority = hip::Stream::Priority::High;
-  } else if (priority >= hip::Stream::Priority::Low) {
-    streamPriority = hip::Stream::Priority::Low;
-  } else {
-    streamPriority = hip::Stream::Priority::Normal;
-  }
-
-  HIP_RETURN(ihipStreamCreate(stream, flags, streamPriority), *stream);
+  HIP_RETURN(ihipStreamCreate(stream, flags, ihipStreamPriority(priority)), *stream);
 }
 
 // ================================================================================================
@@ -283,8 +486,13 @@ hipError_t hipStreamGetFlags(hipStream_t stream, unsigned int* flags) {
 hipError_t hipStreamSynchronize(hipStream_t stream) {
   HIP_INIT_API(hipStreamSynchronize, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   // Wait for the current host queue
-  hip::getQueue(stream)->finish();
+  amd::HostQueue* queue = hip::getQueue(stream);
+  hip::Stream* hStream = (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                             : reinterpret_cast<hip::Stream*>(stream);
+  hStream->Wait(queue);
 
   HIP_RETURN(hipSuccess);
 }
@@ -297,7 +505,11 @@ hipError_t hipStreamDestroy(hipStream_t stream) {
     HIP_RETURN(hipErrorInvalidHandle);
   }
 
-  reinterpret_cast<hip::Stream*>(stream)->Destroy();
+  hip::Stream* hStream = reinterpret_cast<hip::Stream*>(stream);
+  // Pool streams stay alive for their next owner
+  if (!hStream->Pooled() || !hStream->GetDevice()->StreamPool()->release(hStream)) {
+    hStream->Destroy();
+  }
 
   HIP_RETURN(hipSuccess);
 }
@@ -310,6 +522,11 @@ hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int
     HIP_RETURN(hipErrorInvalidHandle);
   }
 
+  hipError_t status = hipSuccess;
+  if (ihipCaptureStreamWaitEvent(stream, event, flags, &status)) {
+    HIP_RETURN(status);
+  }
+
   amd::HostQueue* queue = hip::getQueue(stream);
 
   hip::Event* e = reinterpret_cast<hip::Event*>(event);
@@ -321,6 +538,8 @@ hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int
 hipError_t hipStreamQuery(hipStream_t stream) {
   HIP_INIT_API(hipStreamQuery, stream);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   amd::HostQueue* hostQueue = hip::getQueue(stream);
 
   amd::Command* command = hostQueue->getLastQueuedCommand(true);
@@ -343,6 +562,8 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
                                 unsigned int flags) {
   HIP_INIT_API(hipStreamAddCallback, stream, callback, userData, flags);
 
+  HIP_RETURN_ONCAPTURE(stream);
+
   amd::HostQueue* hostQueue = hip::getQueue(stream);
   amd::Command* command = hostQueue->getLastQueuedCommand(true);
   if (command == nullptr) {
@@ -351,13 +572,27 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
     command->enqueue();
   }
   amd::Event& event = command->event();
-  StreamCallback* cbo = new StreamCallback(stream, callback, userData, command);
+  hip::Device* device = (stream == nullptr) ? hip::getCurrentDevice() :
+                        reinterpret_cast<hip::Stream*>(stream)->GetDevice();
+  amd::UserEvent* done = new amd::UserEvent(hostQueue->context());
+  StreamCallback* cbo = new StreamCallback(stream, callback, userData, command, done,
+                                           device->CallbackExecutor());
 
   if(!event.setCallback(CL_COMPLETE, ihipStreamCallback, reinterpret_cast<void*>(cbo))) {
+    done->release();
     command->release();
-    return hipErrorInvalidHandle;
+    delete cbo;
+    HIP_RETURN(hipErrorInvalidHandle);
   }
 
+  // The callback runs on the executor after the command completed, so hold back the stream's
+  // later work, and hipStreamSynchronize, until it returned. The queue flushes the command
+  // before it blocks on the user event
+  amd::Command::EventWaitList waitList{done};
+  amd::Command* block = new amd::Marker(*hostQueue, kMarkerDisableFlush, waitList);
+  block->enqueue();
+  block->release();
+
   event.notifyCmdQueue();
 
   HIP_RETURN(hipSuccess);
@@ -380,6 +615,71 @@ hipError_t hipExtStreamCreateWithCUMask(hipStream_t* stream, uint32_t cuMaskSize
   HIP_RETURN(ihipStreamCreate(stream, hipStreamDefault, hip::Stream::Priority::Normal, cuMaskv), *stream);
 }
 
+// ================================================================================================
+hipError_t hipExtStreamPoolAcquire(hipStream_t* stream, unsigned int flags, int priority,
+                                   uint32_t cuMaskSize, const uint32_t* cuMask) {
+  HIP_INIT_API(hipExtStreamPoolAcquire, stream, flags, priority, cuMaskSize, cuMask);
+
+  if (stream == nullptr || (cuMaskSize != 0 && cuMask == nullptr)) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+  if (flags != hipStreamDefault && flags != hipStreamNonBlocking) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  hip_impl::Stream_pool<hip::Stream*>::Key key;
+  key.flags = flags;
+  key.priority = ihipStreamPriority(priority);
+  if (cuMaskSize != 0) {
+    key.cu_mask.assign(cuMask, cuMask + cuMaskSize);
+  }
+
+  hip::Stream* hStream = hip::getCurrentDevice()->StreamPool()->acquire(key);
+  if (hStream == nullptr) {
+    HIP_RETURN(hipErrorOutOfMemory);
+  }
+  *stream = reinterpret_cast<hipStream_t>(hStream);
+
+  HIP_RETURN(hipSuccess, *stream);
+}
+
+// ================================================================================================
+hipError_t hipExtStreamPoolRelease(hipStream_t stream) {
+  HIP_INIT_API(hipExtStreamPoolRelease, stream);
+
+  if (stream == nullptr) {
+    HIP_RETURN(hipErrorInvalidHandle);
+  }
+
+  hip::Stream* hStream = reinterpret_cast<hip::Stream*>(stream);
+  if (!hStream->Pooled() || !hStream->GetDevice()->StreamPool()->release(hStream)) {
+    HIP_RETURN(hipErrorInvalidHandle);
+  }
+
+  HIP_RETURN(hipSuccess);
+}
+
+// ================================================================================================
+hipError_t hipExtStreamGetWaitStats(hipStream_t stream, hipExtStreamWaitStats_t* stats) {
+  HIP_INIT_API(hipExtStreamGetWaitStats, stream, stats);
+
+  if (stats == nullptr) {
+    HIP_RETURN(hipErrorInvalidValue);
+  }
+
+  hip::Stream* hStream = (stream == nullptr) ? hip::getCurrentDevice()->GetNullStream()
+                                             : reinterpret_cast<hip::Stream*>(stream);
+  const hip_impl::Wait_stats s = hStream->Waiter().stats();
+  stats->waits = s.waits;
+  stats->spinCompletions = s.spin_completions;
+  stats->yieldCompletions = s.yield_completions;
+  stats->blockCompletions = s.block_completions;
+  stats->waitNs = s.wait_ns;
+  stats->spinNs = s.spin_ns;
+
+  HIP_RETURN(hipSuccess);
+}
+
 // ================================================================================================
 hipError_t hipStreamGetPriority(hipStream_t stream, int* priority) {
   HIP_INIT_API(hipStreamGetPriority, stream, priority);
@@ -24,6 +24,8 @@ THE SOFTWARE.
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <string>
+#include <vector>
 
 #define NUM_GROUPS 1
 #define GROUP_SIZE 1
@@ -31,6 +33,7 @@ THE SOFTWARE.
 #define TIMING_RUN_COUNT 100
 #define TOTAL_RUN_COUNT WARMUP_RUN_COUNT + TIMING_RUN_COUNT
 #define BATCH_SIZE 1000
+#define MAX_LAUNCH_BATCH 64
 
 #define FILE_NAME "test_kernel.code"
 #define KERNEL_NAME "test"
@@ -103,6 +106,48 @@ int main() {
     }
     print_timing("hipLaunchKernelGGL enqueue rate", results);
 
+#ifdef __HIP_PLATFORM_HCC__
+    /************************************************************************************/
+    /* Batched launch host overhead:                                                    */
+    /* Measure host time per kernel to enqueue a sequence of kernels one by one vs.     */
+    /* with a single hipExtModuleLaunchKernelBatch call                                 */
+    /************************************************************************************/
+
+    for (int batch = 1; batch <= MAX_LAUNCH_BATCH; batch *= 2) {
+        std::vector<hipExtLaunchBatchParams> launches(batch);
+        for (auto& l : launches) {
+            l.function = function;
+            l.gridDim = dim3(1);
+            l.blockDim = dim3(1);
+            l.sharedMemBytes = 0;
+            l.kernelParams = &params;
+            l.extra = nullptr;
+        }
+
+        for (auto i = 0; i < TOTAL_RUN_COUNT; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int j = 0; j < batch; j++) {
+                hipModuleLaunchKernel(function, 1, 1, 1, 1, 1, 1, 0, 0, &params, nullptr);
+            }
+            auto stop = std::chrono::high_resolution_clock::now();
+            results[i] = std::chrono::duration<float, std::milli>(stop - start).count();
+            hipStreamSynchronize(stream0);
+        }
+        print_timing("hipModuleLaunchKernel x " + std::to_string(batch) + " per-kernel host overhead",
+                     results, batch);
+
+        for (auto i = 0; i < TOTAL_RUN_COUNT; ++i) {
+            auto start = std::chrono::high_resolution_clock::now();
+            hipExtModuleLaunchKernelBatch(launches.data(), batch, stream0);
+            auto stop = std::chrono::high_resolution_clock::now();
+            results[i] = std::chrono::duration<float, std::milli>(stop - start).count();
+            hipStreamSynchronize(stream0);
+        }
+        print_timing("hipExtModuleLaunchKernelBatch of " + std::to_string(batch) +
+                     " per-kernel host overhead", results, batch);
+    }
+#endif
+
     /***********************************************************************************/
     /* Single dispatch execution latency using HIP events:                             */   
     /* Measures latency to start & finish executing a kernel with GPU-scope visibility    */ 
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Spin-then-yield-then-block waits for stream, event and copy completion,
+// shared by the HCC and ROCclr runtimes.
+//
+// Spinning gives the lowest latency for short waits but burns a core; blocking
+// frees the core but adds the wakeup latency of an interrupt. The adaptive
+// policy spins for an interval learned from recent waits on the same object
+// (twice their moving average, capped), then yields for as long again, then
+// blocks. Waits much longer than the cap quickly drive the spin interval down
+// to its minimum, so long kernels cost little CPU, while streams of short
+// kernels keep completing inside the spin phase.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace hip_impl {
+
+enum class Wait_policy {
+    active,   // spin until done
+    blocked,  // block in the runtime right away
+    adaptive  // spin, then yield, then block
+};
+
+// Counters of one waiter. Waits that found the work already done are counted
+// in waits only.
+struct Wait_stats {
+    std::uint64_t waits = 0;
+    std::uint64_t spin_completions = 0;   // done while spinning, any policy
+    std::uint64_t yield_completions = 0;  // done while yielding (adaptive)
+    std::uint64_t block_completions = 0;  // done while blocked
+    std::uint64_t wait_ns = 0;            // total time spent waiting
+    std::uint64_t spin_ns = 0;            // current spin interval (adaptive)
+};
+
+class Adaptive_waiter {
+   public:
+    static constexpr std::uint64_t min_spin_ns() { return 1000; }
+
+    explicit Adaptive_waiter(std::uint64_t max_spin_ns = 50000)
+        : max_spin_ns_{std::max(max_spin_ns, min_spin_ns())}, avg_ns_{max_spin_ns_ / 2} {}
+
+    Adaptive_waiter(const Adaptive_waiter&) = delete;
+    Adaptive_waiter& operator=(const Adaptive_waiter&) = delete;
+
+    // Waits until done() returns true. block(bool blocking) must wait for
+    // completion itself, blocking the thread if blocking is true and spinning
+    // otherwise. done() is polled, so it should be cheap (a signal load).
+    template <typename Done, typename Block>
+    void wait(Wait_policy policy, Done done, Block block) {
+        waits_.fetch_add(1, std::memory_order_relaxed);
+        if (done()) return;
+
+        const auto start = clock::now();
+        std::atomic<std::uint64_t>* phase = &block_completions_;
+        if (policy == Wait_policy::active) {
+            block(false);
+            phase = &spin_completions_;
+        } else if (policy == Wait_policy::blocked) {
+            block(true);
+        } else {
+            const auto spin = std::chrono::nanoseconds{spin_ns()};
+            if (poll(done, start + spin, false)) {
+                phase = &spin_completions_;
+            } else if (poll(done, start + 2 * spin, true)) {
+                phase = &yield_completions_;
+            } else {
+                block(true);
+            }
+        }
+
+        const std::uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     clock::now() - start).count();
+        phase->fetch_add(1, std::memory_order_relaxed);
+        wait_ns_.fetch_add(ns, std::memory_order_relaxed);
+        learn(ns);
+    }
+
+    // Twice the average recent wait, capped, unless the average itself is
+    // past the cap: a spin that is not expected to see completion is not
+    // worth it.
+    std::uint64_t spin_ns() const {
+        const std::uint64_t avg = avg_ns_.load(std::memory_order_relaxed);
+        if (avg > max_spin_ns_) return min_spin_ns();
+        return std::min(std::max(2 * avg, min_spin_ns()), max_spin_ns_);
+    }
+
+    Wait_stats stats() const {
+        Wait_stats s;
+        s.waits = waits_.load(std::memory_order_relaxed);
+        s.spin_completions = spin_completions_.load(std::memory_order_relaxed);
+        s.yield_completions = yield_completions_.load(std::memory_order_relaxed);
+        s.block_completions = block_completions_.load(std::memory_order_relaxed);
+        s.wait_ns = wait_ns_.load(std::memory_order_relaxed);
+        s.spin_ns = spin_ns();
+        return s;
+    }
+
+   private:
+    using clock = std::chrono::steady_clock;
+
+    template <typename Done>
+    static bool poll(Done& done, clock::time_point until, bool yield) {
+        do {
+            if (done()) return true;
+            if (yield) {
+                std::this_thread::yield();
+            } else {
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+                __builtin_ia32_pause();
+#endif
+            }
+        } while (clock::now() < until);
+        return done();
+    }
+
+    // Moving average with weight 1/8, so a change in the workload is picked
+    // up within a few waits. Concurrent waiters may lose an update, which
+    // only delays learning.
+    void learn(std::uint64_t ns) {
+        const std::uint64_t avg = avg_ns_.load(std::memory_order_relaxed);
+        // Clamp so one very long wait does not take many waits to forget.
+        ns = std::min(ns, 4 * max_spin_ns_);
+        avg_ns_.store(avg - avg / 8 + ns / 8, std::memory_order_relaxed);
+    }
+
+    const std::uint64_t max_spin_ns_;
+    std::atomic<std::uint64_t> avg_ns_;
+    std::atomic<std::uint64_t> waits_{0};
+    std::atomic<std::uint64_t> spin_completions_{0};
+    std::atomic<std::uint64_t> yield_completions_{0};
+    std::atomic<std::uint64_t> block_completions_{0};
+    std::atomic<std::uint64_t> wait_ns_{0};
+};
+}  // namespace hip_impl
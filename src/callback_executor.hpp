@@ -0,0 +1,154 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Runs host callbacks (hipStreamAddCallback) for one device on a small pool of
+// worker threads, so the thread that observes GPU completion only queues them.
+// Shared by the HCC and ROCclr runtimes.
+//
+// Every worker owns a lock-free LIFO of posted tasks. A worker takes the whole
+// list with one exchange, reverses it and runs the batch, so producers never
+// block and workers touch the shared list once per batch. Tasks are mapped to
+// workers by key (the stream), which keeps the tasks of one stream in post
+// order while different streams run in parallel.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hip_impl {
+
+class Callback_executor {
+   public:
+    // Intrusive task, owned by the caller until run() is called on it. run()
+    // may delete the task.
+    struct Task {
+        void (*run)(Task*) = nullptr;
+        Task* next = nullptr;
+    };
+
+    explicit Callback_executor(unsigned threads) {
+        if (threads == 0) threads = 1;
+        workers_.reserve(threads);
+        for (unsigned i = 0; i != threads; ++i) {
+            workers_.emplace_back(new Worker);
+            workers_.back()->thread = std::thread{&Callback_executor::work, workers_.back().get()};
+        }
+    }
+
+    // Runs the tasks still queued, then joins the workers.
+    ~Callback_executor() {
+        for (auto& w : workers_) {
+            {
+                std::lock_guard<std::mutex> lck{w->mutex};
+                w->stop = true;
+            }
+            w->cv.notify_one();
+        }
+        for (auto& w : workers_) w->thread.join();
+    }
+
+    // Queues t. Tasks posted with the same key run in post order, on one thread.
+    void post(const void* key, Task* t) {
+        Worker& w = *workers_[slot(key)];
+        t->next = w.head.load(std::memory_order_relaxed);
+        while (!w.head.compare_exchange_weak(t->next, t)) {
+        }
+        // Pairs with the worker setting sleeping before its last look at head.
+        if (w.sleeping.load()) {
+            std::lock_guard<std::mutex> lck{w.mutex};
+            w.cv.notify_one();
+        }
+    }
+
+    std::size_t threads() const { return workers_.size(); }
+
+    // Tasks run and batches taken so far, over all workers.
+    std::uint64_t tasks() const { return sum(&Worker::tasks); }
+    std::uint64_t batches() const { return sum(&Worker::batches); }
+
+   private:
+    struct Worker {
+        std::atomic<Task*> head{nullptr};
+        std::atomic<bool> sleeping{false};
+        std::atomic<std::uint64_t> tasks{0};
+        std::atomic<std::uint64_t> batches{0};
+        bool stop = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::thread thread;
+    };
+
+    std::size_t slot(const void* key) const {
+        std::uint64_t h = reinterpret_cast<std::uintptr_t>(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h % workers_.size());
+    }
+
+    std::uint64_t sum(std::atomic<std::uint64_t> Worker::*counter) const {
+        std::uint64_t r = 0;
+        for (auto& w : workers_) r += ((*w).*counter).load(std::memory_order_relaxed);
+        return r;
+    }
+
+    static void work(Worker* w) {
+        for (;;) {
+            Task* batch = w->head.exchange(nullptr);
+            if (!batch) {
+                std::unique_lock<std::mutex> lck{w->mutex};
+                w->sleeping.store(true);
+                while (!(batch = w->head.exchange(nullptr)) && !w->stop) w->cv.wait(lck);
+                w->sleeping.store(false);
+                if (!batch) return;
+            }
+
+            // The list is newest first; reverse it to run in post order.
+            Task* fifo = nullptr;
+            std::uint64_t n = 0;
+            while (batch) {
+                Task* next = batch->next;
+                batch->next = fifo;
+                fifo = batch;
+                batch = next;
+                ++n;
+            }
+            while (fifo) {
+                Task* next = fifo->next;
+                fifo->run(fifo);
+                fifo = next;
+            }
+            w->tasks.fetch_add(n, std::memory_order_relaxed);
+            w->batches.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+}  // namespace hip_impl
@@ -22,10 +22,13 @@ THE SOFTWARE.
 
 #pragma once
 
+#include "code_object_bundle_index.hpp"
+
 #include <hsa/hsa.h>
 
 #include <algorithm>
 #include <cstdint>
+#include <ios>
 #include <istream>
 #include <iterator>
 #include <string>
@@ -111,42 +114,80 @@ class Bundled_code_header {
     friend inline bool read(RandomAccessIterator f, RandomAccessIterator l,
                             Bundled_code_header& x) {
         if (f == l) return false;
-        std::copy_n(f, sizeof(x.header_.cbuf_), x.header_.cbuf_);
-        if (valid(x)) {
-            x.bundles_.resize(x.header_.bundle_cnt_);
-
-            auto it = f + sizeof(x.header_.cbuf_);
-            for (auto&& y : x.bundles_) {
-                std::copy_n(it, sizeof(y.header.cbuf), y.header.cbuf);
-                it += sizeof(y.header.cbuf);
-
-                y.triple.assign(it, it + y.header.triple_sz);
-                #ifdef DISABLE_REDUCED_GPU_BLOB_COPY
-                std::copy_n(f + y.header.offset, y.header.bundle_sz, std::back_inserter(y.blob));
-                #else
-                auto& gpuArch = get_all_gpuarch();
-                auto itgpuArch = std::find(gpuArch.begin(),gpuArch.end(),y.triple);
-                if (itgpuArch != gpuArch.end()){
-                    std::copy_n(f + y.header.offset, y.header.bundle_sz, std::back_inserter(y.blob));
-                }
-                #endif
-                it += y.header.triple_sz;
-                x.bundled_code_size = std::max(x.bundled_code_size, 
-                                               y.header.offset + y.header.bundle_sz);
-            }
-
-            return true;
+        const Bundle_index index{&*f, static_cast<std::size_t>(l - f)};
+        if (!index.valid()) return false;
+
+        std::copy_n(&*f, sizeof(x.header_.cbuf_), x.header_.cbuf_);
+        x.bundles_.resize(index.entries().size());
+        auto y = x.bundles_.begin();
+        for (auto&& e : index.entries()) {
+            y->header.offset = e.blob.data() - &*f;
+            y->header.bundle_sz = e.blob.size();
+            y->header.triple_sz = e.triple.size();
+            y->triple = e.triple.str();
+            #ifdef DISABLE_REDUCED_GPU_BLOB_COPY
+            y->blob = e.blob.str();
+            #else
+            auto& gpuArch = get_all_gpuarch();
+            if (gpuArch.find(y->triple) != gpuArch.end()) y->blob = e.blob.str();
+            #endif
+            ++y;
         }
+        x.bundled_code_size = index.extent();
 
-        return false;
+        return true;
     }
     friend inline bool read(const std::vector<char>& blob, Bundled_code_header& x) {
         return read(blob.cbegin(), blob.cend(), x);
     }
+    // Reads the bundle starting at the stream's position. Only the headers and
+    // the code objects that are kept are read, the stream is not buffered.
     friend inline bool read(std::istream& is, Bundled_code_header& x) {
-        return read(
-            std::vector<char>{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}},
-            x);
+        const auto start = is.tellg();
+        if (start == std::istream::pos_type(-1)) return false;
+        is.seekg(0, std::ios::end);
+        const auto end = is.tellg();
+        if (end == std::istream::pos_type(-1) || end < start) return false;
+        const std::uint64_t size = end - start;
+        is.seekg(start);
+
+        Header_ h;
+        if (size < sizeof(h.cbuf_) || !is.read(h.cbuf_, sizeof(h.cbuf_))) return false;
+        if (!Bundle_index::is_bundle(h.cbuf_, sizeof(h.cbuf_))) return false;
+        std::uint64_t pos = sizeof(h.cbuf_);
+        if (h.bundle_cnt_ > (size - pos) / sizeof(Bundled_code::Header)) return false;
+
+        std::vector<Bundled_code> bundles(h.bundle_cnt_);
+        std::uint64_t extent = pos;
+        for (auto&& y : bundles) {
+            if (!is.read(y.header.cbuf, sizeof(y.header.cbuf))) return false;
+            pos += sizeof(y.header.cbuf);
+            if (y.header.triple_sz > size - pos) return false;
+            if (y.header.offset > size || y.header.bundle_sz > size - y.header.offset) {
+                return false;
+            }
+            y.triple.resize(y.header.triple_sz);
+            if (!is.read(&y.triple[0], y.triple.size())) return false;
+            pos += y.header.triple_sz;
+            extent = std::max(extent, y.header.offset + y.header.bundle_sz);
+        }
+
+        for (auto&& y : bundles) {
+            #if !defined(DISABLE_REDUCED_GPU_BLOB_COPY)
+            auto& gpuArch = get_all_gpuarch();
+            if (gpuArch.find(y.triple) == gpuArch.end()) continue;
+            #endif
+            y.blob.resize(y.header.bundle_sz);
+            is.seekg(start + static_cast<std::streamoff>(y.header.offset));
+            if (!is.read(&y.blob[0], y.blob.size())) return false;
+        }
+        is.seekg(start + static_cast<std::streamoff>(std::max(pos, extent)));
+
+        x.header_ = h;
+        x.bundles_ = std::move(bundles);
+        x.bundled_code_size = std::max(pos, extent);
+
+        return true;
     }
     // FRIENDS - ACCESSORS
     friend inline bool valid(const Bundled_code_header& x) {
@@ -170,18 +211,11 @@ class Bundled_code_header {
         // hipLoadModuleData is so poorly specified (for no fault of its own).
         if (!maybe_blob) return;
 
-        if (!valid(*static_cast<const Bundled_code_header*>(maybe_blob))) return;
-        auto ph = static_cast<const Header_*>(maybe_blob);
-
-        size_t sz = sizeof(Header_) + ph->bundle_cnt_ * sizeof(Bundled_code::Header);
-        auto pb = static_cast<const char*>(maybe_blob) + sizeof(Header_);
-        auto n = ph->bundle_cnt_;
-        while (n--) {
-            sz += reinterpret_cast<const Bundled_code::Header*>(pb)->bundle_sz;
-            pb += sizeof(Bundled_code::Header);
-        }
+        const auto p = static_cast<const char*>(maybe_blob);
+        const Bundle_index index{p, Bundle_index::unknown_size};
+        if (!index.valid()) return;
 
-        read(static_cast<const char*>(maybe_blob), static_cast<const char*>(maybe_blob) + sz, *this);      
+        read(p, p + index.extent(), *this);
     }
     Bundled_code_header(const Bundled_code_header&) = default;
     Bundled_code_header(Bundled_code_header&&) = default;
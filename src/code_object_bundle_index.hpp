@@ -0,0 +1,211 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Read-only index over a clang offload bundle, shared by the HCC and ROCclr
+// runtimes. The index never copies: triples and code objects are returned as
+// views into the caller's buffer (typically a mapped file or ELF section),
+// which must outlive the index. Every header field is bounds checked against
+// the buffer size before use.
+//
+// Bundle layout:
+//   char     magic[24]            "__CLANG_OFFLOAD_BUNDLE__"
+//   uint64_t bundle_cnt
+//   bundle_cnt x { uint64_t offset, uint64_t size, uint64_t triple_sz,
+//                  char triple[triple_sz] }
+//   code objects, at offset from the start of the bundle
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace hip_impl {
+
+// Minimal non-owning view over bytes; the runtimes still build as C++11/14,
+// so std::string_view is not available.
+class Byte_view {
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+   public:
+    Byte_view() = default;
+    Byte_view(const char* data, std::size_t size) : data_{data}, size_{size} {}
+    Byte_view(const char* str) : data_{str}, size_{std::strlen(str)} {}
+    Byte_view(const std::string& str) : data_{str.data()}, size_{str.size()} {}
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+
+    bool starts_with(Byte_view x) const {
+        return size_ >= x.size_ && std::memcmp(data_, x.data_, x.size_) == 0;
+    }
+    Byte_view substr(std::size_t pos) const {
+        return pos >= size_ ? Byte_view{} : Byte_view{data_ + pos, size_ - pos};
+    }
+    std::string str() const { return std::string{data_, size_}; }
+
+    friend bool operator==(Byte_view x, Byte_view y) {
+        return x.size_ == y.size_ && std::memcmp(x.data_, y.data_, x.size_) == 0;
+    }
+    friend bool operator!=(Byte_view x, Byte_view y) { return !(x == y); }
+};
+
+struct Byte_view_hash {
+    std::size_t operator()(Byte_view x) const {
+        // FNV-1a, target names are a handful of short strings.
+        std::uint64_t h = 14695981039346656037ull;
+        for (char c : x) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ull;
+        }
+        return static_cast<std::size_t>(h);
+    }
+};
+
+class Bundle_index {
+   public:
+    static const char* magic() { return "__CLANG_OFFLOAD_BUNDLE__"; }
+    static constexpr std::size_t magic_sz = 24;
+    static constexpr std::size_t header_sz = magic_sz + sizeof(std::uint64_t);
+    static constexpr std::size_t entry_header_sz = 3 * sizeof(std::uint64_t);
+
+    struct Entry {
+        Byte_view triple;  // full offload triple, e.g. hip-amdgcn-amd-amdhsa-gfx906
+        Byte_view target;  // triple without the offload prefix, e.g. gfx906
+        Byte_view blob;    // code object
+    };
+
+    // Size to pass to parse() when the extent of the buffer is not known,
+    // e.g. a bundle handed to hipModuleLoadData. The header is then trusted.
+    static constexpr std::size_t unknown_size = std::numeric_limits<std::size_t>::max();
+
+    Bundle_index() = default;
+    Bundle_index(const void* data, std::size_t size) { parse(data, size); }
+
+    static bool is_bundle(const void* data, std::size_t size) {
+        return data && size >= header_sz && std::memcmp(data, magic(), magic_sz) == 0;
+    }
+
+    // Indexes the bundle at the start of [data, data + size). Returns false,
+    // leaving the index empty, if the buffer is not a well formed bundle.
+    bool parse(const void* data, std::size_t size) {
+        clear();
+        if (!is_bundle(data, size)) return false;
+
+        const char* base = static_cast<const char*>(data);
+        if (size == unknown_size) {
+            size = unknown_size - reinterpret_cast<std::uintptr_t>(base);
+        }
+
+        const std::uint64_t cnt = read_u64(base + magic_sz);
+        if (cnt > (size - header_sz) / entry_header_sz) return false;
+
+        entries_.reserve(cnt);
+        std::size_t pos = header_sz;
+        std::size_t extent = pos;
+        for (std::uint64_t i = 0; i != cnt; ++i) {
+            if (size - pos < entry_header_sz) return fail();
+            const std::uint64_t offset = read_u64(base + pos);
+            const std::uint64_t blob_sz = read_u64(base + pos + 8);
+            const std::uint64_t triple_sz = read_u64(base + pos + 16);
+            pos += entry_header_sz;
+
+            if (triple_sz > size - pos) return fail();
+            if (offset > size || blob_sz > size - offset) return fail();
+
+            Entry e;
+            e.triple = Byte_view{base + pos, static_cast<std::size_t>(triple_sz)};
+            e.target = target_of(e.triple);
+            e.blob = Byte_view{base + offset, static_cast<std::size_t>(blob_sz)};
+            pos += triple_sz;
+
+            if (offset + blob_sz > extent) extent = offset + blob_sz;
+            entries_.push_back(e);
+        }
+        extent_ = pos > extent ? pos : extent;
+
+        by_target_.reserve(entries_.size());
+        for (std::size_t i = 0; i != entries_.size(); ++i) {
+            // The first bundle for a target wins, as with a linear search.
+            if (!entries_[i].target.empty()) by_target_.emplace(entries_[i].target, i);
+        }
+        return true;
+    }
+
+    void clear() {
+        entries_.clear();
+        by_target_.clear();
+        extent_ = 0;
+    }
+
+    bool valid() const { return extent_ != 0; }
+    const std::vector<Entry>& entries() const { return entries_; }
+
+    // Bytes from the start of the bundle to the end of its last header or
+    // code object, i.e. where the next bundle of a concatenation starts.
+    std::size_t extent() const { return extent_; }
+
+    // O(1) lookup by target name (gfx906) as produced by target_of().
+    const Entry* find(Byte_view target) const {
+        const auto it = by_target_.find(target);
+        return it == by_target_.cend() ? nullptr : &entries_[it->second];
+    }
+
+    // Strips the HIP-Clang or HCC offload prefix from triple. Returns an empty
+    // view for triples that are not AMDGPU code objects (e.g. the host entry).
+    static Byte_view target_of(Byte_view triple) {
+        static const char* const prefixes[] = {
+            "hip-amdgcn-amd-amdhsa-",   // HIP-Clang
+            "hcc-amdgcn-amd-amdhsa--",  // HCC
+            "hcc-amdgcn--amdhsa-"       // HCC, old triple format
+        };
+        for (const char* p : prefixes) {
+            if (triple.starts_with(p)) return triple.substr(std::strlen(p));
+        }
+        return Byte_view{};
+    }
+
+   private:
+    static std::uint64_t read_u64(const char* p) {
+        std::uint64_t r;
+        std::memcpy(&r, p, sizeof(r));
+        return r;
+    }
+
+    bool fail() {
+        clear();
+        return false;
+    }
+
+    std::vector<Entry> entries_;
+    std::unordered_map<Byte_view, std::size_t, Byte_view_hash> by_target_;
+    std::size_t extent_ = 0;
+};
+}  // namespace hip_impl
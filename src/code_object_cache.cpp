@@ -0,0 +1,300 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "code_object_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hip_impl {
+
+namespace {
+
+const char entry_magic[8] = {'H', 'I', 'P', 'C', 'O', 'M', 'D', '1'};
+const char entry_suffix[] = ".hipco";
+
+inline std::uint64_t rotl(std::uint64_t x, unsigned r) { return (x << r) | (x >> (64 - r)); }
+
+inline std::uint64_t fmix(std::uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Two 64-bit lanes over 8-byte words, in the spirit of MurmurHash3.
+std::pair<std::uint64_t, std::uint64_t> hash128(const char* data, std::size_t size) {
+    std::uint64_t h1 = 0x9e3779b97f4a7c15ull ^ size;
+    std::uint64_t h2 = 0xc2b2ae3d27d4eb4full + size;
+
+    auto mix = [&](std::uint64_t w) {
+        h1 = rotl(h1 ^ (w * 0x87c37b91114253d5ull), 31) * 0x4cf5ad432745937full;
+        h2 = (rotl(h2 + (w * 0x52dce729ull), 33) * 0x9e3779b97f4a7c15ull) ^ h1;
+    };
+
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, data + i, sizeof(w));
+        mix(w);
+    }
+    if (i != size) {
+        std::uint64_t w = 0;
+        std::memcpy(&w, data + i, size - i);
+        mix(w);
+    }
+
+    h1 += h2;
+    h2 += h1;
+    return {fmix(h1), fmix(h2 ^ h1)};
+}
+
+template <typename T>
+void put(std::string& buf, const T& x) {
+    buf.append(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+void put(std::string& buf, const std::string& s) {
+    put(buf, static_cast<std::uint64_t>(s.size()));
+    buf += s;
+}
+
+class Reader {
+    const char* p_;
+    const char* end_;
+
+   public:
+    explicit Reader(const std::string& s) : p_{s.data()}, end_{s.data() + s.size()} {}
+
+    std::size_t left() const { return end_ - p_; }
+    bool at_end() const { return p_ == end_; }
+
+    template <typename T>
+    bool get(T& x) {
+        if (left() < sizeof(x)) return false;
+        std::memcpy(&x, p_, sizeof(x));
+        p_ += sizeof(x);
+        return true;
+    }
+
+    bool get(std::string& s) {
+        std::uint64_t n;
+        if (!get(n) || n > left()) return false;
+        s.assign(p_, n);
+        p_ += n;
+        return true;
+    }
+
+    // Element counts are bounded by what the remaining bytes could hold.
+    bool get_count(std::uint64_t& n, std::size_t min_element) {
+        return get(n) && n <= left() / min_element;
+    }
+};
+
+bool read_file(const std::string& path, std::string& out) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    bool ok = std::fseek(f, 0, SEEK_END) == 0;
+    const long size = ok ? std::ftell(f) : -1;
+    ok = ok && size >= 0 && std::fseek(f, 0, SEEK_SET) == 0;
+    if (ok) {
+        out.resize(size);
+        ok = std::fread(&out[0], 1, size, f) == std::size_t(size);
+    }
+    std::fclose(f);
+    return ok;
+}
+
+bool is_entry(const char* name) {
+    const std::size_t n = std::strlen(name);
+    const std::size_t s = sizeof(entry_suffix) - 1;
+    return n > s && std::strcmp(name + n - s, entry_suffix) == 0;
+}
+
+struct Entry_file {
+    std::string path;
+    struct timespec mtime;
+    std::uint64_t size;
+};
+
+std::vector<Entry_file> list_entries(const std::string& dir) {
+    std::vector<Entry_file> r;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return r;
+    while (dirent* e = readdir(d)) {
+        if (!is_entry(e->d_name)) continue;
+        Entry_file f;
+        f.path = dir + "/" + e->d_name;
+        struct stat st;
+        if (stat(f.path.c_str(), &st) != 0) continue;
+        f.mtime = st.st_mtim;
+        f.size = st.st_size;
+        r.push_back(std::move(f));
+    }
+    closedir(d);
+    return r;
+}
+
+}  // namespace
+
+std::string content_hash(const char* data, std::size_t size) {
+    const auto h = hash128(data, size);
+    char r[33];
+    std::snprintf(r, sizeof(r), "%016llx%016llx", static_cast<unsigned long long>(h.first),
+                  static_cast<unsigned long long>(h.second));
+    return r;
+}
+
+std::string Code_object_metadata::serialize() const {
+    std::string r;
+    put(r, static_cast<std::uint64_t>(kernargs.size()));
+    for (auto&& k : kernargs) {
+        put(r, k.first);
+        put(r, static_cast<std::uint64_t>(k.second.size()));
+        for (auto&& a : k.second) {
+            put(r, static_cast<std::uint64_t>(a.first));
+            put(r, static_cast<std::uint64_t>(a.second));
+        }
+    }
+    put(r, static_cast<std::uint64_t>(undefined_symbols.size()));
+    for (auto&& s : undefined_symbols) put(r, s);
+    return r;
+}
+
+bool Code_object_metadata::deserialize(const std::string& data) {
+    Reader r{data};
+    valid = true;
+    std::uint64_t n;
+
+    if (!r.get_count(n, 2 * sizeof(std::uint64_t))) return false;
+    kernargs.resize(n);
+    for (auto&& k : kernargs) {
+        std::uint64_t m;
+        if (!r.get(k.first) || !r.get_count(m, 2 * sizeof(std::uint64_t))) return false;
+        k.second.resize(m);
+        for (auto&& a : k.second) {
+            std::uint64_t size, align;
+            if (!r.get(size) || !r.get(align)) return false;
+            a = std::make_pair(std::size_t(size), std::size_t(align));
+        }
+    }
+
+    if (!r.get_count(n, sizeof(std::uint64_t))) return false;
+    undefined_symbols.resize(n);
+    for (auto&& s : undefined_symbols) {
+        if (!r.get(s)) return false;
+    }
+    return r.at_end();
+}
+
+Code_object_cache::Code_object_cache(std::string dir, std::uint64_t max_bytes)
+    : dir_{std::move(dir)}, max_bytes_{max_bytes}, bytes_{0}, hits_{0}, misses_{0} {
+    std::uint64_t total = 0;
+    for (auto&& e : list_entries(dir_)) total += e.size;
+    bytes_ = total;
+}
+
+std::string Code_object_cache::path_for(const std::string& key) const {
+    return dir_ + "/" + content_hash(key.data(), key.size()) + entry_suffix;
+}
+
+bool Code_object_cache::load(const std::string& key, std::string& value) {
+    const std::string path = path_for(key);
+
+    // Layout: magic, key, payload, payload hash.
+    std::string file;
+    std::string stored_key;
+    std::uint64_t h1, h2;
+    bool ok = read_file(path, file);
+    if (ok) {
+        Reader r{file};
+        char magic[sizeof(entry_magic)];
+        ok = r.get(magic) && std::memcmp(magic, entry_magic, sizeof(magic)) == 0 &&
+             r.get(stored_key) && stored_key == key && r.get(value) && r.get(h1) && r.get(h2) &&
+             r.at_end() && std::make_pair(h1, h2) == hash128(value.data(), value.size());
+    }
+
+    if (!ok) {
+        ++misses_;
+        return false;
+    }
+
+    // Mark as recently used for eviction.
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    ++hits_;
+    return true;
+}
+
+void Code_object_cache::store(const std::string& key, const std::string& value) {
+    std::string buf;
+    buf.append(entry_magic, sizeof(entry_magic));
+    put(buf, key);
+    put(buf, value);
+    const auto h = hash128(value.data(), value.size());
+    put(buf, h.first);
+    put(buf, h.second);
+
+    if (buf.size() > max_bytes_) return;
+
+    static std::atomic<unsigned> seq{0};
+    const std::string path = path_for(key);
+    const std::string tmp = path + "." + std::to_string(getpid()) + "." +
+        std::to_string(seq++) + ".tmp";
+
+    FILE* out = std::fopen(tmp.c_str(), "wb");
+    if (!out) return;
+    const bool ok = std::fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    if (std::fclose(out) != 0 || !ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return;
+    }
+
+    if ((bytes_ += buf.size()) > max_bytes_) evict(max_bytes_ - max_bytes_ / 4);
+}
+
+void Code_object_cache::evict(std::uint64_t target) {
+    std::vector<Entry_file> entries = list_entries(dir_);
+    std::sort(entries.begin(), entries.end(), [](const Entry_file& x, const Entry_file& y) {
+        return x.mtime.tv_sec != y.mtime.tv_sec ? x.mtime.tv_sec < y.mtime.tv_sec
+                                                : x.mtime.tv_nsec < y.mtime.tv_nsec;
+    });
+
+    std::uint64_t total = 0;
+    for (auto&& e : entries) total += e.size;
+
+    // Another process may remove the same entry first, which is harmless.
+    for (auto it = entries.begin(); it != entries.end() && total > target; ++it) {
+        std::remove(it->path.c_str());
+        total -= it->size;
+    }
+    bytes_ = total;
+}
+
+}  // namespace hip_impl
@@ -0,0 +1,94 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HIP_SRC_CODE_OBJECT_CACHE_H
+#define HIP_SRC_CODE_OBJECT_CACHE_H
+
+// Persistent cache of what the runtime parses out of each code object, so a
+// restarted process does not walk the same ELF notes and symbol tables again.
+//
+// Entries are keyed by a hash of the code object contents and live as one
+// file each in a cache directory shared between processes. Files are written
+// under a private name and renamed into place, so readers only ever see
+// complete entries, and each entry carries its key and a payload checksum.
+// Hits refresh the file's mtime; once the directory grows past its budget
+// the least recently used entries are removed.
+//
+// No HCC or HSA dependencies, so it can be unit tested on the host.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+// 128-bit hash of a byte range, as 32 hex digits.
+std::string content_hash(const char* data, std::size_t size);
+
+// Parsed metadata of one code object.
+struct Code_object_metadata {
+    // Kernel name to (size, alignment) of each argument, in order.
+    std::vector<std::pair<std::string, std::vector<std::pair<std::size_t, std::size_t>>>>
+        kernargs;
+    // Names of undefined dynamic symbols, i.e. globals the host must define.
+    std::vector<std::string> undefined_symbols;
+    // False if the code object could not be parsed; never stored on disk.
+    bool valid = true;
+
+    std::string serialize() const;
+    // Returns false, leaving *this unspecified, if data is malformed.
+    bool deserialize(const std::string& data);
+};
+
+class Code_object_cache {
+   public:
+    // dir must exist; max_bytes bounds the total size of all entries.
+    Code_object_cache(std::string dir, std::uint64_t max_bytes);
+
+    // Returns true and fills value if key has a valid entry.
+    bool load(const std::string& key, std::string& value);
+    void store(const std::string& key, const std::string& value);
+
+    // Removes least recently used entries until at most target bytes remain.
+    void evict(std::uint64_t target);
+
+    const std::string& dir() const { return dir_; }
+    std::uint64_t hits() const { return hits_; }
+    std::uint64_t misses() const { return misses_; }
+
+   private:
+    std::string path_for(const std::string& key) const;
+
+    const std::string dir_;
+    const std::uint64_t max_bytes_;
+    // Estimate of the directory size; other processes also add and evict.
+    std::atomic<std::uint64_t> bytes_;
+    std::atomic<std::uint64_t> hits_;
+    std::atomic<std::uint64_t> misses_;
+};
+
+}  // namespace hip_impl
+
+#endif  // HIP_SRC_CODE_OBJECT_CACHE_H
@@ -0,0 +1,226 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+// Stream capture and replay planning behind hipExtStreamBeginCapture and
+// hipExtGraphInstantiate, shared by the HCC and ROCclr runtimes. The runtimes
+// supply the node payload (prepared kernel dispatches, copies, event records);
+// this header only tracks how nodes depend on each other.
+//
+// While a stream captures, each command issued to it becomes a node that
+// depends on the previous node of the stream and on the nodes behind the
+// events the stream waited for. A stream that waits for an event recorded
+// during the capture joins it, which is how a capture forks into branches.
+// Nodes are kept in capture order, which is a topological order.
+//
+// Replay maps that order onto a few lanes (streams): a node continues the
+// lane of a dependency when it is still that lane's last node, so chains stay
+// on one lane, and independent branches open new lanes. Lanes only wait for
+// each other where a dependency crosses them.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+template <typename Node>
+struct Command_graph {
+    std::vector<Node> nodes;
+    // deps[i] are the nodes node i depends on, in ascending order. All of
+    // them were captured before node i.
+    std::vector<std::vector<std::uint32_t>> deps;
+};
+
+// Streams and events are only used as keys, so any handle type will do.
+template <typename Node>
+class Graph_capture {
+   public:
+    // origin is the stream the capture starts on, and has to end on.
+    explicit Graph_capture(const void* origin) : origin_{origin} { streams_[origin]; }
+
+    const void* origin() const { return origin_; }
+
+    // Appends node as the next command of stream and returns its index. If
+    // event is not null, the node records it: streams waiting for event from
+    // now on depend on the node.
+    std::uint32_t add(const void* stream, Node node, const void* event = nullptr) {
+        std::lock_guard<std::mutex> lck{mutex_};
+        Stream_state& s = streams_[stream];
+        std::vector<std::uint32_t> deps;
+        deps.swap(s.joins);
+        if (s.has_tail) deps.push_back(s.tail);
+        std::sort(deps.begin(), deps.end());
+        deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+
+        const std::uint32_t i = static_cast<std::uint32_t>(graph_.nodes.size());
+        graph_.nodes.push_back(std::move(node));
+        graph_.deps.push_back(std::move(deps));
+        s.tail = i;
+        s.has_tail = true;
+        if (event) events_[event] = i;
+        return i;
+    }
+
+    // Makes the next node of stream depend on the node that recorded event,
+    // adding stream to the capture if needed. Returns false, changing
+    // nothing, if event was not recorded during this capture.
+    bool wait(const void* stream, const void* event) {
+        std::lock_guard<std::mutex> lck{mutex_};
+        const auto it = events_.find(event);
+        if (it == events_.cend()) return false;
+        streams_[stream].joins.push_back(it->second);
+        return true;
+    }
+
+    bool recorded(const void* event) const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return events_.count(event) != 0;
+    }
+
+    // Streams that took part in the capture, origin included.
+    std::vector<const void*> streams() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        std::vector<const void*> r;
+        r.reserve(streams_.size());
+        for (auto& s : streams_) r.push_back(s.first);
+        return r;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return graph_.nodes.size();
+    }
+
+    // Marks the capture as failed, by an operation the graph can't record.
+    // Ending it then yields no graph.
+    void invalidate() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        invalid_ = true;
+    }
+
+    bool valid() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return !invalid_;
+    }
+
+    // Removes stream, which is going away, from the capture. Its nodes and
+    // the events they recorded stay in the graph.
+    void leave(const void* stream) {
+        std::lock_guard<std::mutex> lck{mutex_};
+        streams_.erase(stream);
+    }
+
+    // Ends the capture and hands out the graph.
+    Command_graph<Node> finish() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        Command_graph<Node> r = std::move(graph_);
+        graph_ = Command_graph<Node>{};
+        streams_.clear();
+        events_.clear();
+        return r;
+    }
+
+   private:
+    struct Stream_state {
+        bool has_tail = false;
+        std::uint32_t tail = 0;             // last node captured on the stream
+        std::vector<std::uint32_t> joins;   // events waited for since then
+    };
+
+    const void* const origin_;
+    mutable std::mutex mutex_;
+    bool invalid_ = false;
+    Command_graph<Node> graph_;
+    std::unordered_map<const void*, Stream_state> streams_;
+    std::unordered_map<const void*, std::uint32_t> events_;
+};
+
+struct Lane_plan {
+    // Upper bound on lanes, whatever the caller asks for.
+    enum : unsigned { lane_limit = 8 };
+
+    unsigned lanes = 0;
+    std::vector<unsigned> lane;                     // lane of each node
+    std::vector<std::vector<std::uint32_t>> waits;  // nodes on other lanes to wait for first
+    std::vector<bool> signals;                      // another lane waits for the node
+};
+
+// Assigns the nodes of a graph with dependencies deps to at most max_lanes
+// lanes. Lane 0 is the stream the graph is launched on.
+inline Lane_plan plan_lanes(const std::vector<std::vector<std::uint32_t>>& deps,
+                            unsigned max_lanes) {
+    Lane_plan p;
+    const std::size_t n = deps.size();
+    p.lane.resize(n);
+    p.waits.resize(n);
+    p.signals.resize(n);
+    max_lanes = std::max(1u, std::min<unsigned>(max_lanes, Lane_plan::lane_limit));
+
+    std::vector<std::uint32_t> tail;  // last node of each lane
+    // seen[l][m] is one past the last node of lane m that lane l waited for.
+    std::vector<std::vector<std::uint32_t>> seen(max_lanes,
+                                                 std::vector<std::uint32_t>(max_lanes));
+
+    for (std::uint32_t i = 0; i != n; ++i) {
+        // Continue the lane of the latest dependency that ends its lane.
+        unsigned l = max_lanes;
+        for (auto d = deps[i].crbegin(); d != deps[i].crend(); ++d) {
+            if (tail[p.lane[*d]] == *d) {
+                l = p.lane[*d];
+                break;
+            }
+        }
+        if (l == max_lanes) {
+            if (tail.size() < max_lanes) {
+                l = static_cast<unsigned>(tail.size());
+                tail.push_back(i);
+            } else {
+                // The lane that went longest without new work is the most
+                // likely to be idle.
+                l = static_cast<unsigned>(std::min_element(tail.cbegin(), tail.cend()) -
+                                          tail.cbegin());
+            }
+        }
+
+        // Waiting for the latest dependency on a lane covers the earlier ones.
+        for (auto d = deps[i].crbegin(); d != deps[i].crend(); ++d) {
+            const unsigned m = p.lane[*d];
+            if (m == l || seen[l][m] > *d) continue;
+            seen[l][m] = *d + 1;
+            p.waits[i].push_back(*d);
+            p.signals[*d] = true;
+        }
+
+        p.lane[i] = l;
+        tail[l] = i;
+    }
+    p.lanes = static_cast<unsigned>(tail.size());
+    return p;
+}
+}  // namespace hip_impl
@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "elf_scan.h"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hip_impl {
+
+namespace {
+
+// Whole file mapped read-only. Pages are only read when touched, so looking
+// at a few sections of a large library costs a few page faults.
+class File_map {
+    void* base_ = MAP_FAILED;
+    std::size_t size_ = 0;
+
+   public:
+    explicit File_map(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            size_ = st.st_size;
+            base_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+    }
+    ~File_map() {
+        if (base_ != MAP_FAILED) munmap(base_, size_);
+    }
+    File_map(const File_map&) = delete;
+    File_map& operator=(const File_map&) = delete;
+
+    bool valid() const { return base_ != MAP_FAILED; }
+    const char* data() const { return static_cast<const char*>(base_); }
+    std::size_t size() const { return size_; }
+};
+
+bool in_bounds(std::uint64_t offset, std::uint64_t size, std::size_t limit) {
+    return offset <= limit && size <= limit - offset;
+}
+
+// True if the string of at most max bytes at name, which need not be
+// terminated within them, is exactly want.
+bool is_named(const char* name, std::size_t max, const char* want) {
+    const std::size_t n = std::strlen(want);
+    return n < max && std::memcmp(name, want, n + 1) == 0;
+}
+
+// Section entry i, or nullptr if the table is out of bounds.
+const Elf64_Shdr* section(const File_map& f, const Elf64_Ehdr& eh, std::size_t i) {
+    if (i >= eh.e_shnum) return nullptr;
+    return reinterpret_cast<const Elf64_Shdr*>(f.data() + eh.e_shoff + i * eh.e_shentsize);
+}
+
+void read_symbols(const File_map& f, const Elf64_Ehdr& eh, const Elf64_Shdr& symtab, Elf_scan& out) {
+    const Elf64_Shdr* strtab = section(f, eh, symtab.sh_link);
+    if (!strtab || !in_bounds(strtab->sh_offset, strtab->sh_size, f.size())) return;
+    if (!in_bounds(symtab.sh_offset, symtab.sh_size, f.size())) return;
+
+    const char* strs = f.data() + strtab->sh_offset;
+    const std::size_t n = symtab.sh_size / sizeof(Elf64_Sym);
+    for (std::size_t i = 0; i != n; ++i) {
+        Elf64_Sym sym;
+        std::memcpy(&sym, f.data() + symtab.sh_offset + i * sizeof(Elf64_Sym), sizeof(sym));
+
+        const unsigned type = ELF64_ST_TYPE(sym.st_info);
+        if (type != STT_OBJECT && type != STT_FUNC) continue;
+        if (sym.st_shndx == SHN_UNDEF || sym.st_name >= strtab->sh_size) continue;
+
+        const char* name = strs + sym.st_name;
+        const std::size_t len = strnlen(name, strtab->sh_size - sym.st_name);
+        if (len == 0) continue;
+
+        Elf_symbol s;
+        s.name.assign(name, len);
+        s.value = sym.st_value;
+        s.size = sym.st_size;
+        (type == STT_OBJECT ? out.objects : out.functions).push_back(std::move(s));
+    }
+}
+
+// Persistent cache -------------------------------------------------------------------------------
+
+struct Cache_key {
+    std::uint64_t dev;
+    std::uint64_t ino;
+    std::int64_t mtime_sec;
+    std::int64_t mtime_nsec;
+    std::uint64_t size;
+};
+
+const char cache_magic[8] = {'H', 'I', 'P', 'E', 'L', 'F', 'C', '1'};
+
+bool cache_key_for(const std::string& path, Cache_key& key) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    key.size = st.st_size;
+    return true;
+}
+
+std::string cache_file_for(const std::string& cache_dir, const std::string& path,
+                           const Cache_key& key) {
+    // FNV-1a over the path and key; the key is verified again on read, a
+    // collision only costs a rescan.
+    std::uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const void* p, std::size_t n) {
+        for (std::size_t i = 0; i != n; ++i) {
+            h ^= static_cast<const unsigned char*>(p)[i];
+            h *= 1099511628211ull;
+        }
+    };
+    mix(path.data(), path.size());
+    mix(&key, sizeof(key));
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "/%016llx.elfscan", static_cast<unsigned long long>(h));
+    return cache_dir + name;
+}
+
+template <typename T>
+void put(std::string& buf, const T& x) {
+    buf.append(reinterpret_cast<const char*>(&x), sizeof(x));
+}
+
+void put_symbols(std::string& buf, const std::vector<Elf_symbol>& syms) {
+    put(buf, static_cast<std::uint64_t>(syms.size()));
+    for (auto&& s : syms) {
+        put(buf, static_cast<std::uint64_t>(s.name.size()));
+        buf += s.name;
+        put(buf, s.value);
+        put(buf, s.size);
+    }
+}
+
+class Reader {
+    const char* p_;
+    const char* end_;
+
+   public:
+    Reader(const char* p, std::size_t n) : p_{p}, end_{p + n} {}
+
+    template <typename T>
+    bool get(T& x) {
+        if (std::size_t(end_ - p_) < sizeof(x)) return false;
+        std::memcpy(&x, p_, sizeof(x));
+        p_ += sizeof(x);
+        return true;
+    }
+
+    bool get_symbols(std::vector<Elf_symbol>& syms) {
+        std::uint64_t n;
+        if (!get(n)) return false;
+        // Each symbol takes at least 24 bytes, reject counts the file can't hold.
+        if (n > std::size_t(end_ - p_) / 24) return false;
+        syms.resize(n);
+        for (auto&& s : syms) {
+            std::uint64_t len;
+            if (!get(len) || len > std::size_t(end_ - p_)) return false;
+            s.name.assign(p_, len);
+            p_ += len;
+            if (!get(s.value) || !get(s.size)) return false;
+        }
+        return true;
+    }
+
+    bool at_end() const { return p_ == end_; }
+};
+
+bool load_cached(const std::string& file, const Cache_key& key, Elf_scan& out) {
+    File_map f{file};
+    if (!f.valid()) return false;
+
+    Reader r{f.data(), f.size()};
+    char magic[sizeof(cache_magic)];
+    Cache_key stored;
+    if (!r.get(magic) || std::memcmp(magic, cache_magic, sizeof(magic)) != 0) return false;
+    if (!r.get(stored) || std::memcmp(&stored, &key, sizeof(key)) != 0) return false;
+    if (!r.get(out.kernel_offset) || !r.get(out.kernel_size)) return false;
+    return r.get_symbols(out.objects) && r.get_symbols(out.functions) && r.at_end();
+}
+
+void store_cached(const std::string& file, const Cache_key& key, const Elf_scan& scan) {
+    std::string buf;
+    buf.append(cache_magic, sizeof(cache_magic));
+    put(buf, key);
+    put(buf, scan.kernel_offset);
+    put(buf, scan.kernel_size);
+    put_symbols(buf, scan.objects);
+    put_symbols(buf, scan.functions);
+
+    // Write to a private name and rename, so concurrent processes never see
+    // a partial entry.
+    const std::string tmp = file + "." + std::to_string(getpid()) + ".tmp";
+    FILE* out = std::fopen(tmp.c_str(), "wb");
+    if (!out) return;
+    const bool ok = std::fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    if (std::fclose(out) != 0 || !ok || std::rename(tmp.c_str(), file.c_str()) != 0) {
+        std::remove(tmp.c_str());
+    }
+}
+
+}  // namespace
+
+bool scan_elf_file(const std::string& path, Elf_scan& out) {
+    File_map f{path};
+    if (!f.valid() || f.size() < sizeof(Elf64_Ehdr)) return false;
+
+    Elf64_Ehdr eh;
+    std::memcpy(&eh, f.data(), sizeof(eh));
+    if (std::memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh.e_ident[EI_DATA] != ELFDATA2LSB) {
+        return false;
+    }
+    if (eh.e_shentsize != sizeof(Elf64_Shdr) ||
+        !in_bounds(eh.e_shoff, std::uint64_t(eh.e_shnum) * eh.e_shentsize, f.size())) {
+        return false;
+    }
+
+    const Elf64_Shdr* names = section(f, eh, eh.e_shstrndx);
+    const bool have_names = names && in_bounds(names->sh_offset, names->sh_size, f.size());
+
+    for (std::size_t i = 0; i != eh.e_shnum; ++i) {
+        const Elf64_Shdr* sh = section(f, eh, i);
+        if (sh->sh_type == SHT_SYMTAB) {
+            read_symbols(f, eh, *sh, out);
+        } else if (have_names && sh->sh_name < names->sh_size && sh->sh_type != SHT_NOBITS &&
+                   is_named(f.data() + names->sh_offset + sh->sh_name,
+                            names->sh_size - sh->sh_name, ".kernel") &&
+                   in_bounds(sh->sh_offset, sh->sh_size, f.size())) {
+            out.kernel_offset = sh->sh_offset;
+            out.kernel_size = sh->sh_size;
+        }
+    }
+    return true;
+}
+
+std::vector<Elf_scan> scan_loaded_elfs(const std::string& cache_dir) {
+    std::vector<Elf_scan> r;
+
+    // Only collect names under the loader lock, scanning happens after.
+    dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
+        Elf_scan s;
+        s.path = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
+            info->dlpi_name : "/proc/self/exe";
+        s.load_bias = info->dlpi_addr;
+        static_cast<std::vector<Elf_scan>*>(p)->push_back(std::move(s));
+        return 0;
+    }, &r);
+
+    std::vector<Elf_scan> scanned;
+    scanned.reserve(r.size());
+    for (auto&& s : r) {
+        Cache_key key;
+        std::string file;
+        if (!cache_dir.empty() && cache_key_for(s.path, key)) {
+            file = cache_file_for(cache_dir, s.path, key);
+            if (load_cached(file, key, s)) {
+                scanned.push_back(std::move(s));
+                continue;
+            }
+            s.objects.clear();
+            s.functions.clear();
+            s.kernel_offset = s.kernel_size = 0;
+        }
+
+        if (!scan_elf_file(s.path, s)) continue;
+        if (!file.empty()) store_cached(file, key, s);
+        scanned.push_back(std::move(s));
+    }
+    return scanned;
+}
+
+Mapped_file_range::Mapped_file_range(const std::string& path, std::uint64_t offset,
+                                     std::uint64_t size) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    const std::uint64_t page = sysconf(_SC_PAGESIZE);
+    const std::uint64_t aligned = offset - offset % page;
+    void* p = mmap(nullptr, size + (offset - aligned), PROT_READ, MAP_PRIVATE, fd, aligned);
+    close(fd);
+    if (p == MAP_FAILED) return;
+
+    base_ = p;
+    mapped_ = size + (offset - aligned);
+    data_ = static_cast<const char*>(p) + (offset - aligned);
+    size_ = size;
+}
+
+Mapped_file_range::~Mapped_file_range() {
+    if (base_) munmap(base_, mapped_);
+}
+
+}  // namespace hip_impl
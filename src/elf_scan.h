@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HIP_SRC_ELF_SCAN_H
+#define HIP_SRC_ELF_SCAN_H
+
+// Single pass over the ELF objects loaded in the process, collecting what
+// program_state needs at startup: the .kernel section holding the offload
+// bundles, and the defined object and function symbols from SHT_SYMTAB.
+//
+// Each object is mapped once and only its section headers, .kernel and the
+// symbol/string tables are touched. With a cache directory, the result for
+// each object is stored keyed by (path, device, inode, mtime, size), so
+// unchanged libraries are not parsed again on later runs.
+//
+// No HCC or HSA dependencies, so it can be unit tested on the host.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hip_impl {
+
+struct Elf_symbol {
+    std::string name;
+    std::uint64_t value = 0;  // not relocated, add Elf_scan::load_bias
+    std::uint64_t size = 0;
+};
+
+struct Elf_scan {
+    std::string path;               // file that was scanned
+    std::uintptr_t load_bias = 0;   // dlpi_addr of the loaded object
+    std::vector<Elf_symbol> objects;    // defined STT_OBJECT symbols
+    std::vector<Elf_symbol> functions;  // defined STT_FUNC symbols
+    std::uint64_t kernel_offset = 0;    // file range of .kernel, if any
+    std::uint64_t kernel_size = 0;
+};
+
+// Scans the ELF file at path. Returns false if it is not a readable 64-bit
+// little endian ELF file; a file without .kernel or SHT_SYMTAB is valid.
+bool scan_elf_file(const std::string& path, Elf_scan& out);
+
+// Scans every object reported by dl_iterate_phdr, "/proc/self/exe" standing
+// in for the main program. cache_dir may be empty to disable the cache.
+std::vector<Elf_scan> scan_loaded_elfs(const std::string& cache_dir);
+
+// Read-only mapping of a byte range of a file, e.g. the .kernel section.
+class Mapped_file_range {
+    void* base_ = nullptr;
+    std::size_t mapped_ = 0;
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+   public:
+    Mapped_file_range(const std::string& path, std::uint64_t offset, std::uint64_t size);
+    ~Mapped_file_range();
+    Mapped_file_range(const Mapped_file_range&) = delete;
+    Mapped_file_range& operator=(const Mapped_file_range&) = delete;
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+};
+
+}  // namespace hip_impl
+
+#endif  // HIP_SRC_ELF_SCAN_H
@@ -0,0 +1,154 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "hip/hip_runtime_api.h"
+
+// Kept in its own translation unit so host-only tools such as hiptracedecode
+// can print error names without pulling in the runtime.
+const char* ihipErrorString(hipError_t hip_error) {
+    switch (hip_error) {
+        case hipSuccess:
+            return "hipSuccess";
+        case hipErrorOutOfMemory:
+            return "hipErrorOutOfMemory";
+        case hipErrorNotInitialized:
+            return "hipErrorNotInitialized";
+        case hipErrorDeinitialized:
+            return "hipErrorDeinitialized";
+        case hipErrorProfilerDisabled:
+            return "hipErrorProfilerDisabled";
+        case hipErrorProfilerNotInitialized:
+            return "hipErrorProfilerNotInitialized";
+        case hipErrorProfilerAlreadyStarted:
+            return "hipErrorProfilerAlreadyStarted";
+        case hipErrorProfilerAlreadyStopped:
+            return "hipErrorProfilerAlreadyStopped";
+         case hipErrorInsufficientDriver:
+            return "hipErrorInsufficientDriver";
+        case hipErrorInvalidImage:
+            return "hipErrorInvalidImage";
+        case hipErrorInvalidContext:
+            return "hipErrorInvalidContext";
+        case hipErrorContextAlreadyCurrent:
+            return "hipErrorContextAlreadyCurrent";
+        case hipErrorMapFailed:
+            return "hipErrorMapFailed";
+        case hipErrorUnmapFailed:
+            return "hipErrorUnmapFailed";
+        case hipErrorArrayIsMapped:
+            return "hipErrorArrayIsMapped";
+        case hipErrorAlreadyMapped:
+            return "hipErrorAlreadyMapped";
+        case hipErrorNoBinaryForGpu:
+            return "hipErrorNoBinaryForGpu";
+        case hipErrorAlreadyAcquired:
+            return "hipErrorAlreadyAcquired";
+        case hipErrorNotMapped:
+            return "hipErrorNotMapped";
+        case hipErrorNotMappedAsArray:
+            return "hipErrorNotMappedAsArray";
+        case hipErrorNotMappedAsPointer:
+            return "hipErrorNotMappedAsPointer";
+        case hipErrorECCNotCorrectable:
+            return "hipErrorECCNotCorrectable";
+        case hipErrorUnsupportedLimit:
+            return "hipErrorUnsupportedLimit";
+        case hipErrorContextAlreadyInUse:
+            return "hipErrorContextAlreadyInUse";
+        case hipErrorPeerAccessUnsupported:
+            return "hipErrorPeerAccessUnsupported";
+        case hipErrorInvalidKernelFile:
+            return "hipErrorInvalidKernelFile";
+        case hipErrorInvalidGraphicsContext:
+            return "hipErrorInvalidGraphicsContext";
+        case hipErrorInvalidSource:
+            return "hipErrorInvalidSource";
+        case hipErrorFileNotFound:
+            return "hipErrorFileNotFound";
+        case hipErrorSharedObjectSymbolNotFound:
+            return "hipErrorSharedObjectSymbolNotFound";
+        case hipErrorSharedObjectInitFailed:
+            return "hipErrorSharedObjectInitFailed";
+        case hipErrorOperatingSystem:
+            return "hipErrorOperatingSystem";
+        case hipErrorSetOnActiveProcess:
+            return "hipErrorSetOnActiveProcess";
+        case hipErrorInvalidHandle:
+            return "hipErrorInvalidHandle";
+        case hipErrorNotFound:
+            return "hipErrorNotFound";
+        case hipErrorIllegalAddress:
+            return "hipErrorIllegalAddress";
+        case hipErrorInvalidSymbol:
+            return "hipErrorInvalidSymbol";
+        case hipErrorMissingConfiguration:
+            return "hipErrorMissingConfiguration";
+        case hipErrorLaunchFailure:
+            return "hipErrorLaunchFailure";
+        case hipErrorCooperativeLaunchTooLarge:
+            return "hipErrorCooperativeLaunchTooLarge";
+        case hipErrorPriorLaunchFailure:
+            return "hipErrorPriorLaunchFailure";
+        case hipErrorLaunchTimeOut:
+            return "hipErrorLaunchTimeOut";
+        case hipErrorLaunchOutOfResources:
+            return "hipErrorLaunchOutOfResources";
+        case hipErrorInvalidDeviceFunction:
+            return "hipErrorInvalidDeviceFunction";
+        case hipErrorInvalidConfiguration:
+            return "hipErrorInvalidConfiguration";
+        case hipErrorInvalidDevice:
+            return "hipErrorInvalidDevice";
+        case hipErrorInvalidValue:
+            return "hipErrorInvalidValue";
+        case hipErrorInvalidDevicePointer:
+            return "hipErrorInvalidDevicePointer";
+        case hipErrorInvalidMemcpyDirection:
+            return "hipErrorInvalidMemcpyDirection";
+        case hipErrorUnknown:
+            return "hipErrorUnknown";
+        case hipErrorNotReady:
+            return "hipErrorNotReady";
+        case hipErrorNoDevice:
+            return "hipErrorNoDevice";
+        case hipErrorPeerAccessAlreadyEnabled:
+            return "hipErrorPeerAccessAlreadyEnabled";
+        case hipErrorPeerAccessNotEnabled:
+            return "hipErrorPeerAccessNotEnabled";
+        case hipErrorRuntimeMemory:
+            return "hipErrorRuntimeMemory";
+        case hipErrorRuntimeOther:
+            return "hipErrorRuntimeOther";
+        case hipErrorHostMemoryAlreadyRegistered:
+            return "hipErrorHostMemoryAlreadyRegistered";
+        case hipErrorHostMemoryNotRegistered:
+            return "hipErrorHostMemoryNotRegistered";
+        case hipErrorAssert:
+            return "hipErrorAssert";
+        case hipErrorNotSupported:
+            return "hipErrorNotSupported";
+        case hipErrorTbd:
+            return "hipErrorTbd";
+        default:
+            return "hipErrorUnknown";
+    };
+};
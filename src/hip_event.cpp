@@ -98,7 +98,9 @@ namespace {
 //---
 
 
-ihipEvent_t::ihipEvent_t(unsigned flags) : _criticalData(this) {
+ihipEvent_t::ihipEvent_t(unsigned flags)
+    : _criticalData(this),
+      _waiter(uint64_t(HIP_WAIT_SPIN_US > 0 ? HIP_WAIT_SPIN_US : 0) * 1000) {
         _flags = flags;
         GET_TLS();
         auto ctx = ihipGetTlsDefaultCtx();
@@ -182,12 +184,14 @@ hipError_t ihipEventCreate(hipEvent_t* event, unsigned flags) {
 
     unsigned supportedFlags = hipEventDefault | hipEventBlockingSync | hipEventDisableTiming |
                               hipEventReleaseToDevice | hipEventReleaseToSystem |
-                              hipEventInterprocess;
+                              hipEventInterprocess | hipEventTimingOnly;
     const unsigned releaseFlags = (hipEventReleaseToDevice | hipEventReleaseToSystem);
 
     const bool illegalFlags =
         (flags & ~supportedFlags) ||             // can't set any unsupported flags.
-        (flags & releaseFlags) == releaseFlags;  // can't set both release flags
+        (flags & releaseFlags) == releaseFlags || // can't set both release flags
+        ((flags & hipEventTimingOnly) &&         // timing-only events are neither untimed nor IPC
+         (flags & (hipEventDisableTiming | hipEventInterprocess)));
 
     if (event && !illegalFlags) {
         *event = new ihipEvent_t(flags);
@@ -213,6 +217,7 @@ hipError_t hipEventCreate(hipEvent_t* event) {
 hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipEventRecord, TRACE_SYNC, event, stream);
     if (!event) return ihipLogStatus(hipErrorInvalidHandle);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureEventRecord(stream, event));
     stream = ihipSyncAndResolveStream(stream);
     LockedAccessor_EventCrit_t eCrit(event->criticalData());
     auto &ecd{eCrit->_eventData};
@@ -231,6 +236,7 @@ hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream) {
     else {
         // Record the event in the stream:
         ecd.marker(stream->locked_recordEvent(event));
+        ecd._type = hipEventTypeIndependent;
         ecd._stream = stream;
         ecd._timestamp = 0;
         ecd._state = hipEventStatusRecording;
@@ -335,8 +341,18 @@ hipError_t hipEventSynchronize(hipEvent_t event) {
         ctx->locked_syncDefaultStream(true, true);
         return ihipLogStatus(hipSuccess);
     } else {
-        ecd.marker().wait((event->_flags & hipEventBlockingSync) ? hc::hcWaitModeBlocked
-                                                                 : hc::hcWaitModeActive);
+        // The recording stream may be gone, take the schedule flags of the event's device.
+        ihipCtx_t* ctx = event->_deviceId < 0 ? ihipGetTlsDefaultCtx()
+                                               : ihipGetPrimaryCtx(event->_deviceId);
+        hc::completion_future& marker = ecd.marker();
+        event->waiter().wait(
+            (event->_flags & hipEventBlockingSync)
+                ? hip_impl::Wait_policy::blocked
+                : ihipWaitPolicy(ihipScheduleMode(ctx ? ctx->_ctxFlags : hipDeviceScheduleAuto)),
+            [&marker]() { return marker.is_ready(); },
+            [&marker](bool blocking) {
+                marker.wait(blocking ? hc::hcWaitModeBlocked : hc::hcWaitModeActive);
+            });
         return ihipLogStatus(hipSuccess);
     }
 }
@@ -427,6 +443,61 @@ hipError_t hipEventQuery(hipEvent_t event) {
     return ihipLogStatus(hipSuccess);
 }
 
+hipError_t hipExtGetMarkerReuseStats(int device, uint64_t* reused, uint64_t* created) {
+    HIP_INIT_API(hipExtGetMarkerReuseStats, device, reused, created);
+
+    if (reused == nullptr || created == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    if (device < 0 || static_cast<unsigned>(device) >= g_deviceCnt) {
+        return ihipLogStatus(hipErrorInvalidDevice);
+    }
+
+    ihipDevice_t* d = ihipGetDevice(device);
+    *reused = d->_markerHits.load(std::memory_order_relaxed);
+    *created = d->_markerMisses.load(std::memory_order_relaxed);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipExtEventGetTimestamps(uint64_t* timestamps, const hipEvent_t* events, size_t count) {
+    HIP_INIT_API(hipExtEventGetTimestamps, timestamps, events, count);
+
+    if (count == 0) return ihipLogStatus(hipSuccess);
+    if (timestamps == nullptr || events == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    uint64_t freqHz = 0;
+    hsa_system_get_info(HSA_SYSTEM_INFO_TIMESTAMP_FREQUENCY, &freqHz);
+    if (freqHz == 0) return ihipLogStatus(hipErrorInvalidValue);
+
+    hipError_t e = hipSuccess;
+    for (size_t i = 0; i != count; ++i) {
+        timestamps[i] = 0;
+        hipEvent_t event = events[i];
+        if (event == nullptr || (event->_flags & hipEventDisableTiming)) {
+            return ihipLogStatus(hipErrorInvalidHandle);
+        }
+
+        // Complete the event in place, so later reads skip the marker.
+        std::pair<hipEventStatus_t, uint64_t> status;
+        {
+            LockedAccessor_EventCrit_t crit(event->criticalData());
+            auto& ecd = crit->_eventData;
+            if (ecd._state == hipEventStatusUnitialized || ecd._state == hipEventStatusCreated) {
+                return ihipLogStatus(hipErrorInvalidHandle);
+            }
+            status = refreshEventStatus(ecd);
+        }
+
+        if (status.first != hipEventStatusComplete) {
+            e = hipErrorNotReady;
+            continue;
+        }
+        const uint64_t ticks = status.second;
+        timestamps[i] = (ticks / freqHz) * 1000000000ull + (ticks % freqHz) * 1000000000ull / freqHz;
+    }
+
+    return ihipLogStatus(e);
+}
+
 hipError_t hipIpcGetEventHandle(hipIpcEventHandle_t* handle, hipEvent_t event)
 {
     HIP_INIT_API(hipIpcGetEventHandle, handle, event);
@@ -0,0 +1,535 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "hip/hip_runtime.h"
+#include "hip_hcc_internal.h"
+#include "trace_helper.h"
+#include "command_graph.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+extern const std::string& FunctionSymbol(const hipFunction_t f);
+
+//-------------------------------------------------------------------------------------------------
+//-------------------------------------------------------------------------------------------------
+// Stream capture and graph replay
+//
+// Kernel nodes keep the dispatch packet and kernel arguments prepared when
+// they were captured, so replaying one only sets the packet fences and writes
+// it to the queue. Runs of kernels on a lane are dispatched under one stream
+// lock. Memsets are captured as the kernels that implement them.
+
+struct ihipGraphNode_t {
+    enum Type { Kernel, Memcpy, EventRecord, EventWait };
+    Type type;
+
+    // Kernel
+    hipFunction_t function;
+    dim3 globalWorkSize;
+    dim3 blockDim;
+    size_t sharedMemBytes;
+    hsa_kernel_dispatch_packet_t aql;  // without fences, which depend on the stream
+    std::vector<char> kernargs;
+
+    // Memcpy
+    void* dst;
+    const void* src;
+    size_t sizeBytes;
+    hipMemcpyKind kind;
+
+    // EventRecord, EventWait
+    hipEvent_t event;
+};
+
+struct ihipGraph_t {
+    ihipGraph_t(hipStream_t origin) : capture{origin} {}
+
+    hip_impl::Graph_capture<ihipGraphNode_t> capture;
+    hip_impl::Command_graph<ihipGraphNode_t> graph;  // set once the capture ends
+};
+
+struct ihipGraphExec_t {
+    std::mutex mutex;  // serializes launches and parameter updates
+    ihipCtx_t* ctx;
+    std::vector<ihipGraphNode_t> nodes;
+    hip_impl::Lane_plan plan;
+    // Streams of the lanes. Lane 0 is the launch stream, set by each launch;
+    // the graph owns the others, so no other work shares them.
+    std::vector<ihipStream_t*> lanes;
+    // Completion of the nodes other lanes wait for, from the last launch.
+    std::vector<hc::completion_future> signals;
+};
+
+namespace {
+
+// Captures in progress, searched by waits of streams that are not capturing
+// yet. Also guards starting, joining and ending captures.
+std::mutex g_capturesMutex;
+std::vector<ihipGraph_t*> g_captures;
+std::atomic<size_t> g_captureCount{0};
+
+hipError_t ihipCaptureNode(hipStream_t stream, ihipGraphNode_t node, hipEvent_t event = nullptr) {
+    ihipGraph_t* graph = stream->capture();
+    if (!graph) return hipErrorInvalidValue;  // the capture ended meanwhile
+    graph->capture.add(stream, std::move(node), event);
+    return hipSuccess;
+}
+
+hc::completion_future ihipStreamMarker(ihipStream_t* stream) {
+    LockedAccessor_StreamCrit_t crit(stream->criticalData());
+    return crit->marker();
+}
+
+void ihipStreamWaitFor(ihipStream_t* stream, const hc::completion_future& cf) {
+    LockedAccessor_StreamCrit_t crit(stream->criticalData());
+    crit->_av.create_blocking_marker(cf, hc::accelerator_scope);
+}
+
+// Dispatches nodes [first, last), kernels of one lane, under one stream lock.
+void ihipReplayKernels(ihipGraphExec_t* exec, size_t first, size_t last, ihipStream_t* stream) {
+    const ihipGraphNode_t& head = exec->nodes[first];
+    grid_launch_parm lp;
+    lp.dynamic_group_mem_bytes = head.sharedMemBytes;
+    stream = ihipPreLaunchKernel(stream,
+                                 dim3(head.globalWorkSize.x / head.blockDim.x,
+                                      head.globalWorkSize.y / head.blockDim.y,
+                                      head.globalWorkSize.z / head.blockDim.z),
+                                 head.blockDim, &lp, FunctionSymbol(head.function).c_str(), false);
+#if (__hcc_workweek__ >= 19213)
+    lp.av->acquire_locked_hsa_queue();
+#endif
+
+    auto& streamCrit = stream->criticalData();
+    const bool trackDispatch = streamCrit._timedDispatches;
+    hc::completion_future cf;
+    for (size_t i = first; i != last; ++i) {
+        const ihipGraphNode_t& node = exec->nodes[i];
+        hsa_kernel_dispatch_packet_t aql = node.aql;
+        aql.header |= lp.launch_fence;
+        lp.av->dispatch_hsa_kernel(&aql, node.kernargs.data(), node.kernargs.size(),
+                                   (trackDispatch && i + 1 == last) ? &cf : nullptr
+#if (__hcc_workweek__ > 17312)
+                                   ,
+                                   FunctionSymbol(node.function).c_str()
+#endif
+        );
+    }
+
+#if (__hcc_workweek__ >= 19213)
+    lp.av->release_locked_hsa_queue();
+#endif
+    if (trackDispatch) {
+        streamCrit.setLastDispatch(cf);
+    }
+    ihipPostLaunchKernel(FunctionSymbol(exec->nodes[last - 1].function).c_str(), stream, lp, false);
+}
+
+hipError_t ihipReplayNode(const ihipGraphNode_t& node, ihipStream_t* stream) {
+    switch (node.type) {
+        case ihipGraphNode_t::Memcpy:
+            try {
+                stream->locked_copyAsync(node.dst, node.src, node.sizeBytes, node.kind);
+            } catch (const ihipException& ex) {
+                return ex._code;
+            }
+            break;
+
+        case ihipGraphNode_t::EventRecord: {
+            LockedAccessor_EventCrit_t eCrit(node.event->criticalData());
+            auto& ecd = eCrit->_eventData;
+            ecd.marker(stream->locked_recordEvent(node.event));
+            ecd._type = hipEventTypeIndependent;
+            ecd._stream = stream;
+            ecd._timestamp = 0;
+            ecd._state = hipEventStatusRecording;
+            break;
+        }
+
+        case ihipGraphNode_t::EventWait: {
+            auto ecd = node.event->locked_copyCrit();
+            if ((ecd._state != hipEventStatusUnitialized) && (ecd._state != hipEventStatusCreated)) {
+                stream->locked_streamWaitEvent(ecd);
+            }
+            break;
+        }
+
+        case ihipGraphNode_t::Kernel:
+            // Dispatched in runs by ihipReplayKernels.
+            return hipErrorUnknown;
+    }
+    return hipSuccess;
+}
+
+hipError_t ihipGraphLaunch(ihipGraphExec_t* exec, ihipStream_t* stream) {
+    const hip_impl::Lane_plan& plan = exec->plan;
+    const size_t count = exec->nodes.size();
+    if (count == 0) return hipSuccess;
+
+    // The other lanes start after the work already queued on stream.
+    exec->lanes[0] = stream;
+    if (plan.lanes > 1) {
+        hc::completion_future fork = ihipStreamMarker(stream);
+        for (unsigned l = 1; l != plan.lanes; ++l) ihipStreamWaitFor(exec->lanes[l], fork);
+    }
+
+    hipError_t e = hipSuccess;
+    for (size_t i = 0; i != count && e == hipSuccess;) {
+        ihipStream_t* lane = exec->lanes[plan.lane[i]];
+        for (auto w : plan.waits[i]) ihipStreamWaitFor(lane, exec->signals[w]);
+
+        size_t last = i + 1;
+        if (exec->nodes[i].type == ihipGraphNode_t::Kernel) {
+            // Extend the run while the next kernel needs no marker or wait in between.
+            while (last != count && exec->nodes[last].type == ihipGraphNode_t::Kernel &&
+                   plan.lane[last] == plan.lane[i] && plan.waits[last].empty() &&
+                   !plan.signals[last - 1]) {
+                ++last;
+            }
+            ihipReplayKernels(exec, i, last, lane);
+        } else {
+            e = ihipReplayNode(exec->nodes[i], lane);
+        }
+        if (plan.signals[last - 1]) exec->signals[last - 1] = ihipStreamMarker(lane);
+        i = last;
+    }
+
+    // Work queued on stream from now on waits for every lane, also on failure.
+    for (unsigned l = 1; l < plan.lanes; ++l) {
+        ihipStreamWaitFor(stream, ihipStreamMarker(exec->lanes[l]));
+    }
+    return e;
+}
+
+void ihipGraphExecDestroy(ihipGraphExec_t* exec) {
+    for (size_t l = 1; l < exec->lanes.size(); ++l) {
+        if (exec->lanes[l]) ihipStreamDestroy(exec->lanes[l]);
+    }
+    delete exec;
+}
+
+}  // namespace
+
+
+//---
+hipError_t ihipCaptureKernel(hipStream_t stream, hipFunction_t f, dim3 globalWorkSize,
+                             dim3 blockDim, size_t sharedMemBytes,
+                             const hsa_kernel_dispatch_packet_t& aql, std::vector<char> kernargs) {
+    ihipGraphNode_t node{};
+    node.type = ihipGraphNode_t::Kernel;
+    node.function = f;
+    node.globalWorkSize = globalWorkSize;
+    node.blockDim = blockDim;
+    node.sharedMemBytes = sharedMemBytes;
+    node.aql = aql;
+    node.kernargs = std::move(kernargs);
+    return ihipCaptureNode(stream, std::move(node));
+}
+
+
+//---
+hipError_t ihipCaptureKernels(hipStream_t stream, std::vector<ihipCapturedKernel> kernels) {
+    std::vector<ihipGraphNode_t> nodes(kernels.size());
+    for (size_t i = 0; i != kernels.size(); ++i) {
+        nodes[i].type = ihipGraphNode_t::Kernel;
+        nodes[i].function = kernels[i].function;
+        nodes[i].globalWorkSize = kernels[i].globalWorkSize;
+        nodes[i].blockDim = kernels[i].blockDim;
+        nodes[i].sharedMemBytes = kernels[i].sharedMemBytes;
+        nodes[i].aql = kernels[i].aql;
+        nodes[i].kernargs = std::move(kernels[i].kernargs);
+    }
+
+    // Ending the capture takes the lock, so it can't end between the nodes.
+    std::lock_guard<std::mutex> lck{g_capturesMutex};
+    ihipGraph_t* graph = stream->capture();
+    if (!graph) return hipErrorInvalidValue;
+    for (auto&& node : nodes) graph->capture.add(stream, std::move(node));
+    return hipSuccess;
+}
+
+
+//---
+hipError_t ihipCaptureMemcpy(hipStream_t stream, void* dst, const void* src, size_t sizeBytes,
+                             hipMemcpyKind kind) {
+    ihipGraphNode_t node{};
+    node.type = ihipGraphNode_t::Memcpy;
+    node.dst = dst;
+    node.src = src;
+    node.sizeBytes = sizeBytes;
+    node.kind = kind;
+    return ihipCaptureNode(stream, std::move(node));
+}
+
+
+//---
+hipError_t ihipCaptureEventRecord(hipStream_t stream, hipEvent_t event) {
+    if (event->_flags & hipEventInterprocess) return hipErrorNotSupported;
+
+    ihipGraphNode_t node{};
+    node.type = ihipGraphNode_t::EventRecord;
+    node.event = event;
+    return ihipCaptureNode(stream, std::move(node), event);
+}
+
+
+//---
+bool ihipCaptureStreamWaitEvent(hipStream_t stream, hipEvent_t event, hipError_t* status) {
+    if (stream == nullptr) return false;
+    if (stream->capture() == nullptr &&
+        g_captureCount.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lck{g_capturesMutex};
+    ihipGraph_t* graph = stream->capture();
+    if (graph == nullptr) {
+        // A stream waiting for an event recorded during a capture joins it.
+        auto it = std::find_if(g_captures.cbegin(), g_captures.cend(),
+                               [event](ihipGraph_t* g) { return g->capture.recorded(event); });
+        if (it == g_captures.cend()) return false;
+        graph = *it;
+        graph->capture.wait(stream, event);
+        stream->setCapture(graph);
+    } else if (!graph->capture.wait(stream, event)) {
+        // An event from outside the capture is waited for at every launch.
+        if (event->_flags & hipEventInterprocess) {
+            *status = hipErrorNotSupported;
+            return true;
+        }
+        ihipGraphNode_t node{};
+        node.type = ihipGraphNode_t::EventWait;
+        node.event = event;
+        graph->capture.add(stream, std::move(node));
+    }
+    *status = hipSuccess;
+    return true;
+}
+
+
+//---
+hipError_t ihipCaptureUnsupported(hipStream_t stream) {
+    ihipGraph_t* graph = stream->capture();
+    if (graph) graph->capture.invalidate();
+    return hipErrorNotSupported;
+}
+
+
+//---
+void ihipStreamLeaveCapture(ihipStream_t* stream) {
+    if (stream->capture() == nullptr) return;
+
+    std::lock_guard<std::mutex> lck{g_capturesMutex};
+    ihipGraph_t* graph = stream->capture();
+    if (graph == nullptr) return;
+    if (graph->capture.origin() != stream) {
+        graph->capture.leave(stream);
+        stream->setCapture(nullptr);
+        return;
+    }
+    // Nothing can end the capture anymore, so drop it.
+    g_captures.erase(std::find(g_captures.begin(), g_captures.end(), graph));
+    g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+    for (const void* s : graph->capture.streams()) {
+        static_cast<ihipStream_t*>(const_cast<void*>(s))->setCapture(nullptr);
+    }
+    tprintf(DB_SYNC, "hipStreamDestroy, %s dropped its capture\n", ToString(stream).c_str());
+    delete graph;
+}
+
+
+//---
+hipError_t hipExtStreamBeginCapture(hipStream_t stream) {
+    HIP_INIT_API(hipExtStreamBeginCapture, stream);
+
+    // The null stream synchronizes with every stream, which a graph can't record.
+    if (stream == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    std::lock_guard<std::mutex> lck{g_capturesMutex};
+    if (stream->capture()) return ihipLogStatus(hipErrorInvalidValue);
+
+    auto graph = new ihipGraph_t{stream};
+    g_captures.push_back(graph);
+    g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+    stream->setCapture(graph);
+    tprintf(DB_SYNC, "hipExtStreamBeginCapture, %s\n", ToString(stream).c_str());
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtStreamEndCapture(hipStream_t stream, hipExtGraph_t* graph) {
+    HIP_INIT_API(hipExtStreamEndCapture, stream, graph);
+
+    if (stream == nullptr || graph == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    ihipGraph_t* g = nullptr;
+    {
+        std::lock_guard<std::mutex> lck{g_capturesMutex};
+        g = stream->capture();
+        if (g == nullptr || g->capture.origin() != stream) {
+            return ihipLogStatus(hipErrorInvalidValue);
+        }
+        g_captures.erase(std::find(g_captures.begin(), g_captures.end(), g));
+        g_captureCount.store(g_captures.size(), std::memory_order_relaxed);
+        for (const void* s : g->capture.streams()) {
+            static_cast<ihipStream_t*>(const_cast<void*>(s))->setCapture(nullptr);
+        }
+    }
+    if (!g->capture.valid()) {
+        tprintf(DB_SYNC, "hipExtStreamEndCapture, %s captured an unsupported command\n",
+                ToString(stream).c_str());
+        delete g;
+        return ihipLogStatus(hipErrorNotSupported);
+    }
+    g->graph = g->capture.finish();
+    tprintf(DB_SYNC, "hipExtStreamEndCapture, %s captured %zu nodes\n", ToString(stream).c_str(),
+            g->graph.nodes.size());
+
+    *graph = g;
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtGraphGetNodeCount(hipExtGraph_t graph, size_t* count) {
+    HIP_INIT_API(hipExtGraphGetNodeCount, graph, count);
+
+    if (graph == nullptr || count == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    *count = graph->graph.nodes.size();
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtGraphDestroy(hipExtGraph_t graph) {
+    HIP_INIT_API(hipExtGraphDestroy, graph);
+
+    if (graph == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    delete graph;
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtGraphInstantiate(hipExtGraphExec_t* exec, hipExtGraph_t graph,
+                                  unsigned int maxStreams) {
+    HIP_INIT_API(hipExtGraphInstantiate, exec, graph, maxStreams);
+
+    if (exec == nullptr || graph == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
+    if (!ctx) return ihipLogStatus(hipErrorInvalidDevice);
+
+    auto e = new ihipGraphExec_t;
+    e->ctx = ctx;
+    e->nodes = graph->graph.nodes;
+    e->plan = hip_impl::plan_lanes(graph->graph.deps, maxStreams);
+    e->signals.resize(e->nodes.size());
+    e->lanes.assign(e->plan.lanes, nullptr);
+    for (unsigned l = 1; l < e->plan.lanes; ++l) {
+        e->lanes[l] = ihipStreamCreateLane(ctx);
+        if (e->lanes[l] == nullptr) {
+            ihipGraphExecDestroy(e);
+            return ihipLogStatus(hipErrorOutOfMemory);
+        }
+    }
+    tprintf(DB_SYNC, "hipExtGraphInstantiate, %zu nodes on %u streams\n", e->nodes.size(),
+            e->plan.lanes);
+
+    *exec = e;
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtGraphExecSetKernelArgs(hipExtGraphExec_t exec, size_t node, void** kernelParams,
+                                        void** extra) {
+    HIP_INIT_API(hipExtGraphExecSetKernelArgs, exec, node, kernelParams, extra);
+
+    if (exec == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    std::lock_guard<std::mutex> lck{exec->mutex};
+    if (node >= exec->nodes.size() || exec->nodes[node].type != ihipGraphNode_t::Kernel) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    // Pack first, so that a bad update leaves the node as it was.
+    ihipGraphNode_t& n = exec->nodes[node];
+    std::vector<char> kernargs;
+    hipError_t e = ihipPackKernargs(n.function, kernelParams, extra, nullptr, kernargs);
+    if (e == hipSuccess) n.kernargs.swap(kernargs);
+
+    return ihipLogStatus(e);
+}
+
+
+//---
+hipError_t hipExtGraphExecSetMemcpyParams(hipExtGraphExec_t exec, size_t node, void* dst,
+                                          const void* src) {
+    HIP_INIT_API(hipExtGraphExecSetMemcpyParams, exec, node, dst, src);
+
+    if (exec == nullptr || dst == nullptr || src == nullptr) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    std::lock_guard<std::mutex> lck{exec->mutex};
+    if (node >= exec->nodes.size() || exec->nodes[node].type != ihipGraphNode_t::Memcpy) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+    exec->nodes[node].dst = dst;
+    exec->nodes[node].src = src;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
+//---
+hipError_t hipExtGraphLaunch(hipExtGraphExec_t exec, hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipExtGraphLaunch, TRACE_KCMD, exec, stream);
+
+    if (exec == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
+    std::lock_guard<std::mutex> lck{exec->mutex};
+    stream = ihipSyncAndResolveStream(stream);
+    if (!stream) return ihipLogStatus(hipErrorInvalidValue);
+
+    return ihipLogStatus(ihipGraphLaunch(exec, stream));
+}
+
+
+//---
+hipError_t hipExtGraphExecDestroy(hipExtGraphExec_t exec) {
+    HIP_INIT_API(hipExtGraphExecDestroy, exec);
+
+    if (exec == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    ihipGraphExecDestroy(exec);
+    return ihipLogStatus(hipSuccess);
+}
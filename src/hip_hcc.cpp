@@ -48,6 +48,9 @@ THE SOFTWARE.
 #include "hip/hip_runtime.h"
 #include "hip_hcc_internal.h"
 #include "hip/hip_ext.h"
+#include "callback_executor.hpp"
+#include "mem_pool.hpp"
+#include "stream_pool.hpp"
 #include "trace_helper.h"
 #include "env.h"
 
@@ -72,6 +75,8 @@ int HIP_API_BLOCKING = 0;
 int HIP_PRINT_ENV = 0;
 int HIP_TRACE_API = 0;
 std::string HIP_TRACE_API_COLOR("green");
+std::string HIP_TRACE_API_FILE;
+int HIP_TRACE_API_BUFFER = 16384;
 
 // TODO - DB_START/STOP need more testing.
 std::string HIP_DB_START_API;
@@ -87,6 +92,22 @@ int HIP_DENY_PEER_ACCESS = 0;
 int HIP_HIDDEN_FREE_MEM = 256;
 // Force async copies to actually use the synchronous copy interface.
 int HIP_FORCE_SYNC_COPY = 0;
+// Pipeline used for synchronous copies to and from pageable host memory.
+int HIP_STAGING_SIZE = 1024;
+int HIP_STAGING_BUFFERS = 4;
+// Budget, in MB, of pageable host ranges kept pinned between copies (0 disables), and the
+// smallest copy, in KB, that pins its range.
+int HIP_PIN_CACHE_SIZE = 0;
+int HIP_PIN_CACHE_MIN_KB = 1024;
+// Threads per device running hipStreamAddCallback callbacks.
+int HIP_CALLBACK_THREADS = 1;
+// Threads per device running hipMemcpyAsync copies to and from pageable host memory (0 copies
+// synchronously in the calling thread).
+int HIP_COPY_THREADS = 0;
+// Streams per context kept by the hipExtStreamPoolAcquire pool.
+int HIP_STREAM_POOL_MAX_QUEUES = 32;
+// Longest spin, in microseconds, of the adaptive wait policy before it yields and blocks.
+int HIP_WAIT_SPIN_US = 50;
 
 // TODO - set these to 0 and 1
 int HIP_EVENT_SYS_RELEASE = 0;
@@ -101,6 +122,9 @@ int HIP_SYNC_STREAM_WAIT = 0;
 int HIP_FORCE_NULL_STREAM = 0;
 
 int HIP_DUMP_CODE_OBJECT = 0;
+std::string HIP_ELF_CACHE_PATH;
+std::string HIP_CODE_OBJECT_CACHE_PATH;
+int HIP_CODE_OBJECT_CACHE_SIZE = 256;
 
 
 #if (__hcc_workweek__ >= 17300)
@@ -194,10 +218,17 @@ ihipCtx_t* ihipGetPrimaryCtx(unsigned deviceIndex) {
 };
 
 hipError_t ihipSynchronize(TlsData *tls) {
-    ihipGetTlsDefaultCtx()->locked_waitAllStreams();  // ignores non-blocking streams, this waits
-                                                      // for all activity to finish.
+    ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
+    ctx->locked_waitAllStreams();  // ignores non-blocking streams, this waits
+                                   // for all activity to finish.
 
-    return (hipSuccess);
+    hipError_t e = hipSuccess;
+    LockedAccessor_CtxCrit_t crit(ctx->criticalData());
+    for (auto stream : crit->const_streams()) {
+        hipError_t streamError = stream->takeAsyncError();
+        if (e == hipSuccess) e = streamError;
+    }
+    return e;
 }
 
 TlsData* tls_get_ptr() {
@@ -240,26 +271,12 @@ ihipStream_t::ihipStream_t(ihipCtx_t* ctx, hc::accelerator_view av, unsigned int
     : _id(0),  // will be set by add function.
       _flags(flags),
       _ctx(ctx),
-      _criticalData(this, av) {
-    unsigned schedBits = ctx->_ctxFlags & hipDeviceScheduleMask;
-
-    switch (schedBits) {
-        case hipDeviceScheduleAuto:
-            _scheduleMode = Auto;
-            break;
-        case hipDeviceScheduleSpin:
-            _scheduleMode = Spin;
-            break;
-        case hipDeviceScheduleYield:
-            _scheduleMode = Yield;
-            break;
-        case hipDeviceScheduleBlockingSync:
-            _scheduleMode = Yield;
-            break;
-        default:
-            _scheduleMode = Auto;
-    };
-};
+      _criticalData(this, av),
+      _scheduleMode(ihipScheduleMode(ctx->_ctxFlags)),
+      _waiter(uint64_t(HIP_WAIT_SPIN_US > 0 ? HIP_WAIT_SPIN_US : 0) * 1000),
+      _capture(nullptr),
+      _pooled(false),
+      _asyncError(hipSuccess) {};
 
 
 //---
@@ -272,30 +289,46 @@ ihipStream_t::~ihipStream_t() {
 }
 
 
-hc::hcWaitMode ihipStream_t::waitMode() const {
-    hc::hcWaitMode waitMode = hc::hcWaitModeActive;
-
-    if (_scheduleMode == Auto) {
-        if (g_deviceCnt > g_numLogicalThreads) {
-            waitMode = hc::hcWaitModeActive;
-        } else {
-            waitMode = hc::hcWaitModeBlocked;
-        }
-    } else if (_scheduleMode == Spin) {
-        waitMode = hc::hcWaitModeActive;
-    } else if (_scheduleMode == Yield) {
-        waitMode = hc::hcWaitModeBlocked;
-    } else {
-        assert(0);  // bad wait mode.
-    }
+ihipStream_t::ScheduleMode ihipScheduleMode(unsigned ctxFlags) {
+    switch (ctxFlags & hipDeviceScheduleMask) {
+        case hipDeviceScheduleAuto:
+            return ihipStream_t::Auto;
+        case hipDeviceScheduleSpin:
+            return ihipStream_t::Spin;
+        case hipDeviceScheduleYield:
+            return ihipStream_t::Yield;
+        case hipDeviceScheduleBlockingSync:
+            return ihipStream_t::Yield;
+        default:
+            return ihipStream_t::Auto;
+    };
+}
 
+hip_impl::Wait_policy ihipWaitPolicy(ihipStream_t::ScheduleMode mode) {
     if (HIP_WAIT_MODE == 1) {
-        waitMode = hc::hcWaitModeBlocked;
+        return hip_impl::Wait_policy::blocked;
     } else if (HIP_WAIT_MODE == 2) {
-        waitMode = hc::hcWaitModeActive;
+        return hip_impl::Wait_policy::active;
+    } else if (HIP_WAIT_MODE == 3) {
+        return hip_impl::Wait_policy::adaptive;
     }
 
-    return waitMode;
+    switch (mode) {
+        case ihipStream_t::Spin:
+            return hip_impl::Wait_policy::active;
+        case ihipStream_t::Yield:
+            return hip_impl::Wait_policy::blocked;
+        case ihipStream_t::Auto:
+        default:
+            // Spin while waits are short, block once they are not.
+            return hip_impl::Wait_policy::adaptive;
+    }
+}
+
+hip_impl::Wait_policy ihipStream_t::waitPolicy() const { return ihipWaitPolicy(_scheduleMode); }
+
+static hc::hcWaitMode hcWaitMode(bool blocking) {
+    return blocking ? hc::hcWaitModeBlocked : hc::hcWaitModeActive;
 }
 
 // Wait for all kernel and data copy commands in this stream to complete.
@@ -303,26 +336,29 @@ hc::hcWaitMode ihipStream_t::waitMode() const {
 void ihipStream_t::wait(LockedAccessor_StreamCrit_t& crit) {
     tprintf(DB_SYNC, "%s wait for queue-empty..\n", ToString(this).c_str());
 
-    crit->_av.wait(waitMode());
+    _waiter.wait(waitPolicy(), [&crit]() { return crit->_av.get_is_empty(); },
+                 [&crit](bool blocking) { crit->_av.wait(hcWaitMode(blocking)); });
 }
 
 //---
 // Wait for all kernel and data copy commands in this stream to complete.
-inline void ihipStream_t::locked_wait(bool& waited) {
+inline void ihipStream_t::locked_wait(bool& waited, bool leaveDirtyList) {
     // create a marker while holding stream lock,
     // but release lock prior to waiting on the marker
     hc::completion_future marker;
     {
         LockedAccessor_StreamCrit_t crit(_criticalData);
+        if (leaveDirtyList) crit->_inDirtyList = false;
         // skipping marker since stream is empty
         if (crit->_av.get_is_empty()) {
             waited = false;
             return;
         }
-        marker = crit->_av.create_marker(hc::no_scope);
+        marker = crit->marker(hc::no_scope);
     }
 
-    marker.wait(waitMode());
+    _waiter.wait(waitPolicy(), [&marker]() { return marker.is_ready(); },
+                 [&marker](bool blocking) { marker.wait(hcWaitMode(blocking)); });
     waited = true;
     return;
 };
@@ -400,7 +436,18 @@ hc::completion_future ihipStream_t::locked_recordEvent(hipEvent_t event) {
 
     // Lock the stream to prevent simultaneous access
     LockedAccessor_StreamCrit_t crit(_criticalData);
-    return crit->_av.create_marker(scopeFlag);
+    if (event->_flags & hipEventTimingOnly) {
+        // The end timestamp of the last kernel is as good as that of a
+        // marker behind it, so no barrier is needed. Otherwise fall back to
+        // a marker without release fence.
+        crit->_timedDispatches = true;
+        if (const hc::completion_future* cf = crit->lastDispatch()) {
+            ihipStreamCountMarker(this, true);
+            return *cf;
+        }
+        scopeFlag = hc::no_scope;
+    }
+    return crit->marker(scopeFlag);
 };
 
 //=============================================================================
@@ -553,7 +600,8 @@ void ihipDeviceCriticalBase_t<DeviceMutex>::addContext(ihipCtx_t* ctx) {
 // ihipDevice_t
 //=================================================================================================
 ihipDevice_t::ihipDevice_t(unsigned deviceId, unsigned deviceCnt, hc::accelerator& acc)
-    : _deviceId(deviceId), _acc(acc), _state(0), _criticalData(this) {
+    : _deviceId(deviceId), _acc(acc), _state(0), _markerHits(0), _markerMisses(0),
+      _criticalData(this) {
     hsa_agent_t* agent = static_cast<hsa_agent_t*>(acc.get_hsa_agent());
     if (agent) {
 	int err;
@@ -585,6 +633,25 @@ ihipDevice_t::~ihipDevice_t() {
     _primaryCtx = NULL;
 }
 
+hip_impl::Callback_executor* ihipDevice_t::callbackExecutor() {
+    // Never freed: callbacks may still be in flight while the process exits,
+    // and joining their threads from a destructor could deadlock.
+    std::call_once(_callbackExecutorOnce, [this]() {
+        _callbackExecutor = new hip_impl::Callback_executor(
+            HIP_CALLBACK_THREADS > 0 ? HIP_CALLBACK_THREADS : 1);
+    });
+    return _callbackExecutor;
+}
+
+hip_impl::Callback_executor* ihipDevice_t::copyExecutor() {
+    // Never freed, for the same reason as callbackExecutor().
+    std::call_once(_copyExecutorOnce, [this]() {
+        _copyExecutor = new hip_impl::Callback_executor(
+            HIP_COPY_THREADS > 0 ? HIP_COPY_THREADS : 1);
+    });
+    return _copyExecutor;
+}
+
 void ihipDevice_t::locked_removeContext(ihipCtx_t* c) {
     LockedAccessor_DeviceCrit_t crit(_criticalData);
 
@@ -625,6 +692,9 @@ void ihipDevice_t::locked_reset() {
 
     _state = 0;
     am_memtracker_reset(_acc);
+    // The index can't tell which host allocations were this device's, so drop all of it; lookups
+    // of other devices' allocations fall back to HSA.
+    hip_internal::clearPointerIndex();
 
     // FIXME - Calling am_memtracker_reset is really bad since it destroyed all buffers allocated by
     // the HCC runtime as well such as the printf buffer.  Re-initialze the printf buffer as a
@@ -1016,6 +1086,8 @@ ihipCtx_t::ihipCtx_t(ihipDevice_t* device, unsigned deviceCnt, unsigned flags)
 
 
 ihipCtx_t::~ihipCtx_t() {
+    delete _streamPool;
+    delete _memPool;
     if (_defaultStream) {
         delete _defaultStream;
         _defaultStream = NULL;
@@ -1044,6 +1116,20 @@ void ihipCtx_t::locked_reset() {
     }
     // Clear the list.
     crit->streams().clear();
+    // The pool's streams were among them.
+    if (_streamPool) _streamPool->clear();
+    {
+        std::lock_guard<std::mutex> lck{_dirtyStreamsMutex};
+        _dirtyStreams.clear();
+    }
+    // The memory pool's events are on the deleted streams, and a device reset frees its blocks.
+    // Release the cached ones, idle now, and start over; blocks still in use become ordinary
+    // allocations for hipFree.
+    if (_memPool) {
+        _memPool->trim(0);
+        delete _memPool;
+        _memPool = newMemPool();
+    }
 
 
     // Create a fresh default stream and add it:
@@ -1100,41 +1186,53 @@ void ihipCtx_t::locked_syncDefaultStream(bool waitOnSelf, bool syncHost) {
 
     tprintf(DB_SYNC, "syncDefaultStream \n");
 
+    // Only streams locked since the last barrier can hold work the null stream has not already
+    // waited for. The rest are skipped without being locked, so the cost scales with the number
+    // of active streams rather than all streams in the context. Non-blocking streams never get on
+    // the list.
+    std::vector<ihipStream_t*> dirtyStreams;
+    {
+        std::lock_guard<std::mutex> lck{_dirtyStreamsMutex};
+        dirtyStreams.swap(_dirtyStreams);
+    }
+    std::vector<ihipStream_t*> skipped;
+
     // Vector of ops sent to each stream that will complete before ops sent to null stream:
     std::vector<hc::completion_future> depOps;
 
     bool last_stream_waited = false;
-    for (auto streamI = crit->const_streams().begin(); streamI != crit->const_streams().end();
-         streamI++) {
-        ihipStream_t* stream = *streamI;
-
-        // Don't wait for streams that have "opted-out" of syncing with NULL stream.
-        // And - don't wait for the NULL stream, unless waitOnSelf specified.
-        bool waitThisStream = (!(stream->_flags & hipStreamNonBlocking)) &&
-                              (waitOnSelf || (stream != _defaultStream));
+    for (ihipStream_t* stream : dirtyStreams) {
+        // Don't wait for the NULL stream, unless waitOnSelf specified.
+        if (!waitOnSelf && stream == _defaultStream) {
+            skipped.push_back(stream);
+            continue;
+        }
 
         if (HIP_SYNC_NULL_STREAM) {
-            if (waitThisStream) {
-                last_stream_waited = false;
-                stream->locked_wait(last_stream_waited);
-            }
+            // Clear the flag in the lock hold that takes the marker; locking the stream again
+            // would put it straight back on the dirty list.
+            last_stream_waited = false;
+            stream->locked_wait(last_stream_waited, true /*leaveDirtyList*/);
         } else {
-            if (waitThisStream) {
-                LockedAccessor_StreamCrit_t streamCrit(stream->criticalData());
-
-                // The last marker will provide appropriate visibility:
-                if (!streamCrit->_av.get_is_empty()) {
-                    depOps.push_back(streamCrit->_av.create_marker(hc::accelerator_scope));
-                    tprintf(DB_SYNC, "  push marker to wait for stream=%s\n",
-                            ToString(stream).c_str());
-                } else {
-                    tprintf(DB_SYNC, "  skipped stream=%s since it is empty\n",
-                            ToString(stream).c_str());
-                }
+            LockedAccessor_StreamCrit_t streamCrit(stream->criticalData());
+            streamCrit->_inDirtyList = false;
+
+            // The last marker will provide appropriate visibility:
+            if (!streamCrit->_av.get_is_empty()) {
+                depOps.push_back(streamCrit->marker());
+                tprintf(DB_SYNC, "  push marker to wait for stream=%s\n",
+                        ToString(stream).c_str());
+            } else {
+                tprintf(DB_SYNC, "  skipped stream=%s since it is empty\n",
+                        ToString(stream).c_str());
             }
         }
     }
 
+    if (!skipped.empty()) {
+        std::lock_guard<std::mutex> lck{_dirtyStreamsMutex};
+        _dirtyStreams.insert(_dirtyStreams.end(), skipped.begin(), skipped.end());
+    }
 
     // Enqueue a barrier to wait on all the barriers we sent above:
     if (!HIP_SYNC_NULL_STREAM && !depOps.empty()) {
@@ -1143,8 +1241,12 @@ void ihipCtx_t::locked_syncDefaultStream(bool waitOnSelf, bool syncHost) {
                 depOps.size(), syncHost);
         hc::completion_future defaultCf = defaultStreamCrit->_av.create_blocking_marker(
             depOps.begin(), depOps.end(), hc::accelerator_scope);
+        // Streams that next wait on the null stream can depend on this barrier directly.
+        defaultStreamCrit->setMarker(defaultCf, hc::accelerator_scope);
         if (syncHost) {
-            defaultCf.wait();  // TODO - account for active or blocking here.
+            _defaultStream->waiter().wait(
+                _defaultStream->waitPolicy(), [&defaultCf]() { return defaultCf.is_ready(); },
+                [&defaultCf](bool blocking) { defaultCf.wait(hcWaitMode(blocking)); });
         }
     }
     else if ( (HIP_SYNC_NULL_STREAM && !last_stream_waited) ||
@@ -1165,6 +1267,33 @@ void ihipCtx_t::locked_removeStream(ihipStream_t* s) {
     LockedAccessor_CtxCrit_t crit(_criticalData);
 
     crit->streams().remove(s);
+
+    std::lock_guard<std::mutex> lck{_dirtyStreamsMutex};
+    _dirtyStreams.erase(std::remove(_dirtyStreams.begin(), _dirtyStreams.end(), s),
+                        _dirtyStreams.end());
+}
+
+
+void ihipCtx_t::markStreamDirty(ihipStream_t* stream) {
+    std::lock_guard<std::mutex> lck{_dirtyStreamsMutex};
+    _dirtyStreams.push_back(stream);
+}
+
+
+void ihipStreamMarkDirty(ihipStream_t* stream) {
+    // Non-blocking streams never synchronize with the null stream.
+    if (stream->_flags & hipStreamNonBlocking) return;
+    stream->getCtx()->markStreamDirty(stream);
+}
+
+
+void ihipStreamCountMarker(ihipStream_t* stream, bool reused) {
+    ihipDevice_t* device = stream->getCtx()->getWriteableDevice();
+    if (reused) {
+        device->_markerHits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        device->_markerMisses.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 
@@ -1346,6 +1475,12 @@ void HipReadEnv() {
                "executes.");
     READ_ENV_S(release, HIP_TRACE_API_COLOR, 0,
                "Color to use for HIP_API.  None/Red/Green/Yellow/Blue/Magenta/Cyan/White");
+    READ_ENV_S(release, HIP_TRACE_API_FILE, 0,
+               "Trace each HIP API call as a binary record written to this file by a background "
+               "thread.  Decode with hiptracedecode.");
+    READ_ENV_I(release, HIP_TRACE_API_BUFFER, 0,
+               "Number of binary trace records buffered per thread for HIP_TRACE_API_FILE. Records "
+               "are dropped when the buffer is full.");
     READ_ENV_S(release, HIP_DB_START_API, 0,
                "Comma-separated list of tid.api_seq_num for when to start debug and profiling.");
     READ_ENV_S(release, HIP_DB_STOP_API, 0,
@@ -1358,13 +1493,40 @@ void HipReadEnv() {
 
 
     READ_ENV_I(release, HIP_WAIT_MODE, 0,
-               "Force synchronization mode. 1= force yield, 2=force spin, 0=defaults specified in "
-               "application");
+               "Force synchronization mode. 1= force yield, 2=force spin, 3=force adaptive spin then "
+               "block, 0=defaults specified in application");
+    READ_ENV_I(release, HIP_WAIT_SPIN_US, 0,
+               "Longest spin, in microseconds, of the adaptive wait policy.  It spins for twice "
+               "the recent average wait, up to this, then yields as long, then blocks.");
     READ_ENV_I(release, HIP_FORCE_P2P_HOST, 0,
                "Force use of host/staging copy for peer-to-peer copies.1=always use copies, "
                "2=always return false for hipDeviceCanAccessPeer");
     READ_ENV_I(release, HIP_FORCE_SYNC_COPY, 0,
                "Force all copies (even hipMemcpyAsync) to use sync copies");
+    READ_ENV_I(release, HIP_STAGING_SIZE, 0,
+               "Size in KB of each pinned staging buffer used by synchronous copies to and from "
+               "pageable host memory.");
+    READ_ENV_I(release, HIP_STAGING_BUFFERS, 0,
+               "Number of staging buffers per thread.  With two or more, copying one chunk on the "
+               "CPU overlaps the DMA of the previous one.");
+    READ_ENV_I(release, HIP_PIN_CACHE_SIZE, 0,
+               "Size in MB of pageable host memory kept pinned after large copies, so copying the "
+               "same buffers again skips the staging buffers.  0 disables the cache.  Needs "
+               "userfaultfd to notice unmapped memory.");
+    READ_ENV_I(release, HIP_PIN_CACHE_MIN_KB, 0,
+               "Smallest copy, in KB, that pins pageable host memory into the pin cache.");
+    READ_ENV_I(release, HIP_CALLBACK_THREADS, 0,
+               "Number of threads per device running stream callbacks.  Callbacks from one "
+               "stream always run in order.");
+    READ_ENV_I(release, HIP_COPY_THREADS, 0,
+               "Number of threads per device running hipMemcpyAsync copies to and from pageable "
+               "host memory, so the call returns before the copy is done.  The host buffer must "
+               "then stay untouched until the copy completes in stream order.  0 copies "
+               "synchronously in the calling thread.");
+    READ_ENV_I(release, HIP_STREAM_POOL_MAX_QUEUES, 0,
+               "Maximum number of streams, each with its own HW queue, kept by the stream pool of "
+               "a context.  Past it, acquired streams are shared with callers asking for the same "
+               "attributes.");
     READ_ENV_I(release, HIP_FAIL_SOC, 0,
                "Fault on Sub-Optimal-Copy, rather than use a slower but functional implementation. "
                " Bit 0x1=Fail on async copy with unpinned memory.  Bit 0x2=Fail peer copy rather "
@@ -1401,6 +1563,15 @@ void HipReadEnv() {
     READ_ENV_I(release, HIP_DUMP_CODE_OBJECT, 0,
                "If set, dump code object as __hip_dump_code_object[nnnn].o in the current directory,"
                "where nnnn is the index number.");
+    READ_ENV_S(release, HIP_ELF_CACHE_PATH, 0,
+               "Existing directory in which to cache the kernel section and symbol tables found in "
+               "loaded ELF objects, so unchanged objects are not parsed again at startup.");
+    READ_ENV_S(release, HIP_CODE_OBJECT_CACHE_PATH, 0,
+               "Existing directory in which to cache the kernel argument layouts and symbols parsed "
+               "from each code object, shared by all processes that use it.");
+    READ_ENV_I(release, HIP_CODE_OBJECT_CACHE_SIZE, 0,
+               "Size limit of HIP_CODE_OBJECT_CACHE_PATH in MB. Least recently used entries are "
+               "removed when it is exceeded.");
 
     // Some flags have both compile-time and runtime flags - generate a warning if user enables the
     // runtime flag but the compile-time flag is disabled.
@@ -1454,6 +1625,11 @@ void HipReadEnv() {
 
     parseTrigger(HIP_DB_START_API, g_dbStartTriggers);
     parseTrigger(HIP_DB_STOP_API, g_dbStopTriggers);
+
+    if (!HIP_TRACE_API_FILE.empty()) {
+        hip_trace::startApiTracer(HIP_TRACE_API_FILE,
+                                  HIP_TRACE_API_BUFFER > 0 ? HIP_TRACE_API_BUFFER : 1, 10 /*ms*/);
+    }
 };
 
 
@@ -1556,6 +1732,7 @@ hipError_t ihipStreamSynchronize(TlsData *tls, hipStream_t stream) {
     if (stream == hipStreamNull) {
         ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
         ctx->locked_syncDefaultStream(true /*waitOnSelf*/, true /*syncToHost*/);
+        e = ctx->_defaultStream->takeAsyncError();
     } else {
         // note this does not synchornize with the NULL stream:
         bool waited;
@@ -1563,7 +1740,7 @@ hipError_t ihipStreamSynchronize(TlsData *tls, hipStream_t stream) {
         if (!waited) {
             Kalmar::getContext()->flushPrintfBuffer();
         }
-        e = hipSuccess;
+        e = stream->takeAsyncError();
     }
 
     return e;
@@ -1601,13 +1778,15 @@ hipStream_t ihipSyncAndResolveStream(hipStream_t stream, bool lockAcquired) {
                 hc::completion_future dcf;
                 {
                     LockedAccessor_StreamCrit_t defaultStreamCrit(defaultStream->criticalData());
-                    // TODO - could call create_blocking_marker(queue) or uses existing marker.
                     if (!defaultStreamCrit->_av.get_is_empty()) {
                         needGatherMarker = true;
 
+                        // Reuses the last null-stream barrier or marker when nothing was sent
+                        // to the default stream since, e.g. when many streams start work after
+                        // one null-stream operation.
                         tprintf(DB_SYNC, "  %s adding marker to default %s for dependency\n",
                                 ToString(stream).c_str(), ToString(defaultStream).c_str());
-                        dcf = defaultStreamCrit->_av.create_marker(hc::accelerator_scope);
+                        dcf = defaultStreamCrit->marker();
                     } else {
                         tprintf(DB_SYNC, "  %s skipping marker since default stream is empty\n",
                                 ToString(stream).c_str());
@@ -1729,136 +1908,6 @@ void ihipPostLaunchKernel(const char* kernelName, hipStream_t stream, grid_launc
 //-------------------------------------------------------------------------------------------------
 
 
-const char* ihipErrorString(hipError_t hip_error) {
-    switch (hip_error) {
-        case hipSuccess:
-            return "hipSuccess";
-        case hipErrorOutOfMemory:
-            return "hipErrorOutOfMemory";
-        case hipErrorNotInitialized:
-            return "hipErrorNotInitialized";
-        case hipErrorDeinitialized:
-            return "hipErrorDeinitialized";
-        case hipErrorProfilerDisabled:
-            return "hipErrorProfilerDisabled";
-        case hipErrorProfilerNotInitialized:
-            return "hipErrorProfilerNotInitialized";
-        case hipErrorProfilerAlreadyStarted:
-            return "hipErrorProfilerAlreadyStarted";
-        case hipErrorProfilerAlreadyStopped:
-            return "hipErrorProfilerAlreadyStopped";
-         case hipErrorInsufficientDriver:
-            return "hipErrorInsufficientDriver";
-        case hipErrorInvalidImage:
-            return "hipErrorInvalidImage";
-        case hipErrorInvalidContext:
-            return "hipErrorInvalidContext";
-        case hipErrorContextAlreadyCurrent:
-            return "hipErrorContextAlreadyCurrent";
-        case hipErrorMapFailed:
-            return "hipErrorMapFailed";
-        case hipErrorUnmapFailed:
-            return "hipErrorUnmapFailed";
-        case hipErrorArrayIsMapped:
-            return "hipErrorArrayIsMapped";
-        case hipErrorAlreadyMapped:
-            return "hipErrorAlreadyMapped";
-        case hipErrorNoBinaryForGpu:
-            return "hipErrorNoBinaryForGpu";
-        case hipErrorAlreadyAcquired:
-            return "hipErrorAlreadyAcquired";
-        case hipErrorNotMapped:
-            return "hipErrorNotMapped";
-        case hipErrorNotMappedAsArray:
-            return "hipErrorNotMappedAsArray";
-        case hipErrorNotMappedAsPointer:
-            return "hipErrorNotMappedAsPointer";
-        case hipErrorECCNotCorrectable:
-            return "hipErrorECCNotCorrectable";
-        case hipErrorUnsupportedLimit:
-            return "hipErrorUnsupportedLimit";
-        case hipErrorContextAlreadyInUse:
-            return "hipErrorContextAlreadyInUse";
-        case hipErrorPeerAccessUnsupported:
-            return "hipErrorPeerAccessUnsupported";
-        case hipErrorInvalidKernelFile:
-            return "hipErrorInvalidKernelFile";
-        case hipErrorInvalidGraphicsContext:
-            return "hipErrorInvalidGraphicsContext";
-        case hipErrorInvalidSource:
-            return "hipErrorInvalidSource";
-        case hipErrorFileNotFound:
-            return "hipErrorFileNotFound";
-        case hipErrorSharedObjectSymbolNotFound:
-            return "hipErrorSharedObjectSymbolNotFound";
-        case hipErrorSharedObjectInitFailed:
-            return "hipErrorSharedObjectInitFailed";
-        case hipErrorOperatingSystem:
-            return "hipErrorOperatingSystem";
-        case hipErrorSetOnActiveProcess:
-            return "hipErrorSetOnActiveProcess";
-        case hipErrorInvalidHandle:
-            return "hipErrorInvalidHandle";
-        case hipErrorNotFound:
-            return "hipErrorNotFound";
-        case hipErrorIllegalAddress:
-            return "hipErrorIllegalAddress";
-        case hipErrorInvalidSymbol:
-            return "hipErrorInvalidSymbol";
-        case hipErrorMissingConfiguration:
-            return "hipErrorMissingConfiguration";
-        case hipErrorLaunchFailure:
-            return "hipErrorLaunchFailure";
-        case hipErrorCooperativeLaunchTooLarge:
-            return "hipErrorCooperativeLaunchTooLarge";
-        case hipErrorPriorLaunchFailure:
-            return "hipErrorPriorLaunchFailure";
-        case hipErrorLaunchTimeOut:
-            return "hipErrorLaunchTimeOut";
-        case hipErrorLaunchOutOfResources:
-            return "hipErrorLaunchOutOfResources";
-        case hipErrorInvalidDeviceFunction:
-            return "hipErrorInvalidDeviceFunction";
-        case hipErrorInvalidConfiguration:
-            return "hipErrorInvalidConfiguration";
-        case hipErrorInvalidDevice:
-            return "hipErrorInvalidDevice";
-        case hipErrorInvalidValue:
-            return "hipErrorInvalidValue";
-        case hipErrorInvalidDevicePointer:
-            return "hipErrorInvalidDevicePointer";
-        case hipErrorInvalidMemcpyDirection:
-            return "hipErrorInvalidMemcpyDirection";
-        case hipErrorUnknown:
-            return "hipErrorUnknown";
-        case hipErrorNotReady:
-            return "hipErrorNotReady";
-        case hipErrorNoDevice:
-            return "hipErrorNoDevice";
-        case hipErrorPeerAccessAlreadyEnabled:
-            return "hipErrorPeerAccessAlreadyEnabled";
-        case hipErrorPeerAccessNotEnabled:
-            return "hipErrorPeerAccessNotEnabled";
-        case hipErrorRuntimeMemory:
-            return "hipErrorRuntimeMemory";
-        case hipErrorRuntimeOther:
-            return "hipErrorRuntimeOther";
-        case hipErrorHostMemoryAlreadyRegistered:
-            return "hipErrorHostMemoryAlreadyRegistered";
-        case hipErrorHostMemoryNotRegistered:
-            return "hipErrorHostMemoryNotRegistered";
-        case hipErrorAssert:
-            return "hipErrorAssert";
-        case hipErrorNotSupported:
-            return "hipErrorNotSupported";
-        case hipErrorTbd:
-            return "hipErrorTbd";
-        default:
-            return "hipErrorUnknown";
-    };
-};
-
-
 // Returns true if copyEngineCtx can see the memory allocated on dstCtx and srcCtx.
 // The peer-list for a context controls which contexts have access to the memory allocated on that
 // context. So we check dstCtx's and srcCtx's peerList to see if the both include thisCtx.
@@ -25,13 +25,19 @@ THE SOFTWARE.
 
 #include <hc.hpp>
 #include <hsa/hsa.h>
+#include <atomic>
 #include <unordered_map>
+#include <mutex>
 #include <stack>
+#include <vector>
 
 #include "hsa/hsa_ext_amd.h"
 #include "hip/hip_runtime.h"
 #include "hip_prof_api.h"
+#include "hip_trace.h"
 #include "hip_util.h"
+#include "adaptive_wait.hpp"
+#include "kernarg_buffer.hpp"
 #include "env.h"
 #include <unordered_map>
 
@@ -67,6 +73,13 @@ extern int HIP_PRINT_ENV;
 extern int HIP_ATP;
 extern int HIP_DB;
 extern int HIP_STAGING_SIZE;    /* size of staging buffers, in KB */
+extern int HIP_STAGING_BUFFERS; /* number of staging buffers per thread */
+extern int HIP_PIN_CACHE_SIZE;  /* pageable host memory kept pinned between copies, in MB */
+extern int HIP_PIN_CACHE_MIN_KB; /* smallest copy that pins its host range, in KB */
+extern int HIP_CALLBACK_THREADS; /* worker threads per device for stream callbacks */
+extern int HIP_COPY_THREADS; /* worker threads per device for async pageable copies */
+extern int HIP_STREAM_POOL_MAX_QUEUES; /* streams kept by the stream pool of a context */
+extern int HIP_WAIT_SPIN_US; /* longest spin of the adaptive wait policy */
 extern int HIP_STREAM_SIGNALS;  /* number of signals to allocate at stream creation */
 extern int HIP_VISIBLE_DEVICES; /* Contains a comma-separated sequence of GPU identifiers */
 extern int HIP_FORCE_P2P_HOST;
@@ -86,6 +99,9 @@ extern int HIP_FORCE_NULL_STREAM;
 extern int HIP_SYNC_FREE;
 
 extern int HIP_DUMP_CODE_OBJECT;
+extern std::string HIP_ELF_CACHE_PATH;
+extern std::string HIP_CODE_OBJECT_CACHE_PATH;
+extern int HIP_CODE_OBJECT_CACHE_SIZE;
 
 // TODO - remove when this is standard behavior.
 extern int HCC_OPT_FLUSH;
@@ -210,6 +226,11 @@ class ihipStream_t;
 class ihipDevice_t;
 class ihipCtx_t;
 struct ihipEventData_t;
+namespace hip_impl {
+class Callback_executor;
+template <typename Stream> class Stream_pool;
+template <typename Stream, typename Event> class Memory_pool;
+}
 
 // Color defs for debug messages:
 #define KNRM "\x1B[0m"
@@ -307,8 +328,16 @@ static inline uint64_t getTicks() { return hc::get_system_ticks(); }
 //---
 extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::string& apiStr);
 
+// Binary trace record for HIP_TRACE_API_FILE, pushed when the API returns.
+#define API_TRACE_BINARY(cid, ...)                                                                 \
+    hip_trace::ApiTraceScope hipApiTraceScope;                                                     \
+    if (hip_trace::g_apiTracer) {                                                                  \
+        hipApiTraceScope.begin(HIP_API_ID_##cid, tls->tidInfo.tid(), tls->tidInfo.apiSeqNum(),     \
+                               ##__VA_ARGS__);                                                     \
+    }
+
 #if (COMPILE_HIP_TRACE_API & 0x1)
-#define API_TRACE(forceTrace, ...)                                                                 \
+#define API_TRACE(cid, forceTrace, ...)                                                            \
     GET_TLS();                                                                                     \
     uint64_t hipApiStartTick = 0;                                                                  \
     {                                                                                              \
@@ -319,11 +348,14 @@ extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::st
             std::string fullStr;                                                                   \
             hipApiStartTick = recordApiTrace(tls, &fullStr, apiStr);                               \
         }                                                                                          \
-    }
+    }                                                                                              \
+    API_TRACE_BINARY(cid, ##__VA_ARGS__)
 
 #else
 // Swallow API_TRACE
-#define API_TRACE(IS_CMD, ...) GET_TLS(); tls->tidInfo.incApiSeqNum();
+#define API_TRACE(cid, IS_CMD, ...) GET_TLS(); tls->tidInfo.incApiSeqNum();                        \
+    uint64_t hipApiStartTick = 0;                                                                  \
+    API_TRACE_BINARY(cid, ##__VA_ARGS__)
 #endif
 
 #define ihipGetTlsDefaultCtx() iihipGetTlsDefaultCtx(tls)
@@ -336,7 +368,7 @@ extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::st
 // generates a trace string that can be output to stderr or to ATP file.
 #define HIP_INIT_API(cid, ...)                                                                     \
     hip_impl::hip_init();                                                                                    \
-    API_TRACE(0, __VA_ARGS__);                                                                     \
+    API_TRACE(cid, 0, ##__VA_ARGS__);                                                              \
     HIP_CB_SPAWNER_OBJECT(cid);
 
 
@@ -345,7 +377,7 @@ extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::st
 // kernel launches, copy commands, memory sets, etc.
 #define HIP_INIT_SPECIAL_API(cid, tbit, ...)                                                       \
     hip_impl::hip_init();                                                                                    \
-    API_TRACE((HIP_TRACE_API & (1 << tbit)), __VA_ARGS__);                                         \
+    API_TRACE(cid, (HIP_TRACE_API & (1 << tbit)), ##__VA_ARGS__);                                  \
     HIP_CB_SPAWNER_OBJECT(cid);
 
 
@@ -356,6 +388,7 @@ extern uint64_t recordApiTrace(TlsData *tls, std::string* fullStr, const std::st
     ({                                                                                                \
         hipError_t localHipStatus = hipStatus; /*local copy so hipStatus only evaluated once*/        \
         tls->lastHipError = localHipStatus;                                                           \
+        hipApiTraceScope.setStatus(localHipStatus);                                                   \
                                                                                                       \
         if ((COMPILE_HIP_TRACE_API & 0x2) && HIP_TRACE_API & (1 << TRACE_ALL)) {                      \
             auto ticks = getTicks() - hipApiStartTick;                                                \
@@ -480,6 +513,7 @@ class LockedAccessor {
         tprintf(DB_SYNC, "locking criticalData=%p for %s..\n", _criticalData,
                 ToString(_criticalData->_parent).c_str());
         _criticalData->_mutex.lock();
+        _criticalData->onLocked();
     };
 
     ~LockedAccessor() {
@@ -513,15 +547,26 @@ struct LockedBase {
     void unlock() { _mutex.unlock(); }
     bool try_lock() { return _mutex.try_lock(); }
 
+    // Called by LockedAccessor once the lock is held; derived types may hide it.
+    void onLocked() {}
+
     MUTEX_TYPE _mutex;
 };
 
 
+// Adds stream to its context's dirty list, see ihipStreamCriticalBase_t::onLocked.
+void ihipStreamMarkDirty(ihipStream_t* stream);
+
+// Counts a marker request on the stream's device as reused (hit) or newly created (miss).
+void ihipStreamCountMarker(ihipStream_t* stream, bool reused);
+
 template <typename MUTEX_TYPE>
 class ihipStreamCriticalBase_t : public LockedBase<MUTEX_TYPE> {
 public:
     ihipStreamCriticalBase_t(ihipStream_t* parentStream, hc::accelerator_view av)
-        :  _parent{parentStream}, _av{av}, _last_op_was_a_copy{false}
+        :  _parent{parentStream}, _av{av}, _last_op_was_a_copy{false},
+           _lockSeq{0}, _inDirtyList{false}, _lastMarkerSeq{0},
+           _lastMarkerScope{hc::no_scope}, _timedDispatches{false}, _lastDispatchSeq{0}
     {}
 
     ~ihipStreamCriticalBase_t() {}
@@ -544,9 +589,77 @@ public:
         return gotLock ? this : nullptr;
     };
 
+    // Every command is enqueued with the lock held, so marking the stream here
+    // keeps it on its context's dirty list whenever it may hold work the null
+    // stream has not waited for yet. See ihipCtx_t::locked_syncDefaultStream.
+    void onLocked() {
+        ++_lockSeq;
+        if (!_inDirtyList) {
+            _inDirtyList = true;
+            ihipStreamMarkDirty(_parent);
+        }
+    }
+
+    // Marker completing after all work enqueued so far, releasing at least
+    // scope. The last marker is recycled if no other lock holder could have
+    // enqueued work since: _lastMarkerSeq is the lock generation it belongs
+    // to, so a marker from an older generation is never handed out again.
+    const hc::completion_future& marker(hc::memory_scope scope = hc::accelerator_scope) {
+        const bool reuse = _lastMarkerSeq != 0 && _lastMarkerSeq + 1 == _lockSeq &&
+                           scopeCovers(_lastMarkerScope, scope);
+        if (!reuse) {
+            _lastMarker = _av.create_marker(scope);
+            _lastMarkerScope = scope;
+        }
+        ihipStreamCountMarker(_parent, reuse);
+        _lastMarkerSeq = _lockSeq;
+        return _lastMarker;
+    }
+
+    // Records cf, just enqueued by this lock holder, as the reusable marker.
+    void setMarker(const hc::completion_future& cf, hc::memory_scope scope) {
+        _lastMarker = cf;
+        _lastMarkerScope = scope;
+        _lastMarkerSeq = _lockSeq;
+    }
+
+    // Records cf, an in-order kernel dispatch just enqueued by this lock holder.
+    void setLastDispatch(const hc::completion_future& cf) {
+        _lastDispatch = cf;
+        _lastDispatchSeq = _lockSeq;
+    }
+
+    // Completion of the last kernel dispatch if nothing was enqueued after it,
+    // else nullptr. Same generation rule as marker().
+    const hc::completion_future* lastDispatch() {
+        if (_lastDispatchSeq == 0 || _lastDispatchSeq + 1 != _lockSeq) return nullptr;
+        _lastDispatchSeq = _lockSeq;
+        return &_lastDispatch;
+    }
+
     ihipStream_t* _parent;
     hc::accelerator_view _av;
     bool _last_op_was_a_copy;
+
+    uint64_t _lockSeq;  // number of times the lock was taken
+    bool _inDirtyList;
+    hc::completion_future _lastMarker;
+    uint64_t _lastMarkerSeq;
+    hc::memory_scope _lastMarkerScope;
+
+    // Set once a timing-only event is recorded on the stream; kernel
+    // dispatches are then tracked in _lastDispatch for later events to reuse.
+    bool _timedDispatches;
+    hc::completion_future _lastDispatch;
+    uint64_t _lastDispatchSeq;
+
+    // Staging for the packed arguments of kernel dispatches, reused by each one.
+    hip_impl::Kernarg_buffer _kernargs;
+
+private:
+    static bool scopeCovers(hc::memory_scope have, hc::memory_scope want) {
+        return have == want || have == hc::system_scope || want == hc::no_scope;
+    }
 };
 
 
@@ -608,7 +721,8 @@ class ihipStream_t {
     LockedAccessor_StreamCrit_t lockopen_preKernelCommand();
     void lockclose_postKernelCommand(const char* kernelName, hc::accelerator_view* av, bool unlockNotNeeded = 0);
 
-    void locked_wait(bool& waited);
+    // leaveDirtyList also takes the stream off its context's dirty list, under the same lock.
+    void locked_wait(bool& waited, bool leaveDirtyList = false);
     void locked_wait();
 
     hc::accelerator_view* locked_getAv() {
@@ -621,8 +735,29 @@ class ihipStream_t {
 
     ihipStreamCritical_t& criticalData() { return _criticalData; };
 
+    // Graph the stream is capturing into, see hip_graph.cpp, or nullptr.
+    ihipGraph_t* capture() const { return _capture.load(std::memory_order_acquire); }
+    void setCapture(ihipGraph_t* graph) { _capture.store(graph, std::memory_order_release); }
+
+    // True for streams created by the context's stream pool, set before they
+    // are handed out.
+    bool pooled() const { return _pooled; }
+    void setPooled() { _pooled = true; }
+
+    // Failure of work the stream ran on the host, such as a pageable copy on
+    // a copy thread, returned by the next synchronize or query of the stream.
+    // Only the first failure is kept.
+    void setAsyncError(hipError_t e) {
+        hipError_t none = hipSuccess;
+        _asyncError.compare_exchange_strong(none, e);
+    }
+    hipError_t takeAsyncError() { return _asyncError.exchange(hipSuccess); }
+
     //---
-    hc::hcWaitMode waitMode() const;
+    hip_impl::Wait_policy waitPolicy() const;
+
+    // Learns how long host waits on this stream take and keeps their statistics.
+    hip_impl::Adaptive_waiter& waiter() { return _waiter; }
 
     // Use this if we already have the stream critical data mutex:
     void wait(LockedAccessor_StreamCrit_t& crit);
@@ -677,6 +812,12 @@ class ihipStream_t {
     friend hipError_t hipStreamQuery(hipStream_t);
 
     ScheduleMode _scheduleMode;
+
+    hip_impl::Adaptive_waiter _waiter;
+
+    std::atomic<ihipGraph_t*> _capture;
+    bool _pooled;
+    std::atomic<hipError_t> _asyncError;
 };
 
 
@@ -770,12 +911,17 @@ class ihipEvent_t {
 
     ihipEventCritical_t& criticalData() { return _criticalData; };
 
+    // Learns how long hipEventSynchronize waits on this event take. The stream the event was
+    // recorded on may be destroyed before the wait, so it is not used.
+    hip_impl::Adaptive_waiter& waiter() { return _waiter; }
+
    public:
     unsigned _flags;
     int _deviceId;
 
    private:
     ihipEventCritical_t _criticalData;
+    hip_impl::Adaptive_waiter _waiter;
 
     friend hipError_t hipEventRecord(hipEvent_t event, hipStream_t stream);
 };
@@ -843,11 +989,27 @@ class ihipDevice_t {
 
     int _state;  // 1 if device is set otherwise 0
 
+    // Markers recycled from a stream's last marker vs. newly created.
+    std::atomic<uint64_t> _markerHits;
+    std::atomic<uint64_t> _markerMisses;
+
+    // Runs this device's stream callbacks, started on first use.
+    hip_impl::Callback_executor* callbackExecutor();
+
+    // Runs this device's hipMemcpyAsync copies to and from pageable memory, started on first use.
+    hip_impl::Callback_executor* copyExecutor();
+
    private:
     hipError_t initProperties(hipDeviceProp_t* prop);
 
    private:
     ihipDeviceCritical_t _criticalData;
+
+    std::once_flag _callbackExecutorOnce;
+    hip_impl::Callback_executor* _callbackExecutor = nullptr;
+
+    std::once_flag _copyExecutorOnce;
+    hip_impl::Callback_executor* _copyExecutor = nullptr;
 };
 //=============================================================================
 
@@ -953,6 +1115,15 @@ class ihipCtx_t {
     void locked_waitAllStreams();
     void locked_syncDefaultStream(bool waitOnSelf, bool syncHost);
 
+    // Called with stream's lock held, see ihipStreamCriticalBase_t::onLocked.
+    void markStreamDirty(ihipStream_t* stream);
+
+    // Streams handed out by hipExtStreamPoolAcquire, created on first use.
+    hip_impl::Stream_pool<ihipStream_t*>* streamPool();
+
+    // Blocks handed out by hipMallocAsync, created on first use.
+    hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>* memPool();
+
     ihipCtxCritical_t& criticalData() { return _criticalData; };
 
     const ihipDevice_t* getDevice() const { return _device; };
@@ -974,6 +1145,19 @@ class ihipCtx_t {
    private:
     ihipDevice_t* _device;
 
+    // Blocking streams whose lock was taken since the last null-stream barrier
+    // looked at them. Streams not on the list have no work the null stream
+    // still needs to wait for. Lock order: ctx critical data, stream, this.
+    std::mutex _dirtyStreamsMutex;
+    std::vector<ihipStream_t*> _dirtyStreams;
+
+    std::once_flag _streamPoolOnce;
+    hip_impl::Stream_pool<ihipStream_t*>* _streamPool = nullptr;
+
+    std::once_flag _memPoolOnce;
+    hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>* _memPool = nullptr;
+    hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>* newMemPool();
+
 
    private:  // Critical data, protected with locked access:
     // Members of _protected data MUST be accessed through the LockedAccessor.
@@ -998,6 +1182,10 @@ extern void ihipCtxStackUpdate();
 extern hipError_t ihipDeviceSetState(TlsData *tls);
 
 extern ihipDevice_t* ihipGetDevice(int);
+// Schedule mode for the hipDeviceSchedule* bits of a context's flags.
+ihipStream_t::ScheduleMode ihipScheduleMode(unsigned ctxFlags);
+// Wait policy for host waits with the given schedule mode, after HIP_WAIT_MODE.
+hip_impl::Wait_policy ihipWaitPolicy(ihipStream_t::ScheduleMode mode);
 ihipCtx_t* ihipGetPrimaryCtx(unsigned deviceIndex);
 hipError_t hipModuleGetFunctionEx(hipFunction_t* hfunc, hipModule_t hmod,
                                   const char* name, hsa_agent_t *agent);
@@ -1005,6 +1193,47 @@ hipError_t hipModuleGetFunctionEx(hipFunction_t* hfunc, hipModule_t hmod,
 
 hipStream_t ihipSyncAndResolveStream(hipStream_t, bool lockAcquired = 0);
 hipError_t ihipStreamSynchronize(TlsData *tls, hipStream_t stream);
+// Non-blocking stream of normal priority for a graph lane, see hip_graph.cpp.
+ihipStream_t* ihipStreamCreateLane(ihipCtx_t* ctx);
+void ihipStreamDestroy(ihipStream_t* stream);
+
+// Packs the explicit kernel arguments, given as kernelParams or extra, and the
+// implicit ones into kernargs.
+hipError_t ihipPackKernargs(hipFunction_t f, void** kernelParams, void** extra,
+                            void** impCoopParams, std::vector<char>& kernargs);
+
+//---
+// Stream capture, see hip_graph.cpp. A command issued to a capturing stream is
+// recorded as a node of its graph by these instead of being enqueued.
+inline bool ihipStreamCapturing(hipStream_t stream) {
+    return stream != nullptr && stream->capture() != nullptr;
+}
+// aql is complete but for its fences; globalWorkSize is in work-items.
+hipError_t ihipCaptureKernel(hipStream_t stream, hipFunction_t f, dim3 globalWorkSize,
+                             dim3 blockDim, size_t sharedMemBytes,
+                             const hsa_kernel_dispatch_packet_t& aql, std::vector<char> kernargs);
+// The arguments of ihipCaptureKernel, for ihipCaptureKernels.
+struct ihipCapturedKernel {
+    hipFunction_t function;
+    dim3 globalWorkSize;
+    dim3 blockDim;
+    size_t sharedMemBytes;
+    hsa_kernel_dispatch_packet_t aql;
+    std::vector<char> kernargs;
+};
+// Captures kernels as consecutive nodes, all of them or none.
+hipError_t ihipCaptureKernels(hipStream_t stream, std::vector<ihipCapturedKernel> kernels);
+hipError_t ihipCaptureMemcpy(hipStream_t stream, void* dst, const void* src, size_t sizeBytes,
+                             hipMemcpyKind kind);
+hipError_t ihipCaptureEventRecord(hipStream_t stream, hipEvent_t event);
+// Returns false if the wait is not part of a capture and has to be enqueued.
+bool ihipCaptureStreamWaitEvent(hipStream_t stream, hipEvent_t event, hipError_t* status);
+// For a command a graph can't record: fails the capture of stream, so that
+// ending it returns no graph, and returns hipErrorNotSupported.
+hipError_t ihipCaptureUnsupported(hipStream_t stream);
+// Removes stream, about to be destroyed, from its capture. Destroying the
+// stream that began a capture drops the capture.
+void ihipStreamLeaveCapture(ihipStream_t* stream);
 
 /**
  * @brief Copies the memory address and size of symbol @p symbolName
@@ -1071,6 +1300,9 @@ hipError_t ihipHostMalloc(TlsData *tls, void** ptr, size_t sizeBytes, unsigned i
 
 hipError_t ihipHostFree(TlsData *tls, void* ptr);
 
+// Forgets every allocation in the pointer index, once a device reset has freed them.
+void clearPointerIndex();
+
 };
 
 #define MAX_COOPERATIVE_GPUs 255
@@ -26,10 +26,16 @@ THE SOFTWARE.
 
 #include "hip/hip_runtime.h"
 #include "hip_hcc_internal.h"
+#include "callback_executor.hpp"
+#include "mem_pool.hpp"
+#include "pin_cache.hpp"
+#include "range_index.hpp"
 #include "trace_helper.h"
 
+#include <algorithm>
 #include <functional>
 #include <fstream>
+#include <vector>
 
 #if __HIP_ENABLE_DEVICE_MALLOC__
 __device__ char __hip_device_heap[__HIP_SIZE_OF_HEAP];
@@ -145,7 +151,7 @@ namespace {
     constexpr std::uint32_t is_cpu_owned{UINT32_MAX};
 
     inline
-    hsa_amd_pointer_info_t info(const void* p)
+    hsa_amd_pointer_info_t hsa_info(const void* p)
     {
         hsa_amd_pointer_info_t r{sizeof(hsa_amd_pointer_info_t)};
         throwing_result_check(
@@ -158,43 +164,156 @@ namespace {
         return r;
     }
 
-    constexpr size_t staging_sz{4 * 1024 * 1024};     // 2 Pages.
+    // Allocations made by allocAndSharePtr with their hsa_info(), so that
+    // copies resolve them without two calls into HSA per pointer. Entries are
+    // erased before the memory is freed.
+    inline
+    hip_impl::Range_index<hsa_amd_pointer_info_t>& pointer_index()
+    {
+        static auto* r = new hip_impl::Range_index<hsa_amd_pointer_info_t>;
+        return *r;
+    }
+
+    inline
+    hsa_amd_pointer_info_t info(const void* p)
+    {
+        hip_impl::Range_index<hsa_amd_pointer_info_t>::Range r;
+        if (pointer_index().find(p, r)) return r.value;
+
+        return hsa_info(p);
+    }
+
     constexpr size_t max_h2d_std_memcpy_sz{8 * 1024}; // 8 KiB.
     constexpr size_t max_d2h_std_memcpy_sz{64};       // 1 cacheline.
 
-    thread_local const std::unique_ptr<void, void (*)(void *)> staging_buffer{
-        []() {
-            hsa_region_t r{};
-            throwing_result_check(hsa_agent_iterate_regions(
-                cpu_agent(), [](hsa_region_t x, void *p) {
-                hsa_region_segment_t seg{};
-                throwing_result_check(
-                    hsa_region_get_info(x, HSA_REGION_INFO_SEGMENT, &seg),
-                    __FILE__, __func__, __LINE__);
+    inline
+    hsa_region_t staging_region() {
+        hsa_region_t r{};
+        throwing_result_check(hsa_agent_iterate_regions(
+            cpu_agent(), [](hsa_region_t x, void *p) {
+            hsa_region_segment_t seg{};
+            throwing_result_check(
+                hsa_region_get_info(x, HSA_REGION_INFO_SEGMENT, &seg),
+                __FILE__, __func__, __LINE__);
 
-                if (seg != HSA_REGION_SEGMENT_GLOBAL) return HSA_STATUS_SUCCESS;
+            if (seg != HSA_REGION_SEGMENT_GLOBAL) return HSA_STATUS_SUCCESS;
 
-                uint32_t flags{};
-                throwing_result_check(hsa_region_get_info(
-                    x, HSA_REGION_INFO_GLOBAL_FLAGS, &flags),
-                    __FILE__, __func__, __LINE__);
+            uint32_t flags{};
+            throwing_result_check(hsa_region_get_info(
+                x, HSA_REGION_INFO_GLOBAL_FLAGS, &flags),
+                __FILE__, __func__, __LINE__);
 
-                if (flags & HSA_REGION_GLOBAL_FLAG_COARSE_GRAINED) {
-                    *static_cast<hsa_region_t *>(p) = x;
+            if (flags & HSA_REGION_GLOBAL_FLAG_COARSE_GRAINED) {
+                *static_cast<hsa_region_t *>(p) = x;
 
-                    return HSA_STATUS_INFO_BREAK;
-                }
+                return HSA_STATUS_INFO_BREAK;
+            }
+
+            return HSA_STATUS_SUCCESS;
+        }, &r), __FILE__, __func__, __LINE__);
+
+        return r;
+    }
+
+    // Stream whose synchronous copy this thread is running; the copy's DMA
+    // waits use its wait policy and count in its statistics.
+    thread_local ihipStream_t* copy_stream{};
+
+    struct Copy_stream_scope {
+        explicit Copy_stream_scope(ihipStream_t* s) { copy_stream = s; }
+        ~Copy_stream_scope() { copy_stream = nullptr; }
+    };
+
+    inline
+    void wait_copy_signal(hsa_signal_t signal) {
+        thread_local hip_impl::Adaptive_waiter thread_waiter{
+            static_cast<uint64_t>(std::max(HIP_WAIT_SPIN_US, 0)) * 1000};
+
+        hip_impl::Adaptive_waiter& waiter{
+            copy_stream ? copy_stream->waiter() : thread_waiter};
+        waiter.wait(
+            copy_stream ? copy_stream->waitPolicy()
+                        : ihipWaitPolicy(ihipStream_t::Auto),
+            [=]() { return hsa_signal_load_relaxed(signal) == 0; },
+            [=](bool blocking) {
+                while (hsa_signal_wait_relaxed(
+                    signal, HSA_SIGNAL_CONDITION_EQ, 0, UINT64_MAX,
+                    blocking ? HSA_WAIT_STATE_BLOCKED : HSA_WAIT_STATE_ACTIVE));
+            });
+    }
+
+    // Per-thread ring of pinned staging buffers for copies to and from
+    // pageable memory, which is streamed through it in chunks rather than
+    // locked. Each slot has its own completion signal, so the CPU can fill
+    // or drain one slot while the DMA engine works on the others. A slot is
+    // always waited on before reuse, so a copy abandoned by an exception
+    // cannot corrupt the next one.
+    class Staging_ring {
+    public:
+        struct Slot {
+            void* buffer{};
+            hsa_signal_t signal{};
+            bool busy{};
+        };
+
+        Staging_ring()
+            : chunk_{static_cast<size_t>(std::max(HIP_STAGING_SIZE, 4)) * 1024},
+              slots_(std::max(HIP_STAGING_BUFFERS, 1)) {
+            const hsa_region_t r{staging_region()};
+            hsa_agent_t cpu{cpu_agent()};
+            for (auto&& x : slots_) {
+                throwing_result_check(hsa_memory_allocate(r, chunk_, &x.buffer),
+                                      __FILE__, __func__, __LINE__);
+                throwing_result_check(hsa_signal_create(0, 1, &cpu, &x.signal),
+                                      __FILE__, __func__, __LINE__);
+            }
+        }
+
+        ~Staging_ring() {
+            drain();
+            for (auto&& x : slots_) {
+                if (x.signal.handle) hsa_signal_destroy(x.signal);
+                if (x.buffer) hsa_memory_free(x.buffer);
+            }
+        }
+
+        Staging_ring(const Staging_ring&) = delete;
+        Staging_ring& operator=(const Staging_ring&) = delete;
+
+        size_t chunk() const { return chunk_; }
+        size_t depth() const { return slots_.size(); }
+
+        // Slot for the i-th chunk of a copy, once its previous DMA is done.
+        Slot& acquire(size_t i) {
+            Slot& x = slots_[i % slots_.size()];
+            wait(x);
+            return x;
+        }
+
+        void copy_async(Slot& x, void* dst, const void* src, size_t n, hsa_agent_t a) {
+            hsa_signal_silent_store_relaxed(x.signal, 1);
+            throwing_result_check(
+                hsa_amd_memory_async_copy(dst, a, src, a, n, 0, nullptr, x.signal),
+                __FILE__, __func__, __LINE__);
+            x.busy = true;
+        }
 
-                return HSA_STATUS_SUCCESS;
-            }, &r), __FILE__, __func__, __LINE__);
+        void wait(Slot& x) {
+            if (!x.busy) return;
+            wait_copy_signal(x.signal);
+            x.busy = false;
+        }
+
+        void drain() {
+            for (auto&& x : slots_) wait(x);
+        }
 
-            void *tp{};
-            throwing_result_check(hsa_memory_allocate(r, staging_sz, &tp),
-                                  __FILE__, __func__, __LINE__);
+    private:
+        const size_t chunk_;
+        std::vector<Slot> slots_;
+    };
 
-            return tp;
-        }(),
-        [](void *ptr) { hsa_memory_free(ptr); }};
+    thread_local Staging_ring staging_ring;
 
     thread_local hsa_signal_t copy_signal{[]() {
         hsa_agent_t cpu{cpu_agent()};
@@ -204,8 +323,33 @@ namespace {
 
         return sgn;
     }()};
+
+    // Pageable host ranges kept pinned between copies, for every device.
+    hip_impl::Pin_cache& pin_cache() {
+        static auto* r = []() {
+            hip_impl::Pin_cache::Hooks hooks;
+            hooks.lock = [](void* base, size_t size) -> void* {
+                std::vector<hsa_agent_t> agents;
+                for (unsigned i = 0; i < g_deviceCnt; ++i) {
+                    agents.push_back(ihipGetDevice(i)->_hsaAgent);
+                }
+                void* agent_ptr = nullptr;
+                if (hsa_amd_memory_lock(base, size, agents.data(), agents.size(),
+                                        &agent_ptr) != HSA_STATUS_SUCCESS) {
+                    return nullptr;
+                }
+                return agent_ptr;
+            };
+            hooks.unlock = [](void* base) { hsa_amd_memory_unlock(base); };
+            return new hip_impl::Pin_cache{
+                std::move(hooks), static_cast<size_t>(std::max(HIP_PIN_CACHE_SIZE, 0)) << 20};
+        }();
+        return *r;
+    }
 } // Unnamed namespace.
 
+void clearPointerIndex() { pointer_index().clear(); }
+
 inline
 void do_copy(void* __restrict dst, const void* __restrict src, size_t n,
              hsa_agent_t da, hsa_agent_t sa) {
@@ -214,8 +358,7 @@ void do_copy(void* __restrict dst, const void* __restrict src, size_t n,
         hsa_amd_memory_async_copy(dst, da, src, sa, n, 0, nullptr, copy_signal),
         __FILE__, __func__, __LINE__);
 
-    while (hsa_signal_wait_relaxed(copy_signal, HSA_SIGNAL_CONDITION_EQ, 0,
-                                   UINT64_MAX, HSA_WAIT_STATE_ACTIVE));
+    wait_copy_signal(copy_signal);
 }
 
 inline
@@ -226,10 +369,71 @@ void do_std_memcpy(
     return std::atomic_thread_fence(std::memory_order_seq_cst);
 }
 
+// Host to device through the staging ring: the std::memcpy of chunk i + 1
+// overlaps the DMA of chunk i.
+inline
+void h2d_staged_copy(void* __restrict dst, const void* __restrict src, size_t n,
+                     hsa_agent_t agent) {
+    Staging_ring& ring = staging_ring;
+    for (size_t i = 0, offset = 0; offset < n; ++i, offset += ring.chunk()) {
+        const size_t m = std::min(ring.chunk(), n - offset);
+        auto& slot = ring.acquire(i);
+        std::memcpy(slot.buffer, static_cast<const char*>(src) + offset, m);
+        ring.copy_async(slot, static_cast<char*>(dst) + offset, slot.buffer, m, agent);
+    }
+    ring.drain();
+}
+
+// Device to host through the staging ring: DMAs run up to depth() chunks
+// ahead of the std::memcpy out of the ring.
+inline
+void d2h_staged_copy(void* __restrict dst, const void* __restrict src, size_t n,
+                     hsa_agent_t agent) {
+    Staging_ring& ring = staging_ring;
+    const size_t chunks = (n + ring.chunk() - 1) / ring.chunk();
+    const auto issue = [&](size_t i) {
+        const size_t offset = i * ring.chunk();
+        const size_t m = std::min(ring.chunk(), n - offset);
+        auto& slot = ring.acquire(i);
+        ring.copy_async(slot, slot.buffer, static_cast<const char*>(src) + offset, m, agent);
+    };
+
+    for (size_t i = 0; i != std::min(ring.depth(), chunks); ++i) issue(i);
+    for (size_t i = 0; i != chunks; ++i) {
+        const size_t offset = i * ring.chunk();
+        const size_t m = std::min(ring.chunk(), n - offset);
+        auto& slot = ring.acquire(i);
+        std::memcpy(static_cast<char*>(dst) + offset, slot.buffer, m);
+        if (i + ring.depth() < chunks) issue(i + ring.depth());
+    }
+}
+
+// Copies through the pin cache when it holds the host side, pinning it first
+// if it is pageable and the copy large enough. Memory the application locked
+// itself is only looked up.
+inline
+bool pin_cached_copy(void* __restrict dst, const void* __restrict src, size_t n,
+                     const void* host, hsa_amd_pointer_info_t hi, hsa_agent_t agent) {
+    hip_impl::Pin_cache& cache = pin_cache();
+    if (!cache.enabled()) return false;
+
+    const bool pageable = hi.type == HSA_EXT_POINTER_TYPE_UNKNOWN;
+    if (!pageable && hi.type != HSA_EXT_POINTER_TYPE_LOCKED) return false;
+
+    const size_t min_pin = static_cast<size_t>(std::max(HIP_PIN_CACHE_MIN_KB, 0)) * 1024;
+    const auto pin = cache.acquire(host, n, pageable && n >= min_pin);
+    if (!pin) return false;
+
+    if (host == dst) dst = pin.device_ptr();
+    else src = pin.device_ptr();
+    do_copy(dst, src, n, agent, agent);
+
+    return true;
+}
+
 inline
 void d2h_copy(void* __restrict dst, const void* __restrict src, size_t n,
-              hsa_amd_pointer_info_t si) {
-    const auto di{info(dst)};
+              hsa_amd_pointer_info_t di, hsa_amd_pointer_info_t si) {
     const auto is_locked{di.type == HSA_EXT_POINTER_TYPE_LOCKED};
 
     if (!is_locked && si.size == is_cpu_owned) {
@@ -241,33 +445,22 @@ void d2h_copy(void* __restrict dst, const void* __restrict src, size_t n,
     if (di.type == HSA_EXT_POINTER_TYPE_HSA) {
         return do_copy(dst, src, n, si.agentOwner, si.agentOwner);
     }
-    
+    if (pin_cached_copy(dst, src, n, dst, di, si.agentOwner)) return;
+
     if (is_locked) {
         dst = static_cast<char*>(di.agentBaseAddress) +
               (static_cast<char*>(dst) -
                static_cast<char*>(di.hostBaseAddress));
         do_copy(dst, src, n, si.agentOwner, si.agentOwner);
     }
-    else if (n <= staging_sz) {
-        do_copy(staging_buffer.get(), src, n, si.agentOwner, si.agentOwner);
-        std::memcpy(dst, staging_buffer.get(), n);
-    }
     else {
-        std::unique_ptr<void, void (*)(void*)> lck{
-            dst, [](void* p) { hsa_amd_memory_unlock(p); }};
-
-        throwing_result_check(hsa_amd_memory_lock(dst, n, &si.agentOwner, 1,
-                                                  const_cast<void**>(&dst)),
-                              __FILE__, __func__, __LINE__);
-
-        do_copy(dst, src, n, si.agentOwner, si.agentOwner);
+        d2h_staged_copy(dst, src, n, si.agentOwner);
     }
 }
 
 inline
 void h2d_copy(void* __restrict dst, const void* __restrict src, size_t n,
-              hsa_amd_pointer_info_t di) {
-    const auto si{info(const_cast<void*>(src))};
+              hsa_amd_pointer_info_t di, hsa_amd_pointer_info_t si) {
     const auto is_locked{si.type == HSA_EXT_POINTER_TYPE_LOCKED};
 
     if (!is_locked && di.size == is_cpu_owned) {
@@ -279,6 +472,7 @@ void h2d_copy(void* __restrict dst, const void* __restrict src, size_t n,
     if (si.type == HSA_EXT_POINTER_TYPE_HSA) {
         return do_copy(dst, src, n, di.agentOwner, di.agentOwner);
     }
+    if (pin_cached_copy(dst, src, n, src, si, di.agentOwner)) return;
 
     if (is_locked) {
         src = static_cast<char*>(si.agentBaseAddress) +
@@ -286,20 +480,8 @@ void h2d_copy(void* __restrict dst, const void* __restrict src, size_t n,
             static_cast<char*>(si.hostBaseAddress));
         do_copy(dst, src, n, di.agentOwner, di.agentOwner);
     }
-    else if (n <= staging_sz) {
-        std::memcpy(staging_buffer.get(), src, n);
-        do_copy(dst, staging_buffer.get(), n, di.agentOwner, di.agentOwner);
-    }
     else {
-        std::unique_ptr<void, void (*)(void*)> lck{
-            const_cast<void*>(src), [](void* p) { hsa_amd_memory_unlock(p); }};
-
-        throwing_result_check(hsa_amd_memory_lock(const_cast<void*>(src), n,
-                                                  &di.agentOwner, 1,
-                                                  const_cast<void**>(&src)),
-                              __FILE__, __func__, __LINE__);
-
-        do_copy(dst, src, n, di.agentOwner, di.agentOwner);
+        h2d_staged_copy(dst, src, n, di.agentOwner);
     }
 }
 
@@ -309,8 +491,8 @@ void generic_copy(void* __restrict dst, const void* __restrict src, size_t n,
     if (di.size == is_cpu_owned && si.size == is_cpu_owned) {
         return do_std_memcpy(dst, src, n);
     }
-    if (di.size == is_cpu_owned) return d2h_copy(dst, src, n, si);
-    if (si.size == is_cpu_owned) return h2d_copy(dst, src, n, di);
+    if (di.size == is_cpu_owned) return d2h_copy(dst, src, n, di, si);
+    if (si.size == is_cpu_owned) return h2d_copy(dst, src, n, di, si);
 
     hsa_status_t res = hsa_amd_agents_allow_access(1u, &si.agentOwner,
                                                    nullptr, di.agentBaseAddress);
@@ -343,8 +525,8 @@ void memcpy_impl(void* __restrict dst, const void* __restrict src, size_t n,
     }
     switch (k) {
     case hipMemcpyHostToHost: std::memcpy(dst, src, n); break;
-    case hipMemcpyHostToDevice: return h2d_copy(dst, src, n, di);
-    case hipMemcpyDeviceToHost: return d2h_copy(dst, src, n, si);
+    case hipMemcpyHostToDevice: return h2d_copy(dst, src, n, di, si);
+    case hipMemcpyDeviceToHost: return d2h_copy(dst, src, n, di, si);
     case hipMemcpyDeviceToDevice: {
         hsa_status_t res = hsa_amd_agents_allow_access(1u, &si.agentOwner,
                                                        nullptr, di.agentBaseAddress);
@@ -361,16 +543,121 @@ void memcpy_impl(void* __restrict dst, const void* __restrict src, size_t n,
     }
 }
 
+// hipMemcpyAsync between pageable host memory and device memory, run by the
+// device's copy threads once the work queued before it on the stream is done.
+// A marker behind it holds back the work queued after it until it completes.
+struct Pageable_copy : hip_impl::Callback_executor::Task {
+    void* dst;
+    const void* src;
+    size_t n;
+    hipMemcpyKind kind;
+    ihipStream_t* stream;
+    hsa_signal_t signal;
+    hip_impl::Callback_executor* executor;
+
+    static void runTask(Task* t) {
+        Pageable_copy* c = static_cast<Pageable_copy*>(t);
+        // There is no caller left to return an error to: record it on the
+        // stream for its next synchronize or query, and release the stream
+        // rather than hang it.
+        try {
+            Copy_stream_scope scope{c->stream};
+            memcpy_impl(c->dst, c->src, c->n, c->kind);
+        }
+        catch (const ihipException& ex) {
+            tprintf(DB_MEM, "hipMemcpyAsync of %zu bytes from %p to %p failed: %s\n", c->n,
+                    c->src, c->dst, hipGetErrorName(ex._code));
+            c->stream->setAsyncError(ex._code);
+        }
+        catch (const std::exception& ex) {
+            tprintf(DB_MEM, "hipMemcpyAsync of %zu bytes from %p to %p failed: %s\n", c->n,
+                    c->src, c->dst, ex.what());
+            c->stream->setAsyncError(hipErrorUnknown);
+        }
+        hsa_signal_store_screlease(c->signal, 0);
+        delete c;
+    }
+};
+
+inline
+bool is_pageable_copy(const void* dst, const void* src) {
+    const auto pageable = [](const hsa_amd_pointer_info_t& x) {
+        return x.type == HSA_EXT_POINTER_TYPE_UNKNOWN;
+    };
+    const auto device = [](const hsa_amd_pointer_info_t& x) {
+        return x.type == HSA_EXT_POINTER_TYPE_HSA && x.size != is_cpu_owned;
+    };
+    const auto di{info(dst)};
+    const auto si{info(src)};
+
+    return (pageable(si) && device(di)) || (device(si) && pageable(di));
+}
+
+// Hands a copy to or from pageable memory to the copy threads of the
+// stream's device, so it no longer blocks the caller. Returns false, leaving
+// the copy to the caller, if the copy threads are disabled or the copy is of
+// another kind.
+inline
+bool pageable_copyAsync(void* dst, const void* src, size_t sizeBytes,
+                        hipMemcpyKind kind, ihipStream_t* stream) {
+    if (HIP_COPY_THREADS <= 0 || HIP_FORCE_SYNC_COPY) return false;
+    if (kind == hipMemcpyHostToHost || kind == hipMemcpyDeviceToDevice) return false;
+    if (!is_pageable_copy(dst, src)) return false;
+
+    LockedAccessor_StreamCrit_t cs{stream->criticalData()};
+
+    // As in hipStreamAddCallback: the first marker's signal drops from 2 to 1
+    // once the preceding work is done, and the copy posted then stores 0,
+    // which releases the blocking marker.
+    auto cf = cs->_av.create_marker(hc::no_scope);
+    auto signal = *reinterpret_cast<hsa_signal_t*>(cf.get_native_handle());
+    hsa_signal_add_relaxed(signal, 1);
+
+    auto c = new Pageable_copy;
+    c->run = &Pageable_copy::runTask;
+    c->dst = dst;
+    c->src = src;
+    c->n = sizeBytes;
+    c->kind = kind;
+    c->stream = stream;
+    c->signal = signal;
+    c->executor = stream->getCtx()->getWriteableDevice()->copyExecutor();
+
+    if (hsa_amd_signal_async_handler(signal, HSA_SIGNAL_CONDITION_EQ, 1,
+            [](hsa_signal_value_t x, void* p) {
+                Pageable_copy* c = static_cast<Pageable_copy*>(p);
+                c->executor->post(c->stream, c);
+                return false;
+            }, c) != HSA_STATUS_SUCCESS) {
+        hsa_signal_subtract_relaxed(signal, 1);
+        delete c;
+        return false;
+    }
+
+    cs->_av.create_blocking_marker(cf, hc::no_scope);
+    cs->_last_op_was_a_copy = true;
+
+    tprintf(DB_COPY, "pageable copyAsync dst=%p src=%p sz=%zu on copy thread\n",
+            dst, src, sizeBytes);
+
+    if (HIP_API_BLOCKING) stream->wait(cs);
+
+    return true;
+}
+
 hipError_t memcpyAsync(void* dst, const void* src, size_t sizeBytes,
                        hipMemcpyKind kind, hipStream_t stream) {
     if (sizeBytes == 0) return hipSuccess;
     if (!dst || !src) return hipErrorInvalidValue;
+    if (ihipStreamCapturing(stream)) return ihipCaptureMemcpy(stream, dst, src, sizeBytes, kind);
 
     try {
         stream = ihipSyncAndResolveStream(stream);
 
         if (!stream) return hipErrorInvalidValue;
 
+        if (pageable_copyAsync(dst, src, sizeBytes, kind, stream)) return hipSuccess;
+
         stream->locked_copyAsync(dst, src, sizeBytes, kind);
     }
     catch (const ihipException& ex) {
@@ -398,8 +685,9 @@ hipError_t memcpySync(void* dst, const void* src, size_t sizeBytes,
         if (!stream) return hipErrorInvalidValue;
 
         LockedAccessor_StreamCrit_t cs{stream->criticalData()};
-        cs->_av.wait();
+        stream->wait(cs);
 
+        Copy_stream_scope scope{stream};
         memcpy_impl(dst, src, sizeBytes, kind);
         cs->_last_op_was_a_copy = true;
     }
@@ -495,6 +783,7 @@ void* allocAndSharePtr(const char* msg, size_t sizeBytes, ihipCtx_t* ctx, bool s
             ptr = nullptr;
         }
     }
+    if (ptr != nullptr) pointer_index().insert(ptr, sizeBytes, hsa_info(ptr));
 
     return ptr;
 }
@@ -584,6 +873,7 @@ hipError_t ihipHostFree(TlsData *tls, void* ptr) {
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, ptr);
         if (status == AM_SUCCESS) {
             if (amPointerInfo._hostPointer == ptr) {
+                pointer_index().erase(ptr);
                 hc::am_free(ptr);
                 hipStatus = hipSuccess;
             }
@@ -1164,6 +1454,8 @@ hipError_t hipHostRegister(void* hostPtr, size_t sizeBytes, unsigned int flags)
     if (hostPtr == NULL) {
         return ihipLogStatus(hipErrorInvalidValue);
     }
+    // The pin cache may hold pages of the range locked.
+    pin_cache().invalidate(hostPtr, sizeBytes);
 
     hc::accelerator acc;
 #if (__hcc_workweek__ >= 17332)
@@ -1247,6 +1539,26 @@ hipError_t hipHostUnregister(void* hostPtr) {
     return ihipLogStatus(hip_status);
 }
 
+hipError_t hipExtPinCacheGetStats(hipExtPinCacheStats_t* stats) {
+    HIP_INIT_API(hipExtPinCacheGetStats, stats);
+
+    if (stats == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+
+    const auto s = pin_cache().stats();
+    stats->budget = s.budget;
+    stats->pinned = s.pinned;
+    stats->peakPinned = s.peak_pinned;
+    stats->lookups = s.lookups;
+    stats->hits = s.hits;
+    stats->misses = s.misses;
+    stats->pins = s.pins;
+    stats->evictions = s.evictions;
+    stats->invalidations = s.invalidations;
+    stats->rejected = s.rejected;
+
+    return ihipLogStatus(hipSuccess);
+}
+
 namespace hip_impl {
 hipError_t hipMemcpyToSymbol(void* dst, const void* src, size_t count,
                              size_t offset, hipMemcpyKind kind,
@@ -1408,6 +1720,8 @@ hipError_t hipMemcpyWithStream(void* dst, const void* src, size_t sizeBytes,
     HIP_INIT_SPECIAL_API(hipMemcpyWithStream, (TRACE_MCMD), dst, src, sizeBytes,
                          kind, stream);
 
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
     return ihipLogStatus(hip_internal::memcpySync(dst, src, sizeBytes, kind,
                                                   stream));
 }
@@ -1718,6 +2032,7 @@ hipError_t hipMemcpy3D(const struct hipMemcpy3DParms* p) {
 
 hipError_t hipMemcpy3DAsync(const struct hipMemcpy3DParms* p, hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipMemcpy3DAsync, (TRACE_MCMD), p, stream);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
     hipError_t e = hipSuccess;
     e = ihipMemcpy3D(p, stream, true);
     return ihipLogStatus(e);
@@ -1846,7 +2161,7 @@ hipError_t ihipMemsetAsync(void* dst, int  value, size_t count, hipStream_t stre
         return hipErrorInvalidValue;
     }
 
-    if (HIP_API_BLOCKING) {
+    if (HIP_API_BLOCKING && !ihipStreamCapturing(stream)) {
         tprintf (DB_SYNC, "%s LAUNCH_BLOCKING wait for hipMemsetAsync.\n", ToString(stream).c_str());
         stream->locked_wait();
     }
@@ -1933,7 +2248,7 @@ hipError_t ihipMemsetSync(void* dst, int  value, size_t count, hipStream_t strea
 	    if (!stream) return hipErrorInvalidValue;
 
         LockedAccessor_StreamCrit_t crit(stream->criticalData());
-        crit->_av.wait(stream->waitMode());
+        stream->wait(crit);
         const auto s = hsa_amd_memory_fill(aligned_dst, value, n);
         if (s != HSA_STATUS_SUCCESS) return hipErrorInvalidValue;
     }
@@ -1967,6 +2282,19 @@ hipError_t getLockedPointer(void *hostPtr, size_t dataLen, void **devicePtrPtr)
         return(hipErrorHostMemoryNotRegistered);
 }
 
+// Pins the pageable host side of a 2D copy as one range, so that its rows hit
+// the pin cache instead of each going through the staging buffers.
+static hip_impl::Pin_cache::Pin ihipPinHostExtent(const void* host, size_t pitch, size_t width,
+                                                  size_t height) {
+    hip_impl::Pin_cache& cache = pin_cache();
+    const size_t extent = pitch * (height - 1) + width;
+    const size_t min_pin = static_cast<size_t>(std::max(HIP_PIN_CACHE_MIN_KB, 0)) * 1024;
+    if (!cache.enabled() || extent < min_pin) return {};
+    if (info(host).type != HSA_EXT_POINTER_TYPE_UNKNOWN) return {};
+
+    return cache.acquire(host, extent, true);
+}
+
 // TODO - review and optimize
 hipError_t ihipMemcpy2D(void* dst, size_t dpitch, const void* src, size_t spitch, size_t width,
                         size_t height, hipMemcpyKind kind) {
@@ -2000,6 +2328,9 @@ hipError_t ihipMemcpy2D(void* dst, size_t dpitch, const void* src, size_t spitch
     } else {
         try {
             if(!isLockedOrD2D) {
+                const auto pin = (kind == hipMemcpyHostToDevice)
+                                     ? ihipPinHostExtent(src, spitch, width, height)
+                                     : ihipPinHostExtent(dst, dpitch, width, height);
                 for (int i = 0; i < height; ++i)
                     stream->locked_copySync((unsigned char*)dst + i * dpitch,
                                     (unsigned char*)src + i * spitch, width, kind);
@@ -2073,6 +2404,7 @@ hipError_t ihipMemcpy2DAsync(void* dst, size_t dpitch, const void* src, size_t s
 hipError_t hipMemcpy2DAsync(void* dst, size_t dpitch, const void* src, size_t spitch, size_t width,
                             size_t height, hipMemcpyKind kind, hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipMemcpy2DAsync, (TRACE_MCMD), dst, dpitch, src, spitch, width, height, kind, stream);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
     hipError_t e = hipSuccess;
     e = ihipMemcpy2DAsync(dst, dpitch, src, spitch, width, height, kind, stream);
     return ihipLogStatus(e);
@@ -2148,6 +2480,7 @@ hipError_t hipMemcpyParam2D(const hip_Memcpy2D* pCopy) {
 
 hipError_t hipMemcpyParam2DAsync(const hip_Memcpy2D* pCopy, hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipMemcpyParam2DAsync, (TRACE_MCMD), pCopy, stream);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
     return ihipLogStatus(ihipMemcpyParam2D(pCopy, stream, true));
 }
 
@@ -2180,6 +2513,7 @@ hipError_t hipMemcpy2DFromArray( void* dst, size_t dpitch, hipArray_const_t src,
 
 hipError_t hipMemcpy2DFromArrayAsync( void* dst, size_t dpitch, hipArray_const_t src, size_t wOffset, size_t hOffset, size_t width, size_t height, hipMemcpyKind kind, hipStream_t stream ){
     HIP_INIT_SPECIAL_API(hipMemcpy2DFromArrayAsync, (TRACE_MCMD), dst, dpitch, src, wOffset, hOffset, width, height, kind, stream);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
     size_t byteSize;
     if (height == 0 || width == 0) return ihipLogStatus(hipSuccess);
     if(src) {
@@ -2341,6 +2675,129 @@ hipError_t hipMemPtrGetInfo(void* ptr, size_t* size) {
 }
 
 
+//---
+hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>* ihipCtx_t::memPool() {
+    std::call_once(_memPoolOnce, [this]() { _memPool = newMemPool(); });
+    return _memPool;
+}
+
+hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>* ihipCtx_t::newMemPool() {
+    hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>::Hooks hooks;
+    hooks.allocate = [this](size_t size) {
+        return hip_internal::allocAndSharePtr("device_mem", size, this, false /*shareWithAll*/,
+                                              0 /*amFlags*/, 0 /*hipFlags*/, 0);
+    };
+    hooks.release = [](void* ptr, hc::completion_future&) {
+        hip_internal::pointer_index().erase(ptr);
+        hc::am_free(ptr);
+    };
+    hooks.record = [](ihipStream_t* stream, hc::completion_future& cf) {
+        LockedAccessor_StreamCrit_t crit(stream->criticalData());
+        cf = crit->marker();
+    };
+    hooks.done = [](hc::completion_future& cf) { return cf.is_ready(); };
+    hooks.wait = [](ihipStream_t* stream, hc::completion_future& cf) {
+        LockedAccessor_StreamCrit_t crit(stream->criticalData());
+        crit->_av.create_blocking_marker(cf, hc::accelerator_scope);
+    };
+    return new hip_impl::Memory_pool<ihipStream_t*, hc::completion_future>(std::move(hooks));
+}
+
+// Hands ptr back to the memory pool of the context that allocated it, in
+// stream order on stream or on that context's null stream. Returns false if
+// ptr is not a block from hipMallocAsync.
+static bool ihipMemPoolFree(void* ptr, const hc::AmPointerInfo& info, hipStream_t stream) {
+    if (info._appId == -1) return false;
+#if USE_APP_PTR_FOR_CTX
+    ihipCtx_t* ctx = static_cast<ihipCtx_t*>(info._appPtr);
+#else
+    ihipCtx_t* ctx = ihipGetPrimaryCtx(info._appId);
+#endif
+    if (!ctx) return false;
+    return ctx->memPool()->free(ptr, stream ? stream : ctx->_defaultStream);
+}
+
+static ihipCtx_t* ihipMemPoolCtx(int device) {
+    if (device < 0 || static_cast<unsigned>(device) >= g_deviceCnt) return nullptr;
+    return ihipGetPrimaryCtx(device);
+}
+
+hipError_t hipMallocAsync(void** ptr, size_t sizeBytes, hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipMallocAsync, (TRACE_MEM), ptr, sizeBytes, stream);
+
+    if (ptr == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    *ptr = nullptr;
+    if (sizeBytes == 0) return ihipLogStatus(hipSuccess);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
+    stream = ihipSyncAndResolveStream(stream);
+    *ptr = stream->getCtx()->memPool()->allocate(sizeBytes, stream);
+
+    return ihipLogStatus(*ptr ? hipSuccess : hipErrorOutOfMemory);
+}
+
+hipError_t hipFreeAsync(void* ptr, hipStream_t stream) {
+    HIP_INIT_SPECIAL_API(hipFreeAsync, (TRACE_MEM), ptr, stream);
+
+    if (ptr == nullptr) return ihipLogStatus(hipSuccess);
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
+    hc::accelerator acc;
+#if (__hcc_workweek__ >= 17332)
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, NULL, 0, acc, 0, 0);
+#else
+    hc::AmPointerInfo amPointerInfo(NULL, NULL, 0, acc, 0, 0);
+#endif
+    if (hc::am_memtracker_getinfo(&amPointerInfo, ptr) != AM_SUCCESS) {
+        return ihipLogStatus(hipErrorInvalidDevicePointer);
+    }
+
+    stream = ihipSyncAndResolveStream(stream);
+    const bool freed = ihipMemPoolFree(ptr, amPointerInfo, stream);
+    return ihipLogStatus(freed ? hipSuccess : hipErrorInvalidDevicePointer);
+}
+
+hipError_t hipExtMemPoolTrimTo(int device, size_t minBytesToKeep) {
+    HIP_INIT_API(hipExtMemPoolTrimTo, device, minBytesToKeep);
+
+    ihipCtx_t* ctx = ihipMemPoolCtx(device);
+    if (!ctx) return ihipLogStatus(hipErrorInvalidDevice);
+    ctx->memPool()->trim(minBytesToKeep);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipExtMemPoolSetReleaseThreshold(int device, size_t bytes) {
+    HIP_INIT_API(hipExtMemPoolSetReleaseThreshold, device, bytes);
+
+    ihipCtx_t* ctx = ihipMemPoolCtx(device);
+    if (!ctx) return ihipLogStatus(hipErrorInvalidDevice);
+    ctx->memPool()->set_release_threshold(bytes);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+hipError_t hipExtMemPoolGetStats(int device, hipExtMemPoolStats_t* stats) {
+    HIP_INIT_API(hipExtMemPoolGetStats, device, stats);
+
+    if (stats == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    ihipCtx_t* ctx = ihipMemPoolCtx(device);
+    if (!ctx) return ihipLogStatus(hipErrorInvalidDevice);
+
+    const auto s = ctx->memPool()->stats();
+    stats->reserved = s.reserved;
+    stats->used = s.used;
+    stats->peakReserved = s.peak_reserved;
+    stats->peakUsed = s.peak_used;
+    stats->allocations = s.allocations;
+    stats->reuses = s.reuses;
+    stats->dependencyWaits = s.dependency_waits;
+    stats->releases = s.releases;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
 hipError_t hipFree(void* ptr) {
     HIP_INIT_SPECIAL_API(hipFree, (TRACE_MEM), ptr);
 
@@ -2380,7 +2837,11 @@ hipError_t hipFree(void* ptr) {
                     ctx->locked_waitAllStreams();  // ignores non-blocking streams, this waits
                                                    // for all activity to finish.
                 }
-                hc::am_free(ptr);
+                // Blocks from hipMallocAsync go back to their pool instead, idle by now.
+                if (!ihipMemPoolFree(ptr, amPointerInfo, hipStreamNull)) {
+                    hip_internal::pointer_index().erase(ptr);
+                    hc::am_free(ptr);
+                }
                 hipStatus = hipSuccess;
             }
         }
@@ -2425,6 +2886,7 @@ hipError_t hipFreeArray(hipArray* array) {
         am_status_t status = hc::am_memtracker_getinfo(&amPointerInfo, array->data);
         if (status == AM_SUCCESS) {
             if (amPointerInfo._hostPointer == NULL) {
+                hip_internal::pointer_index().erase(array->data);
                 hc::am_free(array->data);
                 hipStatus = hipSuccess;
             }
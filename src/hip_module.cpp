@@ -134,6 +134,120 @@ extern hipError_t ihipGetDeviceProperties(hipDeviceProp_t* props, int device);
         return ihipLogStatus(hipStatus);                                                           \
     }
 
+// Returns in size the bytes taken by the explicit kernel arguments of f, given
+// as kernelParams or extra, and the implicit ones, after validating them.
+static hipError_t ihipKernargsSize(hipFunction_t f, void** kernelParams, void** extra,
+                                   size_t& size) {
+    using namespace hip_impl;
+
+    size = 0;
+    if (kernelParams) {
+        if (extra) return hipErrorInvalidValue;
+
+        for (auto&& x : f->_kernarg_layout) {
+            size = round_up_to_next_multiple_nonnegative(size, x.second) + x.first;
+        }
+    } else if (extra) {
+        if (extra[0] == HIP_LAUNCH_PARAM_BUFFER_POINTER &&
+            extra[2] == HIP_LAUNCH_PARAM_BUFFER_SIZE && extra[4] == HIP_LAUNCH_PARAM_END) {
+            size = *(size_t*)(extra[3]);
+        } else {
+            return hipErrorNotInitialized;
+        }
+    }
+    else if (f->_kernarg_layout.size() != 0) {
+        return hipErrorInvalidValue;
+    }
+
+    // 56 bytes at the end for implicit kernel arguments.
+    size += ((~size + 1) & (HIP_IMPLICIT_KERNARG_ALIGNMENT - 1)) + HIP_IMPLICIT_KERNARG_SIZE;
+    return hipSuccess;
+}
+
+// Writes the arguments validated by ihipKernargsSize, size bytes, to kernargs.
+static void ihipWriteKernargs(hipFunction_t f, void** kernelParams, void** extra,
+                              void** impCoopParams, char* kernargs, size_t size) {
+    using namespace hip_impl;
+
+    size_t pos = 0;
+    if (kernelParams) {
+        for (auto&& x : f->_kernarg_layout) {
+            const size_t begin = round_up_to_next_multiple_nonnegative(pos, x.second);
+            memset(kernargs + pos, 0, begin - pos);
+            memcpy(kernargs + begin, *kernelParams, x.first);
+            pos = begin + x.first;
+
+            ++kernelParams;
+        }
+    } else if (extra) {
+        pos = *(size_t*)(extra[3]);
+        if (pos) memcpy(kernargs, extra[1], pos);
+    }
+
+    // Implicit kernel arguments are zero.
+    memset(kernargs + pos, 0, size - pos);
+
+    if (impCoopParams) {
+        // The sixth index is for multi-grid synchronization
+        memcpy(kernargs + size - HIP_IMPLICIT_KERNARG_SIZE + 6 * HIP_IMPLICIT_KERNARG_ALIGNMENT,
+               *impCoopParams, HIP_IMPLICIT_KERNARG_ALIGNMENT);
+    }
+}
+
+// Packs the explicit kernel arguments, given as kernelParams or extra, and the
+// implicit ones into kernargs.
+hipError_t ihipPackKernargs(hipFunction_t f, void** kernelParams, void** extra,
+                            void** impCoopParams, std::vector<char>& kernargs) {
+    size_t size;
+    hipError_t e = ihipKernargsSize(f, kernelParams, extra, size);
+    if (e != hipSuccess) return e;
+
+    kernargs.resize(size);
+    ihipWriteKernargs(f, kernelParams, extra, impCoopParams, kernargs.data(), size);
+    return hipSuccess;
+}
+
+// Fills the dispatch packet of f, except for the fences which are set once
+// the stream is known, see ihipPreLaunchKernel.
+static void ihipFillDispatchPacket(hipFunction_t f, uint32_t globalWorkSizeX,
+                                   uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
+                                   uint32_t localWorkSizeX, uint32_t localWorkSizeY,
+                                   uint32_t localWorkSizeZ, size_t sharedMemBytes, uint32_t flags,
+                                   hsa_kernel_dispatch_packet_t& aql) {
+    memset(&aql, 0, sizeof(aql));
+
+    // aql.completion_signal._handle = 0;
+    // aql.kernarg_address = 0;
+
+    aql.workgroup_size_x = localWorkSizeX;
+    aql.workgroup_size_y = localWorkSizeY;
+    aql.workgroup_size_z = localWorkSizeZ;
+    aql.grid_size_x = globalWorkSizeX;
+    aql.grid_size_y = globalWorkSizeY;
+    aql.grid_size_z = globalWorkSizeZ;
+    if (f->_is_code_object_v3) {
+        const auto* header =
+            reinterpret_cast<const amd_kernel_code_v3_t*>(f->_header);
+        aql.group_segment_size =
+            header->group_segment_fixed_size + sharedMemBytes;
+        aql.private_segment_size =
+            header->private_segment_fixed_size;
+    } else {
+        aql.group_segment_size =
+            f->_header->workgroup_group_segment_byte_size + sharedMemBytes;
+        aql.private_segment_size =
+            f->_header->workitem_private_segment_byte_size;
+    }
+    aql.kernel_object = f->_object;
+    aql.setup = 3 << HSA_KERNEL_DISPATCH_PACKET_SETUP_DIMENSIONS;
+    aql.header =
+        (HSA_PACKET_TYPE_KERNEL_DISPATCH << HSA_PACKET_HEADER_TYPE);
+    if((flags & 0x1)== 0 ) {
+        //in_order
+        aql.header |= (1 << HSA_PACKET_HEADER_BARRIER);
+    }
+}
+
 hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t globalWorkSizeX,
                                   uint32_t globalWorkSizeY, uint32_t globalWorkSizeZ,
                                   uint32_t localWorkSizeX, uint32_t localWorkSizeY,
@@ -150,50 +264,25 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
         ret = hipErrorInvalidDevice;
 
     } else {
-        int deviceId = ctx->getDevice()->_deviceId;
-        ihipDevice_t* currentDevice = ihipGetDevice(deviceId);
-        hsa_agent_t gpuAgent = (hsa_agent_t)currentDevice->_hsaAgent;
-
-        std::vector<char> kernargs{};
-        if (kernelParams) {
-            if (extra) return hipErrorInvalidValue;
+        size_t kernargSize;
+        hipError_t e = ihipKernargsSize(f, kernelParams, extra, kernargSize);
+        if (e != hipSuccess) return e;
 
-            for (auto&& x : f->_kernarg_layout) {
-                const auto p{static_cast<const char*>(*kernelParams)};
-
-                kernargs.insert(
-                    kernargs.cend(),
-                    round_up_to_next_multiple_nonnegative(
-                        kernargs.size(), x.second) - kernargs.size(),
-                    '\0');
-                kernargs.insert(kernargs.cend(), p, p + x.first);
+        hsa_kernel_dispatch_packet_t aql;
+        ihipFillDispatchPacket(f, globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ,
+                               localWorkSizeX, localWorkSizeY, localWorkSizeZ, sharedMemBytes,
+                               flags, aql);
 
-                ++kernelParams;
+        if (!isStreamLocked && ihipStreamCapturing(hStream)) {
+            if (startEvent || stopEvent || impCoopParams || coopAV) {
+                return ihipCaptureUnsupported(hStream);
             }
-        } else if (extra) {
-            if (extra[0] == HIP_LAUNCH_PARAM_BUFFER_POINTER &&
-                extra[2] == HIP_LAUNCH_PARAM_BUFFER_SIZE && extra[4] == HIP_LAUNCH_PARAM_END) {
-                auto args = (char*)extra[1];
-                size_t argSize = *(size_t*)(extra[3]);
-                kernargs.insert(kernargs.end(), args, args+argSize);
-            } else {
-                return hipErrorNotInitialized;
-            }
-
-        } 
-        else if (f->_kernarg_layout.size() != 0) {
-            return hipErrorInvalidValue;
-        }
-
-        // Insert 56-bytes at the end for implicit kernel arguments and fill with value zero.
-        size_t padSize = (~kernargs.size() + 1) & (HIP_IMPLICIT_KERNARG_ALIGNMENT - 1);
-        kernargs.insert(kernargs.end(), padSize + HIP_IMPLICIT_KERNARG_SIZE, 0);
-
-        if (impCoopParams) {
-            const auto p{static_cast<const char*>(*impCoopParams)};
-            // The sixth index is for multi-grid synchronization
-            copy(p, p + HIP_IMPLICIT_KERNARG_ALIGNMENT,
-                    (kernargs.end() - HIP_IMPLICIT_KERNARG_SIZE) + 6 * HIP_IMPLICIT_KERNARG_ALIGNMENT);
+            std::vector<char> kernargs(kernargSize);
+            ihipWriteKernargs(f, kernelParams, extra, nullptr, kernargs.data(), kernargSize);
+            return ihipCaptureKernel(hStream, f,
+                                     dim3(globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ),
+                                     dim3(localWorkSizeX, localWorkSizeY, localWorkSizeZ),
+                                     sharedMemBytes, aql, std::move(kernargs));
         }
 
         /*
@@ -206,51 +295,26 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
             hStream, dim3(globalWorkSizeX/localWorkSizeX, globalWorkSizeY/localWorkSizeY, globalWorkSizeZ/localWorkSizeZ),
             dim3(localWorkSizeX, localWorkSizeY, localWorkSizeZ), &lp, f->_name.c_str(), isStreamLocked);
 
-        hsa_kernel_dispatch_packet_t aql;
-
-        memset(&aql, 0, sizeof(aql));
-
-        // aql.completion_signal._handle = 0;
-        // aql.kernarg_address = 0;
-
-        aql.workgroup_size_x = localWorkSizeX;
-        aql.workgroup_size_y = localWorkSizeY;
-        aql.workgroup_size_z = localWorkSizeZ;
-        aql.grid_size_x = globalWorkSizeX;
-        aql.grid_size_y = globalWorkSizeY;
-        aql.grid_size_z = globalWorkSizeZ;
-        if (f->_is_code_object_v3) {
-            const auto* header =
-                reinterpret_cast<const amd_kernel_code_v3_t*>(f->_header);
-            aql.group_segment_size =
-                header->group_segment_fixed_size + sharedMemBytes;
-            aql.private_segment_size =
-                header->private_segment_fixed_size;
-        } else {
-            aql.group_segment_size =
-                f->_header->workgroup_group_segment_byte_size + sharedMemBytes;
-            aql.private_segment_size =
-                f->_header->workitem_private_segment_byte_size;
-        }
-        aql.kernel_object = f->_object;
-        aql.setup = 3 << HSA_KERNEL_DISPATCH_PACKET_SETUP_DIMENSIONS;
-        aql.header =
-            (HSA_PACKET_TYPE_KERNEL_DISPATCH << HSA_PACKET_HEADER_TYPE);
-        if((flags & 0x1)== 0 ) {
-            //in_order
-            aql.header |= (1 << HSA_PACKET_HEADER_BARRIER);
-        }
-
         aql.header |= lp.launch_fence;
 
         hc::completion_future cf;
 
+        // Keep the completion of in-order dispatches for timing-only events,
+        // see ihipStream_t::locked_recordEvent.
+        auto& streamCrit = hStream->criticalData();
+        const bool trackDispatch = !coopAV && (flags & 0x1) == 0 && streamCrit._timedDispatches;
+
         if (coopAV) {
             lp.av = coopAV;
         }
 
-        lp.av->dispatch_hsa_kernel(&aql, kernargs.data(), kernargs.size(),
-                                   (startEvent || stopEvent) ? &cf : nullptr
+        // dispatch_hsa_kernel copies the arguments to the kernarg segment, so
+        // the stream's staging buffer is free again once it returns.
+        char* kernargs = streamCrit._kernargs.get(kernargSize);
+        ihipWriteKernargs(f, kernelParams, extra, impCoopParams, kernargs, kernargSize);
+
+        lp.av->dispatch_hsa_kernel(&aql, kernargs, kernargSize,
+                                   (startEvent || stopEvent || trackDispatch) ? &cf : nullptr
 #if (__hcc_workweek__ > 17312)
                                    ,
                                    f->_name.c_str()
@@ -264,6 +328,9 @@ hipError_t ihipModuleLaunchKernel(TlsData *tls, hipFunction_t f, uint32_t global
         if (stopEvent) {
             stopEvent->attachToCompletionFuture(&cf, hStream, hipEventTypeStopCommand);
         }
+        if (trackDispatch) {
+            streamCrit.setLastDispatch(cf);
+        }
 
         ihipPostLaunchKernel(f->_name.c_str(), hStream, lp, isStreamLocked);
 
@@ -321,6 +388,107 @@ hipError_t hipHccModuleLaunchKernel(hipFunction_t f, uint32_t globalWorkSizeX,
         localWorkSizeZ, sharedMemBytes, hStream, kernelParams, extra, startEvent, stopEvent, 0));
 }
 
+hipError_t hipExtModuleLaunchKernelBatch(const hipExtLaunchBatchParams* launches, uint32_t count,
+                                         hipStream_t hStream, uint32_t flags) {
+    HIP_INIT_SPECIAL_API(hipExtModuleLaunchKernelBatch, TRACE_KCMD, launches, count, hStream, flags);
+
+    if (count == 0) return ihipLogStatus(hipSuccess);
+    if (launches == nullptr) return ihipLogStatus(hipErrorInvalidValue);
+    if (ihipGetTlsDefaultCtx() == nullptr) return ihipLogStatus(hipErrorInvalidDevice);
+
+    // Validate every launch first, so that a bad entry launches nothing.
+    std::vector<size_t> kernargSizes(count);
+    std::vector<hsa_kernel_dispatch_packet_t> aql(count);
+    for (uint32_t i = 0; i != count; ++i) {
+        const hipExtLaunchBatchParams& l = launches[i];
+        if (l.function == nullptr) return ihipLogStatus(hipErrorInvalidResourceHandle);
+
+        size_t globalWorkSizeX = (size_t)l.gridDim.x * (size_t)l.blockDim.x;
+        size_t globalWorkSizeY = (size_t)l.gridDim.y * (size_t)l.blockDim.y;
+        size_t globalWorkSizeZ = (size_t)l.gridDim.z * (size_t)l.blockDim.z;
+        if (globalWorkSizeX > UINT32_MAX || globalWorkSizeY > UINT32_MAX ||
+            globalWorkSizeZ > UINT32_MAX) {
+            return ihipLogStatus(hipErrorInvalidConfiguration);
+        }
+
+        hipError_t e = ihipKernargsSize(l.function, l.kernelParams, l.extra, kernargSizes[i]);
+        if (e != hipSuccess) return ihipLogStatus(e);
+        ihipFillDispatchPacket(l.function, globalWorkSizeX, globalWorkSizeY, globalWorkSizeZ,
+                               l.blockDim.x, l.blockDim.y, l.blockDim.z, l.sharedMemBytes, flags,
+                               aql[i]);
+    }
+
+    if (ihipStreamCapturing(hStream)) {
+        // Pack every entry before adding any, the batch is captured whole or not at all.
+        std::vector<ihipCapturedKernel> kernels(count);
+        for (uint32_t i = 0; i != count; ++i) {
+            const hipExtLaunchBatchParams& l = launches[i];
+            ihipCapturedKernel& k = kernels[i];
+            k.function = l.function;
+            k.globalWorkSize = dim3(l.gridDim.x * l.blockDim.x, l.gridDim.y * l.blockDim.y,
+                                    l.gridDim.z * l.blockDim.z);
+            k.blockDim = l.blockDim;
+            k.sharedMemBytes = l.sharedMemBytes;
+            k.aql = aql[i];
+            k.kernargs.resize(kernargSizes[i]);
+            ihipWriteKernargs(l.function, l.kernelParams, l.extra, nullptr, k.kernargs.data(),
+                              kernargSizes[i]);
+        }
+        return ihipLogStatus(ihipCaptureKernels(hStream, std::move(kernels)));
+    }
+
+    // Lock the stream and its HSA queue once for the whole batch.
+    grid_launch_parm lp;
+    lp.dynamic_group_mem_bytes = launches[0].sharedMemBytes;
+    hStream = ihipPreLaunchKernel(hStream, launches[0].gridDim, launches[0].blockDim, &lp,
+                                  launches[0].function->_name.c_str(), false);
+#if (__hcc_workweek__ >= 19213)
+    lp.av->acquire_locked_hsa_queue();
+#endif
+
+    auto& streamCrit = hStream->criticalData();
+    const bool trackDispatch = (flags & 0x1) == 0 && streamCrit._timedDispatches;
+    hc::completion_future cf;
+    for (uint32_t i = 0; i != count; ++i) {
+        const hipExtLaunchBatchParams& l = launches[i];
+        char* kernargs = streamCrit._kernargs.get(kernargSizes[i]);
+        ihipWriteKernargs(l.function, l.kernelParams, l.extra, nullptr, kernargs,
+                          kernargSizes[i]);
+
+        aql[i].header |= lp.launch_fence;
+        lp.av->dispatch_hsa_kernel(&aql[i], kernargs, kernargSizes[i],
+                                   (trackDispatch && i + 1 == count) ? &cf : nullptr
+#if (__hcc_workweek__ > 17312)
+                                   ,
+                                   l.function->_name.c_str()
+#endif
+        );
+    }
+
+#if (__hcc_workweek__ >= 19213)
+    lp.av->release_locked_hsa_queue();
+#endif
+    if (trackDispatch) {
+        streamCrit.setLastDispatch(cf);
+    }
+    ihipPostLaunchKernel(launches[count - 1].function->_name.c_str(), hStream, lp, false);
+
+    return ihipLogStatus(hipSuccess);
+}
+
+// Multi-device launches lock their streams up front, so a graph can't record
+// them; they fail the captures of their streams instead.
+static hipError_t ihipCaptureMultiDeviceUnsupported(const hipLaunchParams* launchParamsList,
+                                                    int numDevices) {
+    hipError_t e = hipSuccess;
+    for (int i = 0; launchParamsList != nullptr && i < numDevices; ++i) {
+        if (ihipStreamCapturing(launchParamsList[i].stream)) {
+            e = ihipCaptureUnsupported(launchParamsList[i].stream);
+        }
+    }
+    return e;
+}
+
 __attribute__((visibility("default")))
 hipError_t ihipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList,
                                               int  numDevices, unsigned int  flags, hip_impl::program_state& ps) {
@@ -403,6 +571,8 @@ __attribute__((visibility("default")))
 hipError_t hipExtLaunchMultiKernelMultiDevice(hipLaunchParams* launchParamsList,
                                               int  numDevices, unsigned int  flags) {
     HIP_INIT_API(hipExtLaunchMultiKernelMultiDevice, launchParamsList, numDevices, flags);
+    hipError_t e = ihipCaptureMultiDeviceUnsupported(launchParamsList, numDevices);
+    if (e != hipSuccess) return ihipLogStatus(e);
     auto& ps = hip_impl::get_program_state();
     return ihipExtLaunchMultiKernelMultiDevice(launchParamsList, numDevices, flags, ps);
 }
@@ -642,6 +812,8 @@ hipError_t hipLaunchCooperativeKernel(const void* func, dim3 gridDim,
     HIP_INIT_API(hipLaunchCooperativeKernel, func, gridDim, blockDim, args,
                  sharedMem, stream);
 
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
     return ihipLogStatus(ihipLaunchCooperativeKernel(func, gridDim, blockDim,
                          args, sharedMem, stream, ps));
 }
@@ -921,6 +1093,8 @@ hipError_t hipLaunchCooperativeKernelMultiDevice(hipLaunchParams* launchParamsLi
     // Skipping passing in ps, because the logging function does not like it
     HIP_INIT_API(hipLaunchCooperativeKernelMultiDevice, launchParamsList,
                  numDevices, flags);
+    hipError_t e = ihipCaptureMultiDeviceUnsupported(launchParamsList, numDevices);
+    if (e != hipSuccess) return ihipLogStatus(e);
 
     return ihipLogStatus(ihipLaunchCooperativeKernelMultiDevice(launchParamsList,
                                                                 numDevices,
@@ -1209,20 +1383,20 @@ string code_object_blob_for_agent(const void* maybe_bundled_code, hsa_agent_t ag
 
     if (!maybe_bundled_code) return {};
 
-    Bundled_code_header tmp{maybe_bundled_code};
+    const Bundle_index index{maybe_bundled_code, Bundle_index::unknown_size};
 
-    if (!valid(tmp)) return {};
+    if (!index.valid()) return {};
 
     const auto agent_isa = isa(agent);
 
-    const auto it = find_if(bundles(tmp).cbegin(), bundles(tmp).cend(), [=](const Bundled_code& x) {
-        return agent_isa == triple_to_hsa_isa(x.triple);
-        ;
+    const auto it = find_if(index.entries().cbegin(), index.entries().cend(),
+                            [=](const Bundle_index::Entry& x) {
+        return agent_isa == triple_to_hsa_isa(x.triple.str());
     });
 
-    if (it == bundles(tmp).cend()) return {};
+    if (it == index.entries().cend()) return {};
 
-    return string{it->blob.cbegin(), it->blob.cend()};
+    return it->blob.str();
 }
 } // Unnamed namespace.
 
@@ -5,6 +5,7 @@
 #include <atomic>
 #include <iostream>
 #include <mutex>
+#include <thread>
 
 #include "hip/hcc_detail/hip_prof_str.h"
 
@@ -17,99 +18,137 @@ class api_callbacks_table_templ {
   typedef Fun fun_t;
   typedef Act act_t;
 
-  // HIP API callbacks table
+  // HIP API callbacks table entry. Entries are immutable once published, a
+  // registration replaces the whole entry and retires the old one.
   struct hip_cb_table_entry_t {
-    volatile std::atomic<bool> sync;
-    volatile std::atomic<uint32_t> sem;
     act_t act;
     void* a_arg;
     fun_t fun;
     void* arg;
   };
 
-  struct hip_cb_table_t {
-    hip_cb_table_entry_t arr[HIP_API_ID_NUMBER];
-  };
-
-  api_callbacks_table_templ() {
-     memset(&callbacks_table_, 0, sizeof(callbacks_table_));
+  api_callbacks_table_templ() : readers_(NULL) {
+    for (uint32_t id = 0; id < HIP_API_ID_NUMBER; ++id) table_[id].store(NULL);
   }
 
   bool set_activity(uint32_t id, act_t fun, void* arg) {
+    if (id >= HIP_API_ID_NUMBER) return false;
     std::lock_guard<mutex_t> lock(mutex_);
-    bool ret = true;
-    if (id < HIP_API_ID_NUMBER) {
-      cb_sync(id);
-      callbacks_table_.arr[id].act = fun;
-      callbacks_table_.arr[id].a_arg = arg;
-      cb_release(id);
-    } else {
-      ret = false;
-    }
-    return ret;
+    hip_cb_table_entry_t e = current(id);
+    e.act = fun;
+    e.a_arg = arg;
+    publish(id, e);
+    return true;
   }
 
   bool set_callback(uint32_t id, fun_t fun, void* arg) {
+    if (id >= HIP_API_ID_NUMBER) return false;
     std::lock_guard<mutex_t> lock(mutex_);
-    bool ret = true;
-    if (id < HIP_API_ID_NUMBER) {
-      cb_sync(id);
-      callbacks_table_.arr[id].fun = fun;
-      callbacks_table_.arr[id].arg = arg;
-      cb_release(id);
-    } else {
-      ret = false;
-    }
-    return ret;
+    hip_cb_table_entry_t e = current(id);
+    e.fun = fun;
+    e.arg = arg;
+    publish(id, e);
+    return true;
   }
 
-  inline hip_cb_table_entry_t& entry(const uint32_t& id) {
-    return callbacks_table_.arr[id];
-  }
-
-  inline void sem_sync(const uint32_t& id) {
-    sem_increment(id);
-    if (entry(id).sync.load() == true) sync_wait(id);
+  // Read side. Returns NULL, after a single load, when nothing is registered
+  // for id. Otherwise the calling thread is marked as a reader and the entry
+  // stays valid until the matching leave().
+  inline const hip_cb_table_entry_t* enter(const uint32_t& id) {
+    if (table_[id].load(std::memory_order_relaxed) == NULL) return NULL;
+
+    reader_t* r = reader();
+    if (r->depth++ == 0) {
+      r->seq.store(r->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      // Pairs with the fence in publish(): either the writer sees this thread
+      // as a reader, or this thread sees the new entry.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    const hip_cb_table_entry_t* e = table_[id].load(std::memory_order_acquire);
+    if (e == NULL) leave();
+    return e;
   }
 
-  inline void sem_release(const uint32_t& id) {
-    sem_decrement(id);
+  inline void leave() {
+    reader_t* r = reader();
+    if (--r->depth == 0) {
+      r->seq.store(r->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
   }
 
  private:
-  inline void cb_sync(const uint32_t& id) {
-    entry(id).sync.store(true);
-    while (entry(id).sem.load() != 0) {}
-  }
+  // Per-thread reader state. seq is odd while the thread is inside a traced
+  // API; depth counts nested APIs on the thread and is only touched by it.
+  // Slots are never freed, a slot released by an exiting thread is reused.
+  struct reader_t {
+    std::atomic<uint64_t> seq;
+    std::atomic<bool> in_use;
+    uint32_t depth;
+    reader_t* next;
+    char pad[64];  // keep slots of different threads off the same cache line
+  };
 
-  inline void cb_release(const uint32_t& id) {
-    entry(id).sync.store(false);
+  struct reader_holder_t {
+    reader_t* slot;
+    reader_holder_t() : slot(NULL) {}
+    ~reader_holder_t() {
+      if (slot != NULL) slot->in_use.store(false, std::memory_order_release);
+    }
+  };
+
+  inline reader_t* reader() {
+    static thread_local reader_holder_t holder;
+    if (holder.slot == NULL) holder.slot = claim_reader();
+    return holder.slot;
   }
 
-  inline void sem_increment(const uint32_t& id) {
-    const uint32_t prev = entry(id).sem.fetch_add(1);
-    if (prev == UINT32_MAX) {
-      std::cerr << "sem overflow id = " << id << std::endl << std::flush;
-      abort();
+  reader_t* claim_reader() {
+    for (reader_t* r = readers_.load(std::memory_order_acquire); r != NULL; r = r->next) {
+      bool expected = false;
+      if (r->in_use.compare_exchange_strong(expected, true)) return r;
     }
+    reader_t* r = new reader_t();
+    r->seq.store(0);
+    r->in_use.store(true);
+    r->depth = 0;
+    r->next = readers_.load(std::memory_order_relaxed);
+    while (!readers_.compare_exchange_weak(r->next, r, std::memory_order_release,
+                                           std::memory_order_relaxed)) {
+    }
+    return r;
   }
 
-  inline void sem_decrement(const uint32_t& id) {
-    const uint32_t prev = entry(id).sem.fetch_sub(1);
-    if (prev == 0) {
-      std::cerr << "sem corrupted id = " << id << std::endl << std::flush;
-      abort();
-    }
+  hip_cb_table_entry_t current(const uint32_t& id) {
+    const hip_cb_table_entry_t* e = table_[id].load(std::memory_order_relaxed);
+    if (e != NULL) return *e;
+    hip_cb_table_entry_t empty = {};
+    return empty;
   }
 
-  void sync_wait(const uint32_t& id) {
-    sem_decrement(id);
-    while (entry(id).sync.load() == true) {}
-    sem_increment(id);
+  // Called with mutex_ held. Publishes the new entry and frees the old one
+  // once no other thread can still be running its callbacks.
+  void publish(const uint32_t& id, const hip_cb_table_entry_t& e) {
+    const hip_cb_table_entry_t* next = NULL;
+    if (e.act != NULL || e.fun != NULL) next = new hip_cb_table_entry_t(e);
+    const hip_cb_table_entry_t* prev = table_[id].exchange(next, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (prev == NULL) return;
+
+    // The calling thread may itself be inside a traced API (registering from
+    // a callback), the spawner keeps its own copy of the entry for that case.
+    reader_t* self = reader();
+    for (reader_t* r = readers_.load(std::memory_order_acquire); r != NULL; r = r->next) {
+      if (r == self) continue;
+      const uint64_t seq = r->seq.load(std::memory_order_acquire);
+      if ((seq & 1) == 0) continue;
+      while (r->seq.load(std::memory_order_acquire) == seq) std::this_thread::yield();
+    }
+    delete prev;
   }
 
   mutex_t mutex_;
-  hip_cb_table_t callbacks_table_;
+  std::atomic<const hip_cb_table_entry_t*> table_[HIP_API_ID_NUMBER];
+  std::atomic<reader_t*> readers_;
 };
 
 
@@ -123,9 +162,12 @@ typedef activity_sync_callback_t hip_act_callback_t;
 
 // HIP API callbacks spawner object macro
 #define HIP_CB_SPAWNER_OBJECT(CB_ID) \
-  hip_api_data_t api_data{}; \
-  INIT_CB_ARGS_DATA(CB_ID, api_data); \
-  api_callbacks_spawner_t<HIP_API_ID_##CB_ID> __api_tracer(HIP_API_ID_##CB_ID, api_data);
+  api_callbacks_spawner_t<HIP_API_ID_##CB_ID> __api_tracer(HIP_API_ID_##CB_ID); \
+  if (__api_tracer.is_enabled()) { \
+    hip_api_data_t& api_data = __api_tracer.api_data(); \
+    INIT_CB_ARGS_DATA(CB_ID, api_data); \
+    __api_tracer.call(); \
+  }
 
 typedef api_callbacks_table_templ<hip_api_record_t,
                                   hip_api_callback_t,
@@ -135,52 +177,60 @@ extern api_callbacks_table_t callbacks_table;
 template <int cid_>
 class api_callbacks_spawner_t {
  public:
-  api_callbacks_spawner_t(const hip_api_id_t& cid, hip_api_data_t& api_data) :
-    api_data_(api_data),
-    record_({})
+  api_callbacks_spawner_t(const hip_api_id_t& cid) :
+    enabled_(false)
   {
     if (cid_ >= HIP_API_ID_NUMBER) {
       fprintf(stderr, "HIP %s bad id %d\n", __FUNCTION__, cid_);
       abort();
     }
-    callbacks_table.sem_sync(cid_);
-
-    act = entry(cid_).act;
-    a_arg = entry(cid_).a_arg;
-    fun = entry(cid_).fun;
-    arg = entry(cid_).arg;
+    const api_callbacks_table_t::hip_cb_table_entry_t* e = callbacks_table.enter(cid_);
+    if (e == NULL) return;
+
+    // Copied so the entry may be retired while this call is in flight, which
+    // only happens when a callback re-registers on its own thread.
+    entry_ = *e;
+    enabled_ = true;
+    api_data_ = hip_api_data_t{};
+    record_ = hip_api_record_t{};
+  }
 
+  void call() {
     api_data_.phase = 0;
-    if (act != NULL) act(cid_, &record_, &api_data_, a_arg);
-    if (fun != NULL) fun(HIP_DOMAIN_ID, cid_, &api_data_, arg);
+    if (entry_.act != NULL) entry_.act(cid_, &record_, &api_data_, entry_.a_arg);
+    if (entry_.fun != NULL) entry_.fun(HIP_DOMAIN_ID, cid_, &api_data_, entry_.arg);
   }
 
   ~api_callbacks_spawner_t() {
+    if (!enabled_) return;
+
     api_data_.phase = 1;
-    if (act != NULL) act(cid_, &record_, &api_data_, a_arg);
-    if (fun != NULL) fun(HIP_DOMAIN_ID, cid_, &api_data_, arg);
+    if (entry_.act != NULL) entry_.act(cid_, &record_, &api_data_, entry_.a_arg);
+    if (entry_.fun != NULL) entry_.fun(HIP_DOMAIN_ID, cid_, &api_data_, entry_.arg);
 
-    callbacks_table.sem_release(cid_);
+    callbacks_table.leave();
   }
 
- private:
-  inline api_callbacks_table_t::hip_cb_table_entry_t& entry(const uint32_t& id) {
-    return callbacks_table.entry(id);
-  }
+  bool is_enabled() const { return enabled_; }
+  hip_api_data_t& api_data() { return api_data_; }
 
-  hip_api_data_t& api_data_;
+ private:
+  bool enabled_;
+  api_callbacks_table_t::hip_cb_table_entry_t entry_;
+  hip_api_data_t api_data_;
   hip_api_record_t record_;
-
-  hip_act_callback_t act;
-  void* a_arg;
-  hip_api_callback_t fun;
-  void* arg;
 };
 
 template <>
 class api_callbacks_spawner_t<HIP_API_ID_NUMBER> {
  public:
-  api_callbacks_spawner_t(const hip_api_id_t& cid, hip_api_data_t& api_data) {}
+  api_callbacks_spawner_t(const hip_api_id_t& cid) {}
+  void call() {}
+  bool is_enabled() const { return false; }
+  hip_api_data_t& api_data() { return api_data_; }
+
+ private:
+  hip_api_data_t api_data_;
 };
 
 #else
@@ -25,6 +25,8 @@ THE SOFTWARE.
 #include "hip/hip_runtime.h"
 #include "hip_hcc_internal.h"
 #include "trace_helper.h"
+#include "callback_executor.hpp"
+#include "stream_pool.hpp"
 
 
 //-------------------------------------------------------------------------------------------------
@@ -47,6 +49,55 @@ enum queue_priority
 };
 #endif
 
+//---
+// Drains stream and removes it from its context, and from the capture it takes
+// part in.
+void ihipStreamDestroy(ihipStream_t* stream) {
+    ihipStreamLeaveCapture(stream);
+    stream->locked_wait();
+    stream->getCtx()->locked_removeStream(stream);
+    delete stream;
+}
+
+
+//---
+// Creates a stream on ctx. cuMask, if not empty, is a bit array of the CUs the
+// stream's queue may use.
+static ihipStream_t* ihipStreamCreateOnCtx(ihipCtx_t* ctx, unsigned int flags, int priority,
+                                           const std::vector<uint32_t>& cuMask = {}) {
+    hc::accelerator acc = ctx->getWriteableDevice()->_acc;
+
+    // TODO - se try-catch loop to detect memory exception?
+    //
+    // Note this is an execute_any_order queue,
+    // CUDA stream behavior is that all kernels submitted will automatically
+    // wait for prev to complete, this behaviour will be mainatined by
+    // hipModuleLaunchKernel. execute_any_order will help
+    // hipExtModuleLaunchKernel , which uses a special flag
+
+#if defined(__HCC__) && (__hcc_major__ < 3) && (__hcc_minor__ < 3)
+    hc::accelerator_view av = acc.create_view();
+#else
+    hc::accelerator_view av = acc.create_view(Kalmar::execute_any_order, Kalmar::queuing_mode_automatic, (Kalmar::queue_priority)priority);
+#endif
+
+    if (!cuMask.empty()) {
+        std::vector<bool> cus(ctx->getDevice()->_computeUnits);
+        for (size_t i = 0; i < cus.size() && i / 32 < cuMask.size(); i++) {
+            cus[i] = (cuMask[i / 32] >> (i % 32)) & 1;
+        }
+        if (!av.set_cu_mask(cus)) return nullptr;
+    }
+
+    // Obtain mutex access to the device critical data, release by destructor
+    LockedAccessor_CtxCrit_t ctxCrit(ctx->criticalData());
+
+    auto istream = new ihipStream_t(ctx, av, flags);
+    ctxCrit->addStream(istream);
+    return istream;
+}
+
+
 //---
 hipError_t ihipStreamCreate(TlsData *tls, hipStream_t* stream, unsigned int flags, int priority) {
     ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
@@ -59,29 +110,7 @@ hipError_t ihipStreamCreate(TlsData *tls, hipStream_t* stream, unsigned int flag
         } else if( NULL == stream ){
             e = hipErrorInvalidValue;
         } else {
-            hc::accelerator acc = ctx->getWriteableDevice()->_acc;
-
-            // TODO - se try-catch loop to detect memory exception?
-            //
-            // Note this is an execute_any_order queue,
-            // CUDA stream behavior is that all kernels submitted will automatically
-            // wait for prev to complete, this behaviour will be mainatined by
-            // hipModuleLaunchKernel. execute_any_order will help
-            // hipExtModuleLaunchKernel , which uses a special flag
-
-            {
-                // Obtain mutex access to the device critical data, release by destructor
-                LockedAccessor_CtxCrit_t ctxCrit(ctx->criticalData());
-
-#if defined(__HCC__) && (__hcc_major__ < 3) && (__hcc_minor__ < 3)
-                auto istream = new ihipStream_t(ctx, acc.create_view(), flags);
-#else
-                auto istream = new ihipStream_t(ctx, acc.create_view(Kalmar::execute_any_order, Kalmar::queuing_mode_automatic, (Kalmar::queue_priority)priority), flags);
-#endif
-
-                ctxCrit->addStream(istream);
-                *stream = istream;
-            }
+            *stream = ihipStreamCreateOnCtx(ctx, flags, priority);
             tprintf(DB_SYNC, "hipStreamCreate, %s\n", ToString(*stream).c_str());
         }
 
@@ -118,6 +147,76 @@ hipError_t hipStreamCreateWithPriority(hipStream_t* stream, unsigned int flags,
     return ihipLogStatus(ihipStreamCreate(tls, stream, flags, priority));
 }
 
+
+//---
+hip_impl::Stream_pool<ihipStream_t*>* ihipCtx_t::streamPool() {
+    std::call_once(_streamPoolOnce, [this]() {
+        _streamPool = new hip_impl::Stream_pool<ihipStream_t*>(
+            HIP_STREAM_POOL_MAX_QUEUES > 0 ? HIP_STREAM_POOL_MAX_QUEUES : 1,
+            [this](const hip_impl::Stream_pool<ihipStream_t*>::Key& key) {
+                ihipStream_t* stream =
+                    ihipStreamCreateOnCtx(this, key.flags, key.priority, key.cu_mask);
+                if (stream) stream->setPooled();
+                return stream;
+            },
+            ihipStreamDestroy);
+    });
+    return _streamPool;
+}
+
+
+//---
+ihipStream_t* ihipStreamCreateLane(ihipCtx_t* ctx) {
+    return ihipStreamCreateOnCtx(ctx, hipStreamNonBlocking, priority_normal);
+}
+
+
+//---
+hipError_t hipExtStreamPoolAcquire(hipStream_t* stream, unsigned int flags, int priority,
+                                   uint32_t cuMaskSize, const uint32_t* cuMask) {
+    HIP_INIT_API(hipExtStreamPoolAcquire, stream, flags, priority, cuMaskSize, cuMask);
+
+    if (stream == NULL || (cuMaskSize != 0 && cuMask == NULL) ||
+        (flags != hipStreamDefault && flags != hipStreamNonBlocking)) {
+        return ihipLogStatus(hipErrorInvalidValue);
+    }
+
+    ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
+    if (!ctx) return ihipLogStatus(hipErrorInvalidDevice);
+
+    if (HIP_FORCE_NULL_STREAM) {
+        *stream = 0;
+        return ihipLogStatus(hipSuccess);
+    }
+
+    hip_impl::Stream_pool<ihipStream_t*>::Key key;
+    key.flags = flags;
+    key.priority = (priority < priority_high ? priority_high : (priority > priority_low ? priority_low : priority));
+    key.cu_mask.assign(cuMask, cuMask + cuMaskSize);
+
+    *stream = ctx->streamPool()->acquire(key);
+    tprintf(DB_SYNC, "hipExtStreamPoolAcquire, %s\n", ToString(*stream).c_str());
+
+    return ihipLogStatus(*stream ? hipSuccess : hipErrorOutOfMemory);
+}
+
+
+//---
+hipError_t hipExtStreamPoolRelease(hipStream_t stream) {
+    HIP_INIT_API(hipExtStreamPoolRelease, stream);
+
+    if (stream == NULL) {
+        return ihipLogStatus(HIP_FORCE_NULL_STREAM ? hipSuccess : hipErrorInvalidHandle);
+    }
+
+    ihipCtx_t* ctx = stream->getCtx();
+    if (!ctx || !stream->pooled() || !ctx->streamPool()->release(stream)) {
+        return ihipLogStatus(hipErrorInvalidHandle);
+    }
+
+    return ihipLogStatus(hipSuccess);
+}
+
 //---
 hipError_t hipDeviceGetStreamPriorityRange(int* leastPriority, int* greatestPriority) {
     HIP_INIT_API(hipDeviceGetStreamPriorityRange, leastPriority, greatestPriority);
@@ -132,6 +231,9 @@ hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int
 
     if (!event) return ihipLogStatus(hipErrorInvalidHandle);
 
+    hipError_t status = hipSuccess;
+    if (ihipCaptureStreamWaitEvent(stream, event, &status)) return ihipLogStatus(status);
+
     auto ecd = event->locked_copyCrit();
     if (event->_flags & hipEventInterprocess) {
         // this is an IPC event
@@ -161,6 +263,8 @@ hipError_t hipStreamWaitEvent(hipStream_t stream, hipEvent_t event, unsigned int
 hipError_t hipStreamQuery(hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipStreamQuery, TRACE_QUERY, stream);
 
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
     // Use default stream if 0 specified:
     if (stream == hipStreamNull) {
         ihipCtx_t* device = ihipGetTlsDefaultCtx();
@@ -174,7 +278,7 @@ hipError_t hipStreamQuery(hipStream_t stream) {
         isEmpty = crit->_av.get_is_empty();
     }
 
-    hipError_t e = isEmpty ? hipSuccess : hipErrorNotReady;
+    hipError_t e = isEmpty ? stream->takeAsyncError() : hipErrorNotReady;
 
     return ihipLogStatus(e);
 }
@@ -184,6 +288,8 @@ hipError_t hipStreamQuery(hipStream_t stream) {
 hipError_t hipStreamSynchronize(hipStream_t stream) {
     HIP_INIT_SPECIAL_API(hipStreamSynchronize, TRACE_SYNC, stream);
 
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
     return ihipLogStatus(ihipStreamSynchronize(tls, stream));
 }
 
@@ -203,15 +309,13 @@ hipError_t hipStreamDestroy(hipStream_t stream) {
             e = hipErrorInvalidHandle;
         }
     } else {
-        stream->locked_wait();
-
         ihipCtx_t* ctx = stream->getCtx();
 
-        if (ctx) {
-            ctx->locked_removeStream(stream);
-            delete stream;
-        } else {
+        if (!ctx) {
             e = hipErrorInvalidHandle;
+        } else if (!stream->pooled() || !ctx->streamPool()->release(stream)) {
+            // Pool streams stay alive for their next owner.
+            ihipStreamDestroy(stream);
         }
     }
 
@@ -219,6 +323,30 @@ hipError_t hipStreamDestroy(hipStream_t stream) {
 }
 
 
+//---
+hipError_t hipExtStreamGetWaitStats(hipStream_t stream, hipExtStreamWaitStats_t* stats) {
+    HIP_INIT_API(hipExtStreamGetWaitStats, stream, stats);
+
+    if (stats == NULL) return ihipLogStatus(hipErrorInvalidValue);
+
+    if (stream == hipStreamNull) {
+        ihipCtx_t* ctx = ihipGetTlsDefaultCtx();
+        if (!ctx) return ihipLogStatus(hipErrorInvalidValue);
+        stream = ctx->_defaultStream;
+    }
+
+    const hip_impl::Wait_stats s = stream->waiter().stats();
+    stats->waits = s.waits;
+    stats->spinCompletions = s.spin_completions;
+    stats->yieldCompletions = s.yield_completions;
+    stats->blockCompletions = s.block_completions;
+    stats->waitNs = s.wait_ns;
+    stats->spinNs = s.spin_ns;
+
+    return ihipLogStatus(hipSuccess);
+}
+
+
 //---
 hipError_t hipStreamGetFlags(hipStream_t stream, unsigned int* flags) {
     HIP_INIT_API(hipStreamGetFlags, stream, flags);
@@ -255,10 +383,32 @@ hipError_t hipStreamGetPriority(hipStream_t stream, int* priority) {
 
 
 //---
+namespace {
+// A callback between two markers: the first marker's signal is bumped so the
+// CP stops at 1 instead of 0, and the second marker waits for it to reach 0,
+// which happens once the callback has run on the device's executor.
+struct StreamCallback : hip_impl::Callback_executor::Task {
+    hipStream_t stream;
+    hipStreamCallback_t callback;
+    void* userData;
+    hsa_signal_t signal;
+    hip_impl::Callback_executor* executor;
+
+    static void runTask(Task* t) {
+        StreamCallback* cb = static_cast<StreamCallback*>(t);
+        cb->callback(cb->stream, hipSuccess, cb->userData);
+        hsa_signal_store_relaxed(cb->signal, 0);
+        delete cb;
+    }
+};
+}  // namespace
+
 hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback, void* userData,
                                 unsigned int flags) {
     HIP_INIT_API(hipStreamAddCallback, stream, callback, userData, flags);
 
+    if (ihipStreamCapturing(stream)) return ihipLogStatus(ihipCaptureUnsupported(stream));
+
     auto stream_original{stream};
     stream = ihipSyncAndResolveStream(stream);
 
@@ -273,21 +423,25 @@ hipError_t hipStreamAddCallback(hipStream_t stream, hipStreamCallback_t callback
     // increment its signal value
     hsa_signal_add_relaxed(signal, 1);
 
-    // create callback that can be passed to hsa_amd_signal_async_handler
-    // this function will call the user's callback, then sets first packet's signal to 0 to indicate completion
-    auto t{new std::function<void()>{[=]() {
-        callback(stream_original, hipSuccess, userData);
-        hsa_signal_store_relaxed(signal, 0);
-    }}};
-
-    // register above callback with HSA runtime to be called when first packet's signal
-    // is decremented from 2 to 1 by CP (or it is already at 1)
+    auto cb = new StreamCallback;
+    cb->run = &StreamCallback::runTask;
+    cb->stream = stream_original;
+    cb->callback = callback;
+    cb->userData = userData;
+    cb->signal = signal;
+    cb->executor = stream->getCtx()->getWriteableDevice()->callbackExecutor();
+
+    // When the CP decrements the first packet's signal from 2 to 1 (or it is
+    // already at 1), hand the callback to the executor. The HSA async handler
+    // thread is shared by all devices, so it must not run user code itself.
+    // Callbacks of one stream are posted in order, and the executor keeps them
+    // in order by keying on the stream.
     hsa_amd_signal_async_handler(signal, HSA_SIGNAL_CONDITION_EQ, 1,
         [](hsa_signal_value_t x, void* p) {
-            (*static_cast<decltype(t)>(p))();
-            delete static_cast<decltype(t)>(p);
+            StreamCallback* cb = static_cast<StreamCallback*>(p);
+            cb->executor->post(cb->stream, cb);
             return false;
-        }, t);
+        }, cb);
 
     // create additional marker that blocks on the first one
     cs->_av.create_blocking_marker(cf, hc::no_scope);
@@ -0,0 +1,275 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "hip_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace hip_trace {
+
+ApiTracer* g_apiTracer = nullptr;
+
+namespace {
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+// Single-producer/single-consumer ring. The owning thread advances _head, the
+// flush thread advances _tail. Records are dropped, never blocked on, when
+// the ring is full.
+struct ThreadRing {
+    explicit ThreadRing(size_t capacity)
+        : records(capacity), mask(capacity - 1), head(0), tail(0), dropped(0), retired(false) {}
+
+    std::vector<ApiRecord> records;
+    const uint64_t mask;
+    std::atomic<uint64_t> head;
+    // Keep producer and consumer indices on separate cache lines.
+    char pad[64];
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> retired;
+};
+
+// Append-only file mapped in fixed size chunks. Growing remaps the file, so
+// only the flush thread touches it.
+class MappedFile {
+   public:
+    static const size_t kChunk = 64 << 20;
+
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (_fd < 0) return false;
+        if (!reserve(sizeof(FileHeader))) return false;
+        _size = sizeof(FileHeader);
+        return true;
+    }
+
+    void* at(size_t offset) { return _base ? _base + offset : nullptr; }
+    size_t size() const { return _size; }
+
+    bool append(const void* data, size_t bytes) {
+        if (!reserve(bytes)) return false;
+        std::memcpy(_base + _size, data, bytes);
+        _size += bytes;
+        return true;
+    }
+
+    void close() {
+        if (_fd < 0) return;
+        if (_base) munmap(_base, _mapped);
+        if (ftruncate(_fd, _size) != 0) {
+            fprintf(stderr, "hip-trace: failed to truncate trace file\n");
+        }
+        ::close(_fd);
+        _fd = -1;
+        _base = nullptr;
+    }
+
+   private:
+    bool reserve(size_t bytes) {
+        if (_size + bytes <= _mapped) return true;
+        size_t mapped = ((_size + bytes + kChunk - 1) / kChunk) * kChunk;
+        if (_base) munmap(_base, _mapped);
+        _base = nullptr;
+        if (ftruncate(_fd, mapped) != 0) return false;
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (p == MAP_FAILED) return false;
+        _base = static_cast<char*>(p);
+        _mapped = mapped;
+        return true;
+    }
+
+    int _fd = -1;
+    char* _base = nullptr;
+    size_t _mapped = 0;
+    size_t _size = 0;
+};
+
+}  // namespace
+
+class ApiTracer {
+   public:
+    ApiTracer(size_t ringRecords, unsigned flushIntervalMs)
+        : _ringRecords(ringRecords), _flushInterval(flushIntervalMs), _stop(false) {}
+
+    bool start(const std::string& path) {
+        if (!_file.open(path)) return false;
+
+        FileHeader* h = header();
+        std::memset(h, 0, sizeof(*h));
+        std::memcpy(h->magic, kMagic, sizeof(kMagic));
+        h->version = kVersion;
+        h->recordSize = sizeof(ApiRecord);
+        h->pid = getpid();
+        h->tscBase = readTsc();
+        h->nsBase = monotonicNs();
+        _headerCopy = *h;
+
+        _flusher = std::thread(&ApiTracer::flushLoop, this);
+        return true;
+    }
+
+    void push(const ApiRecord& rec) {
+        ThreadRing* ring = threadRing();
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        if (head - ring->tail.load(std::memory_order_acquire) > ring->mask) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring->records[head & ring->mask] = rec;
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lck{_flushMutex};
+            _stop = true;
+        }
+        _flushCv.notify_one();
+        if (_flusher.joinable()) _flusher.join();
+        drain();
+        _file.close();
+    }
+
+   private:
+    // Marks the calling thread's ring retired when the thread exits, so the
+    // flush thread can release it once drained.
+    struct RingHolder {
+        ThreadRing* ring = nullptr;
+        ~RingHolder() {
+            if (ring) ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    ThreadRing* threadRing() {
+        static thread_local RingHolder holder;
+        if (!holder.ring) {
+            size_t capacity = 1;
+            while (capacity < _ringRecords) capacity <<= 1;
+            holder.ring = new ThreadRing(capacity);
+            std::lock_guard<std::mutex> lck{_ringsMutex};
+            _rings.push_back(holder.ring);
+        }
+        return holder.ring;
+    }
+
+    FileHeader* header() { return static_cast<FileHeader*>(_file.at(0)); }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lck{_flushMutex};
+        while (!_stop) {
+            _flushCv.wait_for(lck, _flushInterval);
+            lck.unlock();
+            drain();
+            lck.lock();
+        }
+    }
+
+    void drain() {
+        std::lock_guard<std::mutex> lck{_ringsMutex};
+        for (auto it = _rings.begin(); it != _rings.end();) {
+            ThreadRing* ring = *it;
+            // Read retired before head so a ring is only freed after its last push is seen.
+            bool retired = ring->retired.load(std::memory_order_acquire);
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) {
+                if (!_file.append(&ring->records[tail & ring->mask], sizeof(ApiRecord))) {
+                    ring->dropped.fetch_add(head - tail, std::memory_order_relaxed);
+                    tail = head;
+                    break;
+                }
+                ++_headerCopy.recordCount;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            _headerCopy.droppedCount += ring->dropped.exchange(0, std::memory_order_relaxed);
+
+            if (retired) {
+                delete ring;
+                it = _rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // Keep the header current so a trace from a crashed process still decodes.
+        _headerCopy.tscLast = readTsc();
+        _headerCopy.nsLast = monotonicNs();
+        if (header()) *header() = _headerCopy;
+    }
+
+    const size_t _ringRecords;
+    const std::chrono::milliseconds _flushInterval;
+
+    std::mutex _ringsMutex;
+    std::list<ThreadRing*> _rings;
+
+    MappedFile _file;
+    FileHeader _headerCopy;
+
+    std::mutex _flushMutex;
+    std::condition_variable _flushCv;
+    bool _stop;
+    std::thread _flusher;
+};
+
+void pushApiRecord(ApiTracer* tracer, const ApiRecord& rec) { tracer->push(rec); }
+
+bool startApiTracer(const std::string& path, size_t ringRecords, unsigned flushIntervalMs) {
+    if (g_apiTracer) return true;
+
+    ApiTracer* tracer = new ApiTracer(ringRecords ? ringRecords : 1, flushIntervalMs);
+    if (!tracer->start(path)) {
+        fprintf(stderr, "hip-trace: unable to create trace file %s\n", path.c_str());
+        delete tracer;
+        return false;
+    }
+
+    g_apiTracer = tracer;
+    std::atexit([]() {
+        // Threads still inside an API keep pushing into their rings, which
+        // stay valid since the tracer itself is never freed.
+        g_apiTracer->stop();
+    });
+    return true;
+}
+
+}  // namespace hip_trace
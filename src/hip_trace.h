@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef HIP_SRC_HIP_TRACE_H
+#define HIP_SRC_HIP_TRACE_H
+
+// Binary API tracer, enabled with HIP_TRACE_API_FILE=<path>.
+//
+// Each API call fills one fixed-size ApiRecord on the caller's stack and pushes
+// it into a single-producer ring owned by the calling thread. A background
+// thread drains all rings into a memory-mapped file. The file is a FileHeader
+// followed by ApiRecords in drain order, and is turned back into the text
+// format of HIP_TRACE_API by the hiptracedecode tool.
+//
+// This header is shared with the decoder and must not depend on HCC.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace hip_trace {
+
+static const char kMagic[8] = {'H', 'I', 'P', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t kVersion = 1;
+static const uint32_t kMaxArgs = 11;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t pid;
+    uint32_t reserved;
+    // Pairs of (tsc, CLOCK_MONOTONIC ns) sampled when tracing starts and each
+    // time the header is updated, used to convert record timestamps.
+    uint64_t tscBase;
+    uint64_t nsBase;
+    uint64_t tscLast;
+    uint64_t nsLast;
+    uint64_t recordCount;
+    uint64_t droppedCount;
+};
+
+struct ApiRecord {
+    uint32_t apiId;     // HIP_API_ID_* from hip_prof_str.h
+    uint32_t tid;       // short tid, as printed by HIP_TRACE_API
+    uint64_t seqNum;    // per-thread API sequence number
+    uint64_t startTsc;
+    uint64_t endTsc;
+    int32_t status;     // hipError_t returned by the API
+    uint32_t argCount;  // number of valid entries in args
+    uint64_t args[kMaxArgs];
+};
+
+static_assert(sizeof(ApiRecord) == 128, "ApiRecord must stay a fixed 128 bytes");
+
+inline uint64_t readTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+// Raw bits of an argument: pointers and integers as is, larger structs
+// truncated to their first 8 bytes.
+template <typename T>
+inline uint64_t toTraceArg(const T& v) {
+    uint64_t r = 0;
+    std::memcpy(&r, &v, sizeof(T) < sizeof(r) ? sizeof(T) : sizeof(r));
+    return r;
+}
+
+inline void captureArgs(ApiRecord&, uint32_t) {}
+
+template <typename T, typename... Args>
+inline void captureArgs(ApiRecord& rec, uint32_t n, const T& first, const Args&... args) {
+    if (n == kMaxArgs) return;
+    rec.args[n] = toTraceArg(first);
+    rec.argCount = n + 1;
+    captureArgs(rec, n + 1, args...);
+}
+
+class ApiTracer;
+// Non-null only when HIP_TRACE_API_FILE is set. Written once during init.
+extern ApiTracer* g_apiTracer;
+
+// Starts the binary tracer writing to path, with ringRecords records of
+// buffering per thread. Returns false if the file could not be created.
+bool startApiTracer(const std::string& path, size_t ringRecords, unsigned flushIntervalMs);
+
+void pushApiRecord(ApiTracer* tracer, const ApiRecord& rec);
+
+// Lives for the duration of one API call. Records nothing unless begin() was
+// called, so the disabled cost is a single pointer test in the caller.
+class ApiTraceScope {
+   public:
+    ApiTraceScope() : _active(false) {}
+    ~ApiTraceScope() {
+        if (_active) {
+            _rec.endTsc = readTsc();
+            pushApiRecord(g_apiTracer, _rec);
+        }
+    }
+
+    template <typename... Args>
+    void begin(uint32_t apiId, uint32_t tid, uint64_t seqNum, const Args&... args) {
+        _rec.apiId = apiId;
+        _rec.tid = tid;
+        _rec.seqNum = seqNum;
+        _rec.status = 0;
+        _rec.argCount = 0;
+        captureArgs(_rec, 0, args...);
+        _active = true;
+        _rec.startTsc = readTsc();
+    }
+
+    void setStatus(int32_t status) { _rec.status = status; }
+
+   private:
+    ApiTraceScope(const ApiTraceScope&) = delete;
+    ApiTraceScope& operator=(const ApiTraceScope&) = delete;
+
+    bool _active;
+    ApiRecord _rec;
+};
+
+}  // namespace hip_trace
+
+#endif  // HIP_SRC_HIP_TRACE_H
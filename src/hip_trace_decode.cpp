@@ -0,0 +1,130 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// hiptracedecode: turns a HIP_TRACE_API_FILE binary trace back into the text
+// format printed by HIP_TRACE_API.
+//
+// usage: hiptracedecode <trace file>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hip/hip_runtime_api.h"
+#include "hip/hcc_detail/hip_prof_str.h"
+
+#include "hip_trace.h"
+
+extern const char* ihipErrorString(hipError_t);
+
+using namespace hip_trace;
+
+// Linear tsc -> CLOCK_MONOTONIC ns mapping from the two calibration pairs in
+// the header. Falls back to treating ticks as ns if the trace never flushed.
+struct Clock {
+    explicit Clock(const FileHeader& h) : tscBase(h.tscBase), nsBase(h.nsBase), nsPerTick(1.0) {
+        if (h.tscLast > h.tscBase && h.nsLast > h.nsBase) {
+            nsPerTick = double(h.nsLast - h.nsBase) / double(h.tscLast - h.tscBase);
+        }
+    }
+
+    uint64_t ns(uint64_t tsc) const { return nsBase + uint64_t(double(tsc - tscBase) * nsPerTick); }
+    uint64_t delta(uint64_t start, uint64_t end) const {
+        return end > start ? uint64_t(double(end - start) * nsPerTick) : 0;
+    }
+
+    uint64_t tscBase;
+    uint64_t nsBase;
+    double nsPerTick;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "error: cannot open %s\n", argv[1]);
+        return 1;
+    }
+    if (size_t(st.st_size) < sizeof(FileHeader)) {
+        fprintf(stderr, "error: %s is too small to be a HIP trace\n", argv[1]);
+        return 1;
+    }
+
+    void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "error: cannot map %s\n", argv[1]);
+        return 1;
+    }
+
+    const FileHeader& h = *static_cast<const FileHeader*>(base);
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion ||
+        h.recordSize != sizeof(ApiRecord)) {
+        fprintf(stderr, "error: %s is not a version %u HIP trace\n", argv[1], kVersion);
+        return 1;
+    }
+
+    // recordCount may lag the file if the process died between flushes; trust
+    // whichever is smaller.
+    size_t available = (st.st_size - sizeof(FileHeader)) / sizeof(ApiRecord);
+    size_t count = std::min<size_t>(available, h.recordCount);
+    const ApiRecord* first = reinterpret_cast<const ApiRecord*>(&h + 1);
+
+    // Records are in drain order, per thread; interleave them back by start time.
+    std::vector<const ApiRecord*> records(count);
+    for (size_t i = 0; i < count; i++) records[i] = first + i;
+    std::stable_sort(records.begin(), records.end(),
+                     [](const ApiRecord* a, const ApiRecord* b) { return a->startTsc < b->startTsc; });
+
+    Clock clock(h);
+    for (const ApiRecord* r : records) {
+        const char* name = hip_api_name(r->apiId);
+
+        printf("<<hip-api pid:%u tid:%u.%lu %s (", h.pid, r->tid, r->seqNum, name);
+        for (uint32_t a = 0; a < r->argCount && a < kMaxArgs; a++) {
+            printf("%s0x%lx", a ? ", " : "", r->args[a]);
+        }
+        printf(") @%lu\n", clock.ns(r->startTsc));
+
+        printf("  hip-api pid:%u tid:%u.%lu %-30s ret=%2d (%s)>> +%lu ns\n", h.pid, r->tid,
+               r->seqNum, name, r->status, ihipErrorString(static_cast<hipError_t>(r->status)),
+               clock.delta(r->startTsc, r->endTsc));
+    }
+
+    if (h.droppedCount) {
+        fprintf(stderr, "warning: %lu records were dropped, increase HIP_TRACE_API_BUFFER\n",
+                h.droppedCount);
+    }
+
+    munmap(base, st.st_size);
+    close(fd);
+    return 0;
+}
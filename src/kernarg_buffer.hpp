@@ -0,0 +1,64 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+// Reusable staging buffer for the packed kernel arguments of one stream.
+//
+// dispatch_hsa_kernel copies the arguments into the queue's kernarg segment
+// before it returns, so each launch can pack into the same memory as the one
+// before. The buffer only grows, to the largest arguments seen. Not thread
+// safe, the stream's lock serializes its launches.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace hip_impl {
+
+class Kernarg_buffer {
+   public:
+    enum : std::size_t { alignment = 16 };
+
+    Kernarg_buffer() = default;
+    Kernarg_buffer(const Kernarg_buffer&) = delete;
+    Kernarg_buffer& operator=(const Kernarg_buffer&) = delete;
+
+    // Returns size bytes aligned to alignment, valid until the next call.
+    char* get(std::size_t size) {
+        if (size > capacity_ || !buf_) {
+            capacity_ = std::max<std::size_t>(size, capacity_);
+            buf_.reset(new char[capacity_ + alignment - 1]);
+        }
+        const std::uintptr_t p = reinterpret_cast<std::uintptr_t>(buf_.get());
+        return reinterpret_cast<char*>((p + alignment - 1) & ~std::uintptr_t(alignment - 1));
+    }
+
+    std::size_t capacity() const { return capacity_; }
+
+   private:
+    std::unique_ptr<char[]> buf_;  // allocated on first use
+    std::size_t capacity_ = 0;
+};
+}  // namespace hip_impl
@@ -0,0 +1,258 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+// Per-device cache of device allocations behind hipMallocAsync/hipFreeAsync,
+// shared by the HCC and ROCclr runtimes.
+//
+// A block freed on a stream gets an event recorded on that stream and goes to
+// the free bin of its size class. The next allocation of that class takes, in
+// order of preference: a block freed on the same stream, which stream order
+// already makes safe; a block whose event has completed; or the oldest block,
+// after making the allocating stream wait for its event. Only when the bin is
+// empty does the pool call into the driver. Blocks are never split, a request
+// is rounded up to its class and gets a whole block.
+//
+// Cached blocks stay reserved until trim() or until a free pushes the reserved
+// total past the release threshold, which then releases completed blocks,
+// largest first, until the pool is back under the threshold. A failed driver
+// allocation releases every completed block and retries once.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+template <typename Stream, typename Event>
+class Memory_pool {
+   public:
+    enum : std::size_t { min_block = 512 };
+
+    struct Stats {
+        std::size_t reserved;  // bytes held from the driver, cached or in use
+        std::size_t used;      // bytes handed out and not yet freed
+        std::size_t peak_reserved;
+        std::size_t peak_used;
+        std::uint64_t allocations;
+        std::uint64_t reuses;            // allocations served from a free bin
+        std::uint64_t dependency_waits;  // reuses that made the stream wait for an event
+        std::uint64_t releases;          // blocks handed back to the driver
+    };
+
+    // The hooks are called with the pool lock held, except allocate and
+    // release, so they may take stream locks but must not re-enter the pool.
+    // An Event{} is unrecorded; record() is always given the block's previous
+    // event, so runtimes whose events are objects can reuse them, and release()
+    // destroys it.
+    struct Hooks {
+        std::function<void*(std::size_t)> allocate;  // null on failure
+        std::function<void(void*, Event&)> release;
+        std::function<void(Stream, Event&)> record;
+        std::function<bool(Event&)> done;
+        std::function<void(Stream, Event&)> wait;
+    };
+
+    explicit Memory_pool(Hooks hooks) : hooks_(std::move(hooks)) {}
+
+    Memory_pool(const Memory_pool&) = delete;
+    Memory_pool& operator=(const Memory_pool&) = delete;
+
+    // Cached blocks are left to the runtime, whose device teardown frees them.
+    ~Memory_pool() = default;
+
+    // Largest size class, the top class below the end of the address space.
+    static constexpr std::size_t max_size = ~(~std::size_t{0} >> 3);
+
+    // Requests round up to min_block, and above that to one of four classes
+    // per power of two, so at most a quarter of a block is wasted. 0 for
+    // sizes above max_size, which can't be rounded up.
+    static std::size_t size_class(std::size_t size) {
+        if (size <= min_block) return min_block;
+        if (size > max_size) return 0;
+        unsigned log2 = 0;
+        for (std::size_t s = size - 1; s >>= 1;) ++log2;
+        const std::size_t step = std::size_t{1} << (log2 - 2);
+        return (size + step - 1) & ~(step - 1);
+    }
+
+    // Returns a block of at least size bytes usable in stream order on
+    // stream, or null if the driver is out of memory.
+    void* allocate(std::size_t size, Stream stream) {
+        const std::size_t cls = size_class(size);
+        if (cls == 0) return nullptr;
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            Block b;
+            if (take(cls, stream, b)) {
+                ++stats_.reuses;
+                return hand_out(b.ptr, cls, std::move(b.event));
+            }
+        }
+
+        void* ptr = hooks_.allocate(cls);
+        if (!ptr) {
+            release_completed(0);
+            ptr = hooks_.allocate(cls);
+            if (!ptr) return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lck{mutex_};
+        stats_.reserved += cls;
+        stats_.peak_reserved = std::max(stats_.peak_reserved, stats_.reserved);
+        return hand_out(ptr, cls, Event{});
+    }
+
+    // Caches ptr once the work queued on stream so far has completed. Returns
+    // false if ptr was not allocated by the pool or is already free.
+    bool free(void* ptr, Stream stream) {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            const auto it = used_.find(ptr);
+            if (it == used_.end()) return false;
+
+            Block b{ptr, it->second.size, stream, std::move(it->second.event)};
+            used_.erase(it);
+            stats_.used -= b.size;
+            hooks_.record(stream, b.event);
+            bins_[b.size].push_back(std::move(b));
+            if (stats_.reserved <= threshold_) return true;
+        }
+        release_completed(threshold_);
+        return true;
+    }
+
+    bool owns(void* ptr) const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return used_.count(ptr) != 0;
+    }
+
+    // Releases completed cached blocks until at most keep bytes are reserved.
+    // Blocks still in use, or whose free has not completed, are kept.
+    void trim(std::size_t keep) { release_completed(keep); }
+
+    void set_release_threshold(std::size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            threshold_ = bytes;
+            if (stats_.reserved <= threshold_) return;
+        }
+        release_completed(bytes);
+    }
+
+    std::size_t release_threshold() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return threshold_;
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return stats_;
+    }
+
+   private:
+    struct Block {
+        void* ptr;
+        std::size_t size;
+        Stream stream;  // stream of the free
+        Event event;    // recorded on stream by the free
+    };
+
+    struct Used {
+        std::size_t size;
+        Event event;  // kept for the next free to re-record
+    };
+
+    bool take(std::size_t cls, Stream stream, Block& out) {
+        const auto bin = bins_.find(cls);
+        if (bin == bins_.end() || bin->second.empty()) return false;
+        std::deque<Block>& blocks = bin->second;
+
+        // Newest first: the most recently freed block is the most likely warm.
+        for (auto b = blocks.rbegin(); b != blocks.rend(); ++b) {
+            if (b->stream == stream) return pop(blocks, std::next(b).base(), out);
+        }
+        for (auto b = blocks.begin(); b != blocks.end(); ++b) {
+            if (hooks_.done(b->event)) return pop(blocks, b, out);
+        }
+        // The oldest free is the closest to completing.
+        hooks_.wait(stream, blocks.front().event);
+        ++stats_.dependency_waits;
+        return pop(blocks, blocks.begin(), out);
+    }
+
+    static bool pop(std::deque<Block>& blocks, typename std::deque<Block>::iterator b,
+                    Block& out) {
+        out = std::move(*b);
+        blocks.erase(b);
+        return true;
+    }
+
+    void* hand_out(void* ptr, std::size_t cls, Event event) {
+        used_.emplace(ptr, Used{cls, std::move(event)});
+        ++stats_.allocations;
+        stats_.used += cls;
+        stats_.peak_used = std::max(stats_.peak_used, stats_.used);
+        return ptr;
+    }
+
+    void release_completed(std::size_t keep) {
+        std::vector<Block> victims;
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            for (auto bin = bins_.rbegin(); bin != bins_.rend(); ++bin) {
+                std::deque<Block>& blocks = bin->second;
+                for (auto b = blocks.begin(); b != blocks.end() && stats_.reserved > keep;) {
+                    if (!hooks_.done(b->event)) {
+                        ++b;
+                        continue;
+                    }
+                    stats_.reserved -= b->size;
+                    ++stats_.releases;
+                    victims.push_back(std::move(*b));
+                    b = blocks.erase(b);
+                }
+                if (stats_.reserved <= keep) break;
+            }
+        }
+        for (auto& b : victims) hooks_.release(b.ptr, b.event);
+    }
+
+    const Hooks hooks_;
+
+    mutable std::mutex mutex_;
+    std::map<std::size_t, std::deque<Block>> bins_;  // free blocks by size class
+    std::unordered_map<void*, Used> used_;
+    std::size_t threshold_ = std::numeric_limits<std::size_t>::max();
+    Stats stats_ = {};
+};
+}  // namespace hip_impl
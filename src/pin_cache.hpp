@@ -0,0 +1,557 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Cache of pinned pageable host ranges, used by the HCC runtime for large
+// copies to and from pageable memory. Instead of streaming such a buffer
+// through the staging ring on every copy, the page-aligned range around it is
+// pinned once and kept pinned, so later copies from any part of it DMA
+// directly. Ranges are evicted least recently used first to stay under a
+// budget of pinned bytes.
+//
+// A pinned page stays pinned after the application unmaps it, so a cached
+// range must be dropped before its address can be reused. Cached ranges are
+// registered with a userfaultfd asking for unmap, remove (madvise, and so the
+// trimming done by free) and remap events. munmap does not return until a
+// monitor thread has read the event, and the monitor reads with the cache
+// lock held and drops the range before releasing it, so no lookup can hit a
+// range after its munmap has returned. The kernel posts the unmap event only
+// after removing the mapping, so another thread may map the same addresses
+// before the range is dropped; a hit therefore also checks that the first and
+// last page copied still belong to the watched mapping. Without userfaultfd
+// the cache stays disabled.
+//
+// The monitor must never wait for an event itself, so it does not allocate,
+// free or call the hooks: dropped ranges are unpinned later, by the next
+// thread using the cache. For the same reason the hooks are always called
+// without the cache lock held, and entries live in a fixed table.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_userfaultfd) && defined(UFFD_FEATURE_EVENT_UNMAP)
+#define HIP_PIN_CACHE_USERFAULTFD 1
+#endif
+#endif
+
+namespace hip_impl {
+
+class Pin_cache {
+   public:
+    enum : std::size_t { max_entries = 128, max_rejected = 16 };
+
+    struct Stats {
+        std::size_t budget;  // 0 if the cache is disabled
+        std::size_t pinned;  // bytes pinned, including dropped ranges not yet unpinned
+        std::size_t peak_pinned;
+        std::uint64_t lookups;
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t pins;           // ranges pinned on a miss
+        std::uint64_t evictions;      // ranges unpinned to stay under the budget
+        std::uint64_t invalidations;  // ranges dropped because they were unmapped or freed
+        std::uint64_t rejected;       // ranges that could not be pinned or watched
+    };
+
+    // lock pins [base, base + size) and returns the address devices use for
+    // base, or null. unlock undoes it. Neither is called with the cache lock
+    // held.
+    struct Hooks {
+        std::function<void*(void*, std::size_t)> lock;
+        std::function<void(void*)> unlock;
+    };
+
+    // A cached range in use by a copy. It stays pinned, even if evicted or
+    // unmapped meanwhile, until the Pin is destroyed.
+    class Pin {
+       public:
+        Pin() = default;
+        Pin(Pin&& x) noexcept : cache_{x.cache_}, slot_{x.slot_}, device_ptr_{x.device_ptr_} {
+            x.cache_ = nullptr;
+        }
+        Pin& operator=(Pin&& x) noexcept {
+            if (this != &x) {
+                reset();
+                std::swap(cache_, x.cache_);
+                slot_ = x.slot_;
+                device_ptr_ = x.device_ptr_;
+            }
+            return *this;
+        }
+        ~Pin() { reset(); }
+
+        explicit operator bool() const { return cache_ != nullptr; }
+
+        // Device address of the pointer passed to acquire().
+        void* device_ptr() const { return device_ptr_; }
+
+        void reset() {
+            if (cache_) cache_->release(slot_);
+            cache_ = nullptr;
+        }
+
+       private:
+        friend class Pin_cache;
+        Pin(Pin_cache* cache, std::size_t slot, void* device_ptr)
+            : cache_{cache}, slot_{slot}, device_ptr_{device_ptr} {}
+
+        Pin_cache* cache_ = nullptr;
+        std::size_t slot_ = 0;
+        void* device_ptr_ = nullptr;
+    };
+
+    // A budget of 0 disables the cache.
+    Pin_cache(Hooks hooks, std::size_t budget)
+        : hooks_(std::move(hooks)), budget_{budget}, page_{page_size()}, entries_(max_entries),
+          rejected_(max_rejected) {
+        if (budget_ != 0) start_monitor();
+    }
+
+    Pin_cache(const Pin_cache&) = delete;
+    Pin_cache& operator=(const Pin_cache&) = delete;
+
+    // Unpins every range. No Pin may outlive the cache.
+    ~Pin_cache() {
+        Unpin_list pinned;
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            for (auto&& e : entries_) {
+                if (e.state == cached || e.state == stale) pinned.push(e.base);
+            }
+        }
+        unpin(pinned);
+        stop_monitor();
+    }
+
+    bool enabled() const { return budget_ != 0 && uffd_ >= 0; }
+
+    // Returns a Pin covering [p, p + n) if a cached range holds it. On a miss,
+    // and if may_pin, pins and caches the pages around it; callers pass false
+    // for memory pinned by other means, e.g. hipHostRegister.
+    Pin acquire(const void* p, std::size_t n, bool may_pin) {
+        if (!enabled() || n == 0) return Pin{};
+        const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(p);
+        const std::uintptr_t last = first + n;
+
+        reap();
+        Unpin_list evicted;
+        std::unique_lock<std::mutex> lck{mutex_};
+        ++stats_.lookups;
+        for (std::size_t i = 0; i != entries_.size(); ++i) {
+            Entry& e = entries_[i];
+            if (e.state == cached && e.base <= first && last <= e.base + e.size) {
+                if (!still_watched(first, last)) {
+                    // Unmapped and mapped again before the unmap event was
+                    // posted. The addresses belong to the new mapping now.
+                    e.state = stale;
+                    ++stats_.invalidations;
+                    has_stale_ = true;
+                    break;
+                }
+                ++e.users;
+                e.last_use = ++tick_;
+                ++stats_.hits;
+                return Pin{this, i, e.device + (first - e.base)};
+            }
+        }
+        ++stats_.misses;
+        if (!may_pin) return Pin{};
+
+        const std::uintptr_t base = first & ~(page_ - 1);
+        const std::size_t size = ((last + page_ - 1) & ~(page_ - 1)) - base;
+        std::size_t slot;
+        if (size > budget_ || was_rejected(base, size) ||
+            !make_room(base, size, slot, evicted)) {
+            lck.unlock();
+            unpin(evicted);
+            return Pin{};
+        }
+        const std::uint64_t generation = generation_;
+        lck.unlock();
+        unpin(evicted);
+
+        void* device = hooks_.lock(reinterpret_cast<void*>(base), size);
+        const bool watched = device && watch(base, size);
+        if (device && !watched) hooks_.unlock(reinterpret_cast<void*>(base));
+
+        lck.lock();
+        Entry& e = entries_[slot];
+        if (!watched || generation_ != generation) {
+            // An event since make_room may have been for this range, which
+            // cannot be told apart from the monitor's side; drop it.
+            e.state = free_slot;
+            stats_.pinned -= size;
+            if (!watched) {
+                ++stats_.rejected;
+                rejected_[next_rejected_++ % max_rejected] = Range{base, size};
+                return Pin{};
+            }
+            lck.unlock();
+            unwatch(base, size);
+            hooks_.unlock(reinterpret_cast<void*>(base));
+            return Pin{};
+        }
+        e.state = cached;
+        e.device = static_cast<char*>(device);
+        e.users = 1;
+        e.last_use = ++tick_;
+        ++stats_.pins;
+        return Pin{this, slot, e.device + (first - base)};
+    }
+
+    // Drops cached ranges overlapping [p, p + n), e.g. before the application
+    // pins them itself.
+    void invalidate(const void* p, std::size_t n) {
+        if (!enabled()) return;
+        const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(p);
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            invalidate_locked(first, first + n, true);
+        }
+        reap();
+    }
+
+    // Unpins every cached range not in use.
+    void trim() {
+        Unpin_list evicted;
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            for (auto&& e : entries_) {
+                if (e.state == cached && e.users == 0) evict(e, evicted);
+            }
+        }
+        unpin(evicted);
+        reap();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        Stats s = stats_;
+        s.budget = enabled() ? budget_ : 0;
+        return s;
+    }
+
+   private:
+    // free_slot -> pinning -> cached -> (evicted) -> free_slot
+    //                                -> stale -> (unpinned once idle) -> free_slot
+    enum State : unsigned char { free_slot, pinning, cached, stale, unpinning };
+
+    struct Entry {
+        std::uintptr_t base = 0;
+        std::size_t size = 0;
+        char* device = nullptr;
+        std::size_t users = 0;
+        std::uint64_t last_use = 0;
+        State state = free_slot;
+    };
+
+    struct Range {
+        std::uintptr_t base;
+        std::size_t size;
+    };
+
+    // Ranges to unpin once the lock is released, on the stack so that
+    // nothing is allocated or freed with the lock held.
+    struct Unpin_list {
+        std::uintptr_t base[max_entries];
+        std::size_t size = 0;
+
+        void push(std::uintptr_t b) { base[size++] = b; }
+    };
+
+    static std::size_t page_size() {
+#if defined(__linux__)
+        const long sz = sysconf(_SC_PAGESIZE);
+        if (sz > 0) return static_cast<std::size_t>(sz);
+#endif
+        return 4096;
+    }
+
+    void release(std::size_t slot) {
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            --entries_[slot].users;
+        }
+        reap();
+    }
+
+    bool was_rejected(std::uintptr_t base, std::size_t size) const {
+        for (auto&& r : rejected_) {
+            if (r.base == base && r.size == size) return true;
+        }
+        return false;
+    }
+
+    // Reserves a slot and budget for a new range, evicting idle ranges least
+    // recently used first, and ranges overlapping it. Fails if ranges in use
+    // are in the way.
+    bool make_room(std::uintptr_t base, std::size_t size, std::size_t& slot,
+                   Unpin_list& evicted) {
+        for (auto&& e : entries_) {
+            if (e.state != free_slot && e.base < base + size && base < e.base + e.size) {
+                if (e.state != cached || e.users != 0) return false;
+            }
+        }
+        for (auto&& e : entries_) {
+            if (e.state == cached && e.base < base + size && base < e.base + e.size) {
+                evict(e, evicted);
+            }
+        }
+
+        slot = max_entries;
+        for (;;) {
+            std::size_t lru = max_entries;
+            for (std::size_t i = 0; i != entries_.size(); ++i) {
+                const Entry& e = entries_[i];
+                if (e.state == free_slot && slot == max_entries) slot = i;
+                if (e.state == cached && e.users == 0 &&
+                    (lru == max_entries || e.last_use < entries_[lru].last_use)) {
+                    lru = i;
+                }
+            }
+            if (slot != max_entries && stats_.pinned + size <= budget_) break;
+            if (lru == max_entries) return false;
+            evict(entries_[lru], evicted);
+        }
+
+        Entry& e = entries_[slot];
+        e.base = base;
+        e.size = size;
+        e.users = 0;
+        e.state = pinning;
+        stats_.pinned += size;
+        stats_.peak_pinned = std::max(stats_.peak_pinned, stats_.pinned);
+        return true;
+    }
+
+    // Takes an idle cached range out of the table; the caller unpins it once
+    // the lock is released.
+    void evict(Entry& e, Unpin_list& evicted) {
+        unwatch(e.base, e.size);
+        evicted.push(e.base);
+        e.state = free_slot;
+        stats_.pinned -= e.size;
+        ++stats_.evictions;
+    }
+
+    void unpin(const Unpin_list& evicted) {
+        for (std::size_t i = 0; i != evicted.size; ++i) {
+            hooks_.unlock(reinterpret_cast<void*>(evicted.base[i]));
+        }
+    }
+
+    // Called by the monitor with the lock held: no allocation, no hooks.
+    // Ranges no longer mapped are not unregistered, as the addresses may
+    // already belong to a new mapping being watched.
+    void invalidate_locked(std::uintptr_t first, std::uintptr_t last, bool mapped) {
+        for (auto&& e : entries_) {
+            if (e.state == cached && e.base < last && first < e.base + e.size) {
+                if (mapped) unwatch(e.base, e.size);
+                e.state = stale;
+                ++stats_.invalidations;
+                has_stale_ = true;
+            }
+        }
+    }
+
+    // Unpins dropped ranges no longer in use.
+    void reap() {
+        std::unique_lock<std::mutex> lck{mutex_};
+        if (!has_stale_) return;
+        has_stale_ = false;
+        for (auto&& e : entries_) {
+            if (e.state != stale) continue;
+            if (e.users != 0) {
+                has_stale_ = true;
+                continue;
+            }
+            e.state = unpinning;
+            lck.unlock();
+            hooks_.unlock(reinterpret_cast<void*>(e.base));
+            lck.lock();
+            e.state = free_slot;
+            stats_.pinned -= e.size;
+        }
+    }
+
+#if defined(HIP_PIN_CACHE_USERFAULTFD)
+    void start_monitor() {
+        int fd = static_cast<int>(syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK));
+#if defined(UFFD_USER_MODE_ONLY)
+        // Unprivileged processes may only watch user mode faults, which is
+        // all the cache needs.
+        if (fd < 0) {
+            fd = static_cast<int>(
+                syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+        }
+#endif
+        if (fd < 0) return;
+
+        uffdio_api api{};
+        api.api = UFFD_API;
+        api.features = UFFD_FEATURE_EVENT_UNMAP | UFFD_FEATURE_EVENT_REMOVE |
+                       UFFD_FEATURE_EVENT_REMAP;
+        wake_ = eventfd(0, EFD_CLOEXEC);
+        if (ioctl(fd, UFFDIO_API, &api) != 0 || wake_ < 0) {
+            close(fd);
+            if (wake_ >= 0) close(wake_);
+            wake_ = -1;
+            return;
+        }
+        uffd_ = fd;
+        monitor_ = std::thread{[this]() { monitor(); }};
+    }
+
+    void stop_monitor() {
+        if (!monitor_.joinable()) return;
+        const std::uint64_t one = 1;
+        while (write(wake_, &one, sizeof(one)) < 0 && errno == EINTR) {
+        }
+        monitor_.join();
+        close(wake_);
+        close(uffd_);
+    }
+
+    bool watch(std::uintptr_t base, std::size_t size) {
+        uffdio_register reg{};
+        reg.range.start = base;
+        reg.range.len = size;
+        reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+        return ioctl(uffd_, UFFDIO_REGISTER, &reg) == 0;
+    }
+
+    void unwatch(std::uintptr_t base, std::size_t size) {
+        uffdio_range range{base, size};
+        ioctl(uffd_, UFFDIO_UNREGISTER, &range);
+    }
+
+    // Zero-filling a present page of a range registered with this
+    // userfaultfd fails with EEXIST and changes nothing; a page of any other
+    // mapping fails with ENOENT.
+    bool still_watched(std::uintptr_t first, std::uintptr_t last) const {
+        const std::uintptr_t pages[2] = {first & ~(page_ - 1), (last - 1) & ~(page_ - 1)};
+        for (std::uintptr_t page : pages) {
+            uffdio_zeropage zero{};
+            zero.range.start = page;
+            zero.range.len = page_;
+            zero.mode = UFFDIO_ZEROPAGE_MODE_DONTWAKE;
+            if (ioctl(uffd_, UFFDIO_ZEROPAGE, &zero) == 0 || errno != EEXIST) return false;
+        }
+        return true;
+    }
+
+    void monitor() {
+        pollfd fds[2] = {{uffd_, POLLIN, 0}, {wake_, POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents != 0) return;
+            if ((fds[0].revents & POLLIN) == 0) continue;
+
+            // Holding the lock across the read is what orders the drop
+            // before the return from munmap.
+            std::lock_guard<std::mutex> lck{mutex_};
+            uffd_msg msgs[16];
+            ssize_t bytes;
+            while ((bytes = read(uffd_, msgs, sizeof(msgs))) > 0) {
+                ++generation_;
+                for (ssize_t i = 0; i != bytes / static_cast<ssize_t>(sizeof(uffd_msg)); ++i) {
+                    handle(msgs[i]);
+                }
+            }
+        }
+    }
+
+    void handle(const uffd_msg& msg) {
+        switch (msg.event) {
+            case UFFD_EVENT_UNMAP:
+                invalidate_locked(msg.arg.remove.start, msg.arg.remove.end, false);
+                break;
+            case UFFD_EVENT_REMOVE:
+                invalidate_locked(msg.arg.remove.start, msg.arg.remove.end, true);
+                break;
+            case UFFD_EVENT_REMAP:
+                invalidate_locked(msg.arg.remap.from, msg.arg.remap.from + msg.arg.remap.len,
+                                  false);
+                // The registration moved with the pages.
+                unwatch(msg.arg.remap.to, msg.arg.remap.len);
+                break;
+            case UFFD_EVENT_PAGEFAULT: {
+                // A missing page in a watched range: it is no longer the page
+                // pinned. Unregistering wakes the faulting thread.
+                const std::uintptr_t page = msg.arg.pagefault.address & ~(page_ - 1);
+                invalidate_locked(page, page + page_, true);
+                unwatch(page, page_);
+                uffdio_range range{page, page_};
+                ioctl(uffd_, UFFDIO_WAKE, &range);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    int uffd_ = -1;
+    int wake_ = -1;
+    std::thread monitor_;
+#else
+    void start_monitor() {}
+    void stop_monitor() {}
+    bool watch(std::uintptr_t, std::size_t) { return false; }
+    bool still_watched(std::uintptr_t, std::uintptr_t) const { return false; }
+    void unwatch(std::uintptr_t, std::size_t) {}
+
+    int uffd_ = -1;
+#endif
+
+    const Hooks hooks_;
+    const std::size_t budget_;
+    const std::size_t page_;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    std::vector<Range> rejected_;
+    std::size_t next_rejected_ = 0;
+    std::uint64_t tick_ = 0;
+    std::uint64_t generation_ = 0;  // userfaultfd events read
+    bool has_stale_ = false;
+    Stats stats_{};
+};
+}  // namespace hip_impl
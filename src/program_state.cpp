@@ -4,7 +4,10 @@
 
 #include <hsa/hsa.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <unordered_map>
 #include <vector>
@@ -90,12 +93,49 @@ namespace hip_impl {
         return t;
     }
 
-    std::mutex executables_cache_mutex;
-    std::vector<hsa_executable_t>& executables_cache(
-        std::string elf, hsa_isa_t isa, hsa_agent_t agent) {
+    Executables_cache_entry& executables_cache(
+        const std::string& elf, hsa_isa_t isa, hsa_agent_t agent) {
+        // Only the lookup is serialized; entries are node based and never
+        // erased, so the returned reference stays valid while it is loaded.
+        static std::mutex cache_mutex;
         static std::unordered_map<std::string,
             std::unordered_map<hsa_isa_t,
-                std::unordered_map<hsa_agent_t, std::vector<hsa_executable_t>>>> cache;
+                std::unordered_map<hsa_agent_t, Executables_cache_entry>>> cache;
+        std::lock_guard<std::mutex> lck{cache_mutex};
         return cache[elf][isa][agent];
     }
+
+    const Code_object_metadata& code_object_metadata(const char* data, std::size_t size) {
+        static std::mutex metadata_mutex;
+        static std::unordered_map<std::string, std::unique_ptr<Code_object_metadata>> metadata;
+        static Code_object_cache* disk_cache = HIP_CODE_OBJECT_CACHE_PATH.empty() ? nullptr :
+            new Code_object_cache{HIP_CODE_OBJECT_CACHE_PATH,
+                                  std::uint64_t(std::max(HIP_CODE_OBJECT_CACHE_SIZE, 1)) << 20};
+
+        const std::string key = content_hash(data, size);
+        {
+            std::lock_guard<std::mutex> lck{metadata_mutex};
+            const auto it = metadata.find(key);
+            if (it != metadata.cend()) return *it->second;
+        }
+
+        // Parse outside the lock, code objects are loaded concurrently.
+        std::unique_ptr<Code_object_metadata> md{new Code_object_metadata};
+        std::string stored;
+        if (!disk_cache || !disk_cache->load(key, stored) || !md->deserialize(stored)) {
+            *md = Code_object_metadata{};
+            md->valid = program_state_impl::read_undefined_symbols(
+                data, size, md->undefined_symbols);
+
+            std::unordered_map<std::string, std::vector<std::pair<std::size_t, std::size_t>>> k;
+            if (md->valid) program_state_impl::parse_kernarg_metadata(std::string(data, size), k);
+            md->kernargs.assign(std::make_move_iterator(k.begin()),
+                                std::make_move_iterator(k.end()));
+
+            if (disk_cache && md->valid) disk_cache->store(key, md->serialize());
+        }
+
+        std::lock_guard<std::mutex> lck{metadata_mutex};
+        return *metadata.emplace(key, std::move(md)).first->second;
+    }
 };
@@ -1,6 +1,8 @@
 #include "../include/hip/hcc_detail/program_state.hpp"
 
 #include "code_object_bundle.inl"
+#include "code_object_cache.h"
+#include "elf_scan.h"
 #include "../include/hip/hcc_detail/hsa_helpers.hpp"
 
 #if !defined(__cpp_exceptions)
@@ -28,12 +30,15 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <atomic>
 #include <deque>
+#include <exception>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -68,9 +73,19 @@ void hip_throw(const std::exception&);
 
 std::vector<hsa_agent_t> all_hsa_agents();
 
-extern std::mutex executables_cache_mutex;
+// Executables loaded for one elf+isa+agent, shared by all program states.
+// loaded guards the one-time load, so different entries load concurrently.
+struct Executables_cache_entry {
+    std::once_flag loaded;
+    std::vector<hsa_executable_t> executables;
+};
+
+Executables_cache_entry& executables_cache(const std::string&, hsa_isa_t, hsa_agent_t);
 
-std::vector<hsa_executable_t>& executables_cache(std::string, hsa_isa_t, hsa_agent_t);
+// Kernarg layouts and undefined symbols of a code object, parsed once per
+// distinct code object and, with HIP_CODE_OBJECT_CACHE_PATH, kept on disk
+// across runs. The reference stays valid for the life of the process.
+const Code_object_metadata& code_object_metadata(const char* data, std::size_t size);
 
 template<typename P>
 inline
@@ -149,6 +164,10 @@ class program_state_impl {
 
 public:
 
+    std::pair<
+        std::once_flag,
+        std::vector<Elf_scan>> elf_scans;
+
     std::pair<
         std::once_flag,
         std::unordered_map<
@@ -216,6 +235,16 @@ public:
         }
     }
 
+    // Every loaded ELF object is parsed once, here, and shared by the code
+    // object, global and function name lookups below.
+    const std::vector<Elf_scan>& get_elf_scans() {
+        std::call_once(elf_scans.first, [this]() {
+            elf_scans.second = scan_loaded_elfs(HIP_ELF_CACHE_PATH);
+        });
+
+        return elf_scans.second;
+    }
+
     const std::unordered_map<
         std::string,
             std::unordered_map<
@@ -223,44 +252,42 @@ public:
                 std::vector<std::string>>>& get_code_object_blobs() {
 
         std::call_once(code_object_blobs.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
-                ELFIO::elfio tmp;
-
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
-
-                if (!tmp.load(elf)) return 0;
-
-                const auto it = find_section_if(tmp, [](const ELFIO::section* x) {
-                    return x->get_name() == ".kernel";
-                });
-
-                if (!it) return 0;
-
-                auto& impl = *static_cast<program_state_impl*>(p);
-
-                std::vector<char> multi_arch_blob(it->get_data(), it->get_data() + it->get_size());
-                auto blob_it = multi_arch_blob.begin();
-                while (blob_it != multi_arch_blob.end()) {
-                    Bundled_code_header tmp{blob_it, multi_arch_blob.end()};
-
-                    if (!valid(tmp)) break;
-
-                    for (auto&& bundle : bundles(tmp)) {
-                        if(bundle.blob.size())
-                            impl.code_object_blobs.second[elf][triple_to_hsa_isa(bundle.triple)].push_back(bundle.blob);
+            for (auto&& elf : get_elf_scans()) {
+                if (elf.kernel_size == 0) continue;
+
+                const Mapped_file_range section{elf.path, elf.kernel_offset, elf.kernel_size};
+
+                if (!section.data()) continue;
+
+                // The section holds one or more concatenated bundles. Index
+                // them in place and copy out only code objects for the GPUs
+                // present.
+                const char* blob_it = section.data();
+                const char* blob_end = blob_it + section.size();
+                while (blob_it != blob_end) {
+                    const Bundle_index index{blob_it, static_cast<std::size_t>(blob_end - blob_it)};
+
+                    if (!index.valid()) break;
+
+                    for (auto&& bundle : index.entries()) {
+                        if (bundle.blob.empty()) continue;
+                        const std::string triple = bundle.triple.str();
+                        #if !defined(DISABLE_REDUCED_GPU_BLOB_COPY)
+                        if (!get_all_gpuarch().count(triple)) continue;
+                        #endif
+                        code_object_blobs.second[elf.path][triple_to_hsa_isa(triple)].push_back(
+                            bundle.blob.str());
                     }
 
-                    blob_it += tmp.bundled_code_size;
-                };
-
-                return 0;
-            }, this);
+                    blob_it += index.extent();
+                }
+            }
         });
 
         return code_object_blobs.second;
     }
 
+    static
     Symbol read_symbol(const ELFIO::symbol_section_accessor& section,
                    unsigned int idx) {
         assert(idx < section.get_symbols_num());
@@ -277,38 +304,12 @@ public:
         std::pair<ELFIO::Elf64_Addr, ELFIO::Elf_Xword>>& get_symbol_addresses() {
 
         std::call_once(symbol_addresses.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* psi_ptr) {
-
-                if (!psi_ptr)
-                    return 0;
-
-                program_state_impl* t = static_cast<program_state_impl*>(psi_ptr);
-
-                ELFIO::elfio tmp;
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
-
-                if (!tmp.load(elf)) return 0;
-
-                auto it = find_section_if(tmp, [](const ELFIO::section* x) { 
-                    return x->get_type() == SHT_SYMTAB;
-                });
-
-                if (!it) return 0;
-
-                const ELFIO::symbol_section_accessor symtab{tmp, it};
-
-                for (auto i = 0u; i != symtab.get_symbols_num(); ++i) {
-                    auto s = t->read_symbol(symtab, i);
-
-                    if (s.type != STT_OBJECT || s.sect_idx == SHN_UNDEF) continue;
-
-                    const auto addr = s.value + info->dlpi_addr;
-                    t->symbol_addresses.second.emplace(std::move(s.name), std::make_pair(addr, s.size));
+            for (auto&& elf : get_elf_scans()) {
+                for (auto&& s : elf.objects) {
+                    const auto addr = s.value + elf.load_bias;
+                    symbol_addresses.second.emplace(s.name, std::make_pair(addr, s.size));
                 }
-
-                return 0;
-            }, this);
+            }
         });
 
         return symbol_addresses.second;
@@ -325,6 +326,7 @@ public:
         return std::get<1>(globals);
     }
 
+    static
     std::vector<std::string> copy_names_of_undefined_symbols(
         const ELFIO::symbol_section_accessor& section) {
         std::vector<std::string> r;
@@ -341,16 +343,31 @@ public:
         return r;
     }
 
+    // Returns false if data is not an ELF file.
+    static
+    bool read_undefined_symbols(const char* data, std::size_t size,
+                                std::vector<std::string>& undefined_symbols) {
+        ELFIO::elfio reader;
+        std::string ts = std::string(data, size);
+        std::stringstream tmp{ts};
+
+        if (!reader.load(tmp)) return false;
+        const auto code_object_dynsym = find_section_if(
+            reader, [](const ELFIO::section* x) {
+                return x->get_type() == SHT_DYNSYM;
+        });
+
+        if (code_object_dynsym) {
+            undefined_symbols = copy_names_of_undefined_symbols(
+                ELFIO::symbol_section_accessor{reader, code_object_dynsym});
+        }
+        return true;
+    }
+
     void associate_code_object_symbols_with_host_allocation(
-        const ELFIO::elfio& reader,
-        ELFIO::section* code_object_dynsym,
+        const std::vector<std::string>& undefined_symbols,
         hsa_agent_t agent,
         hsa_executable_t executable) {
-        if (!code_object_dynsym) return;
-
-        const auto undefined_symbols = copy_names_of_undefined_symbols(
-            ELFIO::symbol_section_accessor{reader, code_object_dynsym});
-
         auto& g = get_globals();
         auto& g_mutex = get_globals_mutex();
         for (auto&& x : undefined_symbols) {
@@ -381,8 +398,10 @@ public:
                 return (void*)nullptr;
             };
 
-            void* p = retrieve_pinned_address_from_cache(g, x);
-            if (p == nullptr) {
+            // Code objects are loaded concurrently (see load_executables), so
+            // the cache is only read under the lock.
+            void* p = nullptr;
+            {
                 std::lock_guard<std::mutex> lck{g_mutex};
                 p = retrieve_pinned_address_from_cache(g, x);
                 if (p == nullptr) {
@@ -424,7 +443,9 @@ public:
 
         RAII_code_reader tmp{new hsa_code_object_reader_t, cor_deleter};
 
-        decltype(code_readers.second)::iterator it;
+        // Other loaders append to the deque concurrently, which invalidates
+        // its iterators but not the element itself, so keep a reference.
+        hsa_code_object_reader_t* reader = nullptr;
         {
           std::lock_guard<std::mutex> lck{code_readers.first};
 
@@ -433,10 +454,11 @@ public:
             file = std::string(data, data_size);
 
           code_readers.second.emplace_back(move(file), move(tmp));
-          it = std::prev(code_readers.second.end());
+          auto& entry = code_readers.second.back();
+          reader = entry.second.get();
 
           if (make_copy)
-            data = it->first.data();
+            data = entry.first.data();
         }
 
         auto check_hsa_error = [](hsa_status_t s) {
@@ -450,10 +472,10 @@ public:
         };
 
         check_hsa_error(hsa_code_object_reader_create_from_memory(
-            data, data_size, it->second.get()));
+            data, data_size, reader));
 
         check_hsa_error(hsa_executable_load_agent_code_object(
-            executable, agent, *it->second, nullptr, nullptr));
+            executable, agent, *reader, nullptr, nullptr));
 
         check_hsa_error(hsa_executable_freeze(executable, nullptr));
     }
@@ -470,41 +492,24 @@ public:
             hsa_agent_iterate_isas(aa, [](hsa_isa_t x, void* d) {
                 auto& p = *static_cast<decltype(data)*>(d);
                 auto& impl = *(p.first);
-                for (const auto code_object_it : impl.get_code_object_blobs()) {
-                    const auto elf = code_object_it.first;
-                    const auto code_object_blobs = code_object_it.second;
-                    const auto it = code_object_blobs.find(x);
-
-                    if (it == code_object_blobs.cend()) continue;
+                hsa_agent_t a = *static_cast<hsa_agent_t*>(p.second);
+                for (auto&& code_object_it : impl.get_code_object_blobs()) {
+                    const auto& elf = code_object_it.first;
+                    const auto it = code_object_it.second.find(x);
 
-                    hsa_agent_t a = *static_cast<hsa_agent_t*>(p.second);
+                    if (it == code_object_it.second.cend()) continue;
 
-                    std::lock_guard<std::mutex> lck{executables_cache_mutex};
+                    // Executables for this elf+isa+agent may already have been
+                    // loaded by another program state; otherwise load them
+                    // here, without blocking loads for other entries.
+                    auto& cached = hip_impl::executables_cache(elf, x, a);
+                    std::call_once(cached.loaded, [&]() {
+                        cached.executables = impl.load_executables(it->second, a);
+                    });
 
-                    std::vector<hsa_executable_t>& current_exes =
-                            hip_impl::executables_cache(elf, x, a);
-                    // check the cache for already loaded executables
-                    if (current_exes.empty()) {
-                        // executables do not yet exist for this elf+isa+agent, create and cache them
-                        for (auto&& blob : it->second) {
-                            hsa_executable_t tmp = {};
-
-                            hsa_executable_create_alt(
-                                HSA_PROFILE_FULL,
-                                HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT,
-                                nullptr,
-                                &tmp);
-
-                            // TODO: this is massively inefficient and only meant for
-                            // illustration.
-                            tmp = impl.load_executable(blob.data(), blob.size(), true, tmp, a);
-
-                            if (tmp.handle) current_exes.push_back(tmp);
-                        }
-                    }
                     // append cached executables to our agent's vector of executables
                     impl.executables[a].second.insert(impl.executables[a].second.end(),
-                            current_exes.begin(), current_exes.end());
+                            cached.executables.begin(), cached.executables.end());
                 }
                 return HSA_STATUS_SUCCESS;
             }, &data);
@@ -513,23 +518,91 @@ public:
         return executables[agent].second;
     }
     
+    // Loads each blob into its own executable for agent. Blobs are
+    // independent, so they are loaded and frozen in parallel by up to
+    // max_loader_threads workers; the result keeps the order of blobs. On
+    // failure every executable created here is destroyed and the first error
+    // is rethrown on the calling thread; without exceptions hip_throw ends
+    // the process in the worker.
+    std::vector<hsa_executable_t> load_executables(
+        const std::vector<std::string>& blobs, hsa_agent_t agent) {
+        static constexpr std::size_t max_loader_threads = 4;
+
+        std::vector<hsa_executable_t> loaded(blobs.size());
+        std::atomic<std::size_t> next{0};
+
+        auto load = [&](hsa_executable_t& tmp) {
+            for (auto i = next++; i < blobs.size(); i = next++) {
+                tmp = {};
+                hsa_executable_create_alt(
+                    HSA_PROFILE_FULL,
+                    HSA_DEFAULT_FLOAT_ROUNDING_MODE_DEFAULT,
+                    nullptr,
+                    &tmp);
+
+                loaded[i] = load_executable(blobs[i].data(), blobs[i].size(), true, tmp, agent);
+                // Blobs without valid metadata are skipped.
+                if (!loaded[i].handle) hsa_executable_destroy(tmp);
+                tmp = {};
+            }
+        };
+
+        #if defined(__cpp_exceptions)
+            std::mutex error_mutex;
+            std::exception_ptr error;
+
+            auto worker = [&]() {
+                hsa_executable_t tmp = {};
+                try {
+                    load(tmp);
+                } catch (...) {
+                    if (tmp.handle) hsa_executable_destroy(tmp);
+                    std::lock_guard<std::mutex> lck{error_mutex};
+                    if (!error) error = std::current_exception();
+                    next = blobs.size();
+                }
+            };
+        #else
+            // hip_throw terminates, there is nothing to clean up.
+            auto worker = [&]() {
+                hsa_executable_t tmp = {};
+                load(tmp);
+            };
+        #endif
+
+        const std::size_t n_threads = std::min(blobs.size(), std::min<std::size_t>(
+            max_loader_threads, std::max(1u, std::thread::hardware_concurrency())));
+        std::vector<std::thread> pool;
+        for (std::size_t i = 1; i < n_threads; ++i) pool.emplace_back(worker);
+        worker();
+        for (auto&& t : pool) t.join();
+
+        #if defined(__cpp_exceptions)
+            if (error) {
+                for (auto&& x : loaded) {
+                    if (x.handle) hsa_executable_destroy(x);
+                }
+                std::rethrow_exception(error);
+            }
+        #endif
+
+        std::vector<hsa_executable_t> r;
+        for (auto&& x : loaded) {
+            if (x.handle) r.push_back(x);
+        }
+        return r;
+    }
+
     hsa_executable_t load_executable(const char* data,
                                      const size_t data_size,
                                      bool make_copy,
                                      hsa_executable_t executable,
                                      hsa_agent_t agent) {
-        ELFIO::elfio reader;
-        std::string ts = std::string(data, data_size);
-        std::stringstream tmp{ts};
+        const auto& metadata = code_object_metadata(data, data_size);
 
-        if (!reader.load(tmp)) return hsa_executable_t{};
-        const auto code_object_dynsym = find_section_if(
-            reader, [](const ELFIO::section* x) {
-                return x->get_type() == SHT_DYNSYM;
-        });
+        if (!metadata.valid) return hsa_executable_t{};
 
-        associate_code_object_symbols_with_host_allocation(reader,
-                                                           code_object_dynsym,
+        associate_code_object_symbols_with_host_allocation(metadata.undefined_symbols,
                                                            agent, executable);
 
         load_code_object_and_freeze_executable(data, data_size, make_copy, agent, executable);
@@ -537,53 +610,14 @@ public:
         return executable;
     }
 
-    std::vector<std::pair<std::uintptr_t, std::string>> function_names_for(
-        const ELFIO::elfio& reader, ELFIO::section* symtab) {
-        std::vector<std::pair<std::uintptr_t, std::string>> r;
-        ELFIO::symbol_section_accessor symbols{reader, symtab};
-
-        for (auto i = 0u; i != symbols.get_symbols_num(); ++i) {
-            // TODO: this is boyscout code, caching the temporaries
-            //       may be of worth.
-            auto tmp = read_symbol(symbols, i);
-
-            if (tmp.type != STT_FUNC) continue;
-            if (tmp.type == SHN_UNDEF) continue;
-            if (tmp.name.empty()) continue;
-
-            r.emplace_back(tmp.value, tmp.name);
-        }
-
-        return r;
-    }
-
     const std::unordered_map<std::uintptr_t, std::string>& get_function_names() {
 
         std::call_once(function_names.first, [this]() {
-            dl_iterate_phdr([](dl_phdr_info* info, std::size_t, void* p) {
-                ELFIO::elfio tmp;
-                const auto elf = (info->dlpi_addr && std::strlen(info->dlpi_name) != 0) ?
-                    info->dlpi_name : "/proc/self/exe";
-
-                if (!tmp.load(elf)) return 0;
-
-                const auto it = find_section_if(tmp, [](const ELFIO::section* x) {
-                    return x->get_type() == SHT_SYMTAB;
-                });
-
-                if (!it) return 0;
-
-                auto& impl = *static_cast<program_state_impl*>(p);
-       
-                auto names = impl.function_names_for(tmp, it);
-                for (auto&& x : names) x.first += info->dlpi_addr;
-
-                impl.function_names.second.insert(
-                    std::make_move_iterator(names.begin()),
-                    std::make_move_iterator(names.end()));
-
-                return 0;
-            }, this);
+            for (auto&& elf : get_elf_scans()) {
+                for (auto&& s : elf.functions) {
+                    function_names.second.emplace(s.value + elf.load_bias, s.name);
+                }
+            }
         });
 
         return function_names.second;
@@ -880,6 +914,17 @@ public:
         std::unordered_map<
             std::string,
             std::vector<std::pair<std::size_t, std::size_t>>>& kernargs)
+    {
+        const auto& metadata = code_object_metadata(blob.data(), blob.size());
+        for (auto&& x : metadata.kernargs) kernargs[x.first] = x.second;
+    }
+
+    static
+    void parse_kernarg_metadata(
+        const std::string& blob,
+        std::unordered_map<
+            std::string,
+            std::vector<std::pair<std::size_t, std::size_t>>>& kernargs)
     {
         std::istringstream istr{blob};
         ELFIO::elfio reader;
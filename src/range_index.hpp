@@ -0,0 +1,419 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+#pragma once
+
+// Address range index behind pointer lookups, shared by the HCC and ROCclr
+// runtimes. Maps each registered allocation [base, base + size) to a value,
+// and finds the allocation containing any pointer without taking a lock.
+//
+// The index is a three level radix table over 48-bit addresses in 4 KiB
+// granules. A granule slot points at the lowest range overlapping the
+// granule; ranges sharing a granule are chained through next, which links a
+// range to the following one starting in its last granule. A 16 MiB chunk
+// covered entirely by one range is recorded once at the middle level instead
+// of in 4096 slots.
+//
+// Writers are serialized by a mutex. Readers never block: range nodes are
+// never freed while the index lives, only recycled, and each carries a
+// sequence number that is odd while the node is dead or being rewritten, so
+// a reader that raced with a writer sees the sequence change and retries.
+// The same check validates a per-thread cache of the last range found.
+//
+// Ranges must not overlap. Ranges above the 48-bit address space are not
+// indexed, insert() returns false and callers keep their own lookup.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace hip_impl {
+
+template <typename Value>
+class Range_index {
+    static_assert(std::is_trivially_copyable<Value>::value,
+                  "Range_index values are copied by readers racing with writers");
+
+   public:
+    enum : unsigned { granule_bits = 12, table_bits = 12, address_bits = 48 };
+
+    struct Range {
+        std::uintptr_t base;
+        std::size_t size;
+        Value value;
+    };
+
+    Range_index() : id_{next_id()} {}
+
+    Range_index(const Range_index&) = delete;
+    Range_index& operator=(const Range_index&) = delete;
+
+    ~Range_index() {
+        for (auto& m : top_) {
+            Mid* mid = m.load(std::memory_order_relaxed);
+            if (!mid) continue;
+            for (auto& l : mid->leaf) delete l.load(std::memory_order_relaxed);
+            delete mid;
+        }
+    }
+
+    // Registers [base, base + size). Returns false if size is 0, the range
+    // is not indexable, or it overlaps a registered range.
+    bool insert(const void* base, std::size_t size, const Value& value) {
+        const std::uintptr_t b = reinterpret_cast<std::uintptr_t>(base);
+        const std::uintptr_t e = b + size;
+        if (size == 0 || e < b || ((e - 1) >> address_bits) != 0) return false;
+
+        std::lock_guard<std::mutex> lck{mutex_};
+        const std::uintptr_t gb = b >> granule_bits;
+        const std::uintptr_t ge = (e - 1) >> granule_bits;
+
+        // The first granule may hold ranges ending before b, and if the range
+        // ends in it too, ranges starting at or after e.
+        Node* prev = nullptr;
+        Node* next = nullptr;
+        for (Node* n = head(gb); n; n = n->next.load(std::memory_order_relaxed)) {
+            if (n->end() <= b) {
+                prev = n;
+            } else if (gb == ge && n->base() >= e) {
+                next = n;
+                break;
+            } else {
+                return false;
+            }
+        }
+        for (std::uintptr_t g = gb + 1; g < ge;) {
+            if (!granules_empty(g, ge)) return false;
+            g = (g | chunk_mask) + 1;
+        }
+        if (ge != gb) {
+            // Only ranges starting at or after e may share the last granule.
+            next = head(ge);
+            if (next && next->base() < e) return false;
+        }
+
+        Node* node = allocate_node();
+        node->write(b, e, next, value);
+
+        if (prev) {
+            prev->next.store(node, std::memory_order_release);
+        } else {
+            set_head(gb, node);
+        }
+        for (std::uintptr_t g = gb + 1; g < ge;) {
+            const std::uintptr_t chunk_end = (g | chunk_mask) + 1;
+            if ((g & chunk_mask) == 0 && chunk_end <= ge) {
+                mid(g, true)->full[chunk_index(g)].store(node, std::memory_order_release);
+                g = chunk_end;
+            } else {
+                set_head(g, node);
+                ++g;
+            }
+        }
+        if (ge != gb) set_head(ge, node);
+        ++size_;
+        return true;
+    }
+
+    // Unregisters the range starting at base. Returns false if there is none.
+    bool erase(const void* base) {
+        const std::uintptr_t b = reinterpret_cast<std::uintptr_t>(base);
+        if ((b >> address_bits) != 0) return false;
+
+        std::lock_guard<std::mutex> lck{mutex_};
+        return erase_locked(b);
+    }
+
+    // Unregisters every range, e.g. once the memory behind them is gone.
+    void clear() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        for (auto& block : blocks_) {
+            for (std::size_t i = 0; i != node_block && size_ != 0; ++i) {
+                const Node& n = block[i];
+                // Live nodes have an even sequence number.
+                if ((n.seq.load(std::memory_order_relaxed) & 1) == 0) erase_locked(n.base());
+            }
+        }
+    }
+
+    // Finds the range containing p. Lock free; a range inserted or erased
+    // concurrently may or may not be found.
+    bool find(const void* p, Range& r) const {
+        const std::uintptr_t a = reinterpret_cast<std::uintptr_t>(p);
+        Cache& c = cache();
+        if (c.index == id_ && c.node->read_if(r, c.seq) && a - r.base < r.size) return true;
+
+        for (;;) {
+            if ((a >> address_bits) != 0) return false;
+            const Mid* m = top_[a >> (granule_bits + 2 * table_bits)].load(std::memory_order_acquire);
+            if (!m) return false;
+            const Node* n = m->full[chunk_index(a >> granule_bits)].load(std::memory_order_acquire);
+            if (!n) {
+                const Leaf* l = m->leaf[chunk_index(a >> granule_bits)].load(std::memory_order_acquire);
+                if (!l) return false;
+                n = l->slot[(a >> granule_bits) & chunk_mask].load(std::memory_order_acquire);
+            }
+
+            bool stale = false;
+            while (n) {
+                std::uint64_t seq;
+                const Node* next;
+                if (!n->read(r, seq, &next)) {
+                    stale = true;
+                    break;
+                }
+                if (a < r.base) return false;
+                if (a - r.base < r.size) {
+                    c.index = id_;
+                    c.node = n;
+                    c.seq = seq;
+                    return true;
+                }
+                n = next;
+            }
+            if (!stale) return false;
+        }
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return size_;
+    }
+
+   private:
+    enum : std::uintptr_t {
+        table_size = std::uintptr_t{1} << table_bits,
+        chunk_mask = table_size - 1
+    };
+    enum : std::size_t { value_words = (sizeof(Value) + 7) / 8, node_block = 1024 };
+
+    // A range, or a dead node waiting to be reused. Fields are atomic so that
+    // readers racing with a rewrite are well defined; seq tells them apart.
+    struct Node {
+        std::atomic<std::uint64_t> seq{1};
+        std::atomic<std::uintptr_t> base_{0};
+        std::atomic<std::uintptr_t> end_{0};
+        std::atomic<Node*> next{nullptr};
+        std::atomic<std::uint64_t> value[value_words];
+
+        std::uintptr_t base() const { return base_.load(std::memory_order_relaxed); }
+        std::uintptr_t end() const { return end_.load(std::memory_order_relaxed); }
+
+        // Writer side; the node is dead (odd seq) and unreachable.
+        void write(std::uintptr_t b, std::uintptr_t e, Node* n, const Value& v) {
+            std::uint64_t words[value_words] = {};
+            std::memcpy(words, &v, sizeof(Value));
+            base_.store(b, std::memory_order_relaxed);
+            end_.store(e, std::memory_order_relaxed);
+            next.store(n, std::memory_order_relaxed);
+            for (std::size_t i = 0; i != value_words; ++i) {
+                value[i].store(words[i], std::memory_order_relaxed);
+            }
+            seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Writer side, once the node is unreachable. A reader seeing the new
+        // seq also sees the unlinking stores, and the fence keeps the next
+        // write() from becoming visible before the seq change.
+        void kill() {
+            seq.store(seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        // Copies the range, and its successor if n is given, out of a live
+        // node. Returns false if the node is dead or changed meanwhile.
+        bool read(Range& r, std::uint64_t& s, const Node** n = nullptr) const {
+            s = seq.load(std::memory_order_acquire);
+            return (s & 1) == 0 && copy(r, s, n);
+        }
+
+        // Same, if the node is still the incarnation read with seq expect.
+        bool read_if(Range& r, std::uint64_t expect) const {
+            const std::uint64_t s = seq.load(std::memory_order_acquire);
+            return s == expect && copy(r, s, nullptr);
+        }
+
+        bool copy(Range& r, std::uint64_t s, const Node** n) const {
+            std::uint64_t words[value_words];
+            const std::uintptr_t b = base_.load(std::memory_order_relaxed);
+            const std::uintptr_t e = end_.load(std::memory_order_relaxed);
+            if (n) *n = next.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i != value_words; ++i) {
+                words[i] = value[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) != s) return false;
+            r.base = b;
+            r.size = e - b;
+            std::memcpy(&r.value, words, sizeof(Value));
+            return true;
+        }
+    };
+
+    struct Leaf {
+        std::atomic<Node*> slot[table_size] = {};
+        std::size_t used = 0;  // non-null slots, writer side
+    };
+
+    struct Mid {
+        std::atomic<Node*> full[table_size] = {};  // chunks covered by one range
+        std::atomic<Leaf*> leaf[table_size] = {};
+    };
+
+    struct Cache {
+        std::uint64_t index = 0;
+        const Node* node = nullptr;
+        std::uint64_t seq = 0;
+    };
+
+    static std::uint64_t next_id() {
+        static std::atomic<std::uint64_t> id{0};
+        return ++id;
+    }
+
+    // One entry per thread, shared by all indexes with the same Value; the
+    // index id keeps an entry from being used with another index.
+    static Cache& cache() {
+        static thread_local Cache c;
+        return c;
+    }
+
+    static std::size_t chunk_index(std::uintptr_t g) { return (g >> table_bits) & chunk_mask; }
+
+    // erase() of the range starting at b, with the lock held.
+    bool erase_locked(std::uintptr_t b) {
+        const std::uintptr_t gb = b >> granule_bits;
+        Node* prev = nullptr;
+        Node* node = head(gb);
+        for (; node && node->base() != b; node = node->next.load(std::memory_order_relaxed)) {
+            if (node->base() > b) return false;
+            prev = node;
+        }
+        if (!node) return false;
+
+        const std::uintptr_t ge = (node->end() - 1) >> granule_bits;
+        Node* next = node->next.load(std::memory_order_relaxed);
+        // Ranges after node in its first granule start in its last granule.
+        Node* after = gb == ge ? next : nullptr;
+        if (prev) {
+            prev->next.store(after, std::memory_order_release);
+        } else {
+            set_head(gb, after);
+        }
+        for (std::uintptr_t g = gb + 1; g < ge;) {
+            const std::uintptr_t chunk_end = (g | chunk_mask) + 1;
+            if ((g & chunk_mask) == 0 && chunk_end <= ge) {
+                mid(g, false)->full[chunk_index(g)].store(nullptr, std::memory_order_release);
+                g = chunk_end;
+            } else {
+                set_head(g, nullptr);
+                ++g;
+            }
+        }
+        if (ge != gb) set_head(ge, next);
+
+        node->kill();
+        free_.push_back(node);
+        --size_;
+        return true;
+    }
+
+    Mid* mid(std::uintptr_t g, bool create) {
+        std::atomic<Mid*>& m = top_[g >> (2 * table_bits)];
+        Mid* r = m.load(std::memory_order_relaxed);
+        if (!r && create) {
+            r = new Mid;
+            m.store(r, std::memory_order_release);
+        }
+        return r;
+    }
+
+    Leaf* leaf(std::uintptr_t g, bool create) {
+        Mid* m = mid(g, create);
+        if (!m) return nullptr;
+        std::atomic<Leaf*>& l = m->leaf[chunk_index(g)];
+        Leaf* r = l.load(std::memory_order_relaxed);
+        if (!r && create) {
+            r = new Leaf;
+            l.store(r, std::memory_order_release);
+        }
+        return r;
+    }
+
+    // Lowest range overlapping granule g, writer side.
+    Node* head(std::uintptr_t g) {
+        Mid* m = mid(g, false);
+        if (!m) return nullptr;
+        if (Node* n = m->full[chunk_index(g)].load(std::memory_order_relaxed)) return n;
+        Leaf* l = m->leaf[chunk_index(g)].load(std::memory_order_relaxed);
+        return l ? l->slot[g & chunk_mask].load(std::memory_order_relaxed) : nullptr;
+    }
+
+    void set_head(std::uintptr_t g, Node* n) {
+        Leaf* l = leaf(g, n != nullptr);
+        if (!l) return;
+        std::atomic<Node*>& s = l->slot[g & chunk_mask];
+        if (!s.load(std::memory_order_relaxed)) ++l->used;
+        if (!n) --l->used;
+        s.store(n, std::memory_order_release);
+    }
+
+    // True if no range overlaps granules [g, end of g's chunk) below ge.
+    bool granules_empty(std::uintptr_t g, std::uintptr_t ge) {
+        Mid* m = mid(g, false);
+        if (!m) return true;
+        if (m->full[chunk_index(g)].load(std::memory_order_relaxed)) return false;
+        Leaf* l = m->leaf[chunk_index(g)].load(std::memory_order_relaxed);
+        if (!l || l->used == 0) return true;
+        const std::uintptr_t last = std::min<std::uintptr_t>(g | chunk_mask, ge - 1);
+        for (; g <= last; ++g) {
+            if (l->slot[g & chunk_mask].load(std::memory_order_relaxed)) return false;
+        }
+        return true;
+    }
+
+    Node* allocate_node() {
+        if (free_.empty()) {
+            blocks_.emplace_back(new Node[node_block]);
+            for (std::size_t i = node_block; i != 0; --i) free_.push_back(&blocks_.back()[i - 1]);
+        }
+        Node* n = free_.back();
+        free_.pop_back();
+        return n;
+    }
+
+    const std::uint64_t id_;
+    std::atomic<Mid*> top_[std::size_t{1} << (address_bits - granule_bits - 2 * table_bits)] = {};
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Node[]>> blocks_;  // nodes are recycled, never freed
+    std::vector<Node*> free_;
+    std::size_t size_ = 0;
+};
+}  // namespace hip_impl
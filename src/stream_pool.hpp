@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#pragma once
+
+// Per-device pool of streams handed out by hipExtStreamPoolAcquire, shared by
+// the HCC and ROCclr runtimes. Creating a stream creates a HW queue, so the
+// pool keeps released streams and hands them out again to callers asking for
+// the same flags, priority and CU mask.
+//
+// The pool keeps at most max_streams streams. Past that, an idle stream with
+// other attributes is destroyed to make room. If every stream is in use, the
+// least loaded one with the same attributes is shared, its users serialized;
+// a stream with other flags or CU mask is never handed out. Without one, a
+// stream is created past the limit and destroyed once released. Released
+// streams are not synchronized; work already queued simply runs ahead of the
+// next owner's work.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace hip_impl {
+
+template <typename Stream>
+class Stream_pool {
+   public:
+    struct Key {
+        unsigned flags = 0;
+        int priority = 0;
+        std::vector<std::uint32_t> cu_mask;  // empty if all CUs may be used
+
+        friend bool operator==(const Key& x, const Key& y) {
+            return x.flags == y.flags && x.priority == y.priority && x.cu_mask == y.cu_mask;
+        }
+    };
+
+    // create returns a null stream on failure. Both are called without the
+    // pool lock held and may take runtime locks.
+    using Create = std::function<Stream(const Key&)>;
+    using Destroy = std::function<void(Stream)>;
+
+    Stream_pool(std::size_t max_streams, Create create, Destroy destroy)
+        : max_{max_streams ? max_streams : 1}, create_{std::move(create)},
+          destroy_{std::move(destroy)} {}
+
+    // Streams still owned by the pool are left to the runtime, which tears
+    // them down with the context or device.
+    ~Stream_pool() = default;
+
+    // Returns a stream with attributes key, idle, new, or shared once the
+    // pool is full. Null only if no stream could be created and there is
+    // none with attributes key to share.
+    Stream acquire(const Key& key) {
+        Stream victim{};
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            if (Entry* e = find_idle(key)) {
+                e->users = 1;
+                ++reused_;
+                return e->stream;
+            }
+            if (entries_.size() + creating_ >= max_) {
+                if (Entry* e = oldest_idle()) {
+                    victim = e->stream;
+                    entries_.erase(entries_.begin() + (e - entries_.data()));
+                } else if (Stream s = share(key)) {
+                    return s;
+                }
+            }
+            ++creating_;
+        }
+
+        if (victim) destroy_(victim);
+        Stream s = create_(key);
+
+        std::lock_guard<std::mutex> lck{mutex_};
+        --creating_;
+        if (!s) return share(key);
+        entries_.push_back(Entry{s, key, 1, 0});
+        ++created_;
+        return s;
+    }
+
+    // Hands s back. Returns false if s is not a pool stream.
+    bool release(Stream s) {
+        Stream victim{};
+        {
+            std::lock_guard<std::mutex> lck{mutex_};
+            auto it = entries_.begin();
+            while (it != entries_.end() && it->stream != s) ++it;
+            if (it == entries_.end()) return false;
+            if (it->users == 0 || --it->users != 0) return true;
+            it->released = ++tick_;
+            // Streams created past the limit go once idle.
+            if (entries_.size() <= max_) return true;
+            victim = s;
+            entries_.erase(it);
+        }
+        destroy_(victim);
+        return true;
+    }
+
+    bool owns(Stream s) const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        for (auto& e : entries_) {
+            if (e.stream == s) return true;
+        }
+        return false;
+    }
+
+    // Forgets every stream without destroying it, for when the runtime has
+    // already destroyed them (device reset).
+    void clear() {
+        std::lock_guard<std::mutex> lck{mutex_};
+        entries_.clear();
+    }
+
+    std::size_t max_streams() const { return max_; }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return entries_.size();
+    }
+
+    // Acquires served by a new stream, an idle stream, or a stream in use.
+    std::uint64_t created() const { return locked_read(created_); }
+    std::uint64_t reused() const { return locked_read(reused_); }
+    std::uint64_t shared() const { return locked_read(shared_); }
+
+   private:
+    struct Entry {
+        Stream stream;
+        Key key;
+        std::size_t users;
+        std::uint64_t released;  // tick of the last release, for LRU eviction
+    };
+
+    // Most recently released match, whose queue is the most likely warm.
+    Entry* find_idle(const Key& key) {
+        Entry* r = nullptr;
+        for (auto& e : entries_) {
+            if (e.users == 0 && e.key == key && (!r || e.released > r->released)) r = &e;
+        }
+        return r;
+    }
+
+    Entry* oldest_idle() {
+        Entry* r = nullptr;
+        for (auto& e : entries_) {
+            if (e.users == 0 && (!r || e.released < r->released)) r = &e;
+        }
+        return r;
+    }
+
+    // The stream with attributes key and the fewest users, or null.
+    Stream share(const Key& key) {
+        Entry* r = nullptr;
+        for (auto& e : entries_) {
+            if (e.key == key && (!r || e.users < r->users)) r = &e;
+        }
+        if (!r) return Stream{};
+        ++r->users;
+        ++shared_;
+        return r->stream;
+    }
+
+    std::uint64_t locked_read(const std::uint64_t& counter) const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        return counter;
+    }
+
+    const std::size_t max_;
+    const Create create_;
+    const Destroy destroy_;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    std::size_t creating_ = 0;  // slots reserved by acquires creating a stream
+    std::uint64_t tick_ = 0;
+    std::uint64_t created_ = 0;
+    std::uint64_t reused_ = 0;
+    std::uint64_t shared_ = 0;
+};
+}  // namespace hip_impl
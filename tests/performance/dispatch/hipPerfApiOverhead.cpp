@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host side cost of cheap HIP API calls. Run with API logging
+// disabled (AMD_LOG_LEVEL unset) to catch regressions in the entry/exit path.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp ../../src/timer.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "timer.h"
+#include "test_common.h"
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+static const unsigned int iterations = 100000;
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    if (getenv("AMD_LOG_LEVEL") != NULL) {
+        printf("Warning: AMD_LOG_LEVEL is set, numbers include API logging\n");
+    }
+
+    hipError_t err = hipSuccess;
+    err = hipSetDevice(p_gpuDevice);
+    CHECK_RESULT(err != hipSuccess, "hipSetDevice failed");
+
+    hipStream_t stream;
+    err = hipStreamCreate(&stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamCreate failed");
+
+    hipEvent_t event;
+    err = hipEventCreate(&event);
+    CHECK_RESULT(err != hipSuccess, "hipEventCreate failed");
+
+    const size_t bufSize = 256;
+    void* dBuf = NULL;
+    void* hBuf = NULL;
+    err = hipMalloc(&dBuf, bufSize);
+    CHECK_RESULT(err != hipSuccess, "hipMalloc failed");
+    err = hipHostMalloc(&hBuf, bufSize);
+    CHECK_RESULT(err != hipSuccess, "hipHostMalloc failed");
+
+    CPerfCounter timer;
+
+    // hipStreamQuery on an idle stream.
+    timer.Reset();
+    timer.Start();
+    for (unsigned int i = 0; i < iterations; i++) {
+        hipStreamQuery(stream);
+    }
+    timer.Stop();
+    printf("HIPPerfApiOverhead hipStreamQuery   %8.1f ns/call\n",
+           1e9 * timer.GetElapsedTime() / iterations);
+
+    // hipEventRecord, drained periodically so the queue does not grow unbounded.
+    timer.Reset();
+    timer.Start();
+    for (unsigned int i = 0; i < iterations; i++) {
+        hipEventRecord(event, stream);
+        if ((i + 1) % 1000 == 0) {
+            timer.Stop();
+            hipStreamSynchronize(stream);
+            timer.Start();
+        }
+    }
+    timer.Stop();
+    hipStreamSynchronize(stream);
+    printf("HIPPerfApiOverhead hipEventRecord   %8.1f ns/call\n",
+           1e9 * timer.GetElapsedTime() / iterations);
+
+    // Small pinned hipMemcpyAsync, host side submission cost only.
+    timer.Reset();
+    timer.Start();
+    for (unsigned int i = 0; i < iterations; i++) {
+        hipMemcpyAsync(dBuf, hBuf, bufSize, hipMemcpyHostToDevice, stream);
+        if ((i + 1) % 1000 == 0) {
+            timer.Stop();
+            hipStreamSynchronize(stream);
+            timer.Start();
+        }
+    }
+    timer.Stop();
+    err = hipStreamSynchronize(stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamSynchronize failed");
+    printf("HIPPerfApiOverhead hipMemcpyAsync   %8.1f ns/call\n",
+           1e9 * timer.GetElapsedTime() / iterations);
+
+    hipHostFree(hBuf);
+    hipFree(dBuf);
+    hipEventDestroy(event);
+    hipStreamDestroy(stream);
+    passed();
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures how aggregate HIP API call throughput scales with the number of
+// host threads. Each thread calls into the runtime on its own stream, so any
+// drop in per-thread rate comes from state shared on the API entry path
+// (profiler callback table, tracing, locks).
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "test_common.h"
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+static const unsigned int threadCounts[] = {1, 2, 4, 8, 16, 32};
+static const unsigned int callsPerThread = 50000;
+
+__global__ void _emptyKernel() {}
+
+enum ApiKind { kGetDevice, kLaunch };
+
+static const char* apiName(ApiKind kind) {
+    return kind == kGetDevice ? "hipGetDevice" : "hipLaunchKernelGGL";
+}
+
+static void worker(ApiKind kind, std::atomic<unsigned int>* ready, std::atomic<bool>* go) {
+    hipError_t err = hipSetDevice(p_gpuDevice);
+    CHECK_RESULT(err != hipSuccess, "hipSetDevice failed");
+    hipStream_t stream;
+    err = hipStreamCreate(&stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamCreate failed");
+
+    ready->fetch_add(1);
+    while (!go->load()) std::this_thread::yield();
+
+    int device = 0;
+    for (unsigned int i = 0; i < callsPerThread; i++) {
+        if (kind == kGetDevice) {
+            hipGetDevice(&device);
+        } else {
+            hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, stream);
+            // Keep queue depth bounded so the measurement stays on the host side.
+            if ((i + 1) % 1000 == 0) hipStreamSynchronize(stream);
+        }
+    }
+
+    err = hipStreamSynchronize(stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamSynchronize failed");
+    hipStreamDestroy(stream);
+}
+
+static void run(ApiKind kind, unsigned int nThreads) {
+    std::atomic<unsigned int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nThreads; t++) {
+        threads.emplace_back(worker, kind, &ready, &go);
+    }
+    while (ready.load() != nThreads) std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& t : threads) t.join();
+    auto end = std::chrono::steady_clock::now();
+
+    double sec = std::chrono::duration<double>(end - start).count();
+    double total = double(callsPerThread) * nThreads;
+    printf("HIPPerfApiThreadScaling %-20s threads %2u  %8.2f Mcalls/s  %8.1f ns/call/thread\n",
+           apiName(kind), nThreads, total / sec / 1e6, 1e9 * sec / callsPerThread);
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipError_t err = hipSetDevice(p_gpuDevice);
+    CHECK_RESULT(err != hipSuccess, "hipSetDevice failed");
+
+    // Warm up, loads the code object for _emptyKernel.
+    hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, 0);
+    err = hipDeviceSynchronize();
+    CHECK_RESULT(err != hipSuccess, "hipDeviceSynchronize failed");
+
+    for (ApiKind kind : {kGetDevice, kLaunch}) {
+        for (unsigned int n : threadCounts) {
+            run(kind, n);
+        }
+    }
+
+    passed();
+}
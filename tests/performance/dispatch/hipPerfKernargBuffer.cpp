@@ -0,0 +1,99 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Launch rate with small and large kernel arguments, which are packed into the
+// stream's reusable kernarg buffer, one launch at a time and as
+// hipExtModuleLaunchKernelBatch batches.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc rocclr
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "hip/hip_ext.h"
+#include "test_common.h"
+
+static const unsigned int launches = 20000;
+static const unsigned int batch = 64;
+
+struct Large {
+    int v[1024];
+};
+
+__global__ void _smallArgs(int* p, int a) { p[hipThreadIdx_x] += a; }
+__global__ void _largeArgs(int* p, Large a) { p[hipThreadIdx_x] += a.v[hipThreadIdx_x]; }
+
+template <typename Args>
+static void run(const char* name, const void* kernel, Args args, int* buf, hipStream_t stream,
+                bool batched) {
+    void* params[] = {&buf, &args};
+    hipExtLaunchBatchParams l;
+    l.function = hip_impl::get_program_state().kernel_descriptor(
+        reinterpret_cast<std::uintptr_t>(kernel), hip_impl::target_agent(stream));
+    l.gridDim = dim3(1);
+    l.blockDim = dim3(64);
+    l.sharedMemBytes = 0;
+    l.kernelParams = params;
+    l.extra = nullptr;
+    std::vector<hipExtLaunchBatchParams> list(batch, l);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < launches; i += batched ? batch : 1) {
+        if (batched) {
+            HIPCHECK(hipExtModuleLaunchKernelBatch(list.data(), batch, stream, 0));
+        } else {
+            HIPCHECK(hipModuleLaunchKernel(l.function, 1, 1, 1, 64, 1, 1, 0, stream, params,
+                                           nullptr));
+        }
+    }
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    printf("%-14s %-8s %9.1f ns/launch\n", name, batched ? "batched" : "single",
+           d.count() / launches);
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int* buf;
+    HIPCHECK(hipMalloc(&buf, 64 * sizeof(int)));
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    Large large = {};
+    for (bool batched : {false, true}) {
+        run("small args", reinterpret_cast<const void*>(&_smallArgs), 1, buf, stream, batched);
+        run("4KB args", reinterpret_cast<const void*>(&_largeArgs), large, buf, stream, batched);
+    }
+
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipFree(buf));
+    passed();
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures host side cost of kernel argument packing for hipLaunchKernelGGL.
+// "heap" is the hip_impl::make_kernarg path that builds a hip_impl::kernarg
+// per launch, "stack" is the compile-time layout written to a stack buffer.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp ../../src/timer.cpp EXCLUDE_HIP_PLATFORM nvcc rocclr EXCLUDE_HIP_COMPILER clang
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include "timer.h"
+#include "test_common.h"
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+static const unsigned int iterations[] = {1000, 10000, 100000};
+
+__global__ void _kernargSpeed(float* outBuf, int n, char c, double d, float* inBuf)
+{
+    int i = (blockIdx.x * blockDim.x + threadIdx.x);
+    if (i < 0)
+        outBuf[i] = inBuf[i] + n + c + d;
+}
+
+static void launchHeap(float* buf, hipStream_t stream)
+{
+    auto kernarg = hip_impl::make_kernarg(
+        _kernargSpeed, std::tuple<float*, int, char, double, float*>{buf, 1, 'a', 1.0, buf});
+    std::size_t kernarg_size = kernarg.size();
+
+    void* config[]{
+        HIP_LAUNCH_PARAM_BUFFER_POINTER,
+        kernarg.data(),
+        HIP_LAUNCH_PARAM_BUFFER_SIZE,
+        &kernarg_size,
+        HIP_LAUNCH_PARAM_END};
+
+    hip_impl::hipLaunchKernelGGLImpl(reinterpret_cast<std::uintptr_t>(&_kernargSpeed),
+                                     dim3(1), dim3(64), 0, stream, &config[0]);
+}
+
+static void launchStack(float* buf, hipStream_t stream)
+{
+    hipLaunchKernelGGL(_kernargSpeed, dim3(1), dim3(64), 0, stream, buf, 1, 'a', 1.0, buf);
+}
+
+static double packOnly(bool heap, float* buf, unsigned int n)
+{
+    volatile std::size_t sink = 0;
+    CPerfCounter timer;
+    timer.Reset();
+    timer.Start();
+    for (unsigned int i = 0; i < n; i++) {
+        if (heap) {
+            auto kernarg = hip_impl::make_kernarg(
+                _kernargSpeed, std::tuple<float*, int, char, double, float*>{buf, 1, 'a', 1.0, buf});
+            sink += kernarg.size();
+        } else {
+            auto kernarg = hip_impl::make_packed_kernarg(
+                _kernargSpeed, std::tuple<float*, int, char, double, float*>{buf, 1, 'a', 1.0, buf});
+            sink += kernarg.size();
+        }
+    }
+    timer.Stop();
+    return 1e9 * timer.GetElapsedTime() / n;
+}
+
+static double launch(bool heap, float* buf, hipStream_t stream, unsigned int n)
+{
+    CPerfCounter timer;
+    timer.Reset();
+    timer.Start();
+    for (unsigned int i = 0; i < n; i++) {
+        if (heap) {
+            launchHeap(buf, stream);
+        } else {
+            launchStack(buf, stream);
+        }
+    }
+    timer.Stop();
+    hipError_t err = hipStreamSynchronize(stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamSynchronize failed");
+    return 1e9 * timer.GetElapsedTime() / n;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    hipError_t err = hipSuccess;
+    hipDeviceProp_t props = {0};
+    err = hipGetDeviceProperties(&props, p_gpuDevice);
+    CHECK_RESULT(err != hipSuccess, "hipGetDeviceProperties failed");
+    printf("Set device to %d : %s\n", p_gpuDevice, props.name);
+
+    float* buf = NULL;
+    err = hipMalloc(&buf, 64 * sizeof(float));
+    CHECK_RESULT(err != hipSuccess, "hipMalloc failed");
+
+    hipStream_t stream;
+    err = hipStreamCreate(&stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamCreate failed");
+
+    // Warm up, loads the code objects and primes the layout check.
+    launchHeap(buf, stream);
+    launchStack(buf, stream);
+    err = hipStreamSynchronize(stream);
+    CHECK_RESULT(err != hipSuccess, "hipStreamSynchronize failed");
+
+    for (unsigned int n : iterations) {
+        double heapPack = packOnly(true, buf, n);
+        double stackPack = packOnly(false, buf, n);
+        double heapLaunch = launch(true, buf, stream, n);
+        double stackLaunch = launch(false, buf, stream, n);
+
+        printf("HIPPerfKernargPacking %7u launches pack (ns) heap %8.1f stack %8.1f "
+               "launch (ns) heap %9.1f stack %9.1f\n",
+               n, heapPack, stackPack, heapLaunch, stackLaunch);
+    }
+
+    hipStreamDestroy(stream);
+    hipFree(buf);
+    passed();
+}
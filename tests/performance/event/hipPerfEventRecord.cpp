@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host cost of hipEventRecord + hipEventQuery, with and without
+// work between records, and reports how many markers were reused instead of
+// created (hipExtGetMarkerReuseStats).
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int iterations = 100000;
+static const unsigned int eventsPerIteration = 4;
+
+__global__ void _emptyKernel() {}
+
+// Records all events on stream, optionally after one kernel launch, then
+// queries them. Prints ns per record/query pair and the marker counters
+// accumulated during the run.
+static void run(const char* name, hipStream_t stream, std::vector<hipEvent_t>& events,
+                bool launch) {
+    uint64_t hits0, misses0;
+    HIPCHECK(hipExtGetMarkerReuseStats(p_gpuDevice, &hits0, &misses0));
+
+    double total = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        if (launch) hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, stream);
+        auto start = std::chrono::steady_clock::now();
+        for (auto e : events) HIPCHECK(hipEventRecord(e, stream));
+        for (auto e : events) hipEventQuery(e);
+        std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+        total += d.count();
+        if ((i + 1) % 1000 == 0) HIPCHECK(hipStreamSynchronize(stream));
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    uint64_t hits1, misses1;
+    HIPCHECK(hipExtGetMarkerReuseStats(p_gpuDevice, &hits1, &misses1));
+    printf("%-28s %10.1f ns/record+query %12llu reused %12llu created\n", name,
+           total / (iterations * events.size()), (unsigned long long)(hits1 - hits0),
+           (unsigned long long)(misses1 - misses0));
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    for (unsigned flags : {(unsigned)hipEventDefault, (unsigned)hipEventDisableTiming}) {
+        std::vector<hipEvent_t> events(eventsPerIteration);
+        for (auto& e : events) HIPCHECK(hipEventCreateWithFlags(&e, flags));
+
+        const bool timing = (flags == hipEventDefault);
+        run(timing ? "timing, back to back" : "no timing, back to back", stream, events,
+            false);
+        run(timing ? "timing, after kernel" : "no timing, after kernel", stream, events, true);
+
+        for (auto e : events) HIPCHECK(hipEventDestroy(e));
+    }
+
+    HIPCHECK(hipStreamDestroy(stream));
+    passed();
+}
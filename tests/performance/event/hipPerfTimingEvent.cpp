@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Times every kernel of a stream with a start and a stop event, as done for
+// per-kernel latency accounting, using default events and then timing-only
+// events (hipEventTimingOnly). Reports the cost per timed kernel, the markers
+// created for the events, and the cost of reading the timings back with
+// hipEventElapsedTime vs. one hipExtEventGetTimestamps call.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int kernels = 4096;
+static const unsigned int rounds = 10;
+
+__global__ void _smallKernel(int* p) { p[hipThreadIdx_x] += 1; }
+
+static void run(const char* name, unsigned flags, hipStream_t stream, int* buf) {
+    std::vector<hipEvent_t> events(2 * kernels);
+    for (auto& e : events) HIPCHECK(hipEventCreateWithFlags(&e, flags));
+    std::vector<uint64_t> timestamps(events.size());
+
+    // Warm up, this also turns on kernel timestamps for timing-only events.
+    for (unsigned int k = 0; k < kernels; k++) {
+        HIPCHECK(hipEventRecord(events[2 * k], stream));
+        hipLaunchKernelGGL(_smallKernel, dim3(1), dim3(64), 0, stream, buf);
+        HIPCHECK(hipEventRecord(events[2 * k + 1], stream));
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    uint64_t hits0, misses0;
+    HIPCHECK(hipExtGetMarkerReuseStats(p_gpuDevice, &hits0, &misses0));
+
+    double launchNs = 0, elapsedNs = 0, batchNs = 0, kernelMs = 0;
+    for (unsigned int r = 0; r < rounds; r++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int k = 0; k < kernels; k++) {
+            HIPCHECK(hipEventRecord(events[2 * k], stream));
+            hipLaunchKernelGGL(_smallKernel, dim3(1), dim3(64), 0, stream, buf);
+            HIPCHECK(hipEventRecord(events[2 * k + 1], stream));
+        }
+        HIPCHECK(hipStreamSynchronize(stream));
+        std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+        launchNs += d.count();
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int k = 0; k < kernels; k++) {
+            float ms;
+            HIPCHECK(hipEventElapsedTime(&ms, events[2 * k], events[2 * k + 1]));
+            kernelMs += ms;
+        }
+        d = std::chrono::steady_clock::now() - start;
+        elapsedNs += d.count();
+
+        start = std::chrono::steady_clock::now();
+        HIPCHECK(hipExtEventGetTimestamps(timestamps.data(), events.data(), events.size()));
+        d = std::chrono::steady_clock::now() - start;
+        batchNs += d.count();
+    }
+
+    uint64_t hits1, misses1;
+    HIPCHECK(hipExtGetMarkerReuseStats(p_gpuDevice, &hits1, &misses1));
+
+    const double n = double(rounds) * kernels;
+    printf("%-12s %9.2f us/timed kernel %9.2f us/kernel (events) %12llu markers %12llu reused "
+           "%8.1f ns/pair elapsed %8.1f ns/pair batched\n",
+           name, launchNs / n / 1000, kernelMs * 1000 / n,
+           (unsigned long long)(misses1 - misses0), (unsigned long long)(hits1 - hits0),
+           elapsedNs / n, batchNs / n);
+
+    for (auto e : events) HIPCHECK(hipEventDestroy(e));
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int* buf;
+    HIPCHECK(hipMalloc(&buf, 64 * sizeof(int)));
+    HIPCHECK(hipMemset(buf, 0, 64 * sizeof(int)));
+
+    // Separate streams, timed launches stay on once enabled for a stream.
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    run("default", hipEventDefault, stream, buf);
+    HIPCHECK(hipStreamDestroy(stream));
+
+    HIPCHECK(hipStreamCreate(&stream));
+    run("timing-only", hipEventTimingOnly, stream, buf);
+    HIPCHECK(hipStreamDestroy(stream));
+
+    HIPCHECK(hipFree(buf));
+    passed();
+}
@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Queues a round trip of pageable host memory through the device with
+// hipMemcpyAsync, then computes on the host before synchronizing, and reports
+// how much of the copy the compute hid. The copy threads are enabled here
+// through HIP_COPY_THREADS unless the environment already sets it; run with
+// HIP_COPY_THREADS=0 to compare with copies that block the caller.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const size_t sizes[] = {1 << 20, 16 << 20, 64 << 20};
+static const unsigned int iterations = 10;
+
+typedef std::chrono::steady_clock Clock;
+
+static double since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Host work standing in for the application's, on memory the copy does not touch.
+static float compute(std::vector<float>& work, unsigned int passes) {
+    for (unsigned int p = 0; p < passes; ++p) {
+        for (float& x : work) x = x * 0.999f + 1.0f;
+    }
+    return work[work.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    // Read when the runtime initializes, on the first HIP call.
+    setenv("HIP_COPY_THREADS", "1", 0);
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    printf("%10s %10s %10s %10s %10s %10s %8s   (ms, pageable host memory)\n", "size",
+           "enqueue", "copy", "compute", "serial", "overlap", "hidden");
+    float sink = 0;
+    for (size_t size : sizes) {
+        std::vector<char> host(size);
+        std::vector<char> back(size);
+        std::vector<float> work(size / sizeof(float), 1.0f);
+        for (size_t i = 0; i < size; ++i) host[i] = static_cast<char>(i * 7);
+        char* dev;
+        HIPCHECK(hipMalloc(&dev, size));
+
+        const auto roundTrip = [&]() {
+            HIPCHECK(hipMemcpyAsync(dev, host.data(), size, hipMemcpyHostToDevice, stream));
+            HIPCHECK(hipMemcpyAsync(back.data(), dev, size, hipMemcpyDeviceToHost, stream));
+        };
+
+        // Warm up the staging buffers and the copy threads.
+        roundTrip();
+        HIPCHECK(hipStreamSynchronize(stream));
+
+        double enqueue = 0, copy = 0, work_s = 0, overlap = 0;
+        for (unsigned int i = 0; i < iterations; ++i) {
+            auto start = Clock::now();
+            roundTrip();
+            HIPCHECK(hipStreamSynchronize(stream));
+            copy += since(start);
+
+            start = Clock::now();
+            sink += compute(work, 4);
+            work_s += since(start);
+
+            memset(back.data(), 0, size);
+            start = Clock::now();
+            roundTrip();
+            enqueue += since(start);
+            sink += compute(work, 4);
+            HIPCHECK(hipStreamSynchronize(stream));
+            overlap += since(start);
+            HIPASSERT(memcmp(host.data(), back.data(), size) == 0);
+        }
+
+        const double serial = copy + work_s;
+        printf("%10zu %10.3f %10.3f %10.3f %10.3f %10.3f %7.1f%%\n", size,
+               1e3 * enqueue / iterations, 1e3 * copy / iterations, 1e3 * work_s / iterations,
+               1e3 * serial / iterations, 1e3 * overlap / iterations,
+               100.0 * std::max(serial - overlap, 0.0) / std::min(copy, work_s));
+        HIPCHECK(hipFree(dev));
+    }
+    HIPASSERT(sink > 0);
+
+    HIPCHECK(hipStreamDestroy(stream));
+    passed();
+}
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Per-request scratch buffers: each request allocates a scratch buffer, runs a
+// kernel through it and frees it, on two streams. Compares hipMalloc/hipFree,
+// which synchronize the device on every free, with hipMallocAsync/hipFreeAsync
+// backed by the device memory pool, and reports the pool statistics.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+
+#include "test_common.h"
+
+static const unsigned int requests = 4000;
+static const unsigned int numStreams = 2;
+static const size_t sizes[] = {64 << 10, 256 << 10, 1 << 20, 4 << 20};
+static const unsigned int threads = 256;
+
+__global__ void _request(int* scratch, size_t n, int* out) {
+    size_t i = hipBlockIdx_x * hipBlockDim_x + hipThreadIdx_x;
+    if (i < n) scratch[i] = 1;
+    __syncthreads();
+    if (hipThreadIdx_x == 0) atomicAdd(out, scratch[hipBlockIdx_x * hipBlockDim_x]);
+}
+
+static void run(bool async, hipStream_t* streams, int* out) {
+    HIPCHECK(hipMemset(out, 0, sizeof(int)));
+    unsigned int expected = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int r = 0; r < requests; ++r) {
+        hipStream_t stream = streams[r % numStreams];
+        const size_t n = sizes[r % (sizeof(sizes) / sizeof(sizes[0]))] / sizeof(int);
+        const unsigned int blocks = (n + threads - 1) / threads;
+        int* scratch;
+        if (async) {
+            HIPCHECK(hipMallocAsync(reinterpret_cast<void**>(&scratch), n * sizeof(int), stream));
+        } else {
+            HIPCHECK(hipMalloc(&scratch, n * sizeof(int)));
+        }
+        hipLaunchKernelGGL(_request, dim3(blocks), dim3(threads), 0, stream, scratch, n, out);
+        expected += blocks;
+        if (async) {
+            HIPCHECK(hipFreeAsync(scratch, stream));
+        } else {
+            HIPCHECK(hipFree(scratch));
+        }
+    }
+    HIPCHECK(hipDeviceSynchronize());
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+
+    int result = 0;
+    HIPCHECK(hipMemcpy(&result, out, sizeof(int), hipMemcpyDeviceToHost));
+    HIPASSERT(static_cast<unsigned int>(result) == expected);
+
+    printf("%-24s %9.2f us/request\n", async ? "hipMallocAsync/FreeAsync" : "hipMalloc/hipFree",
+           d.count() / requests);
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int* out;
+    HIPCHECK(hipMalloc(&out, sizeof(int)));
+    hipStream_t streams[numStreams];
+    for (unsigned int i = 0; i < numStreams; ++i) HIPCHECK(hipStreamCreate(&streams[i]));
+
+    run(false, streams, out);
+    run(true, streams, out);
+
+    hipExtMemPoolStats_t s;
+    HIPCHECK(hipExtMemPoolGetStats(p_gpuDevice, &s));
+    printf("pool: %zu reserved %zu peak reserved %llu allocations %llu reuses "
+           "%llu dependency waits\n",
+           s.reserved, s.peakReserved, (unsigned long long)s.allocations,
+           (unsigned long long)s.reuses, (unsigned long long)s.dependencyWaits);
+    HIPASSERT(s.used == 0);
+
+    HIPCHECK(hipExtMemPoolTrimTo(p_gpuDevice, 0));
+    HIPCHECK(hipExtMemPoolGetStats(p_gpuDevice, &s));
+    HIPASSERT(s.reserved == 0);
+
+    for (unsigned int i = 0; i < numStreams; ++i) HIPCHECK(hipStreamDestroy(streams[i]));
+    HIPCHECK(hipFree(out));
+    passed();
+}
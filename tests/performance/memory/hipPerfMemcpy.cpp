@@ -24,12 +24,19 @@
  */
 
 #include "test_common.h"
+#include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 
 #define NUM_SIZE 8
 #define NUM_ITER 0x40000
 
+// Pageable (malloc'd) copies, 64 KB to 256 MB, staged by the runtime.
+#define NUM_PAGEABLE_SIZE 7
+#define PAGEABLE_BYTES_PER_SIZE (1ull << 30)
+
 
 using namespace std;
 
@@ -43,6 +50,7 @@ class hipPerfMemcpy {
     ~hipPerfMemcpy() {};
     void open(int deviceID);
     void run(unsigned int testNumber);
+    void runPageable(unsigned int testNumber);
 };
 
 hipPerfMemcpy::hipPerfMemcpy() : numBuffers_(0) {
@@ -100,6 +108,43 @@ void hipPerfMemcpy::run(unsigned int testNumber) {
 
 }
 
+void hipPerfMemcpy::runPageable(unsigned int testNumber) {
+  const size_t size = size_t(64 * 1024) << (2 * testNumber);
+  const size_t iters = std::max<size_t>(1, std::min<size_t>(1000, PAGEABLE_BYTES_PER_SIZE / size));
+
+  char* A = static_cast<char*>(malloc(size));
+  char* B = static_cast<char*>(malloc(size));
+  char* Ad = nullptr;
+  HIPASSERT(A && B);
+  for (size_t i = 0; i < size; i++) A[i] = static_cast<char>(i * 13 + 7);
+  memset(B, 0, size);
+  HIPCHECK(hipMalloc(&Ad, size));
+
+  // Warm up, also faults in both host buffers.
+  HIPCHECK(hipMemcpy(Ad, A, size, hipMemcpyHostToDevice));
+  HIPCHECK(hipMemcpy(B, Ad, size, hipMemcpyDeviceToHost));
+  HIPASSERT(memcmp(A, B, size) == 0);
+
+  auto start = chrono::steady_clock::now();
+  for (size_t j = 0; j < iters; j++) {
+    HIPCHECK(hipMemcpy(Ad, A, size, hipMemcpyHostToDevice));
+  }
+  chrono::duration<double> h2d = chrono::steady_clock::now() - start;
+
+  start = chrono::steady_clock::now();
+  for (size_t j = 0; j < iters; j++) {
+    HIPCHECK(hipMemcpy(B, Ad, size, hipMemcpyDeviceToHost));
+  }
+  chrono::duration<double> d2h = chrono::steady_clock::now() - start;
+
+  cout << "hipPerfMemcpy pageable " << size / 1024 << " KB: Host to Device "
+      << double(size) * iters / h2d.count() / 1e9 << " GB/s, Device to Host "
+      << double(size) * iters / d2h.count() / 1e9 << " GB/s" << endl;
+
+  free(A);
+  free(B);
+  HIPCHECK(hipFree(Ad));
+}
 
 int main() {
   hipPerfMemcpy hipPerfMemcpy;
@@ -111,6 +156,10 @@ int main() {
     hipPerfMemcpy.run(testCase);
   }
 
+  for (auto testCase = 0; testCase < NUM_PAGEABLE_SIZE; testCase++) {
+    hipPerfMemcpy.runPageable(testCase);
+  }
+
   passed();
 
 }
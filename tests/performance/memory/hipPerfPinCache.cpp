@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Copies the same pageable host buffers to and from the device over and over,
+// as an iterative application does, and reports the bandwidth and the pin
+// cache hit rate. The cache is enabled here through HIP_PIN_CACHE_SIZE unless
+// the environment already sets it; run with HIP_PIN_CACHE_SIZE=0 to compare
+// with the staging buffers.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const size_t sizes[] = {1 << 20, 16 << 20, 64 << 20};
+static const unsigned int iterations = 20;
+
+int main(int argc, char* argv[]) {
+    // Read when the runtime initializes, on the first HIP call.
+    setenv("HIP_PIN_CACHE_SIZE", "512", 0);
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    printf("%10s %12s %12s   (GB/s, pageable host memory)\n", "size", "H2D", "D2H");
+    for (size_t size : sizes) {
+        std::vector<char> host(size, 1);
+        std::vector<char> back(size, 0);
+        char* dev;
+        HIPCHECK(hipMalloc(&dev, size));
+
+        double seconds[2] = {};
+        for (unsigned int i = 0; i < iterations; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            HIPCHECK(hipMemcpy(dev, host.data(), size, hipMemcpyHostToDevice));
+            auto mid = std::chrono::steady_clock::now();
+            HIPCHECK(hipMemcpy(back.data(), dev, size, hipMemcpyDeviceToHost));
+            auto end = std::chrono::steady_clock::now();
+            seconds[0] += std::chrono::duration<double>(mid - start).count();
+            seconds[1] += std::chrono::duration<double>(end - mid).count();
+        }
+        HIPASSERT(memcmp(host.data(), back.data(), size) == 0);
+        printf("%10zu %12.2f %12.2f\n", size, size * 1e-9 * iterations / seconds[0],
+               size * 1e-9 * iterations / seconds[1]);
+        HIPCHECK(hipFree(dev));
+    }
+
+    hipExtPinCacheStats_t s;
+    hipError_t e = hipExtPinCacheGetStats(&s);
+    if (e == hipErrorNotSupported) {
+        printf("pin cache: not supported by this runtime\n");
+    } else {
+        HIPCHECK(e);
+        printf("pin cache: %zu budget %zu pinned %zu peak %llu lookups %llu hits (%.1f%%) "
+               "%llu pins %llu evictions %llu invalidations %llu rejected\n",
+               s.budget, s.pinned, s.peakPinned, (unsigned long long)s.lookups,
+               (unsigned long long)s.hits, s.lookups ? 100.0 * s.hits / s.lookups : 0.0,
+               (unsigned long long)s.pins, (unsigned long long)s.evictions,
+               (unsigned long long)s.invalidations, (unsigned long long)s.rejected);
+    }
+    passed();
+}
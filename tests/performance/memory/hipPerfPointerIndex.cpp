@@ -0,0 +1,168 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host-only benchmark for resolving pointers to allocations with 1M live
+// ranges. Compares an ordered map under a lock, as the runtimes' memory
+// trackers use, with hip_impl::Range_index, for random pointers and for
+// repeated pointers into the same allocation (served by the per-thread
+// last-hit cache), from 1 to 8 threads.
+//
+// usage: hipPerfPointerIndex [ranges, default 1000000]
+
+/* HIT_START
+ * BUILD_CMD: hipPerfPointerIndex %cxx -I%S/../../../src %S/%s -o %T/%t -std=c++11 -O2 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "range_index.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+struct Allocation {
+    std::uintptr_t base;
+    std::size_t size;
+};
+
+// The ordered map lookup being replaced: last range starting at or below p.
+class Locked_map {
+   public:
+    void insert(const Allocation& a) { map_[a.base] = a.size; }
+
+    bool find(std::uintptr_t p, std::uintptr_t& base) const {
+        std::lock_guard<std::mutex> lck{mutex_};
+        auto it = map_.upper_bound(p);
+        if (it == map_.begin()) return false;
+        --it;
+        if (p - it->first >= it->second) return false;
+        base = it->first;
+        return true;
+    }
+
+   private:
+    mutable std::mutex mutex_;
+    std::map<std::uintptr_t, std::size_t> map_;
+};
+
+static const unsigned lookups = 1000000;
+
+// Pointers into random allocations, each used repeat times in a row.
+static std::vector<std::uintptr_t> makePointers(const std::vector<Allocation>& allocs,
+                                                unsigned repeat, unsigned seed) {
+    std::mt19937_64 rng{seed};
+    std::vector<std::uintptr_t> ptrs(lookups);
+    for (unsigned i = 0; i < lookups; i += repeat) {
+        const Allocation& a = allocs[rng() % allocs.size()];
+        for (unsigned j = i; j < i + repeat && j < lookups; ++j) ptrs[j] = a.base + rng() % a.size;
+    }
+    return ptrs;
+}
+
+template <typename Find>
+static double run(unsigned threads, const std::vector<Allocation>& allocs, unsigned repeat,
+                  Find find) {
+    std::vector<std::vector<std::uintptr_t>> ptrs;
+    for (unsigned t = 0; t < threads; ++t) ptrs.push_back(makePointers(allocs, repeat, t));
+
+    std::atomic<unsigned> ready{0};
+    std::atomic<std::uint64_t> found{0};
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            ++ready;
+            while (ready.load() != threads) {
+            }
+            std::uint64_t n = 0;
+            for (std::uintptr_t p : ptrs[t]) n += find(p);
+            found += n;
+        });
+    }
+    for (auto& w : workers) w.join();
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    CHECK_RESULT(found != std::uint64_t{lookups} * threads, "lookup missed a live range");
+    // Aggregate lookups per microsecond across threads.
+    return 1000.0 * lookups * threads / d.count();
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned ranges = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+    // Allocations of 256 B to 2 MiB in a 48-bit address space, with gaps.
+    std::mt19937_64 rng{1};
+    std::vector<Allocation> allocs;
+    allocs.reserve(ranges);
+    std::uintptr_t next = 0x7f0000000000;
+    for (unsigned i = 0; i < ranges; ++i) {
+        const std::size_t size = std::size_t{256} << (rng() % 14);
+        allocs.push_back(Allocation{next, size});
+        next += (size + 4095) / 4096 * 4096 + (rng() % 4) * 4096;
+    }
+
+    Locked_map map;
+    hip_impl::Range_index<std::uintptr_t> index;
+    auto start = std::chrono::steady_clock::now();
+    for (const Allocation& a : allocs) map.insert(a);
+    std::chrono::duration<double, std::milli> mapMs = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (const Allocation& a : allocs) {
+        CHECK_RESULT(!index.insert(reinterpret_cast<void*>(a.base), a.size, a.base),
+                     "insert failed");
+    }
+    std::chrono::duration<double, std::milli> indexMs = std::chrono::steady_clock::now() - start;
+    printf("%u ranges: build %.1f ms (map) %.1f ms (index)\n", ranges, mapMs.count(),
+           indexMs.count());
+
+    printf("%-8s %-8s %14s %16s\n", "threads", "pattern", "map lookups/us", "index lookups/us");
+    for (unsigned threads : {1u, 2u, 4u, 8u}) {
+        for (unsigned repeat : {1u, 16u}) {
+            const double m = run(threads, allocs, repeat, [&](std::uintptr_t p) {
+                std::uintptr_t base;
+                return map.find(p, base);
+            });
+            const double x = run(threads, allocs, repeat, [&](std::uintptr_t p) {
+                hip_impl::Range_index<std::uintptr_t>::Range r;
+                return index.find(reinterpret_cast<void*>(p), r) && r.value == r.base;
+            });
+            printf("%-8u %-8s %14.1f %16.1f\n", threads, repeat == 1 ? "random" : "repeat", m, x);
+        }
+    }
+
+    printf("PASSED!\n");
+    return 0;
+}
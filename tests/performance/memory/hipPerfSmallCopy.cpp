@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Latency of small transfers into sub-ranges of a large arena: hipMemcpy in
+// each direction and hipMemset, at interior offsets spread across the arena,
+// from 4 bytes to 64 KB. Also times binding linear texture objects to interior
+// ranges, which on ROCclr goes through a sub-buffer view of the arena: cycling
+// over as many ranges as ROCclr caches views per allocation (hits), and over
+// more ranges than that (misses).
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const size_t arenaSize = 256 << 20;
+static const size_t sizes[] = {4, 64, 512, 4 << 10, 64 << 10};
+static const unsigned int iterations = 2000;
+static const unsigned int offsets = 16;
+// Sub-buffer views ROCclr keeps per allocation.
+static const unsigned int cachedViews = 4;
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+// Interior offset for iteration i, cycling over ranges of the offsets spread
+// across the arena, away from its start and aligned for the texture formats
+// used below.
+static size_t offsetAt(unsigned int i, unsigned int ranges = offsets) {
+    const size_t stride = ((arenaSize - (128 << 10)) / offsets) & ~size_t(255);
+    return (4 << 10) + (i % ranges) * stride;
+}
+
+static double copyLatency(char* arena, char* host, size_t size, hipMemcpyKind kind) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        char* dev = arena + offsetAt(i);
+        switch (kind) {
+            case hipMemcpyHostToDevice:
+                HIPCHECK(hipMemcpy(dev, host, size, kind));
+                break;
+            case hipMemcpyDeviceToHost:
+                HIPCHECK(hipMemcpy(host, dev, size, kind));
+                break;
+            default:
+                HIPCHECK(hipMemcpy(dev, arena + offsetAt(i + 1), size, kind));
+                break;
+        }
+    }
+    HIPCHECK(hipDeviceSynchronize());
+    return Micros(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+static double memsetLatency(char* arena, size_t size) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        HIPCHECK(hipMemset(arena + offsetAt(i), i & 0xff, size));
+    }
+    HIPCHECK(hipDeviceSynchronize());
+    return Micros(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+static double textureLatency(char* arena, size_t size, unsigned int ranges) {
+    hipResourceDesc resDesc;
+    memset(&resDesc, 0, sizeof(resDesc));
+    resDesc.resType = hipResourceTypeLinear;
+    resDesc.res.linear.desc = hipCreateChannelDesc(32, 0, 0, 0, hipChannelFormatKindFloat);
+    resDesc.res.linear.sizeInBytes = size;
+
+    hipTextureDesc texDesc;
+    memset(&texDesc, 0, sizeof(texDesc));
+    texDesc.readMode = hipReadModeElementType;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; ++i) {
+        resDesc.res.linear.devPtr = arena + offsetAt(i, ranges);
+        hipTextureObject_t texObj = 0;
+        HIPCHECK(hipCreateTextureObject(&texObj, &resDesc, &texDesc, NULL));
+        HIPCHECK(hipDestroyTextureObject(texObj));
+    }
+    return Micros(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    char* arena;
+    HIPCHECK(hipMalloc(&arena, arenaSize));
+    char* host;
+    HIPCHECK(hipHostMalloc(&host, 64 << 10));
+    memset(host, 0x5a, 64 << 10);
+
+    printf("%10s %10s %10s %10s %10s %10s %10s   (us per call)\n", "size", "H2D", "D2H", "D2D",
+           "memset", "tex hit", "tex miss");
+    for (size_t size : sizes) {
+        // Warm up the arena and the copy paths once per size.
+        HIPCHECK(hipMemcpy(arena + offsetAt(0), host, size, hipMemcpyHostToDevice));
+        const double h2d = copyLatency(arena, host, size, hipMemcpyHostToDevice);
+        const double d2h = copyLatency(arena, host, size, hipMemcpyDeviceToHost);
+        const double d2d = copyLatency(arena, host, size, hipMemcpyDeviceToDevice);
+        const double set = memsetLatency(arena, size);
+        const double texHit = textureLatency(arena, size, cachedViews);
+        const double texMiss = textureLatency(arena, size, offsets);
+        printf("%10zu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", size, h2d, d2h, d2d, set,
+               texHit, texMiss);
+    }
+
+    // The last memset must have reached the last interior range.
+    std::vector<char> check(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+    const unsigned int last = iterations - 1;
+    HIPCHECK(hipMemcpy(check.data(), arena + offsetAt(last), check.size(),
+                       hipMemcpyDeviceToHost));
+    for (char c : check) HIPASSERT(c == static_cast<char>(last & 0xff));
+
+    HIPCHECK(hipHostFree(host));
+    HIPCHECK(hipFree(arena));
+    passed();
+}
@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only benchmark for opening large fat binaries. Writes a sparse
+// synthetic bundle of several GB with one code object per target, then
+// compares reading it into memory and copying the matching code object (the
+// old std::istream path) with indexing the mapped file in place.
+//
+// usage: hipPerfBundleIndex [total GB, default 2] [targets, default 6]
+
+/* HIT_START
+ * BUILD_CMD: hipPerfBundleIndex %cxx -I%S/../../../src %S/%s -o %T/%t -std=c++11
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "code_object_bundle_index.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using hip_impl::Bundle_index;
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+static const char* kPath = "hipPerfBundleIndex.bundle";
+
+static long maxRssMB() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss / 1024;
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+static std::string targetName(unsigned i) {
+    static const char* const names[] = {"gfx803", "gfx900", "gfx906", "gfx908",
+                                        "gfx1010", "gfx1011", "gfx1012", "gfx1030"};
+    return i < sizeof(names) / sizeof(names[0]) ? names[i] : "gfx9" + std::to_string(100 + i);
+}
+
+// Writes headers only; the code objects are holes in a sparse file.
+static void writeBundle(uint64_t total, unsigned targets) {
+    std::vector<char> hdr(Bundle_index::header_sz);
+    std::memcpy(&hdr[0], Bundle_index::magic(), Bundle_index::magic_sz);
+    uint64_t cnt = targets;
+    std::memcpy(&hdr[Bundle_index::magic_sz], &cnt, sizeof(cnt));
+
+    std::vector<std::string> triples;
+    size_t hdrSize = hdr.size();
+    for (unsigned i = 0; i < targets; i++) {
+        triples.push_back("hip-amdgcn-amd-amdhsa-" + targetName(i));
+        hdrSize += Bundle_index::entry_header_sz + triples.back().size();
+    }
+
+    const uint64_t blobSize = (total - hdrSize) / targets;
+    uint64_t offset = hdrSize;
+    for (auto&& t : triples) {
+        uint64_t fields[3] = {offset, blobSize, t.size()};
+        hdr.insert(hdr.end(), reinterpret_cast<char*>(fields),
+                   reinterpret_cast<char*>(fields) + sizeof(fields));
+        hdr.insert(hdr.end(), t.begin(), t.end());
+        offset += blobSize;
+    }
+
+    int fd = open(kPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK_RESULT(fd < 0, "cannot create bundle file");
+    CHECK_RESULT(write(fd, hdr.data(), hdr.size()) != ssize_t(hdr.size()), "write failed");
+    CHECK_RESULT(ftruncate(fd, offset) != 0, "ftruncate failed");
+    close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    const double gb = argc > 1 ? atof(argv[1]) : 2.0;
+    const unsigned targets = argc > 2 ? atoi(argv[2]) : 6;
+    const uint64_t total = uint64_t(gb * (1ull << 30));
+    const std::string want = targetName(targets / 2);
+
+    writeBundle(total, targets);
+    printf("HIPPerfBundleIndex bundle %.1f GB, %u targets, looking up %s\n", gb, targets,
+           want.c_str());
+
+    // Indexed: map the file, index the headers, hand out a view of one code
+    // object. Only the header pages are touched.
+    {
+        const long rssBefore = maxRssMB();
+        auto start = std::chrono::steady_clock::now();
+
+        int fd = open(kPath, O_RDONLY);
+        CHECK_RESULT(fd < 0, "cannot open bundle file");
+        struct stat st;
+        fstat(fd, &st);
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        CHECK_RESULT(p == MAP_FAILED, "mmap failed");
+
+        Bundle_index index{p, size_t(st.st_size)};
+        const Bundle_index::Entry* e = index.find(want);
+        CHECK_RESULT(e == nullptr, "target not found in index");
+
+        const double ms = msSince(start);
+        printf("HIPPerfBundleIndex indexed  %10.3f ms  peak RSS +%ld MB  blob %zu bytes\n", ms,
+               maxRssMB() - rssBefore, e->blob.size());
+
+        std::vector<std::string> names;
+        for (unsigned i = 0; i < targets; i++) names.push_back(targetName(i));
+
+        const unsigned lookups = 1000000;
+        volatile size_t sink = 0;
+        start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < lookups; i++) {
+            sink += index.find(names[i % targets])->blob.size();
+        }
+        printf("HIPPerfBundleIndex lookup   %10.1f ns/lookup\n", 1e6 * msSince(start) / lookups);
+
+        munmap(p, st.st_size);
+        close(fd);
+    }
+
+    // Copying: the old istream path, whole file into a vector, then a copy
+    // of the matching code object.
+    {
+        const long rssBefore = maxRssMB();
+        auto start = std::chrono::steady_clock::now();
+
+        std::ifstream is{kPath, std::ios::binary};
+        std::vector<char> file{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+        Bundle_index index{file.data(), file.size()};
+        const Bundle_index::Entry* e = index.find(want);
+        CHECK_RESULT(e == nullptr, "target not found in copy");
+        std::string blob = e->blob.str();
+
+        const double ms = msSince(start);
+        printf("HIPPerfBundleIndex copying  %10.3f ms  peak RSS +%ld MB  blob %zu bytes\n", ms,
+               maxRssMB() - rssBefore, blob.size());
+    }
+
+    unlink(kPath);
+    printf("PASSED!\n");
+    return 0;
+}
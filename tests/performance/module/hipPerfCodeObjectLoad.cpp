@@ -0,0 +1,115 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures cold start: time from process start to the first kernel launch
+// completing on every device, which includes loading and freezing the code
+// objects of this binary for each GPU. Each configuration runs in a fresh
+// child process so nothing is cached between runs:
+//   serial   - one thread launches on device 0, then 1, ...
+//   parallel - one thread per device launches at the same time
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc rocclr
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test_common.h"
+
+#define CHECK_RESULT(test, msg)         \
+    if ((test))                         \
+    {                                   \
+        printf("\n%s\n", msg);          \
+        abort();                        \
+    }
+
+// A few distinct kernels so there is a realistic amount of code to load.
+template <int N>
+__global__ void coldKernel(int* out) {
+    out[threadIdx.x] = N * threadIdx.x;
+}
+
+static void launchAll(int device) {
+    hipError_t err = hipSetDevice(device);
+    CHECK_RESULT(err != hipSuccess, "hipSetDevice failed");
+
+    int* buf = NULL;
+    err = hipMalloc(&buf, 64 * sizeof(int));
+    CHECK_RESULT(err != hipSuccess, "hipMalloc failed");
+
+    hipLaunchKernelGGL(coldKernel<1>, dim3(1), dim3(64), 0, 0, buf);
+    hipLaunchKernelGGL(coldKernel<2>, dim3(1), dim3(64), 0, 0, buf);
+    hipLaunchKernelGGL(coldKernel<3>, dim3(1), dim3(64), 0, 0, buf);
+    hipLaunchKernelGGL(coldKernel<4>, dim3(1), dim3(64), 0, 0, buf);
+    err = hipDeviceSynchronize();
+    CHECK_RESULT(err != hipSuccess, "hipDeviceSynchronize failed");
+
+    hipFree(buf);
+}
+
+static int runChild(const char* mode) {
+    auto start = std::chrono::steady_clock::now();
+
+    int count = 0;
+    hipError_t err = hipGetDeviceCount(&count);
+    CHECK_RESULT(err != hipSuccess, "hipGetDeviceCount failed");
+    auto init = std::chrono::steady_clock::now();
+
+    if (strcmp(mode, "parallel") == 0) {
+        std::vector<std::thread> threads;
+        for (int d = 0; d < count; d++) threads.emplace_back(launchAll, d);
+        for (auto& t : threads) t.join();
+    } else {
+        for (int d = 0; d < count; d++) launchAll(d);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    printf("HIPPerfCodeObjectLoad %-8s devices %d  init %8.1f ms  first launch %8.1f ms  "
+           "total %8.1f ms\n",
+           mode, count, std::chrono::duration<double, std::milli>(init - start).count(),
+           std::chrono::duration<double, std::milli>(end - init).count(),
+           std::chrono::duration<double, std::milli>(end - start).count());
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--child") == 0) {
+        return runChild(argv[2]);
+    }
+
+    // No HIP calls in the parent, so every child starts cold.
+    for (const char* mode : {"serial", "parallel"}) {
+        std::string cmd = std::string(argv[0]) + " --child " + mode;
+        CHECK_RESULT(system(cmd.c_str()) != 0, "child run failed");
+    }
+
+    passed();
+}
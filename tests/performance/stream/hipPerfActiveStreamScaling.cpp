@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures blocking-stream submission throughput from several threads spread
+// over all devices. Every submission to a blocking stream must first order
+// itself after the null stream of its device, and every null-stream command
+// after the blocking streams of that device. Neither should slow down with
+// idle streams or with work on other devices.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int threadsPerDevice[] = {1, 4};
+static const unsigned int idleStreamsPerDevice = 64;
+static const unsigned int iterations = 5000;
+// One null-stream command every nullStreamPeriod launches.
+static const unsigned int nullStreamPeriod = 100;
+
+__global__ void _emptyKernel() {}
+
+static void worker(int device, std::atomic<bool>* go, double* launchesPerSec) {
+    HIPCHECK(hipSetDevice(device));
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+    int* dBuf = NULL;
+    HIPCHECK(hipMalloc(&dBuf, sizeof(int)));
+
+    while (!go->load()) std::this_thread::yield();
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, stream);
+        if ((i + 1) % nullStreamPeriod == 0) {
+            HIPCHECK(hipMemsetAsync(dBuf, 0, sizeof(int), 0));
+        }
+    }
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    *launchesPerSec = iterations / d.count();
+
+    HIPCHECK(hipStreamSynchronize(stream));
+    HIPCHECK(hipDeviceSynchronize());
+    HIPCHECK(hipFree(dBuf));
+    HIPCHECK(hipStreamDestroy(stream));
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    int numDevices = 0;
+    HIPCHECK(hipGetDeviceCount(&numDevices));
+
+    // Idle blocking streams with some history, as in a long running process.
+    std::vector<hipStream_t> idleStreams;
+    for (int d = 0; d < numDevices; d++) {
+        HIPCHECK(hipSetDevice(d));
+        for (unsigned int s = 0; s < idleStreamsPerDevice; s++) {
+            hipStream_t stream;
+            HIPCHECK(hipStreamCreate(&stream));
+            hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, stream);
+            idleStreams.push_back(stream);
+        }
+        HIPCHECK(hipDeviceSynchronize());
+    }
+
+    printf("%8s %8s %8s %20s %20s\n", "devices", "threads", "idle", "launches/s total",
+           "launches/s thread");
+
+    // 1, 2, 4, ... devices, always ending with all of them.
+    std::vector<int> deviceCounts;
+    for (int devices = 1; devices < numDevices; devices *= 2) deviceCounts.push_back(devices);
+    deviceCounts.push_back(numDevices);
+
+    for (int devices : deviceCounts) {
+        for (unsigned int perDevice : threadsPerDevice) {
+            const unsigned int numThreads = devices * perDevice;
+            std::atomic<bool> go(false);
+            std::vector<double> rates(numThreads, 0.0);
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < numThreads; t++) {
+                threads.emplace_back(worker, t % devices, &go, &rates[t]);
+            }
+            go.store(true);
+            for (auto& t : threads) t.join();
+
+            double total = 0;
+            for (double r : rates) total += r;
+            printf("%8d %8u %8u %20.0f %20.0f\n", devices, numThreads,
+                   devices * idleStreamsPerDevice, total, total / numThreads);
+        }
+    }
+
+    for (auto& s : idleStreams) HIPCHECK(hipStreamDestroy(s));
+    passed();
+}
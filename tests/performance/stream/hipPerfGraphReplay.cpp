@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Replays a sequence of small kernels and copies on two independent branches,
+// first issued eagerly through the API and then captured once with
+// hipExtStreamBeginCapture and replayed with hipExtGraphLaunch on one stream
+// and on up to four streams. The last run patches the first kernel's arguments
+// before every replay, as done when only the inputs of an iteration change.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int kernelsPerBranch = 64;
+static const unsigned int iterations = 200;
+static const unsigned int elements = 256;
+
+__global__ void _addKernel(int* p, int v) { p[hipThreadIdx_x] += v; }
+
+// Issues one iteration: two branches of kernelsPerBranch kernels, forked from
+// and joined back into stream, each ending with a copy to host.
+static void issue(hipStream_t stream, hipStream_t side, hipEvent_t fork, hipEvent_t join,
+                  int* bufA, int* bufB, int* hostA, int* hostB) {
+    HIPCHECK(hipEventRecord(fork, stream));
+    HIPCHECK(hipStreamWaitEvent(side, fork, 0));
+    for (unsigned int k = 0; k < kernelsPerBranch; k++) {
+        hipLaunchKernelGGL(_addKernel, dim3(1), dim3(elements), 0, stream, bufA, 1);
+        hipLaunchKernelGGL(_addKernel, dim3(1), dim3(elements), 0, side, bufB, 2);
+    }
+    HIPCHECK(hipMemcpyAsync(hostA, bufA, elements * sizeof(int), hipMemcpyDeviceToHost, stream));
+    HIPCHECK(hipMemcpyAsync(hostB, bufB, elements * sizeof(int), hipMemcpyDeviceToHost, side));
+    HIPCHECK(hipEventRecord(join, side));
+    HIPCHECK(hipStreamWaitEvent(stream, join, 0));
+}
+
+static void report(const char* name, double ns) {
+    printf("%-22s %9.2f us/iteration %9.2f us/op\n", name, ns / iterations / 1000,
+           ns / iterations / (2 * kernelsPerBranch + 2) / 1000);
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int *bufA, *bufB, *hostA, *hostB;
+    HIPCHECK(hipMalloc(&bufA, elements * sizeof(int)));
+    HIPCHECK(hipMalloc(&bufB, elements * sizeof(int)));
+    HIPCHECK(hipHostMalloc(&hostA, elements * sizeof(int)));
+    HIPCHECK(hipHostMalloc(&hostB, elements * sizeof(int)));
+    HIPCHECK(hipMemset(bufA, 0, elements * sizeof(int)));
+    HIPCHECK(hipMemset(bufB, 0, elements * sizeof(int)));
+
+    hipStream_t stream, side;
+    hipEvent_t fork, join;
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipStreamCreate(&side));
+    HIPCHECK(hipEventCreateWithFlags(&fork, hipEventDisableTiming));
+    HIPCHECK(hipEventCreateWithFlags(&join, hipEventDisableTiming));
+
+    // Eager, also warms up the kernel.
+    issue(stream, side, fork, join, bufA, bufB, hostA, hostB);
+    HIPCHECK(hipStreamSynchronize(stream));
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        issue(stream, side, fork, join, bufA, bufB, hostA, hostB);
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+    std::chrono::duration<double, std::nano> d = std::chrono::steady_clock::now() - start;
+    report("eager", d.count());
+
+    hipError_t e = hipExtStreamBeginCapture(stream);
+    if (e == hipErrorNotSupported) {
+        printf("stream capture not supported, skipped\n");
+        passed();
+    }
+    HIPCHECK(e);
+    issue(stream, side, fork, join, bufA, bufB, hostA, hostB);
+    hipExtGraph_t graph;
+    HIPCHECK(hipExtStreamEndCapture(stream, &graph));
+    size_t nodes;
+    HIPCHECK(hipExtGraphGetNodeCount(graph, &nodes));
+    printf("captured %zu nodes\n", nodes);
+
+    const unsigned int maxStreams[] = {1, 4};
+    for (auto m : maxStreams) {
+        hipExtGraphExec_t exec;
+        HIPCHECK(hipExtGraphInstantiate(&exec, graph, m));
+        HIPCHECK(hipExtGraphLaunch(exec, stream));
+        HIPCHECK(hipStreamSynchronize(stream));
+
+        start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < iterations; i++) {
+            HIPCHECK(hipExtGraphLaunch(exec, stream));
+        }
+        HIPCHECK(hipStreamSynchronize(stream));
+        d = std::chrono::steady_clock::now() - start;
+        char name[64];
+        snprintf(name, sizeof(name), "replay, %u stream(s)", m);
+        report(name, d.count());
+        HIPCHECK(hipExtGraphExecDestroy(exec));
+    }
+
+    // Node 0 records fork, node 1 is the first kernel on stream, patched to add
+    // 0 or 1 in turns.
+    hipExtGraphExec_t exec;
+    HIPCHECK(hipExtGraphInstantiate(&exec, graph, 4));
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        int v = i & 1;
+        void* args[] = {&bufA, &v};
+        HIPCHECK(hipExtGraphExecSetKernelArgs(exec, 1, args, nullptr));
+        HIPCHECK(hipExtGraphLaunch(exec, stream));
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+    d = std::chrono::steady_clock::now() - start;
+    report("patched replay", d.count());
+
+    // Every run adds kernelsPerBranch to each element of bufA and twice that to
+    // bufB, except for the first kernel of the patched runs.
+    const int runs = 1 + iterations + 2 * (1 + iterations) + iterations;
+    const int expectA = runs * kernelsPerBranch - iterations + iterations / 2;
+    const int expectB = 2 * runs * kernelsPerBranch;
+    for (unsigned int i = 0; i < elements; i++) {
+        if (hostA[i] != expectA || hostB[i] != expectB) {
+            failed("mismatch at %u: %d/%d, expected %d/%d\n", i, hostA[i], hostB[i], expectA,
+                   expectB);
+        }
+    }
+
+    HIPCHECK(hipExtGraphExecDestroy(exec));
+    HIPCHECK(hipExtGraphDestroy(graph));
+    HIPCHECK(hipEventDestroy(fork));
+    HIPCHECK(hipEventDestroy(join));
+    HIPCHECK(hipStreamDestroy(side));
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipHostFree(hostA));
+    HIPCHECK(hipHostFree(hostB));
+    HIPCHECK(hipFree(bufA));
+    HIPCHECK(hipFree(bufB));
+    passed();
+}
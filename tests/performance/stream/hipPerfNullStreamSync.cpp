@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures the host cost of null-stream operations as the number of streams
+// in the context grows. Every null-stream command must wait for work on the
+// other blocking streams; with only a few of them active, the cost should not
+// depend on how many streams exist.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int streamCounts[] = {1, 16, 64, 256};
+static const unsigned int iterations = 2000;
+
+__global__ void _emptyKernel() {}
+
+// Average microseconds per iteration of op, with all of streams idle except
+// activeStreams of them, which get one kernel launch before each op.
+template <typename Op>
+static double measure(std::vector<hipStream_t>& streams, unsigned int activeStreams, Op op) {
+    HIPCHECK(hipDeviceSynchronize());
+
+    double total = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        for (unsigned int s = 0; s < activeStreams; s++) {
+            hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, streams[s]);
+        }
+        auto start = std::chrono::steady_clock::now();
+        op();
+        std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+        total += d.count();
+    }
+
+    HIPCHECK(hipDeviceSynchronize());
+    return total / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int* dBuf = NULL;
+    int hBuf = 0;
+    HIPCHECK(hipMalloc(&dBuf, sizeof(int)));
+
+    printf("%8s %8s %22s %22s %22s\n", "streams", "active", "hipMemsetAsync(null)",
+           "hipMemcpy H2D 4B", "hipStreamSync(null)");
+
+    for (unsigned int n : streamCounts) {
+        std::vector<hipStream_t> streams(n);
+        for (auto& s : streams) {
+            HIPCHECK(hipStreamCreate(&s));
+            // Give every stream some history, as in a long running process.
+            hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, s);
+        }
+
+        for (unsigned int active : {0u, 1u}) {
+            double memsetUs = measure(streams, active, [&]() {
+                HIPCHECK(hipMemsetAsync(dBuf, 0, sizeof(int), 0));
+            });
+            double memcpyUs = measure(streams, active, [&]() {
+                HIPCHECK(hipMemcpy(dBuf, &hBuf, sizeof(int), hipMemcpyHostToDevice));
+            });
+            double syncUs = measure(streams, active, [&]() {
+                HIPCHECK(hipStreamSynchronize(0));
+            });
+            printf("%8u %8u %19.2f us %19.2f us %19.2f us\n", n, active, memsetUs, memcpyUs,
+                   syncUs);
+        }
+
+        for (auto& s : streams) HIPCHECK(hipStreamDestroy(s));
+    }
+
+    HIPCHECK(hipFree(dBuf));
+    passed();
+}
@@ -0,0 +1,124 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Measures hipStreamAddCallback throughput: several streams each chain an
+// empty kernel and a callback, and the callbacks do a fixed amount of CPU
+// work. Run with HIP_CALLBACK_THREADS=1,2,4,... to see callbacks from
+// different streams spread over the executor threads. Also checks that the
+// callbacks of every stream ran in order.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "test_common.h"
+
+#ifdef __HIP_PLATFORM_HCC__
+#define HIPRT_CB
+#endif
+
+static const unsigned int numStreams = 8;
+static const unsigned int callbacksPerStream = 5000;
+static const unsigned int workUs[] = {0, 5, 20};
+
+__global__ void _emptyKernel() {}
+
+struct StreamState {
+    unsigned int next;
+    bool outOfOrder;
+    unsigned int workUs;
+};
+
+struct CallbackArg {
+    StreamState* state;
+    unsigned int seq;
+};
+
+static std::atomic<unsigned int> completed(0);
+
+static void HIPRT_CB callback(hipStream_t stream, hipError_t status, void* userData) {
+    CallbackArg* arg = static_cast<CallbackArg*>(userData);
+    StreamState* state = arg->state;
+    if (state->next != arg->seq) state->outOfOrder = true;
+    state->next = arg->seq + 1;
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(state->workUs);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+    completed++;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    const char* threads = getenv("HIP_CALLBACK_THREADS");
+    printf("HIP_CALLBACK_THREADS=%s\n", threads ? threads : "(default)");
+    printf("%8s %8s %16s\n", "streams", "work us", "callbacks/s");
+
+    std::vector<hipStream_t> streams(numStreams);
+    for (auto& s : streams) HIPCHECK(hipStreamCreate(&s));
+
+    std::vector<CallbackArg> args(numStreams * callbacksPerStream);
+    std::vector<StreamState> states(numStreams);
+
+    for (unsigned int work : workUs) {
+        for (unsigned int s = 0; s < numStreams; s++) states[s] = StreamState{0, false, work};
+        completed = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < callbacksPerStream; i++) {
+            for (unsigned int s = 0; s < numStreams; s++) {
+                CallbackArg& arg = args[i * numStreams + s];
+                arg.state = &states[s];
+                arg.seq = i;
+                hipLaunchKernelGGL(_emptyKernel, dim3(1), dim3(1), 0, streams[s]);
+                HIPCHECK(hipStreamAddCallback(streams[s], callback, &arg, 0));
+            }
+        }
+        for (auto& s : streams) HIPCHECK(hipStreamSynchronize(s));
+        // Callbacks may still be returning after the streams drained.
+        while (completed != numStreams * callbacksPerStream) {
+        }
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+
+        for (auto& st : states) {
+            if (st.outOfOrder || st.next != callbacksPerStream) {
+                failed("callbacks of a stream ran out of order");
+            }
+        }
+        printf("%8u %8u %16.0f\n", numStreams, work,
+               numStreams * callbacksPerStream / d.count());
+    }
+
+    for (auto& s : streams) HIPCHECK(hipStreamDestroy(s));
+    passed();
+}
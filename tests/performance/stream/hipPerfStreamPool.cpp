@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Compares short-lived streams from hipStreamCreate/hipStreamDestroy with
+// streams from hipExtStreamPoolAcquire/hipExtStreamPoolRelease, each used for
+// one small copy, as a request handler would. A second pass runs more threads,
+// each holding a stream, than the pool has queues (HIP_STREAM_POOL_MAX_QUEUES,
+// default 32), which must share streams rather than fail.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "test_common.h"
+
+static const unsigned int iterations = 2000;
+static const size_t copySize = 4096;
+
+enum Mode { CreateDestroy, Pool };
+
+static double runRequests(Mode mode, int priority, void* dst, const void* src) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        hipStream_t stream;
+        if (mode == CreateDestroy) {
+            HIPCHECK(hipStreamCreateWithPriority(&stream, hipStreamNonBlocking, priority));
+        } else {
+            HIPCHECK(hipExtStreamPoolAcquire(&stream, hipStreamNonBlocking, priority, 0, NULL));
+        }
+        HIPCHECK(hipMemcpyAsync(dst, src, copySize, hipMemcpyHostToDevice, stream));
+        HIPCHECK(hipStreamSynchronize(stream));
+        if (mode == CreateDestroy) {
+            HIPCHECK(hipStreamDestroy(stream));
+        } else {
+            HIPCHECK(hipExtStreamPoolRelease(stream));
+        }
+    }
+    std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - start;
+    return us.count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    HipTest::parseStandardArguments(argc, argv, true);
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+
+    int leastPriority = 0, greatestPriority = 0;
+    HIPCHECK(hipDeviceGetStreamPriorityRange(&leastPriority, &greatestPriority));
+
+    void* dst = NULL;
+    void* src = NULL;
+    HIPCHECK(hipMalloc(&dst, copySize));
+    HIPCHECK(hipHostMalloc(&src, copySize));
+
+    // Warm up the pool so the first acquire is not counted.
+    runRequests(Pool, greatestPriority, dst, src);
+
+    const int priorities[] = {leastPriority, greatestPriority};
+    for (int priority : priorities) {
+        double create = runRequests(CreateDestroy, priority, dst, src);
+        double pool = runRequests(Pool, priority, dst, src);
+        printf("HIPPerfStreamPool priority %2d create/destroy %8.1f us/request, "
+               "pool %8.1f us/request (%.1fx)\n",
+               priority, create, pool, create / pool);
+    }
+
+    // Oversubscription: every thread holds its stream for the whole run.
+    const unsigned int numThreads = 128;
+    std::vector<std::thread> threads;
+    std::vector<hipStream_t> held(numThreads);
+    std::vector<void*> dsts(numThreads);
+    for (unsigned int t = 0; t < numThreads; t++) {
+        HIPCHECK(hipMalloc(&dsts[t], copySize));
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            HIPCHECK(hipSetDevice(p_gpuDevice));
+            HIPCHECK(hipExtStreamPoolAcquire(&held[t], hipStreamNonBlocking, 0, 0, NULL));
+            for (unsigned int i = 0; i < iterations / 100; i++) {
+                HIPCHECK(hipMemcpyAsync(dsts[t], src, copySize, hipMemcpyHostToDevice, held[t]));
+            }
+            HIPCHECK(hipStreamSynchronize(held[t]));
+        });
+    }
+    for (auto& t : threads) t.join();
+    std::chrono::duration<double, std::milli> ms = std::chrono::steady_clock::now() - start;
+
+    std::vector<hipStream_t> distinct(held);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    printf("HIPPerfStreamPool %u threads on %zu pooled streams %8.2f ms\n", numThreads,
+           distinct.size(), ms.count());
+
+    for (unsigned int t = 0; t < numThreads; t++) {
+        HIPCHECK(hipExtStreamPoolRelease(held[t]));
+        HIPCHECK(hipFree(dsts[t]));
+    }
+    HIPCHECK(hipHostFree(src));
+    HIPCHECK(hipFree(dst));
+    passed();
+}
@@ -0,0 +1,139 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Compares host wait policies on hipStreamSynchronize: spin (HIP_WAIT_MODE=2),
+// block (HIP_WAIT_MODE=1) and adaptive spin-then-block (HIP_WAIT_MODE=3), for
+// kernels of increasing length. Each policy runs in a child process, since the
+// policy is fixed when the device is initialized. Reports the mean time from
+// launch to the return of hipStreamSynchronize, the CPU time the process
+// used per wait, and where the adaptive waits completed.
+
+/* HIT_START
+ * BUILD: %t %s ../../src/test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "test_common.h"
+
+static const unsigned int iterations = 500;
+static const unsigned int kernelUs[] = {0, 20, 200, 2000};
+
+struct Policy {
+    const char* name;
+    const char* waitMode;
+};
+
+static const Policy policies[] = {{"spin", "2"}, {"block", "1"}, {"adaptive", "3"}};
+
+// Spins for the given number of clock64() ticks.
+__global__ void spinKernel(long long ticks) {
+    long long start = clock64();
+    while (clock64() - start < ticks) {
+    }
+}
+
+static double nowUs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+}
+
+static void runPolicy(const char* name) {
+    HIPCHECK(hipSetDevice(p_gpuDevice));
+    hipDeviceProp_t props;
+    HIPCHECK(hipGetDeviceProperties(&props, p_gpuDevice));
+    // clock64() ticks at clockInstructionRate kHz.
+    const long long ticksPerUs = props.clockInstructionRate / 1000;
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    for (unsigned int us : kernelUs) {
+        const long long ticks = us * ticksPerUs;
+        // Warm up, and let the adaptive policy learn the kernel length.
+        for (unsigned int i = 0; i < 20; i++) {
+            hipLaunchKernelGGL(spinKernel, dim3(1), dim3(1), 0, stream, ticks);
+            HIPCHECK(hipStreamSynchronize(stream));
+        }
+
+        hipExtStreamWaitStats_t before, after;
+        HIPCHECK(hipExtStreamGetWaitStats(stream, &before));
+        const double wall0 = nowUs(CLOCK_MONOTONIC);
+        const double cpu0 = nowUs(CLOCK_PROCESS_CPUTIME_ID);
+        for (unsigned int i = 0; i < iterations; i++) {
+            hipLaunchKernelGGL(spinKernel, dim3(1), dim3(1), 0, stream, ticks);
+            HIPCHECK(hipStreamSynchronize(stream));
+        }
+        const double cpu = nowUs(CLOCK_PROCESS_CPUTIME_ID) - cpu0;
+        const double wall = nowUs(CLOCK_MONOTONIC) - wall0;
+        HIPCHECK(hipExtStreamGetWaitStats(stream, &after));
+
+        printf("HIPPerfSyncPolicy %-8s kernel %5u us: latency %9.1f us, cpu %9.1f us/wait "
+               "(%3.0f%%), done spinning %4llu yielding %4llu blocked %4llu, spin %6.1f us\n",
+               name, us, wall / iterations, cpu / iterations, 100.0 * cpu / wall,
+               (unsigned long long)(after.spinCompletions - before.spinCompletions),
+               (unsigned long long)(after.yieldCompletions - before.yieldCompletions),
+               (unsigned long long)(after.blockCompletions - before.blockCompletions),
+               after.spinNs / 1000.0);
+    }
+
+    HIPCHECK(hipStreamDestroy(stream));
+}
+
+int main(int argc, char* argv[]) {
+    // Child: argv[1] is the policy name, the wait mode is already in the environment.
+    if (argc > 1 && strcmp(argv[1], "--policy") == 0 && argc > 2) {
+        runPolicy(argv[2]);
+        return 0;
+    }
+
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    for (const Policy& policy : policies) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            failed("fork failed");
+        } else if (pid == 0) {
+            setenv("HIP_WAIT_MODE", policy.waitMode, 1);
+            char* args[] = {argv[0], const_cast<char*>("--policy"),
+                            const_cast<char*>(policy.name), NULL};
+            execv("/proc/self/exe", args);
+            _exit(127);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed("policy %s failed", policy.name);
+        }
+    }
+
+    passed();
+}
@@ -0,0 +1,307 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host-only checks for hip_impl::Memory_pool, which backs hipMallocAsync and
+// hipFreeAsync.
+
+/* HIT_START
+ * BUILD_CMD: hipMemPool %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "mem_pool.hpp"
+#include "../../host_check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A stream is an index into the runtime's queues; an event is the position of
+// a marker in one of them, completed once the queue has retired that far.
+struct Event {
+    int stream = -1;
+    unsigned seq = 0;
+};
+
+using Pool = hip_impl::Memory_pool<int, Event>;
+
+struct Runtime {
+    std::vector<unsigned> queued = std::vector<unsigned>(4, 0);
+    std::vector<unsigned> retired = std::vector<unsigned>(4, 0);
+    std::vector<std::pair<int, Event>> waits;  // (waiting stream, event)
+    std::map<void*, std::size_t> live;
+    std::size_t limit = ~std::size_t{0};  // bytes the driver may hand out
+    std::size_t bytes = 0;
+    int allocs = 0;
+
+    ~Runtime() {
+        for (auto& p : live) std::free(p.first);
+    }
+
+    void finish(int s) { retired[s] = queued[s]; }
+
+    Pool::Hooks hooks() {
+        Pool::Hooks h;
+        h.allocate = [this](std::size_t size) -> void* {
+            if (bytes + size > limit) return nullptr;
+            void* p = std::malloc(size);
+            live[p] = size;
+            bytes += size;
+            ++allocs;
+            return p;
+        };
+        h.release = [this](void* p, Event& e) {
+            CHECK(live.count(p) == 1);
+            CHECK(e.stream < 0 || retired[e.stream] >= e.seq);
+            bytes -= live[p];
+            live.erase(p);
+            std::free(p);
+        };
+        h.record = [this](int s, Event& e) {
+            e.stream = s;
+            e.seq = ++queued[s];
+        };
+        h.done = [this](Event& e) { return e.stream < 0 || retired[e.stream] >= e.seq; };
+        h.wait = [this](int s, Event& e) { waits.push_back(std::make_pair(s, e)); };
+        return h;
+    }
+};
+
+void test_size_classes() {
+    CHECK(Pool::size_class(0) == 512);
+    CHECK(Pool::size_class(1) == 512);
+    CHECK(Pool::size_class(512) == 512);
+    CHECK(Pool::size_class(513) == 640);
+    CHECK(Pool::size_class(1024) == 1024);
+    CHECK(Pool::size_class(1025) == 1280);
+    CHECK(Pool::size_class(3 << 20) == 3 << 20);
+    CHECK(Pool::size_class((3 << 20) + 1) == 7 << 19);
+    CHECK(Pool::size_class(Pool::max_size) == Pool::max_size);
+    CHECK(Pool::size_class(Pool::max_size + 1) == 0);
+    CHECK(Pool::size_class(~std::size_t{0}) == 0);
+    for (std::size_t s = 1; s < (1 << 16); s += 7) {
+        const std::size_t c = Pool::size_class(s);
+        CHECK(c >= s && (c <= 512 || c - s < c / 4));
+        CHECK(Pool::size_class(c) == c);
+    }
+}
+
+void test_same_stream_reuse() {
+    Runtime rt;
+    Pool pool{rt.hooks()};
+
+    void* a = pool.allocate(1000, 0);
+    CHECK(a && pool.owns(a));
+    CHECK(pool.free(a, 0));
+    CHECK(!pool.owns(a));
+    // Still pending on stream 0, but stream order makes it safe there.
+    CHECK(pool.allocate(1000, 0) == a);
+    // A request of the same class gets the same block.
+    CHECK(pool.free(a, 0));
+    CHECK(pool.allocate(900, 0) == a);
+    CHECK(rt.allocs == 1 && rt.waits.empty());
+
+    const Pool::Stats st = pool.stats();
+    CHECK(st.allocations == 3 && st.reuses == 2 && st.dependency_waits == 0);
+    CHECK(st.reserved == 1024 && st.used == 1024);
+
+    CHECK(!pool.free(&rt, 0));  // not a pool block
+    CHECK(pool.free(a, 0));
+    CHECK(!pool.free(a, 0));  // already free
+}
+
+void test_cross_stream_reuse() {
+    Runtime rt;
+    Pool pool{rt.hooks()};
+
+    void* a = pool.allocate(4096, 0);
+    void* b = pool.allocate(4096, 0);
+    pool.free(a, 0);
+    pool.free(b, 0);
+
+    // Completed frees are reused without a dependency.
+    rt.finish(0);
+    void* c = pool.allocate(4096, 1);
+    CHECK(c == a || c == b);
+    CHECK(rt.waits.empty());
+
+    // A pending free on another stream is reused after making stream 1 wait
+    // on its event; the older free is picked.
+    void* d = pool.allocate(4096, 1);
+    pool.free(c, 0);
+    pool.free(d, 0);
+    void* e = pool.allocate(4096, 2);
+    CHECK(e == c);
+    CHECK(rt.waits.size() == 1 && rt.waits[0].first == 2 && rt.waits[0].second.stream == 0);
+    CHECK(rt.waits[0].second.seq == rt.queued[0] - 1);
+    CHECK(pool.stats().dependency_waits == 1 && rt.allocs == 2);
+
+    // Same-stream blocks beat completed ones on other streams.
+    rt.finish(0);
+    void* f = pool.allocate(4096, 2);
+    pool.free(f, 2);
+    CHECK(pool.allocate(4096, 2) == f);
+}
+
+void test_release_threshold() {
+    Runtime rt;
+    Pool pool{rt.hooks()};
+    CHECK(pool.release_threshold() == ~std::size_t{0});
+
+    std::vector<void*> ptrs;
+    for (int i = 0; i != 8; ++i) ptrs.push_back(pool.allocate(1 << 20, 0));
+    for (void* p : ptrs) pool.free(p, 0);
+    CHECK(pool.stats().reserved == 8u << 20 && pool.stats().used == 0);
+
+    // Nothing has completed, so nothing can go back yet.
+    pool.set_release_threshold(2 << 20);
+    CHECK(pool.stats().reserved == 8u << 20);
+
+    rt.finish(0);
+    void* p = pool.allocate(1 << 20, 0);
+    pool.free(p, 0);  // over the threshold: releases completed blocks
+    CHECK(pool.stats().reserved <= 2u << 20);
+    CHECK(pool.stats().releases >= 6);
+
+    pool.trim(0);
+    CHECK(pool.stats().reserved == 1u << 20);  // the last free is still pending
+    rt.finish(0);
+    pool.trim(0);
+    CHECK(pool.stats().reserved == 0 && rt.live.empty());
+    CHECK(pool.stats().peak_reserved == 8u << 20 && pool.stats().peak_used == 8u << 20);
+}
+
+void test_trim_keeps_used_and_pending() {
+    Runtime rt;
+    Pool pool{rt.hooks()};
+
+    void* used = pool.allocate(64 << 10, 0);
+    void* pending = pool.allocate(64 << 10, 1);
+    void* done = pool.allocate(64 << 10, 2);
+    pool.free(pending, 1);
+    pool.free(done, 2);
+    rt.finish(2);
+
+    pool.trim(0);
+    CHECK(rt.live.count(used) && rt.live.count(pending) && !rt.live.count(done));
+    CHECK(pool.stats().reserved == 128u << 10);
+    CHECK(pool.owns(used));
+}
+
+void test_out_of_memory() {
+    Runtime rt;
+    rt.limit = 3 << 20;
+    Pool pool{rt.hooks()};
+
+    void* a = pool.allocate(1 << 20, 0);
+    void* b = pool.allocate(1 << 20, 0);
+    CHECK(a && b);
+    pool.free(a, 0);
+    pool.free(b, 0);
+    rt.finish(0);
+
+    // The 2 MiB class has no cached block and the driver is full; the pool
+    // releases the completed 1 MiB blocks and retries.
+    void* c = pool.allocate(2 << 20, 1);
+    CHECK(c && rt.live.size() == 1);
+    CHECK(pool.stats().reserved == 2u << 20);
+
+    // Nothing left to release.
+    CHECK(pool.allocate(2 << 20, 1) == nullptr);
+    CHECK(pool.stats().used == 2u << 20);
+
+    // Too large for any size class; the driver isn't asked.
+    const int allocs = rt.allocs;
+    CHECK(pool.allocate(~std::size_t{0}, 1) == nullptr);
+    CHECK(rt.allocs == allocs);
+}
+
+void test_threads() {
+    Runtime rt;
+    std::mutex mutex;  // the fake runtime's hooks are not thread safe
+    Pool::Hooks h = rt.hooks();
+    Pool::Hooks locked;
+    locked.allocate = [&](std::size_t s) {
+        std::lock_guard<std::mutex> lck{mutex};
+        return h.allocate(s);
+    };
+    locked.release = [&](void* p, Event& e) {
+        std::lock_guard<std::mutex> lck{mutex};
+        h.release(p, e);
+    };
+    locked.record = [&](int s, Event& e) {
+        std::lock_guard<std::mutex> lck{mutex};
+        h.record(s, e);
+        rt.finish(s);
+    };
+    locked.done = [&](Event& e) {
+        std::lock_guard<std::mutex> lck{mutex};
+        return h.done(e);
+    };
+    locked.wait = [&](int s, Event& e) {
+        std::lock_guard<std::mutex> lck{mutex};
+        h.wait(s, e);
+    };
+    Pool pool{locked};
+    pool.set_release_threshold(1 << 20);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t) {
+        threads.emplace_back([&pool, t]() {
+            for (int i = 0; i != 2000; ++i) {
+                const std::size_t size = 256u << (i % 10);
+                char* p = static_cast<char*>(pool.allocate(size, t));
+                CHECK(p);
+                p[0] = p[size - 1] = static_cast<char>(t);  // blocks never overlap
+                CHECK(p[0] == t && p[size - 1] == t);
+                CHECK(pool.free(p, t));
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    const Pool::Stats st = pool.stats();
+    CHECK(st.used == 0 && st.allocations == 8000);
+    CHECK(st.reuses > 7000);
+    pool.trim(0);
+    CHECK(rt.live.empty());
+}
+}  // namespace
+
+int main() {
+    test_size_classes();
+    test_same_stream_reuse();
+    test_cross_stream_reuse();
+    test_release_threshold();
+    test_trim_keeps_used_and_pending();
+    test_out_of_memory();
+    test_threads();
+    std::printf("PASSED!\n");
+    return 0;
+}
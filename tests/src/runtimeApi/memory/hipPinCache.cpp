@@ -0,0 +1,326 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host-only checks for hip_impl::Pin_cache, the cache of pinned pageable
+// ranges, with fake pin hooks: hits, the LRU budget, and ranges dropped by
+// munmap, free, madvise and mremap, also while other threads use the cache.
+
+/* HIT_START
+ * BUILD_CMD: hipPinCache %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "pin_cache.hpp"
+#include "../../host_check.h"
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Cache = hip_impl::Pin_cache;
+
+const std::uintptr_t device_tag = std::uintptr_t{1} << 46;
+const std::size_t mb = 1 << 20;
+
+// Fake driver: a pinned range remembers the first word of its memory, which
+// the tests set to a unique value per mapping, so a hit on a range pinned
+// before an munmap is caught.
+struct Driver {
+    std::mutex mutex;
+    std::map<std::uintptr_t, std::uint64_t> pinned;
+    std::uint64_t locks = 0;
+    std::uint64_t unlocks = 0;
+
+    Cache::Hooks hooks() {
+        Cache::Hooks h;
+        h.lock = [this](void* base, std::size_t size) -> void* {
+            // Pinning faults every page in, writable.
+            for (std::size_t i = 0; i < size; i += 4096) {
+                volatile char* c = static_cast<char*>(base) + i;
+                *c = *c;
+            }
+            std::lock_guard<std::mutex> lck{mutex};
+            const auto b = reinterpret_cast<std::uintptr_t>(base);
+            CHECK(pinned.count(b) == 0);
+            pinned[b] = *static_cast<std::uint64_t*>(base);
+            ++locks;
+            return reinterpret_cast<void*>(b + device_tag);
+        };
+        h.unlock = [this](void* base) {
+            std::lock_guard<std::mutex> lck{mutex};
+            CHECK(pinned.erase(reinterpret_cast<std::uintptr_t>(base)) == 1);
+            ++unlocks;
+        };
+        return h;
+    }
+
+    bool is_pinned(const void* p) {
+        std::lock_guard<std::mutex> lck{mutex};
+        return pinned.count(reinterpret_cast<std::uintptr_t>(p)) != 0;
+    }
+
+    std::uint64_t pinned_id(const void* p) {
+        std::lock_guard<std::mutex> lck{mutex};
+        return pinned.at(reinterpret_cast<std::uintptr_t>(p));
+    }
+};
+
+char* map_buffer(std::size_t size, std::uint64_t id) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(p != MAP_FAILED);
+    std::memcpy(p, &id, sizeof(id));
+    return static_cast<char*>(p);
+}
+
+void* device_of(const void* p) {
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(p) + device_tag);
+}
+
+void test_disabled() {
+    Driver d;
+    Cache cache{d.hooks(), 0};
+    char* buf = map_buffer(mb, 1);
+    CHECK(!cache.enabled());
+    CHECK(!cache.acquire(buf, mb, true));
+    CHECK(d.locks == 0);
+    CHECK(cache.stats().budget == 0);
+    munmap(buf, mb);
+}
+
+void test_hits() {
+    Driver d;
+    {
+        Cache cache{d.hooks(), 64 * mb};
+        char* buf = map_buffer(4 * mb, 1);
+        {
+            Cache::Pin pin = cache.acquire(buf + 100, mb, true);
+            CHECK(pin);
+            CHECK(pin.device_ptr() == device_of(buf + 100));
+        }
+        {
+            // Any part of a cached range hits, and nothing is pinned twice.
+            Cache::Pin pin = cache.acquire(buf + 4096, mb - 4096, false);
+            CHECK(pin);
+            CHECK(pin.device_ptr() == device_of(buf + 4096));
+        }
+        // Past the pages pinned for the first copy.
+        CHECK(!cache.acquire(buf + 3 * mb, mb, false));
+
+        Cache::Stats s = cache.stats();
+        CHECK(s.budget == 64 * mb);
+        CHECK(s.lookups == 3 && s.hits == 1 && s.misses == 2 && s.pins == 1);
+        CHECK(s.pinned == mb + 4096);
+        CHECK(d.is_pinned(buf) && d.locks == 1);
+
+        cache.trim();
+        CHECK(!d.is_pinned(buf));
+        CHECK(cache.stats().pinned == 0);
+
+        // Memory pinned by other means is only looked up.
+        CHECK(!cache.acquire(buf, mb, false));
+        CHECK(d.locks == 1);
+
+        CHECK(cache.acquire(buf, 2 * mb, true));
+        munmap(buf, 4 * mb);
+    }
+    // The last range is unpinned with the cache.
+    CHECK(d.pinned.empty());
+}
+
+void test_budget() {
+    Driver d;
+    Cache cache{d.hooks(), 3 * mb};
+    char* bufs[4];
+    for (int i = 0; i != 4; ++i) bufs[i] = map_buffer(mb, i);
+
+    for (int i = 0; i != 3; ++i) CHECK(cache.acquire(bufs[i], mb, true));
+    CHECK(cache.acquire(bufs[0], mb, true));  // bufs[1] is now least recently used
+    CHECK(cache.acquire(bufs[3], mb, true));
+    CHECK(d.is_pinned(bufs[0]) && !d.is_pinned(bufs[1]) && d.is_pinned(bufs[2]) &&
+          d.is_pinned(bufs[3]));
+    CHECK(cache.stats().evictions == 1);
+
+    {
+        // Ranges in use are not evicted; with no room left, a miss pins nothing.
+        Cache::Pin p0 = cache.acquire(bufs[0], mb, true);
+        Cache::Pin p2 = cache.acquire(bufs[2], mb, true);
+        Cache::Pin p3 = cache.acquire(bufs[3], mb, true);
+        CHECK(!cache.acquire(bufs[1], mb, true));
+        CHECK(!d.is_pinned(bufs[1]));
+    }
+    CHECK(cache.acquire(bufs[1], mb, true));
+    CHECK(cache.stats().pinned <= 3 * mb);
+
+    // Larger than the budget.
+    char* big = map_buffer(4 * mb, 5);
+    CHECK(!cache.acquire(big, 4 * mb, true));
+
+    // A range overlapping an idle cached one replaces it.
+    CHECK(cache.acquire(big, mb, true));
+    CHECK(cache.acquire(big + mb / 2, mb, true));
+    CHECK(!d.is_pinned(big) && d.is_pinned(big + mb / 2));
+
+    cache.trim();
+    CHECK(d.pinned.empty());
+    for (int i = 0; i != 4; ++i) munmap(bufs[i], mb);
+    munmap(big, 4 * mb);
+}
+
+void test_invalidation() {
+    Driver d;
+    Cache cache{d.hooks(), 64 * mb};
+
+    // munmap: the range is dropped by the time munmap returns.
+    char* buf = map_buffer(2 * mb, 1);
+    CHECK(cache.acquire(buf, 2 * mb, true));
+    munmap(buf, 2 * mb);
+    CHECK(cache.stats().invalidations == 1);
+    char* again = map_buffer(2 * mb, 2);
+    {
+        Cache::Pin pin = cache.acquire(again, 2 * mb, true);
+        CHECK(pin);
+        CHECK(d.pinned_id(again) == 2);
+    }
+    if (again != buf) CHECK(!d.is_pinned(buf));
+
+    // A range in use stays pinned until released.
+    {
+        Cache::Pin pin = cache.acquire(again, 2 * mb, true);
+        munmap(again, 2 * mb);
+        CHECK(cache.stats().invalidations == 2);
+        CHECK(d.is_pinned(again));
+    }
+    CHECK(!d.is_pinned(again));
+
+    std::uint64_t dropped = 2;
+#if !defined(__SANITIZE_ADDRESS__)
+    // free of a block large enough for malloc to map it on its own. The
+    // sanitizer allocators keep freed memory mapped.
+    char* heap = static_cast<char*>(std::malloc(8 * mb));
+    CHECK(cache.acquire(heap + mb, 4 * mb, true));
+    std::free(heap);
+    CHECK(cache.stats().invalidations == ++dropped);
+#endif
+
+    // madvise(MADV_DONTNEED) drops the pages.
+    buf = map_buffer(2 * mb, 3);
+    CHECK(cache.acquire(buf, 2 * mb, true));
+    CHECK(madvise(buf + mb, mb, MADV_DONTNEED) == 0);
+    CHECK(cache.stats().invalidations == ++dropped);
+    CHECK(!cache.acquire(buf, 2 * mb, false));
+    std::memset(buf, 1, 2 * mb);
+
+    // mremap moves the pages; the new mapping is not watched.
+    CHECK(cache.acquire(buf, 2 * mb, true));
+    void* moved = mremap(buf, 2 * mb, 64 * mb, MREMAP_MAYMOVE);
+    CHECK(moved != MAP_FAILED);
+    CHECK(cache.stats().invalidations == ++dropped);
+    std::memset(moved, 2, 64 * mb);
+    munmap(moved, 64 * mb);
+
+    // Explicit invalidation, e.g. before hipHostRegister.
+    buf = map_buffer(2 * mb, 4);
+    CHECK(cache.acquire(buf, 2 * mb, true));
+    cache.invalidate(buf + mb, 1);
+    CHECK(!d.is_pinned(buf));
+    CHECK(cache.stats().invalidations == ++dropped);
+    munmap(buf, 2 * mb);
+
+    cache.trim();
+    CHECK(d.pinned.empty());
+    CHECK(cache.stats().pinned == 0);
+}
+
+// Threads map, copy through and unmap their own buffers while others do the
+// same; no copy may hit a range pinned for an earlier mapping.
+void test_stress() {
+    Driver d;
+    Cache cache{d.hooks(), 16 * mb};
+    std::atomic<std::uint64_t> next_id{1};
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i != 200; ++i) {
+                const std::size_t size = mb / 2 * (1 + i % 4);
+                const std::uint64_t id = next_id++;
+                char* buf = map_buffer(size, id);
+                for (int copy = 0; copy != 3; ++copy) {
+                    Cache::Pin pin = cache.acquire(buf, size, true);
+                    if (pin) {
+                        CHECK(pin.device_ptr() == device_of(buf));
+                        CHECK(d.pinned_id(buf) == id);
+                    }
+                }
+                if (i % 2) {
+                    munmap(buf, size);
+                } else {
+                    CHECK(madvise(buf, size, MADV_DONTNEED) == 0);
+                    std::memcpy(buf, &id, sizeof(id));
+                    Cache::Pin pin = cache.acquire(buf, size, true);
+                    if (pin) CHECK(d.pinned_id(buf) == id);
+                    pin.reset();
+                    munmap(buf, size);
+                }
+            }
+        });
+    }
+    for (auto&& t : threads) t.join();
+
+    Cache::Stats s = cache.stats();
+    CHECK(s.hits + s.misses == s.lookups);
+    CHECK(s.pinned <= 16 * mb && s.peak_pinned <= 16 * mb);
+    CHECK(s.pins > 0 && s.invalidations > 0);
+    cache.trim();
+    CHECK(d.pinned.empty());
+}
+
+}  // namespace
+
+int main() {
+    test_disabled();
+    {
+        Driver d;
+        Cache probe{d.hooks(), mb};
+        if (!probe.enabled()) {
+            std::printf("userfaultfd unavailable, pin cache disabled\n");
+            std::printf("PASSED!\n");
+            return 0;
+        }
+    }
+    test_hits();
+    test_budget();
+    test_invalidation();
+    test_stress();
+    std::printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,292 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host-only checks for hip_impl::Range_index, the lock-free pointer to
+// allocation index, including readers racing with inserts and erases.
+
+/* HIT_START
+ * BUILD_CMD: hipRangeIndex %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "range_index.hpp"
+#include "../../host_check.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Info {
+    std::uintptr_t id;
+    unsigned device;
+};
+
+using Index = hip_impl::Range_index<Info>;
+
+const void* at(std::uintptr_t a) { return reinterpret_cast<const void*>(a); }
+
+// Finds p and checks it resolves to the range [base, base + size) with id.
+void expect(const Index& ix, std::uintptr_t p, std::uintptr_t base, std::size_t size,
+            std::uintptr_t id) {
+    Index::Range r;
+    CHECK(ix.find(at(p), r));
+    CHECK(r.base == base && r.size == size && r.value.id == id);
+}
+
+void expect_none(const Index& ix, std::uintptr_t p) {
+    Index::Range r;
+    CHECK(!ix.find(at(p), r));
+}
+
+void test_basic() {
+    Index ix;
+    const std::uintptr_t a = 0x7f0000001000;
+    CHECK(ix.insert(at(a), 256, Info{1, 0}));
+    expect(ix, a, a, 256, 1);
+    expect(ix, a + 255, a, 256, 1);
+    expect_none(ix, a + 256);
+    expect_none(ix, a - 1);
+    expect_none(ix, 0);
+
+    CHECK(!ix.insert(at(a), 0, Info{2, 0}));
+    CHECK(!ix.insert(at(a + 128), 16, Info{2, 0}));  // overlaps
+    CHECK(!ix.insert(at(a - 16), 17, Info{2, 0}));
+    CHECK(!ix.insert(at(std::uintptr_t{1} << 48), 16, Info{2, 0}));  // not indexable
+    CHECK(!ix.insert(at(~std::uintptr_t{0} - 8), 16, Info{2, 0}));   // wraps
+    CHECK(ix.size() == 1);
+
+    CHECK(!ix.erase(at(a + 1)));
+    CHECK(ix.erase(at(a)));
+    CHECK(!ix.erase(at(a)));
+    expect_none(ix, a);
+    CHECK(ix.size() == 0);
+}
+
+void test_shared_granule() {
+    // Several small ranges in one 4 KiB granule, plus ranges spanning into
+    // it from both sides.
+    Index ix;
+    const std::uintptr_t g = 0x10000000;
+    CHECK(ix.insert(at(g + 1024), 512, Info{2, 0}));
+    CHECK(ix.insert(at(g + 3072), 64, Info{4, 0}));
+    CHECK(ix.insert(at(g + 256), 256, Info{1, 0}));
+    CHECK(ix.insert(at(g + 2048), 512, Info{3, 0}));
+    CHECK(ix.insert(at(g - 8192), 8192 + 128, Info{0, 0}));  // ends in the granule
+    CHECK(ix.insert(at(g + 3584), 8192, Info{5, 0}));        // starts in it
+    CHECK(!ix.insert(at(g + 1500), 100, Info{9, 0}));
+    CHECK(!ix.insert(at(g + 100), 100, Info{9, 0}));
+    CHECK(!ix.insert(at(g + 3500), 100, Info{9, 0}));
+
+    expect(ix, g - 8192, g - 8192, 8192 + 128, 0);
+    expect(ix, g + 127, g - 8192, 8192 + 128, 0);
+    expect_none(ix, g + 128);
+    expect(ix, g + 300, g + 256, 256, 1);
+    expect(ix, g + 1024, g + 1024, 512, 2);
+    expect_none(ix, g + 1536);
+    expect(ix, g + 2559, g + 2048, 512, 3);
+    expect(ix, g + 3100, g + 3072, 64, 4);
+    expect(ix, g + 3584, g + 3584, 8192, 5);
+    expect(ix, g + 8192, g + 3584, 8192, 5);
+    expect_none(ix, g + 3584 + 8192);
+
+    // Erase from the middle, the head and the tail of the chain.
+    CHECK(ix.erase(at(g + 2048)));
+    expect_none(ix, g + 2048);
+    expect(ix, g + 3100, g + 3072, 64, 4);
+    CHECK(ix.erase(at(g - 8192)));
+    expect_none(ix, g);
+    expect(ix, g + 300, g + 256, 256, 1);
+    CHECK(ix.erase(at(g + 3584)));
+    expect_none(ix, g + 4096);
+    expect(ix, g + 3072, g + 3072, 64, 4);
+    CHECK(ix.insert(at(g + 2000), 1000, Info{6, 0}));
+    expect(ix, g + 2999, g + 2000, 1000, 6);
+    CHECK(ix.size() == 4);
+}
+
+void test_large_ranges() {
+    Index ix;
+    // 40 GiB, with whole 16 MiB chunks recorded once.
+    const std::uintptr_t a = 0x100000000000 + 12345;
+    const std::size_t size = std::size_t{40} << 30;
+    CHECK(ix.insert(at(a), size, Info{7, 1}));
+    for (std::uintptr_t p = a; p < a + size; p += (std::size_t{1} << 29) + 4093) {
+        expect(ix, p, a, size, 7);
+    }
+    expect(ix, a + size - 1, a, size, 7);
+    expect_none(ix, a + size);
+    CHECK(!ix.insert(at(a + (std::size_t{20} << 30)), 4096, Info{8, 0}));
+    CHECK(ix.insert(at(a + size), 4096, Info{8, 0}));
+    CHECK(ix.insert(at(a - 100), 100, Info{9, 0}));
+    expect(ix, a + size, a + size, 4096, 8);
+    expect(ix, a - 1, a - 100, 100, 9);
+
+    CHECK(ix.erase(at(a)));
+    expect_none(ix, a + (std::size_t{20} << 30));
+    CHECK(ix.insert(at(a + (std::size_t{20} << 30)), 4096, Info{10, 0}));
+    expect(ix, a + (std::size_t{20} << 30) + 5, a + (std::size_t{20} << 30), 4096, 10);
+    expect(ix, a + size, a + size, 4096, 8);
+}
+
+void test_clear() {
+    Index ix;
+    const std::uintptr_t g = 0x20000000;
+    const std::size_t large = std::size_t{1} << 26;
+    CHECK(ix.insert(at(g + 256), 256, Info{1, 0}));
+    CHECK(ix.insert(at(g + 1024), 512, Info{2, 0}));
+    CHECK(ix.insert(at(g + 4096), large, Info{3, 1}));
+    expect(ix, g + 300, g + 256, 256, 1);  // cached by this thread
+
+    ix.clear();
+    CHECK(ix.size() == 0);
+    expect_none(ix, g + 300);
+    expect_none(ix, g + 1024);
+    expect_none(ix, g + 4096 + large / 2);
+
+    // Memory handed out again at overlapping addresses.
+    CHECK(ix.insert(at(g), large, Info{4, 0}));
+    expect(ix, g + 300, g, large, 4);
+    ix.clear();
+    ix.clear();
+    CHECK(ix.size() == 0);
+}
+
+// Matches a sorted reference through random inserts and erases.
+void test_random() {
+    Index ix;
+    std::mt19937_64 rng{42};
+    const std::uintptr_t base = 0x200000000000;
+    const std::size_t span = 1 << 26;
+    std::vector<std::pair<std::uintptr_t, std::size_t>> live;  // sorted by base
+
+    for (int i = 0; i != 20000; ++i) {
+        const std::uintptr_t b = base + rng() % span;
+        const std::size_t size = 1 + rng() % (rng() % 8 == 0 ? (1 << 20) : 6000);
+        auto it = live.begin();
+        while (it != live.end() && it->first < b) ++it;
+        const bool overlaps = (it != live.end() && it->first < b + size) ||
+                              (it != live.begin() && std::prev(it)->first + std::prev(it)->second > b);
+        CHECK(ix.insert(at(b), size, Info{b, 0}) == !overlaps);
+        if (!overlaps) live.insert(it, std::make_pair(b, size));
+
+        if (!live.empty() && rng() % 3 == 0) {
+            const std::size_t k = rng() % live.size();
+            CHECK(ix.erase(at(live[k].first)));
+            live.erase(live.begin() + k);
+        }
+        for (int j = 0; j != 4; ++j) {
+            const std::uintptr_t p = base + rng() % span;
+            std::uintptr_t id = 0;
+            for (auto& r : live) {
+                if (p >= r.first && p - r.first < r.second) id = r.first;
+            }
+            Index::Range r;
+            CHECK(ix.find(at(p), r) == (id != 0));
+            CHECK(id == 0 || r.value.id == id);
+        }
+    }
+    CHECK(ix.size() == live.size());
+}
+
+// Readers look up permanent ranges, which must always be found, and ranges
+// being inserted and erased by writers, which must never resolve to a range
+// that does not contain the pointer.
+void test_stress() {
+    Index ix;
+    const std::uintptr_t base = 0x300000000000;
+    const unsigned permanent = 4096;
+    for (unsigned i = 0; i != permanent; ++i) {
+        const std::uintptr_t b = base + i * 8192;
+        CHECK(ix.insert(at(b), 4096 + 512, Info{b, 0}));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> transient_hits{0};
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w != 2; ++w) {
+        threads.emplace_back([&, w]() {
+            std::mt19937_64 rng{w};
+            std::vector<std::uintptr_t> mine;
+            for (int i = 0; i != 200000; ++i) {
+                // Gaps between permanent ranges, split between the writers.
+                const std::uintptr_t slot = (rng() % (permanent / 2)) * 2 + w;
+                const std::uintptr_t b = base + slot * 8192 + 4096 + 512 + (rng() % 8) * 64;
+                if (ix.insert(at(b), 1024 + (rng() % 4) * 512, Info{b, 1})) mine.push_back(b);
+                if (mine.size() > 256 || (rng() % 2 && !mine.empty())) {
+                    const std::size_t k = rng() % mine.size();
+                    CHECK(ix.erase(at(mine[k])));
+                    mine[k] = mine.back();
+                    mine.pop_back();
+                }
+            }
+            for (std::uintptr_t b : mine) CHECK(ix.erase(at(b)));
+        });
+    }
+    for (unsigned t = 0; t != 4; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 rng{100 + t};
+            while (!stop.load(std::memory_order_relaxed)) {
+                const std::uintptr_t p = base + rng() % (permanent * 8192);
+                const std::uintptr_t page = (p - base) / 8192;
+                const bool in_permanent = (p - base) % 8192 < 4096 + 512;
+                Index::Range r;
+                const bool found = ix.find(at(p), r);
+                if (in_permanent) {
+                    CHECK(found && r.value.id == base + page * 8192 && r.value.device == 0);
+                    // Again, through the thread's last-hit cache.
+                    CHECK(ix.find(at(p), r) && r.value.id == base + page * 8192);
+                } else if (found) {
+                    CHECK(r.value.device == 1 && r.value.id == r.base);
+                    CHECK(p >= r.base && p - r.base < r.size);
+                    ++transient_hits;
+                }
+            }
+        });
+    }
+    threads[0].join();
+    threads[1].join();
+    stop = true;
+    for (std::size_t i = 2; i != threads.size(); ++i) threads[i].join();
+
+    CHECK(ix.size() == permanent);
+    CHECK(transient_hits > 0);
+}
+}  // namespace
+
+int main() {
+    test_basic();
+    test_shared_granule();
+    test_large_ranges();
+    test_clear();
+    test_random();
+    test_stress();
+    std::printf("PASSED!\n");
+    return 0;
+}
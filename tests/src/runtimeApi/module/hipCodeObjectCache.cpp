@@ -0,0 +1,219 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Code_object_cache, the persistent cache of
+// parsed code object metadata.
+
+/* HIT_START
+ * BUILD_CMD: hipCodeObjectCache %cxx -I%S/../../../../src %S/%s %S/../../../../src/code_object_cache.cpp -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "code_object_cache.h"
+#include "../../host_check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using hip_impl::Code_object_cache;
+using hip_impl::Code_object_metadata;
+
+static std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> r;
+    DIR* d = opendir(dir.c_str());
+    CHECK(d);
+    while (dirent* e = readdir(d)) {
+        if (e->d_name[0] != '.') r.push_back(dir + "/" + e->d_name);
+    }
+    closedir(d);
+    return r;
+}
+
+static std::string make_dir() {
+    char tmpl[] = "/tmp/hipCodeObjectCacheXXXXXX";
+    CHECK(mkdtemp(tmpl));
+    return tmpl;
+}
+
+static void remove_dir(const std::string& dir) {
+    for (auto&& e : list_dir(dir)) unlink(e.c_str());
+    rmdir(dir.c_str());
+}
+
+static Code_object_metadata sample_metadata() {
+    Code_object_metadata md;
+    md.kernargs.push_back({"_Z6vecAddPfS_S_i", {{8, 8}, {8, 8}, {8, 8}, {4, 4}}});
+    md.kernargs.push_back({"_Z5emptyv", {}});
+    md.undefined_symbols = {"_ZN2hc13printf_bufferE", "global_counter"};
+    return md;
+}
+
+static void test_hash() {
+    const std::string a(1000, 'a');
+    std::string b = a;
+    b[999] = 'b';
+    CHECK(hip_impl::content_hash(a.data(), a.size()) == hip_impl::content_hash(a.data(), a.size()));
+    CHECK(hip_impl::content_hash(a.data(), a.size()) != hip_impl::content_hash(b.data(), b.size()));
+    CHECK(hip_impl::content_hash(a.data(), 999) != hip_impl::content_hash(a.data(), 1000));
+    CHECK(hip_impl::content_hash(a.data(), 0).size() == 32);
+}
+
+static void test_metadata_round_trip() {
+    const Code_object_metadata md = sample_metadata();
+    const std::string s = md.serialize();
+
+    Code_object_metadata r;
+    CHECK(r.deserialize(s));
+    CHECK(r.kernargs == md.kernargs);
+    CHECK(r.undefined_symbols == md.undefined_symbols);
+    CHECK(r.valid);
+
+    // Every truncation and trailing garbage is rejected.
+    for (size_t n = 0; n != s.size(); ++n) CHECK(!r.deserialize(s.substr(0, n)));
+    CHECK(!r.deserialize(s + "x"));
+
+    // A huge element count must not be trusted.
+    std::string bad = s;
+    const uint64_t huge = ~0ull / 2;
+    std::memcpy(&bad[0], &huge, sizeof(huge));
+    CHECK(!r.deserialize(bad));
+}
+
+static void test_store_load() {
+    const std::string dir = make_dir();
+    Code_object_cache cache{dir, 1 << 20};
+    const std::string value = sample_metadata().serialize();
+
+    std::string out;
+    CHECK(!cache.load("k1", out));
+    cache.store("k1", value);
+    CHECK(cache.load("k1", out) && out == value);
+    CHECK(cache.hits() == 1 && cache.misses() == 1);
+
+    // A second instance, as in another process, sees the entry.
+    Code_object_cache other{dir, 1 << 20};
+    CHECK(other.load("k1", out) && out == value);
+
+    // A damaged payload is a miss.
+    const std::vector<std::string> files = list_dir(dir);
+    CHECK(files.size() == 1);
+    {
+        const int fd = open(files[0].c_str(), O_WRONLY);
+        CHECK(fd >= 0);
+        CHECK(pwrite(fd, "X", 1, 40) == 1);
+        close(fd);
+    }
+    CHECK(!cache.load("k1", out));
+    CHECK(truncate(files[0].c_str(), 10) == 0);
+    CHECK(!cache.load("k1", out));
+
+    // Storing again replaces the damaged entry.
+    cache.store("k1", value);
+    CHECK(cache.load("k1", out) && out == value);
+
+    remove_dir(dir);
+}
+
+static void test_eviction() {
+    const std::string dir = make_dir();
+    const std::string value(1000, 'v');
+    Code_object_cache cache{dir, 10000};
+
+    for (int i = 0; i != 6; ++i) cache.store("key" + std::to_string(i), value);
+    CHECK(list_dir(dir).size() == 6);
+
+    // Age all entries, oldest first, then use key0 so it is the most recent.
+    int age = 100;
+    for (int i = 0; i != 6; ++i) {
+        std::string out;
+        CHECK(cache.load("key" + std::to_string(i), out));
+    }
+    for (auto&& f : list_dir(dir)) {
+        struct timespec t[2];
+        t[0].tv_sec = t[1].tv_sec = time(nullptr) - age--;
+        t[0].tv_nsec = t[1].tv_nsec = 0;
+        CHECK(utimensat(AT_FDCWD, f.c_str(), t, 0) == 0);
+    }
+    std::string out;
+    CHECK(cache.load("key0", out));
+
+    // Going over budget removes the least recently used entries, down to 3/4.
+    for (int i = 6; i != 12; ++i) cache.store("key" + std::to_string(i), value);
+    uint64_t total = 0;
+    for (auto&& f : list_dir(dir)) {
+        struct stat st;
+        CHECK(stat(f.c_str(), &st) == 0);
+        total += st.st_size;
+    }
+    CHECK(total <= 10000);
+    CHECK(cache.load("key0", out));
+    CHECK(cache.load("key11", out));
+
+    remove_dir(dir);
+}
+
+static void test_concurrent() {
+    const std::string dir = make_dir();
+    const std::string value = sample_metadata().serialize();
+
+    // Writers and readers race on the same entry; readers must only ever see
+    // a miss or the complete value.
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 8; ++t) {
+        threads.emplace_back([&dir, &value, t]() {
+            Code_object_cache cache{dir, 1 << 20};
+            for (int i = 0; i != 200; ++i) {
+                std::string out;
+                if (t % 2) {
+                    cache.store("shared", value);
+                } else if (cache.load("shared", out)) {
+                    CHECK(out == value);
+                }
+            }
+        });
+    }
+    for (auto&& t : threads) t.join();
+
+    // No temporary files are left behind.
+    CHECK(list_dir(dir).size() == 1);
+    remove_dir(dir);
+}
+
+int main() {
+    test_hash();
+    test_metadata_round_trip();
+    test_store_load();
+    test_eviction();
+    test_concurrent();
+    printf("PASSED!\n");
+    return 0;
+}
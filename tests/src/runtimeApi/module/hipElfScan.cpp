@@ -0,0 +1,220 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::scan_loaded_elfs, the single pass over the
+// loaded ELF objects used by program_state, and its on-disk cache.
+
+/* HIT_START
+ * BUILD_CMD: hipElfScan %cxx -I%S/../../../../src %S/%s %S/../../../../src/elf_scan.cpp -o %T/%t -std=c++11 -ldl
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "elf_scan.h"
+#include "../../host_check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <elf.h>
+#include <unistd.h>
+
+using hip_impl::Elf_scan;
+using hip_impl::Elf_symbol;
+
+extern "C" {
+int elf_scan_test_global[4] = {1, 2, 3, 4};
+__attribute__((noinline)) int elf_scan_test_function(int x) { return x + elf_scan_test_global[0]; }
+}
+
+static const Elf_symbol* find(const std::vector<Elf_symbol>& syms, const char* name) {
+    for (auto&& s : syms) {
+        if (s.name == name) return &s;
+    }
+    return nullptr;
+}
+
+static const Elf_scan& main_program(const std::vector<Elf_scan>& scans) {
+    for (auto&& s : scans) {
+        if (find(s.objects, "elf_scan_test_global")) return s;
+    }
+    printf("main program not found\n");
+    abort();
+}
+
+static void test_own_symbols(const std::vector<Elf_scan>& scans) {
+    const Elf_scan& exe = main_program(scans);
+
+    const Elf_symbol* g = find(exe.objects, "elf_scan_test_global");
+    CHECK(g->value + exe.load_bias == reinterpret_cast<std::uintptr_t>(&elf_scan_test_global));
+    CHECK(g->size == sizeof(elf_scan_test_global));
+
+    const Elf_symbol* f = find(exe.functions, "elf_scan_test_function");
+    CHECK(f);
+    CHECK(f->value + exe.load_bias == reinterpret_cast<std::uintptr_t>(&elf_scan_test_function));
+    CHECK(!find(exe.objects, "elf_scan_test_function"));
+
+    // Host-only build, there is no offload bundle.
+    CHECK(exe.kernel_size == 0);
+}
+
+static bool same(const std::vector<Elf_symbol>& x, const std::vector<Elf_symbol>& y) {
+    if (x.size() != y.size()) return false;
+    for (size_t i = 0; i != x.size(); ++i) {
+        if (x[i].name != y[i].name || x[i].value != y[i].value || x[i].size != y[i].size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool same(const std::vector<Elf_scan>& x, const std::vector<Elf_scan>& y) {
+    if (x.size() != y.size()) return false;
+    for (size_t i = 0; i != x.size(); ++i) {
+        if (x[i].path != y[i].path || x[i].load_bias != y[i].load_bias ||
+            x[i].kernel_offset != y[i].kernel_offset || x[i].kernel_size != y[i].kernel_size ||
+            !same(x[i].objects, y[i].objects) || !same(x[i].functions, y[i].functions)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> r;
+    DIR* d = opendir(dir.c_str());
+    CHECK(d);
+    while (dirent* e = readdir(d)) {
+        if (e->d_name[0] != '.') r.push_back(dir + "/" + e->d_name);
+    }
+    closedir(d);
+    return r;
+}
+
+static void test_cache(const std::vector<Elf_scan>& uncached) {
+    char tmpl[] = "/tmp/hipElfScanXXXXXX";
+    const std::string dir = mkdtemp(tmpl);
+
+    // First run fills the cache, the second reads it back.
+    const std::vector<Elf_scan> first = hip_impl::scan_loaded_elfs(dir);
+    CHECK(same(first, uncached));
+    const std::vector<std::string> entries = list_dir(dir);
+    CHECK(!entries.empty());
+    CHECK(same(hip_impl::scan_loaded_elfs(dir), uncached));
+
+    // Damaged entries are ignored and rewritten.
+    for (auto&& e : entries) CHECK(truncate(e.c_str(), 20) == 0);
+    CHECK(same(hip_impl::scan_loaded_elfs(dir), uncached));
+    CHECK(same(hip_impl::scan_loaded_elfs(dir), uncached));
+
+    for (auto&& e : list_dir(dir)) unlink(e.c_str());
+    rmdir(dir.c_str());
+}
+
+static void test_not_elf() {
+    char tmpl[] = "/tmp/hipElfScanXXXXXX";
+    const int fd = mkstemp(tmpl);
+    CHECK(fd >= 0);
+    std::string text(10000, 'x');
+    for (size_t i = 0; i != text.size(); ++i) text[i] = char('a' + i % 26);
+    CHECK(write(fd, text.data(), text.size()) == ssize_t(text.size()));
+    close(fd);
+
+    Elf_scan s;
+    CHECK(!hip_impl::scan_elf_file(tmpl, s));
+    CHECK(!hip_impl::scan_elf_file("/nonexistent/file", s));
+
+    // A range that does not start on a page boundary.
+    {
+        const hip_impl::Mapped_file_range r{tmpl, 5000, 100};
+        CHECK(r.data() && r.size() == 100);
+        CHECK(std::memcmp(r.data(), text.data() + 5000, 100) == 0);
+    }
+
+    unlink(tmpl);
+}
+
+// Scans an ELF file whose only section besides the name table is a 16 byte
+// one named by the string at name_offset in names, which takes exactly
+// names.size() bytes. Returns the kernel section size found.
+static uint64_t scan_named_section(const std::string& names, uint32_t name_offset) {
+    const size_t data_offset = sizeof(Elf64_Ehdr);
+    const size_t names_offset = data_offset + 16;
+    const size_t shoff = (names_offset + names.size() + 7) & ~size_t(7);
+
+    std::vector<char> file(shoff + 3 * sizeof(Elf64_Shdr));
+    Elf64_Ehdr eh = {};
+    std::memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_shoff = shoff;
+    eh.e_shentsize = sizeof(Elf64_Shdr);
+    eh.e_shnum = 3;
+    eh.e_shstrndx = 2;
+    std::memcpy(file.data(), &eh, sizeof(eh));
+    std::memcpy(file.data() + names_offset, names.data(), names.size());
+
+    Elf64_Shdr sh[3] = {};
+    sh[1].sh_name = name_offset;
+    sh[1].sh_type = SHT_PROGBITS;
+    sh[1].sh_offset = data_offset;
+    sh[1].sh_size = 16;
+    sh[2].sh_type = SHT_STRTAB;
+    sh[2].sh_offset = names_offset;
+    sh[2].sh_size = names.size();
+    std::memcpy(file.data() + shoff, sh, sizeof(sh));
+
+    char tmpl[] = "/tmp/hipElfScanXXXXXX";
+    const int fd = mkstemp(tmpl);
+    CHECK(fd >= 0);
+    CHECK(write(fd, file.data(), file.size()) == ssize_t(file.size()));
+    close(fd);
+
+    Elf_scan s;
+    CHECK(hip_impl::scan_elf_file(tmpl, s));
+    unlink(tmpl);
+    return s.kernel_size;
+}
+
+static void test_kernel_section() {
+    CHECK(scan_named_section(std::string("\0.kernel\0", 9), 1) == 16);
+    CHECK(scan_named_section(std::string("\0.text\0.kernel\0", 15), 7) == 16);
+    // Names cut short by the end of the table, or longer than .kernel.
+    CHECK(scan_named_section(std::string("\0.ker", 5), 1) == 0);
+    CHECK(scan_named_section(std::string("\0.kernel", 8), 1) == 0);
+    CHECK(scan_named_section(std::string("\0.kernels\0", 10), 1) == 0);
+    CHECK(scan_named_section(std::string("\0.text\0", 7), 1) == 0);
+}
+
+int main() {
+    const std::vector<Elf_scan> scans = hip_impl::scan_loaded_elfs("");
+    test_own_symbols(scans);
+    test_cache(scans);
+    test_not_elf();
+    test_kernel_section();
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Launches a chain of dependent copies with hipExtModuleLaunchKernelBatch and
+// checks that they ran in order, and that a batch with an invalid entry
+// launches nothing.
+
+/* HIT_START
+ * BUILD_CMD: vcpy_kernel.code %hc --genco %S/vcpy_kernel.cpp -o vcpy_kernel.code EXCLUDE_HIP_PLATFORM nvcc
+ * BUILD: %t %s ../../test_common.cpp EXCLUDE_HIP_PLATFORM nvcc
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "hip/hip_runtime.h"
+#include "hip/hip_ext.h"
+#include <vector>
+
+#include "test_common.h"
+
+#define LEN 64
+#define SIZE (LEN * sizeof(float))
+#define CHAIN 32
+
+#define fileName "vcpy_kernel.code"
+#define kernel_name "hello_world"
+
+struct CopyArgs {
+    void* src;
+    void* dst;
+};
+
+int main() {
+    HIPCHECK(hipInit(0));
+
+    hipDevice_t device;
+    hipCtx_t context;
+    HIPCHECK(hipDeviceGet(&device, 0));
+    HIPCHECK(hipCtxCreate(&context, 0, device));
+
+    hipModule_t Module;
+    hipFunction_t Function;
+    HIPCHECK(hipModuleLoad(&Module, fileName));
+    HIPCHECK(hipModuleGetFunction(&Function, Module, kernel_name));
+
+    hipStream_t stream;
+    HIPCHECK(hipStreamCreate(&stream));
+
+    // buffers[i + 1] is copied from buffers[i] by the i-th kernel of the batch.
+    std::vector<float> host(LEN);
+    std::vector<hipDeviceptr_t> buffers(CHAIN + 1);
+    for (auto& b : buffers) {
+        HIPCHECK(hipMalloc((void**)&b, SIZE));
+        HIPCHECK(hipMemset(b, 0, SIZE));
+    }
+    for (uint32_t i = 0; i < LEN; i++) host[i] = i * 1.0f;
+    HIPCHECK(hipMemcpyHtoD(buffers[0], host.data(), SIZE));
+
+    std::vector<CopyArgs> args(CHAIN);
+    std::vector<size_t> sizes(CHAIN, sizeof(CopyArgs));
+    std::vector<std::vector<void*>> configs(CHAIN);
+    std::vector<hipExtLaunchBatchParams> launches(CHAIN);
+    for (int i = 0; i < CHAIN; i++) {
+        args[i].src = buffers[i];
+        args[i].dst = buffers[i + 1];
+        configs[i] = {HIP_LAUNCH_PARAM_BUFFER_POINTER, &args[i], HIP_LAUNCH_PARAM_BUFFER_SIZE,
+                      &sizes[i], HIP_LAUNCH_PARAM_END};
+        launches[i].function = Function;
+        launches[i].gridDim = dim3(1);
+        launches[i].blockDim = dim3(LEN);
+        launches[i].sharedMemBytes = 0;
+        launches[i].kernelParams = nullptr;
+        launches[i].extra = configs[i].data();
+    }
+
+    // A null function anywhere in the batch fails it before anything runs.
+    std::vector<hipExtLaunchBatchParams> bad(launches);
+    bad[CHAIN / 2].function = nullptr;
+    if (hipExtModuleLaunchKernelBatch(bad.data(), CHAIN, stream) == hipSuccess) {
+        failed("batch with a null function was launched");
+    }
+    HIPCHECK(hipStreamSynchronize(stream));
+    std::vector<float> out(LEN);
+    HIPCHECK(hipMemcpyDtoH(out.data(), buffers[1], SIZE));
+    for (uint32_t i = 0; i < LEN; i++) {
+        if (out[i] != 0.0f) failed("invalid batch launched its first kernel");
+    }
+
+    HIPCHECK(hipExtModuleLaunchKernelBatch(launches.data(), 0, stream));
+    HIPCHECK(hipExtModuleLaunchKernelBatch(launches.data(), CHAIN, stream));
+    HIPCHECK(hipStreamSynchronize(stream));
+
+    HIPCHECK(hipMemcpyDtoH(out.data(), buffers[CHAIN], SIZE));
+    for (uint32_t i = 0; i < LEN; i++) {
+        if (out[i] != host[i]) failed("mismatch at %u: %f != %f", i, out[i], host[i]);
+    }
+
+    for (auto b : buffers) HIPCHECK(hipFree(b));
+    HIPCHECK(hipStreamDestroy(stream));
+    HIPCHECK(hipModuleUnload(Module));
+    HIPCHECK(hipCtxDestroy(context));
+    passed();
+}
@@ -0,0 +1,67 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Kernarg_buffer, which stages the kernel
+// arguments of each stream's launches.
+
+/* HIT_START
+ * BUILD_CMD: hipKernargBuffer %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "kernarg_buffer.hpp"
+#include "../../host_check.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+bool aligned(const char* p) {
+    return reinterpret_cast<std::uintptr_t>(p) % hip_impl::Kernarg_buffer::alignment == 0;
+}
+
+// Launches of the same or smaller size reuse the memory; a larger one grows it.
+void test_reuse_grow() {
+    hip_impl::Kernarg_buffer buf;
+    char* p0 = buf.get(100);
+    CHECK(aligned(p0) && buf.capacity() == 100);
+    std::memset(p0, 1, 100);
+    CHECK(buf.get(100) == p0);
+    CHECK(buf.get(8) == p0);
+
+    char* p1 = buf.get(4096);
+    CHECK(aligned(p1) && buf.capacity() == 4096);
+    std::memset(p1, 2, 4096);
+    CHECK(buf.get(100) == p1 && buf.capacity() == 4096);
+}
+}  // namespace
+
+int main() {
+    test_reuse_grow();
+
+    std::printf("PASSED!\n");
+    return 0;
+}
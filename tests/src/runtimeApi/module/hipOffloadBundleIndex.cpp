@@ -0,0 +1,172 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Bundle_index, the offload bundle reader
+// shared by the HCC and ROCclr runtimes.
+
+/* HIT_START
+ * BUILD_CMD: hipOffloadBundleIndex %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "code_object_bundle_index.hpp"
+#include "../../host_check.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+using hip_impl::Bundle_index;
+using hip_impl::Byte_view;
+
+static void put_u64(std::vector<char>& v, size_t pos, uint64_t x) {
+    std::memcpy(&v[pos], &x, sizeof(x));
+}
+
+// Builds a bundle laid out like clang-offload-bundler output: header, entry
+// headers with triples, then the code objects.
+static std::vector<char> make_bundle(const std::vector<std::pair<std::string, std::string>>& items) {
+    size_t hdr = Bundle_index::header_sz;
+    for (auto&& i : items) hdr += Bundle_index::entry_header_sz + i.first.size();
+
+    std::vector<char> v(hdr);
+    std::memcpy(&v[0], Bundle_index::magic(), Bundle_index::magic_sz);
+    put_u64(v, Bundle_index::magic_sz, items.size());
+
+    size_t pos = Bundle_index::header_sz;
+    for (auto&& i : items) {
+        put_u64(v, pos, v.size());
+        put_u64(v, pos + 8, i.second.size());
+        put_u64(v, pos + 16, i.first.size());
+        std::memcpy(&v[pos + 24], i.first.data(), i.first.size());
+        pos += Bundle_index::entry_header_sz + i.first.size();
+        v.insert(v.end(), i.second.begin(), i.second.end());
+    }
+    return v;
+}
+
+static std::vector<char> sample() {
+    return make_bundle({{"host-x86_64-unknown-linux", ""},
+                        {"hip-amdgcn-amd-amdhsa-gfx900", "code-gfx900"},
+                        {"hcc-amdgcn-amd-amdhsa--gfx906", "code-gfx906"},
+                        {"hcc-amdgcn--amdhsa-gfx803", "code-gfx803"}});
+}
+
+static void test_lookup() {
+    const std::vector<char> v = sample();
+    Bundle_index index{v.data(), v.size()};
+    CHECK(index.valid());
+    CHECK(index.entries().size() == 4);
+    CHECK(index.extent() == v.size());
+
+    CHECK(index.entries()[0].target.empty());
+    CHECK(index.entries()[1].triple == Byte_view("hip-amdgcn-amd-amdhsa-gfx900"));
+
+    const Bundle_index::Entry* e = index.find("gfx900");
+    CHECK(e && e->blob == Byte_view("code-gfx900"));
+    // Views point into the caller's buffer, nothing is copied.
+    CHECK(e->blob.data() >= v.data() && e->blob.end() <= v.data() + v.size());
+
+    e = index.find("gfx906");
+    CHECK(e && e->blob == Byte_view("code-gfx906"));
+    e = index.find("gfx803");
+    CHECK(e && e->blob == Byte_view("code-gfx803"));
+    CHECK(index.find("gfx908") == nullptr);
+    CHECK(index.find("gfx90") == nullptr);
+}
+
+static void test_unknown_size() {
+    const std::vector<char> v = sample();
+    Bundle_index index{v.data(), Bundle_index::unknown_size};
+    CHECK(index.valid());
+    CHECK(index.extent() == v.size());
+    CHECK(index.find("gfx906") != nullptr);
+}
+
+static void test_concatenated() {
+    std::vector<char> v = sample();
+    const size_t first = v.size();
+    const std::vector<char> w = make_bundle({{"hip-amdgcn-amd-amdhsa-gfx908", "code-gfx908"}});
+    v.insert(v.end(), w.begin(), w.end());
+
+    Bundle_index index{v.data(), v.size()};
+    CHECK(index.valid() && index.extent() == first);
+    CHECK(index.parse(v.data() + first, v.size() - first));
+    CHECK(index.find("gfx908") != nullptr);
+}
+
+static void expect_invalid(const std::vector<char>& v) {
+    Bundle_index index{v.data(), v.size()};
+    CHECK(!index.valid());
+    CHECK(index.entries().empty());
+    CHECK(index.find("gfx900") == nullptr);
+}
+
+static void test_malformed() {
+    const std::vector<char> good = sample();
+    const size_t entry0 = Bundle_index::header_sz;
+
+    // Wrong magic.
+    std::vector<char> v = good;
+    v[0] = 'X';
+    expect_invalid(v);
+
+    // Truncated in every possible place.
+    for (size_t n = 0; n < good.size(); ++n) {
+        Bundle_index index{good.data(), n};
+        CHECK(!index.valid());
+    }
+
+    // Bundle count larger than the entry headers that fit.
+    v = good;
+    put_u64(v, Bundle_index::magic_sz, ~0ull);
+    expect_invalid(v);
+
+    // Triple running past the end.
+    v = good;
+    put_u64(v, entry0 + 16, v.size());
+    expect_invalid(v);
+
+    // Code object starting past the end.
+    v = good;
+    put_u64(v, entry0, v.size() + 1);
+    expect_invalid(v);
+
+    // offset + size wrapping around.
+    v = good;
+    put_u64(v, entry0 + 8, ~0ull - 8);
+    expect_invalid(v);
+}
+
+int main() {
+    test_lookup();
+    test_unknown_size();
+    test_concatenated();
+    test_malformed();
+    printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+Copyright (c) 2015-present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Launches the same kernel from many host threads at once, each on its own
+// stream with its own arguments, and checks no launch picked up another
+// thread's arguments.
+
+/* HIT_START
+ * BUILD: %t %s ../../test_common.cpp NVCC_OPTIONS -std=c++11
+ * TEST: %t
+ * HIT_END
+ */
+
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "test_common.h"
+
+#define N 1024
+#define NUM_THREADS 16
+#define LAUNCHES_PER_THREAD 200
+
+__global__ void Fill(int* Array, int base, int launch) {
+    int tx = threadIdx.x + blockIdx.x * blockDim.x;
+    Array[tx] = base + launch;
+}
+
+void run(int threadId) {
+    hipStream_t stream;
+    int* Ad;
+    int* Ah;
+    const size_t size = N * sizeof(int);
+    const int base = threadId * 100000;
+
+    HIPCHECK(hipStreamCreate(&stream));
+    HIPCHECK(hipMalloc(&Ad, size));
+    HIPCHECK(hipHostMalloc((void**)&Ah, size, hipHostMallocDefault));
+
+    for (int i = 0; i < LAUNCHES_PER_THREAD; i++) {
+        hipLaunchKernelGGL(Fill, dim3(N / 256), dim3(256), 0, stream, Ad, base, i);
+        HIPCHECK(hipGetLastError());
+        // Check some launches in between so an argument mix-up in any of
+        // them is not hidden by a later launch overwriting the buffer.
+        if (i % 50 == 0 || i == LAUNCHES_PER_THREAD - 1) {
+            HIPCHECK(hipMemcpyAsync(Ah, Ad, size, hipMemcpyDeviceToHost, stream));
+            HIPCHECK(hipStreamSynchronize(stream));
+            for (int j = 0; j < N; j++) {
+                HIPASSERT(Ah[j] == base + i);
+            }
+        }
+    }
+
+    HIPCHECK(hipHostFree(Ah));
+    HIPCHECK(hipFree(Ad));
+    HIPCHECK(hipStreamDestroy(stream));
+}
+
+int main(int argc, char** argv) {
+    HipTest::parseStandardArguments(argc, argv, true);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back(run, t);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    passed();
+}
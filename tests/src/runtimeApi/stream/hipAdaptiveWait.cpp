@@ -0,0 +1,138 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Adaptive_waiter, the spin-then-yield-then-block
+// policy of hipStreamSynchronize, hipEventSynchronize and synchronous copies.
+
+/* HIT_START
+ * BUILD_CMD: hipAdaptiveWait %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "adaptive_wait.hpp"
+#include "../../host_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+
+using hip_impl::Adaptive_waiter;
+using hip_impl::Wait_policy;
+
+// Completes after a delay, like a kernel; block() sleeps on it like the runtime.
+struct Work {
+    std::atomic<bool> done{false};
+    std::thread thread;
+
+    explicit Work(std::chrono::microseconds us) {
+        thread = std::thread{[this, us]() {
+            std::this_thread::sleep_for(us);
+            done = true;
+        }};
+    }
+    ~Work() { thread.join(); }
+};
+
+struct Observed {
+    int blocks = 0;
+    bool blocking = false;
+};
+
+void wait_for(Adaptive_waiter& w, Wait_policy p, std::chrono::microseconds us,
+              Observed* seen = nullptr) {
+    Work work{us};
+    w.wait(p, [&work]() { return work.done.load(); },
+           [&work, seen](bool blocking) {
+               if (seen) {
+                   ++seen->blocks;
+                   seen->blocking = blocking;
+               }
+               while (!work.done) {
+                   std::this_thread::sleep_for(std::chrono::microseconds{50});
+               }
+           });
+    CHECK(work.done);
+}
+
+void test_done() {
+    Adaptive_waiter w;
+    int blocks = 0;
+    w.wait(Wait_policy::adaptive, []() { return true; }, [&blocks](bool) { ++blocks; });
+    CHECK(blocks == 0);
+    hip_impl::Wait_stats s = w.stats();
+    CHECK(s.waits == 1);
+    CHECK(s.spin_completions + s.yield_completions + s.block_completions == 0);
+}
+
+void test_fixed_policies() {
+    Adaptive_waiter w;
+    Observed seen;
+    wait_for(w, Wait_policy::active, std::chrono::microseconds{200}, &seen);
+    CHECK(seen.blocks == 1 && !seen.blocking);
+    wait_for(w, Wait_policy::blocked, std::chrono::microseconds{200}, &seen);
+    CHECK(seen.blocks == 2 && seen.blocking);
+    hip_impl::Wait_stats s = w.stats();
+    CHECK(s.spin_completions == 1 && s.block_completions == 1);
+}
+
+// Long waits shrink the spin to its minimum and end up blocked.
+void test_long_waits_block() {
+    const std::uint64_t max_spin_ns = 20000;
+    Adaptive_waiter w{max_spin_ns};
+    Observed seen;
+    for (int i = 0; i != 40; ++i) {
+        wait_for(w, Wait_policy::adaptive, std::chrono::milliseconds{2}, &seen);
+    }
+    CHECK(w.stats().spin_ns == Adaptive_waiter::min_spin_ns());
+    CHECK(seen.blocks > 30 && seen.blocking);
+    CHECK(w.stats().wait_ns >= 40 * 2000000ull);
+}
+
+// Short waits learn a spin interval that covers them; it never passes the cap.
+void test_short_waits_spin() {
+    const std::uint64_t max_spin_ns = 5000000;
+    Adaptive_waiter w{max_spin_ns};
+    for (int i = 0; i != 40; ++i) {
+        wait_for(w, Wait_policy::adaptive, std::chrono::microseconds{100});
+    }
+    hip_impl::Wait_stats s = w.stats();
+    CHECK(s.spin_ns >= 100000 && s.spin_ns <= max_spin_ns);
+    CHECK(s.spin_completions + s.yield_completions > s.block_completions);
+    CHECK(s.waits == 40);
+}
+
+}  // namespace
+
+int main() {
+    test_done();
+    test_fixed_policies();
+    test_long_waits_block();
+    test_short_waits_spin();
+
+    std::printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Callback_executor, which runs
+// hipStreamAddCallback callbacks on per-device worker threads.
+
+/* HIT_START
+ * BUILD_CMD: hipCallbackExecutor %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "callback_executor.hpp"
+#include "../../host_check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// One producer per stream; each stream checks it sees its tasks in order.
+struct Stream {
+    std::atomic<unsigned> next{0};
+    std::atomic<bool> out_of_order{false};
+};
+
+struct Seq_task : hip_impl::Callback_executor::Task {
+    Stream* stream;
+    unsigned seq;
+
+    static void run_task(Task* t) {
+        Seq_task* s = static_cast<Seq_task*>(t);
+        if (s->stream->next.load(std::memory_order_relaxed) != s->seq) {
+            s->stream->out_of_order = true;
+        }
+        s->stream->next.store(s->seq + 1, std::memory_order_relaxed);
+        delete s;
+    }
+};
+
+void post_all(hip_impl::Callback_executor& ex, Stream* streams, unsigned n_streams,
+              unsigned per_stream) {
+    std::vector<std::thread> producers;
+    for (unsigned i = 0; i != n_streams; ++i) {
+        producers.emplace_back([&ex, &streams, i, per_stream]() {
+            for (unsigned seq = 0; seq != per_stream; ++seq) {
+                Seq_task* t = new Seq_task;
+                t->run = &Seq_task::run_task;
+                t->stream = &streams[i];
+                t->seq = seq;
+                ex.post(&streams[i], t);
+            }
+        });
+    }
+    for (auto& p : producers) p.join();
+}
+
+void test_fifo_per_key(unsigned threads) {
+    const unsigned n_streams = 8;
+    const unsigned per_stream = 20000;
+    Stream streams[n_streams];
+    std::uint64_t tasks = 0;
+    {
+        hip_impl::Callback_executor ex{threads};
+        CHECK(ex.threads() == (threads ? threads : 1));
+        post_all(ex, streams, n_streams, per_stream);
+        // The destructor drains what is still queued.
+        tasks = ex.tasks();
+    }
+    for (auto& s : streams) {
+        CHECK(!s.out_of_order);
+        CHECK(s.next == per_stream);
+    }
+    CHECK(tasks <= std::uint64_t{n_streams} * per_stream);
+}
+
+struct Count_task : hip_impl::Callback_executor::Task {
+    std::atomic<unsigned>* count;
+    static void run_task(Task* t) { ++*static_cast<Count_task*>(t)->count; }
+};
+
+// Workers go to sleep when idle and must wake up for every later post.
+void test_wakeup() {
+    hip_impl::Callback_executor ex{2};
+    std::atomic<unsigned> count{0};
+    std::vector<Count_task> tasks(200);
+    for (unsigned i = 0; i != tasks.size(); ++i) {
+        tasks[i].run = &Count_task::run_task;
+        tasks[i].count = &count;
+        ex.post(&tasks[i], &tasks[i]);
+        if (i % 50 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        while (count != i + 1) std::this_thread::yield();
+    }
+    CHECK(ex.tasks() <= tasks.size());
+    CHECK(ex.batches() <= ex.tasks());
+}
+
+}  // namespace
+
+int main() {
+    test_fifo_per_key(0);
+    test_fifo_per_key(1);
+    test_fifo_per_key(4);
+    test_wakeup();
+
+    std::printf("PASSED!\n");
+    return 0;
+}
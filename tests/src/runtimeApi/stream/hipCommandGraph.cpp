@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+// Host-only checks for hip_impl::Graph_capture and hip_impl::plan_lanes,
+// which back hipExtStreamBeginCapture and hipExtGraphInstantiate.
+
+/* HIT_START
+ * BUILD_CMD: hipCommandGraph %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "command_graph.hpp"
+#include "../../host_check.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Capture = hip_impl::Graph_capture<char>;
+using Deps = std::vector<std::vector<std::uint32_t>>;
+
+// Streams and events are only compared, any distinct addresses will do.
+int s0, s1, e0, e1, e2;
+
+// Every dependency of a node must either be earlier on its lane, or be
+// covered by a wait of the node or of an earlier node of its lane for the same
+// or a later node of the dependency's lane.
+void check_plan(const Deps& deps, const hip_impl::Lane_plan& p, unsigned max_lanes) {
+    CHECK(p.lane.size() == deps.size());
+    CHECK(p.lanes <= max_lanes && p.lanes <= hip_impl::Lane_plan::lane_limit);
+    for (std::uint32_t i = 0; i != deps.size(); ++i) {
+        CHECK(p.lane[i] < p.lanes);
+        for (std::uint32_t w : p.waits[i]) {
+            CHECK(w < i && p.lane[w] != p.lane[i] && p.signals[w]);
+        }
+        for (std::uint32_t d : deps[i]) {
+            if (p.lane[d] == p.lane[i]) continue;
+            bool covered = false;
+            for (std::uint32_t j = 0; j <= i && !covered; ++j) {
+                if (p.lane[j] != p.lane[i]) continue;
+                for (std::uint32_t w : p.waits[j]) {
+                    if (p.lane[w] == p.lane[d] && w >= d) covered = true;
+                }
+            }
+            CHECK(covered);
+        }
+    }
+}
+
+void test_chain() {
+    Capture c{&s0};
+    for (char i = 0; i != 5; ++i) CHECK(c.add(&s0, i) == std::uint32_t(i));
+    auto g = c.finish();
+    CHECK(g.nodes.size() == 5 && g.nodes[3] == 3);
+    CHECK(g.deps[0].empty());
+    for (std::uint32_t i = 1; i != 5; ++i) CHECK(g.deps[i] == std::vector<std::uint32_t>{i - 1});
+
+    // A chain never leaves the launch stream, however many lanes are allowed.
+    auto p = hip_impl::plan_lanes(g.deps, 4);
+    check_plan(g.deps, p, 4);
+    CHECK(p.lanes == 1);
+    for (auto& w : p.waits) CHECK(w.empty());
+    CHECK(c.size() == 0);
+}
+
+// s0: A, record e0, C, wait e1, E
+// s1: wait e0, B, record e1
+void test_fork_join() {
+    Capture c{&s0};
+    CHECK(c.add(&s0, 'A', &e0) == 0);
+    CHECK(!c.wait(&s1, &e2));  // not recorded in the capture
+    CHECK(c.wait(&s1, &e0));
+    CHECK(c.add(&s1, 'B', &e1) == 1);
+    CHECK(c.add(&s0, 'C') == 2);
+    CHECK(c.wait(&s0, &e1));
+    CHECK(c.add(&s0, 'E') == 3);
+    CHECK(c.recorded(&e1) && !c.recorded(&e2));
+    CHECK(c.streams().size() == 2);
+
+    auto g = c.finish();
+    CHECK((g.deps[1] == std::vector<std::uint32_t>{0}));
+    CHECK((g.deps[2] == std::vector<std::uint32_t>{0}));
+    CHECK((g.deps[3] == std::vector<std::uint32_t>{1, 2}));
+
+    // B continues A's lane, C branches off to a new one, E joins them.
+    auto p = hip_impl::plan_lanes(g.deps, 4);
+    check_plan(g.deps, p, 4);
+    CHECK(p.lanes == 2);
+    CHECK(p.lane[0] == 0 && p.lane[1] == 0 && p.lane[2] == 1 && p.lane[3] == 1);
+    CHECK((p.waits[2] == std::vector<std::uint32_t>{0}));
+    CHECK((p.waits[3] == std::vector<std::uint32_t>{1}));
+    CHECK(p.signals[0] && p.signals[1] && !p.signals[2] && !p.signals[3]);
+
+    // One lane serializes everything in capture order.
+    p = hip_impl::plan_lanes(g.deps, 1);
+    check_plan(g.deps, p, 1);
+    CHECK(p.lanes == 1);
+    for (auto& w : p.waits) CHECK(w.empty());
+}
+
+void test_invalidate_leave() {
+    Capture c{&s0};
+    CHECK(c.add(&s0, 'A', &e0) == 0);
+    CHECK(c.wait(&s1, &e0));
+    CHECK(c.add(&s1, 'B') == 1);
+    CHECK(c.valid());
+
+    // A stream going away leaves the capture, its nodes stay.
+    c.leave(&s1);
+    CHECK(c.streams() == std::vector<const void*>{&s0});
+    CHECK(c.size() == 2 && c.recorded(&e0));
+
+    c.invalidate();
+    CHECK(!c.valid());
+}
+
+void test_wide() {
+    // 32 independent nodes, then one node joining them all.
+    Deps deps(33);
+    for (std::uint32_t i = 0; i != 32; ++i) deps[32].push_back(i);
+
+    auto p = hip_impl::plan_lanes(deps, 100);
+    check_plan(deps, p, 100);
+    CHECK(p.lanes == hip_impl::Lane_plan::lane_limit);
+    // Only the last node of each other lane is waited for.
+    CHECK(p.waits[32].size() == p.lanes - 1);
+
+    p = hip_impl::plan_lanes(deps, 0);
+    CHECK(p.lanes == 1);
+}
+
+void test_random() {
+    std::mt19937 rng{7};
+    for (unsigned round = 0; round != 200; ++round) {
+        const std::uint32_t n = 1 + rng() % 64;
+        Deps deps(n);
+        for (std::uint32_t i = 1; i != n; ++i) {
+            for (std::uint32_t j = 0; j != i; ++j) {
+                if (rng() % 8 == 0) deps[i].push_back(j);
+            }
+        }
+        const unsigned lanes = 1 + rng() % 6;
+        check_plan(deps, hip_impl::plan_lanes(deps, lanes), lanes);
+    }
+}
+
+void test_threads() {
+    Capture c{&s0};
+    int streams[4];
+    std::vector<std::thread> threads;
+    for (auto& s : streams) {
+        threads.emplace_back([&c, &s]() {
+            for (unsigned i = 0; i != 1000; ++i) c.add(&s, 'k');
+        });
+    }
+    for (auto& t : threads) t.join();
+    CHECK(c.size() == 4000);
+    CHECK(c.streams().size() == 5);
+
+    // Each stream still forms one chain.
+    auto g = c.finish();
+    std::size_t roots = 0;
+    for (auto& d : g.deps) roots += d.empty();
+    CHECK(roots == 4);
+}
+
+}  // namespace
+
+int main() {
+    test_chain();
+    test_fork_join();
+    test_invalidate_leave();
+    test_wide();
+    test_random();
+    test_threads();
+
+    std::printf("PASSED!\n");
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2015 - present Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+// Host-only checks for hip_impl::Stream_pool, which backs
+// hipExtStreamPoolAcquire and hipExtStreamPoolRelease.
+
+/* HIT_START
+ * BUILD_CMD: hipStreamPool %cxx -I%S/../../../../src %S/%s -o %T/%t -std=c++11 -pthread
+ * TEST: %t
+ * HIT_END
+ */
+
+#include "stream_pool.hpp"
+#include "../../host_check.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Stream {
+    unsigned flags;
+    int priority;
+    std::atomic<unsigned> users{0};
+    bool destroyed = false;
+};
+
+using Pool = hip_impl::Stream_pool<Stream*>;
+
+// Stands in for the HCC or ROCclr runtime, which keeps ownership of pool
+// streams: streams are freed when the runtime goes away, destroyed or not.
+struct Runtime {
+    std::atomic<int> live{0};
+    std::atomic<int> created{0};
+    bool fail = false;
+    std::mutex mutex;
+    std::vector<Stream*> streams;
+
+    ~Runtime() {
+        for (Stream* s : streams) delete s;
+    }
+
+    Pool::Create create() {
+        return [this](const Pool::Key& key) -> Stream* {
+            if (fail) return nullptr;
+            ++live;
+            ++created;
+            Stream* s = new Stream;
+            s->flags = key.flags;
+            s->priority = key.priority;
+            std::lock_guard<std::mutex> lck{mutex};
+            streams.push_back(s);
+            return s;
+        };
+    }
+
+    Pool::Destroy destroy() {
+        return [this](Stream* s) {
+            CHECK(!s->destroyed);
+            s->destroyed = true;
+            --live;
+        };
+    }
+};
+
+Pool::Key key(unsigned flags, int priority, std::vector<std::uint32_t> cu_mask = {}) {
+    Pool::Key k;
+    k.flags = flags;
+    k.priority = priority;
+    k.cu_mask = cu_mask;
+    return k;
+}
+
+void test_reuse() {
+    Runtime rt;
+    Pool pool{4, rt.create(), rt.destroy()};
+
+    Stream* a = pool.acquire(key(0, 0));
+    CHECK(a && pool.release(a));
+    CHECK(pool.acquire(key(0, 0)) == a);
+    CHECK(rt.created == 1 && pool.reused() == 1);
+
+    // Different attributes never get a's queue while a slot is free.
+    Stream* b = pool.acquire(key(0, -1));
+    Stream* c = pool.acquire(key(0, 0, {0xf}));
+    CHECK(b != a && c != a && c != b);
+    CHECK(b->priority == -1);
+    CHECK(pool.size() == 3);
+
+    CHECK(!pool.release(nullptr));
+    Stream other;
+    CHECK(!pool.owns(&other) && !pool.release(&other));
+
+    // The runtime owns what is left; clear() only forgets.
+    pool.clear();
+    CHECK(pool.size() == 0 && rt.live == 3);
+}
+
+void test_cap() {
+    Runtime rt;
+    Pool pool{2, rt.create(), rt.destroy()};
+
+    Stream* a = pool.acquire(key(0, 0));
+    Stream* b = pool.acquire(key(1, -1));
+    CHECK(rt.created == 2);
+
+    // Full and all in use: share a stream with the same attributes.
+    CHECK(pool.acquire(key(0, 0)) == a);
+    CHECK(pool.acquire(key(1, -1)) == b);
+    CHECK(rt.created == 2 && pool.shared() == 2);
+
+    // Other attributes get a stream past the limit, destroyed once released.
+    Stream* d = pool.acquire(key(0, 0, {1}));
+    CHECK(d != a && d != b && rt.created == 3 && pool.size() == 3);
+    CHECK(pool.release(d));
+    CHECK(d->destroyed && pool.size() == 2 && !pool.owns(d));
+
+    // a stays in use until its last user releases it.
+    CHECK(pool.release(a) && pool.release(a));
+    CHECK(pool.acquire(key(0, 0)) == a);
+    CHECK(pool.release(a));
+    CHECK(pool.release(b) && pool.release(b));
+
+    // Full with a and b idle: the older, a, is destroyed to make room for
+    // other attributes.
+    CHECK(pool.acquire(key(1, -1)) == b);
+    Stream* c = pool.acquire(key(0, 1));
+    CHECK(c->priority == 1 && a->destroyed);
+    CHECK(rt.created == 4 && rt.live == 2 && pool.size() == 2);
+
+    // Creation failures fall back to sharing the same attributes only.
+    rt.fail = true;
+    CHECK(pool.acquire(key(1, -1)) == b);
+    CHECK(pool.acquire(key(1, 0)) == nullptr);
+}
+
+void test_threads() {
+    Runtime rt;
+    const std::size_t max_streams = 4;
+    Pool pool{max_streams, rt.create(), rt.destroy()};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t != 8; ++t) {
+        threads.emplace_back([&pool, t]() {
+            for (unsigned i = 0; i != 20000; ++i) {
+                const int priority = int(i % 3) - 1;
+                Stream* s = pool.acquire(key(t % 2, priority));
+                CHECK(s && !s->destroyed);
+                CHECK(s->flags == t % 2 && s->priority == priority);
+                ++s->users;
+                --s->users;
+                CHECK(pool.release(s));
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+    CHECK(pool.size() <= max_streams && rt.live == int(pool.size()));
+    CHECK(pool.created() + pool.reused() + pool.shared() == 8 * 20000);
+}
+
+}  // namespace
+
+int main() {
+    test_reuse();
+    test_cap();
+    test_threads();
+
+    std::printf("PASSED!\n");
+    return 0;
+}